@@ -0,0 +1,147 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bm_adapt.h"
+
+
+/* bots per CPU when no ceiling is given */
+#define ADAPT_BOTS_PER_CPU 2
+
+/* the machine is overloaded if any of these is passed */
+#define ADAPT_MIN_IDLE_SHARE 0.05
+#define ADAPT_MAX_LOAD_PER_CPU 1.5
+#define ADAPT_MAX_LATENCY_RATIO 2.0
+
+/* and has headroom if all of these are */
+#define ADAPT_ROOM_IDLE_SHARE 0.15
+#define ADAPT_ROOM_LOAD_PER_CPU 1.0
+#define ADAPT_ROOM_LATENCY_RATIO 1.5
+
+
+void initAdaptiveLimit( AdaptiveLimit *adapt,
+			const int floor,
+			const int ceiling,
+			const int step )
+{
+  long n;
+
+  n = sysconf( _SC_NPROCESSORS_ONLN );
+  adapt->numCPUs = n > 0 ? n : 1;
+
+  adapt->floor = floor > 0 ? floor : 1;
+  adapt->ceiling = ceiling > 0 ? ceiling : adapt->numCPUs * ADAPT_BOTS_PER_CPU;
+  if( adapt->ceiling < adapt->floor ) {
+
+    adapt->ceiling = adapt->floor;
+  }
+  adapt->step = step > 0 ? step : 1;
+
+  adapt->limit = adapt->numCPUs;
+  if( adapt->limit < adapt->floor ) {
+
+    adapt->limit = adapt->floor;
+  } else if( adapt->limit > adapt->ceiling ) {
+
+    adapt->limit = adapt->ceiling;
+  }
+
+  adapt->haveSample = 0;
+  adapt->idleShare = -1;
+  adapt->loadPerCPU = -1;
+  adapt->latencyRatio = -1;
+}
+
+/* share of CPU time spent idle since the last sample
+   returns -1 if it can't be told yet */
+static double sampleIdleShare( AdaptiveLimit *adapt )
+{
+  FILE *file;
+  uint64_t v[ 8 ], busy, idle;
+  double share;
+  int n;
+
+  file = fopen( "/proc/stat", "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  memset( v, 0, sizeof( v ) );
+  n = fscanf( file, "cpu %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64
+	      " %"SCNu64" %"SCNu64" %"SCNu64" %"SCNu64,
+	      &v[ 0 ], &v[ 1 ], &v[ 2 ], &v[ 3 ],
+	      &v[ 4 ], &v[ 5 ], &v[ 6 ], &v[ 7 ] );
+  fclose( file );
+  if( n < 4 ) {
+
+    return -1;
+  }
+
+  /* user nice system idle iowait irq softirq steal - waiting on I/O
+     leaves the CPU free for bots */
+  idle = v[ 3 ] + v[ 4 ];
+  busy = v[ 0 ] + v[ 1 ] + v[ 2 ] + v[ 5 ] + v[ 6 ] + v[ 7 ];
+
+  share = -1;
+  if( adapt->haveSample && busy + idle > adapt->lastBusy + adapt->lastIdle ) {
+
+    share = (double)( idle - adapt->lastIdle )
+      / ( ( busy + idle ) - ( adapt->lastBusy + adapt->lastIdle ) );
+  }
+  adapt->lastBusy = busy;
+  adapt->lastIdle = idle;
+  adapt->haveSample = 1;
+  return share;
+}
+
+/* one minute load average per CPU, or -1 if it can't be read */
+static double sampleLoadPerCPU( const AdaptiveLimit *adapt )
+{
+  double load[ 1 ];
+
+  if( getloadavg( load, 1 ) < 1 ) {
+
+    return -1;
+  }
+  return load[ 0 ] / adapt->numCPUs;
+}
+
+int adaptiveUpdate( AdaptiveLimit *adapt,
+		    const double latencyRatio,
+		    const int wantMore )
+{
+  int cut;
+
+  adapt->idleShare = sampleIdleShare( adapt );
+  adapt->loadPerCPU = sampleLoadPerCPU( adapt );
+  adapt->latencyRatio = latencyRatio;
+
+  if( ( adapt->idleShare >= 0 && adapt->idleShare < ADAPT_MIN_IDLE_SHARE )
+      || adapt->loadPerCPU > ADAPT_MAX_LOAD_PER_CPU
+      || latencyRatio > ADAPT_MAX_LATENCY_RATIO ) {
+
+    cut = adapt->limit / 4;
+    adapt->limit -= cut > 0 ? cut : 1;
+    if( adapt->limit < adapt->floor ) {
+
+      adapt->limit = adapt->floor;
+    }
+  } else if( wantMore
+	     && adapt->idleShare > ADAPT_ROOM_IDLE_SHARE
+	     && adapt->loadPerCPU >= 0
+	     && adapt->loadPerCPU < ADAPT_ROOM_LOAD_PER_CPU
+	     && latencyRatio < ADAPT_ROOM_LATENCY_RATIO ) {
+
+    adapt->limit += adapt->step;
+    if( adapt->limit > adapt->ceiling ) {
+
+      adapt->limit = adapt->ceiling;
+    }
+  }
+
+  return adapt->limit;
+}
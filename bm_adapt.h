@@ -0,0 +1,56 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_ADAPT_H
+#define _BM_ADAPT_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* Adaptive limit on the number of running bots
+
+   the limit is moved between a floor and a ceiling from measurements
+   of the machine: the share of CPU time spent idle, the load average
+   per CPU, and how much slower bots are responding than they do at
+   their best.  it drops by a quarter as soon as anything says the
+   machine is overloaded, and only rises, by a step at a time, when
+   there is headroom everywhere and something is waiting for room to
+   run.  the owner applies the limit - this only does the sums */
+
+typedef struct {
+  int floor; /* never below this */
+  int ceiling; /* never above this */
+  int step; /* bots added on each increase */
+  int limit;
+
+  int numCPUs;
+  uint64_t lastBusy; /* /proc/stat jiffies at the last sample */
+  uint64_t lastIdle;
+  int haveSample; /* 0 until /proc/stat has been read once */
+
+  /* measurements from the last update, -1 when unknown */
+  double idleShare;
+  double loadPerCPU;
+  double latencyRatio;
+} AdaptiveLimit;
+
+
+/* the limit starts at one bot per CPU, kept between floor and ceiling
+   a ceiling of 0 means a few bots per CPU */
+void initAdaptiveLimit( AdaptiveLimit *adapt,
+			const int floor,
+			const int ceiling,
+			const int step );
+
+/* measure the machine and move the limit
+   latencyRatio is the worst slow down of a running bot's responses
+   against its best, or -1 if there is nothing to go on
+   wantMore is non-zero if something is waiting for the limit to rise
+   returns the new limit */
+int adaptiveUpdate( AdaptiveLimit *adapt,
+		    const double latencyRatio,
+		    const int wantMore );
+
+#endif
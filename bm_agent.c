@@ -0,0 +1,886 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include "game.h"
+#include "net.h"
+#include "bm_hash.h"
+#include "bm_event.h"
+
+
+/* Worker agent for the benchmark server
+
+   the agent logs in to bm_server as one of its agentUser accounts,
+   then registers its capacity with
+   "AGENT name host cores memoryMB [bot ...]".  the server places jobs
+   on it with
+   "JOB id #args dealerArgs... #bots (seat position command)...",
+   and the agent runs the dealer and bots from its working directory,
+   which needs the dealer, game files and bot commands at the same
+   paths the server uses.  the agent answers with "PORTS id port ..."
+   once the dealer is listening, streams the dealer's log file and
+   standard error back as "LOG id kind text" lines, and finishes with
+   "DONE id status cpuMicros".  "KILL id" stops a job early */
+
+#define AGENT_DEALER "dealer"
+#define AGENT_LOGDIR "logs"
+/* the server names each job's log after the run, in here */
+#define AGENT_RUN_LOGDIR AGENT_LOGDIR "/running"
+/* how often running jobs' log files are checked for new output */
+#define AGENT_TAIL_MICROS 250000
+/* most output sent in one LOG message, so the message fits in a line */
+#define AGENT_MAX_CHUNK ( READBUF_LEN - 64 )
+
+
+typedef struct AgentJob_struct AgentJob;
+
+/* output from a dealer pipe, split into lines */
+typedef struct {
+  int fd; /* -1 once closed */
+  EventWatch watch;
+  AgentJob *job;
+  size_t len; /* bytes of unfinished line in buf */
+  char buf[ AGENT_MAX_CHUNK ];
+} JobOutput;
+
+struct AgentJob_struct {
+  uint32_t id;
+  pid_t dealerPID;
+  int numBots;
+  struct {
+    int seat;
+    int position;
+    char *command;
+    pid_t pid;
+  } bots[ MAX_PLAYERS ];
+  int havePorts;
+
+  JobOutput out; /* dealer's standard output, for the ports */
+  JobOutput err; /* dealer's standard error */
+
+  char logName[ READBUF_LEN + 8 ];
+  int logFD;
+  off_t logOffset; /* how much of the log has been sent */
+
+  int status; /* dealer's wait status */
+  int64_t cpuMicros; /* CPU used by the dealer and bots */
+};
+
+typedef struct {
+  EventLoop events;
+
+  int serverFD;
+  ReadBuf *fromServer;
+  EventWatch serverWatch;
+
+  int signalFD; /* SIGCHLD, and SIGTERM/SIGINT to stop */
+  EventWatch signalWatch;
+
+  EventTimer tailTimer;
+
+  HashTable *jobs; /* job ID -> AgentJob */
+  HashTable *pids; /* dealer/bot PID -> AgentJob */
+
+  int devnullfd;
+} AgentState;
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: bm_agent bm_hostname bm_port user password [options]\n" );
+  fprintf( file, "  --name [name] agent name [default is the host name]\n" );
+  fprintf( file, "  --host [address] address network players connect to\n" );
+  fprintf( file, "    [default is the address the server sees]\n" );
+  fprintf( file, "  --cores [#] bots to run at once [default is online CPUs]\n" );
+  fprintf( file, "  --memory_mb [#] memory for bots [default is physical memory]\n" );
+  fprintf( file, "  --bots bot1,bot2,... bots installed here [default is all]\n" );
+}
+
+static void sendToServer( AgentState *agent, const char *msg, const int len )
+{
+  if( write( agent->serverFD, msg, len ) < len ) {
+
+    fprintf( stderr, "ERROR: failed while sending to server\n" );
+    exit( EXIT_FAILURE );
+  }
+}
+
+/* send len bytes of data as LOG messages of the given kind, a line at a
+   time - a partial line at the end is held back unless flush is set
+   returns the number of bytes sent */
+static size_t sendOutput( AgentState *agent,
+			  const AgentJob *job,
+			  const char kind,
+			  const char *data,
+			  const size_t len,
+			  const int flush )
+{
+  int msgLen, partial;
+  size_t pos, n;
+  const char *newline;
+  char msg[ READBUF_LEN ];
+
+  pos = 0;
+  while( pos < len ) {
+
+    newline = (const char *)memchr( &data[ pos ], '\n', len - pos );
+    n = newline ? newline - &data[ pos ] + 1 : len - pos;
+    partial = 0;
+    if( n > AGENT_MAX_CHUNK ) {
+      /* too long for one message */
+
+      n = AGENT_MAX_CHUNK;
+      partial = 1;
+    } else if( newline == NULL ) {
+
+      if( !flush ) {
+
+	break;
+      }
+      partial = 1;
+    }
+
+    msgLen = snprintf( msg, sizeof( msg ), "LOG %"PRIu32" %c ",
+		       job->id, partial ? tolower( kind ) : kind );
+    memcpy( &msg[ msgLen ], &data[ pos ], n );
+    msgLen += n;
+    if( partial ) {
+
+      msg[ msgLen ] = '\n';
+      ++msgLen;
+    }
+    sendToServer( agent, msg, msgLen );
+    pos += n;
+  }
+
+  return pos;
+}
+
+/* send anything new in the job's log file */
+static void tailLog( AgentState *agent, AgentJob *job, const int flush )
+{
+  ssize_t r;
+  size_t sent;
+  char buf[ AGENT_MAX_CHUNK * 2 ];
+
+  if( job->logFD < 0 ) {
+
+    /* the dealer creates the log once it starts */
+    job->logFD = open( job->logName, O_RDONLY | O_CLOEXEC );
+    if( job->logFD < 0 ) {
+
+      return;
+    }
+  }
+
+  while( ( r = pread( job->logFD, buf, sizeof( buf ), job->logOffset ) ) > 0 ) {
+
+    sent = sendOutput( agent, job, 'L', buf, r, flush );
+    job->logOffset += sent;
+    if( sent < r ) {
+      /* holding back a partial line */
+
+      break;
+    }
+  }
+}
+
+static void tailTimerEvent( EventLoop *loop, EventTimer *timer )
+{
+  AgentState *agent = (AgentState *)loop->data;
+  HashEntry *cur;
+
+  for( cur = hashNextEntry( agent->jobs, NULL );
+       cur != NULL; cur = hashNextEntry( agent->jobs, cur ) ) {
+
+    tailLog( agent, (AgentJob *)cur->value, 0 );
+  }
+}
+
+static void closeOutput( AgentState *agent, JobOutput *output )
+{
+  if( output->fd < 0 ) {
+
+    return;
+  }
+
+  eventWatchRemove( &agent->events, &output->watch );
+  close( output->fd );
+  output->fd = -1;
+}
+
+/* send DONE for the job and forget it, if everything has finished */
+static void checkJobDone( AgentState *agent, AgentJob *job )
+{
+  int b, len;
+  char msg[ 128 ];
+
+  if( job->dealerPID || job->out.fd >= 0 || job->err.fd >= 0 ) {
+
+    return;
+  }
+  for( b = 0; b < job->numBots; ++b ) {
+
+    if( job->bots[ b ].pid ) {
+
+      return;
+    }
+  }
+
+  tailLog( agent, job, 1 );
+  len = snprintf( msg, sizeof( msg ), "DONE %"PRIu32" %d %"PRId64"\n",
+		  job->id, job->status, job->cpuMicros );
+  sendToServer( agent, msg, len );
+
+  hashRemoveInt( agent->jobs, job->id );
+  if( agent->jobs->numEntries == 0 ) {
+
+    eventTimerStop( &agent->events, &agent->tailTimer );
+  }
+  if( job->logFD >= 0 ) {
+
+    close( job->logFD );
+  }
+  unlink( job->logName );
+  for( b = 0; b < job->numBots; ++b ) {
+
+    free( job->bots[ b ].command );
+  }
+  free( job );
+}
+
+static pid_t startBot( AgentState *agent,
+		       AgentJob *job,
+		       const int b,
+		       const uint16_t port )
+{
+  pid_t pid;
+  char portString[ 8 ], posString[ 16 ];
+
+  pid = fork();
+  if( pid < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    return 0;
+  }
+  if( !pid ) {
+    /* child runs the bot command, throwing away its output */
+    sigset_t set;
+
+    sigemptyset( &set );
+    sigprocmask( SIG_SETMASK, &set, NULL );
+
+    snprintf( portString, sizeof( portString ), "%"PRIu16, port );
+    snprintf( posString, sizeof( posString ), "%d", job->bots[ b ].position );
+    dup2( agent->devnullfd, 1 );
+    dup2( agent->devnullfd, 2 );
+
+    execl( job->bots[ b ].command,
+	   job->bots[ b ].command,
+	   "localhost",
+	   portString,
+	   posString,
+	   NULL );
+
+    fprintf( stderr, "ERROR: could not start bot %s\n",
+	     job->bots[ b ].command );
+    exit( EXIT_FAILURE );
+  }
+
+  hashAddInt( agent->pids, pid, job );
+  return pid;
+}
+
+/* the dealer has printed its ports, so start the bots and tell the
+   server where network players should connect */
+static void handlePorts( AgentState *agent, AgentJob *job, const char *line )
+{
+  int b, p, pos, t, len, numPorts;
+  uint16_t ports[ MAX_PLAYERS ];
+  char msg[ READBUF_LEN ];
+
+  pos = 0;
+  for( numPorts = 0; numPorts < MAX_PLAYERS; ++numPorts ) {
+
+    if( sscanf( &line[ pos ], " %"SCNu16"%n", &ports[ numPorts ], &t ) < 1 ) {
+
+      break;
+    }
+    pos += t;
+  }
+
+  for( b = 0; b < job->numBots; ++b ) {
+
+    if( job->bots[ b ].seat < numPorts ) {
+
+      job->bots[ b ].pid
+	= startBot( agent, job, b, ports[ job->bots[ b ].seat ] );
+    }
+  }
+
+  len = snprintf( msg, sizeof( msg ), "PORTS %"PRIu32, job->id );
+  for( p = 0; p < numPorts; ++p ) {
+
+    len += snprintf( &msg[ len ], sizeof( msg ) - len, " %"PRIu16, ports[ p ] );
+  }
+  msg[ len ] = '\n';
+  ++len;
+  sendToServer( agent, msg, len );
+  job->havePorts = 1;
+}
+
+/* read what's available from a dealer pipe into output->buf
+   returns 0 at end of file, otherwise 1 */
+static int readOutput( JobOutput *output )
+{
+  ssize_t r;
+
+  r = read( output->fd,
+	    &output->buf[ output->len ],
+	    sizeof( output->buf ) - output->len );
+  if( r < 0 ) {
+
+    return errno == EAGAIN || errno == EINTR;
+  }
+  output->len += r;
+  return r > 0;
+}
+
+static void dealerOutEvent( EventLoop *loop,
+			    EventWatch *watch,
+			    const uint32_t events )
+{
+  AgentState *agent = (AgentState *)loop->data;
+  JobOutput *output = (JobOutput *)watch->data;
+  AgentJob *job = output->job;
+  int more;
+  char *newline;
+
+  more = readOutput( output );
+
+  /* the first line is the ports, and anything after is the final
+     values, which are in the log anyway */
+  if( !job->havePorts
+      && ( newline = (char *)memchr( output->buf, '\n', output->len ) ) ) {
+
+    *newline = 0;
+    handlePorts( agent, job, output->buf );
+  }
+  if( job->havePorts || output->len == sizeof( output->buf ) ) {
+
+    output->len = 0;
+  }
+
+  if( !more ) {
+
+    closeOutput( agent, output );
+    checkJobDone( agent, job );
+  }
+}
+
+static void dealerErrEvent( EventLoop *loop,
+			    EventWatch *watch,
+			    const uint32_t events )
+{
+  AgentState *agent = (AgentState *)loop->data;
+  JobOutput *output = (JobOutput *)watch->data;
+  size_t sent;
+  int more;
+
+  more = readOutput( output );
+  sent = sendOutput( agent, output->job, 'E', output->buf, output->len, !more );
+  memmove( output->buf, &output->buf[ sent ], output->len - sent );
+  output->len -= sent;
+
+  if( !more ) {
+
+    closeOutput( agent, output );
+    checkJobDone( agent, output->job );
+  }
+}
+
+static int watchOutput( AgentState *agent,
+			AgentJob *job,
+			JobOutput *output,
+			const int fd,
+			EventHandler handler )
+{
+  output->fd = fd;
+  output->job = job;
+  output->len = 0;
+  fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+  return eventWatchAdd( &agent->events,
+			&output->watch,
+			fd,
+			EPOLLIN,
+			handler,
+			output );
+}
+
+/* pipe which isn't inherited by other jobs' dealers and bots */
+static int makePipe( int fds[ 2 ] )
+{
+  if( pipe( fds ) < 0 ) {
+
+    return -1;
+  }
+  fcntl( fds[ 0 ], F_SETFD, FD_CLOEXEC );
+  fcntl( fds[ 1 ], F_SETFD, FD_CLOEXEC );
+  return 0;
+}
+
+/* handle "JOB id #args dealerArgs... #bots (seat position command)..."
+   returns 0 on success, -1 on failure */
+static int startJob( AgentState *agent, const char *line )
+{
+  int numArgs, a, b, pos, t, outPipe[ 2 ], errPipe[ 2 ];
+  AgentJob *job;
+  char *argv[ MAX_PLAYERS + 64 ];
+  char args[ MAX_PLAYERS + 64 ][ READBUF_LEN ];
+  char command[ READBUF_LEN ];
+
+  job = (AgentJob *)calloc( 1, sizeof( AgentJob ) );
+  assert( job != 0 );
+  job->out.fd = -1;
+  job->err.fd = -1;
+  job->logFD = -1;
+
+  if( sscanf( line, "JOB %"SCNu32" %d%n", &job->id, &numArgs, &pos ) < 2
+      || numArgs < 1 || numArgs > MAX_PLAYERS + 62 ) {
+
+    free( job );
+    return -1;
+  }
+  argv[ 0 ] = AGENT_DEALER;
+  for( a = 0; a < numArgs; ++a ) {
+
+    if( sscanf( &line[ pos ], " %s%n", args[ a ], &t ) < 1 ) {
+
+      free( job );
+      return -1;
+    }
+    pos += t;
+    argv[ a + 1 ] = args[ a ];
+  }
+  argv[ numArgs + 1 ] = NULL;
+
+  if( sscanf( &line[ pos ], " %d%n", &job->numBots, &t ) < 1
+      || job->numBots < 0 || job->numBots > MAX_PLAYERS ) {
+
+    free( job );
+    return -1;
+  }
+  pos += t;
+  for( b = 0; b < job->numBots; ++b ) {
+
+    if( sscanf( &line[ pos ], " %d %d %s%n",
+		&job->bots[ b ].seat,
+		&job->bots[ b ].position,
+		command,
+		&t ) < 3 ) {
+
+      while( b > 0 ) {
+	--b;
+	free( job->bots[ b ].command );
+      }
+      free( job );
+      return -1;
+    }
+    pos += t;
+    job->bots[ b ].command = strdup( command );
+  }
+
+  /* the log is the run's own, and the server gets all of it */
+  snprintf( job->logName, sizeof( job->logName ), "%s.log", args[ 0 ] );
+  unlink( job->logName );
+  job->logOffset = 0;
+
+  if( makePipe( outPipe ) < 0 ) {
+
+    job->numBots = 0;
+    job->status = EXIT_FAILURE << 8;
+    checkJobDone( agent, job );
+    return 0;
+  }
+  if( makePipe( errPipe ) < 0 ) {
+
+    close( outPipe[ 0 ] );
+    close( outPipe[ 1 ] );
+    job->numBots = 0;
+    job->status = EXIT_FAILURE << 8;
+    checkJobDone( agent, job );
+    return 0;
+  }
+
+  hashAddInt( agent->jobs, job->id, job );
+  if( !eventTimerIsRunning( &agent->tailTimer ) ) {
+
+    eventTimerStart( &agent->events,
+		     &agent->tailTimer,
+		     AGENT_TAIL_MICROS,
+		     AGENT_TAIL_MICROS,
+		     tailTimerEvent,
+		     NULL );
+  }
+
+  job->dealerPID = fork();
+  if( job->dealerPID < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    job->dealerPID = 0;
+    job->status = EXIT_FAILURE << 8;
+  } else if( !job->dealerPID ) {
+    /* child runs the dealer */
+    sigset_t set;
+
+    sigemptyset( &set );
+    sigprocmask( SIG_SETMASK, &set, NULL );
+    dup2( outPipe[ 1 ], 1 );
+    dup2( errPipe[ 1 ], 2 );
+
+    execv( AGENT_DEALER, argv );
+
+    fprintf( stderr, "ERROR: could not start dealer\n" );
+    exit( EXIT_FAILURE );
+  } else {
+
+    hashAddInt( agent->pids, job->dealerPID, job );
+  }
+
+  close( outPipe[ 1 ] );
+  close( errPipe[ 1 ] );
+  if( watchOutput( agent, job, &job->out, outPipe[ 0 ], dealerOutEvent ) < 0
+      || watchOutput( agent, job, &job->err, errPipe[ 0 ], dealerErrEvent ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not watch dealer output\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  return 0;
+}
+
+static void killJob( AgentJob *job )
+{
+  int b;
+
+  if( job->dealerPID ) {
+
+    kill( job->dealerPID, SIGTERM );
+  }
+  for( b = 0; b < job->numBots; ++b ) {
+
+    if( job->bots[ b ].pid ) {
+
+      kill( job->bots[ b ].pid, SIGTERM );
+    }
+  }
+}
+
+static void killAllJobs( AgentState *agent )
+{
+  HashEntry *cur;
+
+  for( cur = hashNextEntry( agent->jobs, NULL );
+       cur != NULL; cur = hashNextEntry( agent->jobs, cur ) ) {
+
+    killJob( (AgentJob *)cur->value );
+  }
+}
+
+static void serverEvent( EventLoop *loop,
+			 EventWatch *watch,
+			 const uint32_t events )
+{
+  AgentState *agent = (AgentState *)loop->data;
+  int r;
+  uint32_t id;
+  AgentJob *job;
+  char line[ READBUF_LEN ];
+
+  while( ( r = getLine( agent->fromServer, READBUF_LEN, line, 0 ) ) >= 0 ) {
+
+    if( r == 0 ) {
+
+      fprintf( stderr, "ERROR: server closed connection\n" );
+      killAllJobs( agent );
+      exit( EXIT_FAILURE );
+    }
+
+    if( !strncmp( line, "JOB ", 4 ) ) {
+
+      if( startJob( agent, line ) < 0 ) {
+
+	fprintf( stderr, "ERROR: bad job from server: %s", line );
+      }
+    } else if( !strncmp( line, "KILL ", 5 ) ) {
+
+      if( sscanf( &line[ 5 ], "%"SCNu32, &id ) == 1
+	  && ( job = (AgentJob *)hashFindInt( agent->jobs, id ) ) ) {
+
+	killJob( job );
+      }
+    } else if( !strncmp( line, "BAD ", 4 ) ) {
+
+      fprintf( stderr, "ERROR: server refused agent: %s", line );
+      exit( EXIT_FAILURE );
+    } else {
+      /* just a message, print it out */
+
+      fputs( line, stdout );
+      fflush( stdout );
+    }
+  }
+}
+
+static void signalEvent( EventLoop *loop,
+			  EventWatch *watch,
+			  const uint32_t events )
+{
+  AgentState *agent = (AgentState *)loop->data;
+  int status, b;
+  pid_t pid;
+  AgentJob *job;
+  struct rusage usage;
+  struct signalfd_siginfo info;
+
+  while( read( agent->signalFD, &info, sizeof( info ) ) == sizeof( info ) ) {
+
+    if( info.ssi_signo != SIGCHLD ) {
+      /* don't leave dealers and bots running after we're gone */
+
+      killAllJobs( agent );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  while( ( pid = wait4( -1, &status, WNOHANG, &usage ) ) > 0 ) {
+
+    job = (AgentJob *)hashRemoveInt( agent->pids, pid );
+    if( job == NULL ) {
+
+      continue;
+    }
+
+    job->cpuMicros += (int64_t)usage.ru_utime.tv_sec * 1000000
+      + usage.ru_utime.tv_usec
+      + (int64_t)usage.ru_stime.tv_sec * 1000000
+      + usage.ru_stime.tv_usec;
+    if( job->dealerPID == pid ) {
+
+      job->dealerPID = 0;
+      job->status = status;
+    }
+    for( b = 0; b < job->numBots; ++b ) {
+
+      if( job->bots[ b ].pid == pid ) {
+
+	job->bots[ b ].pid = 0;
+      }
+    }
+
+    checkJobDone( agent, job );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  AgentState agent;
+  int i, longOpt, len, cores;
+  uint16_t port;
+  int64_t memoryMB;
+  sigset_t signals;
+  char *name, *host, *bots;
+  char hostname[ READBUF_LEN ];
+  char msg[ READBUF_LEN ];
+  static struct option longOptions[] = {
+    { "name", 1, 0, 0 },
+    { "host", 1, 0, 0 },
+    { "cores", 1, 0, 0 },
+    { "memory_mb", 1, 0, 0 },
+    { "bots", 1, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+
+  /* defaults describe this machine */
+  if( gethostname( hostname, sizeof( hostname ) ) < 0 ) {
+
+    strcpy( hostname, "agent" );
+  }
+  name = hostname;
+  host = "-";
+  cores = sysconf( _SC_NPROCESSORS_ONLN );
+  memoryMB = (int64_t)sysconf( _SC_PHYS_PAGES ) * sysconf( _SC_PAGESIZE )
+    / ( 1024 * 1024 );
+  bots = NULL;
+
+  while( ( i = getopt_long( argc, argv, "", longOptions, &longOpt ) ) >= 0 ) {
+
+    if( i != 0 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+
+    switch( longOpt ) {
+    case 0:
+      name = optarg;
+      break;
+
+    case 1:
+      host = optarg;
+      break;
+
+    case 2:
+      if( sscanf( optarg, "%d", &cores ) < 1 || cores < 0 ) {
+
+	fprintf( stderr, "ERROR: invalid number of cores %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 3:
+      if( sscanf( optarg, "%"SCNd64, &memoryMB ) < 1 || memoryMB < 0 ) {
+
+	fprintf( stderr, "ERROR: invalid memory size %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 4:
+      bots = optarg;
+      break;
+    }
+  }
+  if( optind + 4 > argc ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  /* the dealer writes its logs under the working directory */
+  if( mkdir( AGENT_LOGDIR, 0755 ) < 0 && errno != EEXIST ) {
+
+    fprintf( stderr, "ERROR: could not create %s\n", AGENT_LOGDIR );
+    exit( EXIT_FAILURE );
+  }
+  if( mkdir( AGENT_RUN_LOGDIR, 0755 ) < 0 && errno != EEXIST ) {
+
+    fprintf( stderr, "ERROR: could not create %s\n", AGENT_RUN_LOGDIR );
+    exit( EXIT_FAILURE );
+  }
+  agent.devnullfd = open( "/dev/null", O_WRONLY | O_CLOEXEC );
+  if( agent.devnullfd < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open /dev/null\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  /* children exiting and requests to stop are reported through a
+     file descriptor */
+  sigemptyset( &signals );
+  sigaddset( &signals, SIGCHLD );
+  sigaddset( &signals, SIGTERM );
+  sigaddset( &signals, SIGINT );
+  if( sigprocmask( SIG_BLOCK, &signals, NULL ) < 0
+      || ( agent.signalFD
+	   = signalfd( -1, &signals, SFD_NONBLOCK | SFD_CLOEXEC ) ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create signalfd\n" );
+    exit( EXIT_FAILURE );
+  }
+  signal( SIGPIPE, SIG_IGN );
+
+  /* connect to the server and register */
+  if( sscanf( argv[ optind + 1 ], "%"SCNu16, &port ) < 1 ) {
+
+    fprintf( stderr, "ERROR: invalid port %s\n", argv[ optind + 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  agent.serverFD = connectTo( argv[ optind ], port );
+  if( agent.serverFD < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  fcntl( agent.serverFD, F_SETFD, FD_CLOEXEC );
+  agent.fromServer = createReadBuf( agent.serverFD );
+
+  len = snprintf( msg, sizeof( msg ), "%s %s\nAGENT %s %s %d %"PRId64,
+		  argv[ optind + 2 ], argv[ optind + 3 ],
+		  name, host, cores, memoryMB );
+  if( bots ) {
+    /* the bot list is comma separated on the command line */
+
+    msg[ len ] = ' ';
+    ++len;
+    for( i = 0; bots[ i ] && len < sizeof( msg ) - 1; ++i ) {
+
+      msg[ len ] = bots[ i ] == ',' ? ' ' : bots[ i ];
+      ++len;
+    }
+    if( bots[ i ] ) {
+
+      fprintf( stderr, "ERROR: bot list is too long\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+  msg[ len ] = '\n';
+  ++len;
+  sendToServer( &agent, msg, len );
+
+  /* everything else is driven by events */
+  if( initEventLoop( &agent.events ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create event loop\n" );
+    exit( EXIT_FAILURE );
+  }
+  agent.events.data = &agent;
+  agent.jobs = newHashTable( HASH_DEFAULT_BUCKETS );
+  agent.pids = newHashTable( HASH_DEFAULT_BUCKETS );
+  initEventTimer( &agent.tailTimer );
+  if( eventWatchAdd( &agent.events,
+		     &agent.serverWatch,
+		     agent.serverFD,
+		     EPOLLIN,
+		     serverEvent,
+		     NULL ) < 0
+      || eventWatchAdd( &agent.events,
+			&agent.signalWatch,
+			agent.signalFD,
+			EPOLLIN,
+			signalEvent,
+			NULL ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not watch server connection\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  while( 1 ) {
+
+    if( runEventLoopOnce( &agent.events ) < 0 ) {
+
+      fprintf( stderr, "ERROR: epoll_wait failed\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,298 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "bm_cache.h"
+
+
+#define CACHE_COPY_LEN 65536
+
+
+/* a file digest, and what the file looked like when it was taken */
+typedef struct {
+  char *path; /* key in cache->files */
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  char digest[ CACHE_DIGEST_LEN + 1 ];
+} FileDigest;
+
+typedef struct {
+  uint32_t state[ 8 ];
+  uint64_t len; /* bytes hashed so far */
+  uint8_t block[ 64 ];
+  int blockLen;
+} Sha256;
+
+static const uint32_t sha256K[ 64 ] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR( x, n ) ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32 - ( n ) ) ) )
+
+static void sha256Init( Sha256 *sha )
+{
+  static const uint32_t initial[ 8 ] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  memcpy( sha->state, initial, sizeof( initial ) );
+  sha->len = 0;
+  sha->blockLen = 0;
+}
+
+static void sha256Block( Sha256 *sha, const uint8_t *block )
+{
+  int i;
+  uint32_t w[ 64 ], v[ 8 ], s0, s1, t1, t2;
+
+  for( i = 0; i < 16; ++i ) {
+
+    w[ i ] = ( (uint32_t)block[ i * 4 ] << 24 )
+      | ( (uint32_t)block[ i * 4 + 1 ] << 16 )
+      | ( (uint32_t)block[ i * 4 + 2 ] << 8 )
+      | (uint32_t)block[ i * 4 + 3 ];
+  }
+  for( ; i < 64; ++i ) {
+
+    s0 = ROTR( w[ i - 15 ], 7 ) ^ ROTR( w[ i - 15 ], 18 )
+      ^ ( w[ i - 15 ] >> 3 );
+    s1 = ROTR( w[ i - 2 ], 17 ) ^ ROTR( w[ i - 2 ], 19 )
+      ^ ( w[ i - 2 ] >> 10 );
+    w[ i ] = w[ i - 16 ] + s0 + w[ i - 7 ] + s1;
+  }
+
+  memcpy( v, sha->state, sizeof( v ) );
+  for( i = 0; i < 64; ++i ) {
+
+    s1 = ROTR( v[ 4 ], 6 ) ^ ROTR( v[ 4 ], 11 ) ^ ROTR( v[ 4 ], 25 );
+    t1 = v[ 7 ] + s1 + ( ( v[ 4 ] & v[ 5 ] ) ^ ( ~v[ 4 ] & v[ 6 ] ) )
+      + sha256K[ i ] + w[ i ];
+    s0 = ROTR( v[ 0 ], 2 ) ^ ROTR( v[ 0 ], 13 ) ^ ROTR( v[ 0 ], 22 );
+    t2 = s0 + ( ( v[ 0 ] & v[ 1 ] ) ^ ( v[ 0 ] & v[ 2 ] )
+		^ ( v[ 1 ] & v[ 2 ] ) );
+
+    v[ 7 ] = v[ 6 ];
+    v[ 6 ] = v[ 5 ];
+    v[ 5 ] = v[ 4 ];
+    v[ 4 ] = v[ 3 ] + t1;
+    v[ 3 ] = v[ 2 ];
+    v[ 2 ] = v[ 1 ];
+    v[ 1 ] = v[ 0 ];
+    v[ 0 ] = t1 + t2;
+  }
+  for( i = 0; i < 8; ++i ) {
+
+    sha->state[ i ] += v[ i ];
+  }
+}
+
+static void sha256Update( Sha256 *sha, const void *data, size_t len )
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t n;
+
+  sha->len += len;
+  while( len ) {
+
+    n = 64 - sha->blockLen;
+    if( n > len ) {
+
+      n = len;
+    }
+    memcpy( &sha->block[ sha->blockLen ], bytes, n );
+    sha->blockLen += n;
+    bytes += n;
+    len -= n;
+
+    if( sha->blockLen == 64 ) {
+
+      sha256Block( sha, sha->block );
+      sha->blockLen = 0;
+    }
+  }
+}
+
+static void sha256Final( Sha256 *sha, char digest[ CACHE_DIGEST_LEN + 1 ] )
+{
+  int i;
+  uint64_t bits = sha->len * 8;
+  uint8_t pad[ 72 ];
+  size_t padLen;
+
+  /* a one bit, zeros up to 56 bytes into a block, then the length */
+  padLen = ( sha->blockLen < 56 ? 56 : 120 ) - sha->blockLen;
+  memset( pad, 0, sizeof( pad ) );
+  pad[ 0 ] = 0x80;
+  for( i = 0; i < 8; ++i ) {
+
+    pad[ padLen + i ] = (uint8_t)( bits >> ( 56 - i * 8 ) );
+  }
+  sha256Update( sha, pad, padLen + 8 );
+  assert( sha->blockLen == 0 );
+
+  for( i = 0; i < 8; ++i ) {
+
+    sprintf( &digest[ i * 8 ], "%08"PRIx32, sha->state[ i ] );
+  }
+}
+
+int initResultCache( ResultCache *cache, const char *dir )
+{
+  if( mkdir( dir, 0755 ) < 0 && errno != EEXIST ) {
+
+    return -1;
+  }
+
+  cache->dir = strdup( dir );
+  assert( cache->dir != 0 );
+  cache->files = newHashTable( HASH_DEFAULT_BUCKETS );
+  return 0;
+}
+
+void cacheDigest( const void *data,
+		  const size_t len,
+		  char digest[ CACHE_DIGEST_LEN + 1 ] )
+{
+  Sha256 sha;
+
+  sha256Init( &sha );
+  sha256Update( &sha, data, len );
+  sha256Final( &sha, digest );
+}
+
+int cacheFileDigest( ResultCache *cache,
+		     const char *path,
+		     char digest[ CACHE_DIGEST_LEN + 1 ] )
+{
+  int fd;
+  ssize_t r;
+  struct stat st;
+  FileDigest *file;
+  Sha256 sha;
+  char buf[ CACHE_COPY_LEN ];
+
+  if( stat( path, &st ) < 0 ) {
+
+    return -1;
+  }
+
+  /* still the same file? */
+  file = (FileDigest *)hashFindString( cache->files, path );
+  if( file && file->dev == st.st_dev && file->ino == st.st_ino
+      && file->size == st.st_size
+      && file->mtime.tv_sec == st.st_mtim.tv_sec
+      && file->mtime.tv_nsec == st.st_mtim.tv_nsec ) {
+
+    memcpy( digest, file->digest, CACHE_DIGEST_LEN + 1 );
+    return 0;
+  }
+
+  fd = open( path, O_RDONLY | O_CLOEXEC );
+  if( fd < 0 ) {
+
+    return -1;
+  }
+  sha256Init( &sha );
+  while( ( r = read( fd, buf, sizeof( buf ) ) ) > 0 ) {
+
+    sha256Update( &sha, buf, r );
+  }
+  close( fd );
+  if( r < 0 ) {
+
+    return -1;
+  }
+  sha256Final( &sha, digest );
+
+  if( file == NULL ) {
+
+    file = (FileDigest *)malloc( sizeof( FileDigest ) );
+    assert( file != 0 );
+    file->path = strdup( path );
+    assert( file->path != 0 );
+    hashAddString( cache->files, file->path, file );
+  }
+  file->dev = st.st_dev;
+  file->ino = st.st_ino;
+  file->size = st.st_size;
+  file->mtime = st.st_mtim;
+  memcpy( file->digest, digest, CACHE_DIGEST_LEN + 1 );
+  return 0;
+}
+
+int cacheOpen( const ResultCache *cache,
+	       const char *key,
+	       const char *suffix )
+{
+  char name[ strlen( cache->dir ) + CACHE_DIGEST_LEN + strlen( suffix ) + 4 ];
+
+  sprintf( name, "%s/%s.%s", cache->dir, key, suffix );
+  return open( name, O_RDONLY | O_CLOEXEC );
+}
+
+int cacheStore( const ResultCache *cache,
+		const char *key,
+		const char *suffix,
+		const int fd,
+		const off_t offset )
+{
+  int out;
+  ssize_t r;
+  off_t pos;
+  char buf[ CACHE_COPY_LEN ];
+  char name[ strlen( cache->dir ) + CACHE_DIGEST_LEN + strlen( suffix ) + 4 ];
+  char tmpName[ sizeof( name ) + 4 ];
+
+  sprintf( name, "%s/%s.%s", cache->dir, key, suffix );
+  sprintf( tmpName, "%s.tmp", name );
+  out = open( tmpName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+  if( out < 0 ) {
+
+    return -1;
+  }
+
+  pos = offset;
+  while( ( r = pread( fd, buf, sizeof( buf ), pos ) ) > 0 ) {
+
+    if( write( out, buf, r ) < r ) {
+
+      r = -1;
+      break;
+    }
+    pos += r;
+  }
+  if( close( out ) < 0 || r < 0 || rename( tmpName, name ) < 0 ) {
+
+    unlink( tmpName );
+    return -1;
+  }
+
+  return 0;
+}
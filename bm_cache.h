@@ -0,0 +1,64 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_CACHE_H
+#define _BM_CACHE_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <sys/types.h>
+#include "bm_hash.h"
+
+
+/* hex digits in a digest, not counting the terminating zero */
+#define CACHE_DIGEST_LEN 64
+
+
+/* Content addressed cache of match output
+
+   entries are files named by the SHA-256 digest of everything which
+   decides what a run does, so an entry never needs invalidating - a
+   changed input is a different key.  files are written to a temporary
+   name and renamed into place, so readers only ever see whole entries.
+   digests of input files are remembered until the file's size, inode
+   or modification time changes, so executables aren't reread for every
+   lookup */
+
+typedef struct {
+  char *dir; /* NULL when the cache is disabled */
+  HashTable *files; /* path -> remembered digest of the file */
+} ResultCache;
+
+
+/* use dir for cache entries, creating it if needed
+   returns 0 on success, -1 on failure */
+int initResultCache( ResultCache *cache, const char *dir );
+
+/* SHA-256 of len bytes of data, as hex */
+void cacheDigest( const void *data,
+		  const size_t len,
+		  char digest[ CACHE_DIGEST_LEN + 1 ] );
+
+/* SHA-256 of the contents of the file at path, as hex
+   returns 0 on success, -1 if the file can't be read */
+int cacheFileDigest( ResultCache *cache,
+		     const char *path,
+		     char digest[ CACHE_DIGEST_LEN + 1 ] );
+
+/* open the entry for key with the given suffix for reading
+   returns the file descriptor, or -1 if there is no such entry */
+int cacheOpen( const ResultCache *cache,
+	       const char *key,
+	       const char *suffix );
+
+/* make everything in fd from offset to the end the entry for key with
+   the given suffix, replacing any existing entry
+   returns 0 on success, -1 on failure */
+int cacheStore( const ResultCache *cache,
+		const char *key,
+		const char *suffix,
+		const int fd,
+		const off_t offset );
+
+#endif
@@ -0,0 +1,288 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+#include <sched.h>
+#include <dirent.h>
+#include "bm_cores.h"
+
+
+#define CORES_NODE_DIR "/sys/devices/system/node"
+
+
+/* parse a kernel style CPU list like "0-3,8" into set
+   returns 0 on success, -1 on failure */
+static int parseCPUList( const char *list, cpu_set_t *set )
+{
+  int first, last, cpu, pos, t;
+
+  CPU_ZERO( set );
+  pos = 0;
+  while( list[ pos ] && list[ pos ] != '\n' ) {
+
+    if( sscanf( &list[ pos ], "%d%n", &first, &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+    last = first;
+    if( list[ pos ] == '-' ) {
+
+      if( sscanf( &list[ pos + 1 ], "%d%n", &last, &t ) < 1 ) {
+
+	return -1;
+      }
+      pos += t + 1;
+    }
+    if( first < 0 || last < first || last >= CPU_SETSIZE ) {
+
+      return -1;
+    }
+    for( cpu = first; cpu <= last; ++cpu ) {
+
+      CPU_SET( cpu, set );
+    }
+
+    if( list[ pos ] == ',' ) {
+
+      ++pos;
+    }
+  }
+
+  return 0;
+}
+
+/* fill in the node of each core from sysfs, if the kernel knows them */
+static void findNodes( CorePool *pool )
+{
+  int node, c;
+  DIR *dir;
+  FILE *file;
+  struct dirent *ent;
+  cpu_set_t nodeCPUs;
+  char name[ 512 ], list[ 4096 ];
+
+  pool->numNodes = 1;
+  dir = opendir( CORES_NODE_DIR );
+  if( dir == NULL ) {
+
+    return;
+  }
+
+  while( ( ent = readdir( dir ) ) != NULL ) {
+
+    if( strncmp( ent->d_name, "node", 4 )
+	|| sscanf( &ent->d_name[ 4 ], "%d", &node ) < 1 ) {
+
+      continue;
+    }
+
+    snprintf( name, sizeof( name ), "%s/%s/cpulist",
+	      CORES_NODE_DIR, ent->d_name );
+    file = fopen( name, "r" );
+    if( file == NULL ) {
+
+      continue;
+    }
+    if( fgets( list, sizeof( list ), file ) != NULL
+	&& parseCPUList( list, &nodeCPUs ) == 0 ) {
+
+      for( c = 0; c < pool->numCores; ++c ) {
+
+	if( CPU_ISSET( pool->cpus[ c ], &nodeCPUs ) ) {
+
+	  pool->nodes[ c ] = node;
+	}
+      }
+      if( node >= pool->numNodes ) {
+
+	pool->numNodes = node + 1;
+      }
+    }
+    fclose( file );
+  }
+
+  closedir( dir );
+}
+
+int initCorePool( CorePool *pool, const char *spec )
+{
+  int cpu, c;
+  cpu_set_t allowed, wanted;
+
+  if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) < 0 ) {
+
+    return -1;
+  }
+  if( !strcasecmp( spec, "all" ) ) {
+
+    wanted = allowed;
+  } else if( parseCPUList( spec, &wanted ) < 0 ) {
+
+    return -1;
+  }
+
+  pool->numCores = CPU_COUNT( &wanted );
+  if( pool->numCores == 0 ) {
+
+    return -1;
+  }
+  pool->cpus = (int *)malloc( sizeof( int ) * pool->numCores );
+  assert( pool->cpus != 0 );
+  pool->nodes = (int *)calloc( pool->numCores, sizeof( int ) );
+  assert( pool->nodes != 0 );
+  pool->inUse = (char *)calloc( pool->numCores, sizeof( char ) );
+  assert( pool->inUse != 0 );
+
+  c = 0;
+  for( cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+
+    if( CPU_ISSET( cpu, &wanted ) ) {
+
+      if( !CPU_ISSET( cpu, &allowed ) ) {
+	/* can't pin anything there */
+
+	free( pool->cpus );
+	free( pool->nodes );
+	free( pool->inUse );
+	return -1;
+      }
+      pool->cpus[ c ] = cpu;
+      ++c;
+    }
+  }
+  pool->numFree = pool->numCores;
+
+  findNodes( pool );
+  return 0;
+}
+
+int corePoolTake( CorePool *pool, const int count, int *cores )
+{
+  int c, n, node, bestNode, bestFree, taken;
+  int nodeFree[ pool->numNodes ];
+
+  if( count > pool->numFree ) {
+
+    return -1;
+  }
+
+  for( n = 0; n < pool->numNodes; ++n ) {
+
+    nodeFree[ n ] = 0;
+  }
+  for( c = 0; c < pool->numCores; ++c ) {
+
+    if( !pool->inUse[ c ] ) {
+
+      ++nodeFree[ pool->nodes[ c ] ];
+    }
+  }
+
+  /* the tightest node the job fits in, so big holes stay open for
+     big jobs, otherwise spread over nodes starting with the emptiest */
+  taken = 0;
+  while( taken < count ) {
+
+    bestNode = -1;
+    bestFree = 0;
+    for( n = 0; n < pool->numNodes; ++n ) {
+
+      if( nodeFree[ n ] >= count - taken
+	  && ( bestFree < count - taken || nodeFree[ n ] < bestFree ) ) {
+
+	bestNode = n;
+	bestFree = nodeFree[ n ];
+      } else if( bestFree < count - taken && nodeFree[ n ] > bestFree ) {
+
+	bestNode = n;
+	bestFree = nodeFree[ n ];
+      }
+    }
+    assert( bestNode >= 0 );
+
+    node = bestNode;
+    for( c = 0; c < pool->numCores && taken < count; ++c ) {
+
+      if( !pool->inUse[ c ] && pool->nodes[ c ] == node ) {
+
+	pool->inUse[ c ] = 1;
+	--nodeFree[ node ];
+	cores[ taken ] = c;
+	++taken;
+      }
+    }
+  }
+
+  pool->numFree -= count;
+  return 0;
+}
+
+void corePoolRelease( CorePool *pool, const int count, const int *cores )
+{
+  int i;
+
+  for( i = 0; i < count; ++i ) {
+
+    assert( pool->inUse[ cores[ i ] ] );
+    pool->inUse[ cores[ i ] ] = 0;
+  }
+  pool->numFree += count;
+}
+
+int corePoolPin( const CorePool *pool,
+		 const int count,
+		 const int *cores,
+		 const pid_t pid )
+{
+  int i;
+  cpu_set_t set;
+
+  CPU_ZERO( &set );
+  for( i = 0; i < count; ++i ) {
+
+    CPU_SET( pool->cpus[ cores[ i ] ], &set );
+  }
+  return sched_setaffinity( pid, sizeof( set ), &set );
+}
+
+int corePoolDescribe( const CorePool *pool,
+		      const int count,
+		      const int *cores,
+		      char *buf,
+		      const size_t bufSize )
+{
+  int i, j, len;
+
+  len = snprintf( buf, bufSize, count > 1 ? "cpus" : "cpu" );
+  for( i = 0; i < count && len < bufSize; ++i ) {
+
+    len += snprintf( &buf[ len ], bufSize - len,
+		     i ? ",%d" : " %d", pool->cpus[ cores[ i ] ] );
+  }
+
+  /* nodes in the order they first appear */
+  for( i = 0; i < count && len < bufSize; ++i ) {
+
+    for( j = 0; j < i; ++j ) {
+
+      if( pool->nodes[ cores[ j ] ] == pool->nodes[ cores[ i ] ] ) {
+
+	break;
+      }
+    }
+    if( j == i ) {
+
+      len += snprintf( &buf[ len ], bufSize - len,
+		       i ? ",%d" : " node %d", pool->nodes[ cores[ i ] ] );
+    }
+  }
+
+  return len < bufSize ? len : bufSize - 1;
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_CORES_H
+#define _BM_CORES_H
+
+#include <sys/types.h>
+
+
+/* Core sets for the benchmark server
+
+   a CorePool is the set of CPUs which jobs may be pinned to, along with
+   the NUMA node of each.  a job takes a disjoint set of free cores,
+   kept within one node when any node has room, and gives them back when
+   it finishes.  cores are referred to by their index in the pool, not
+   by CPU number */
+
+typedef struct {
+  int numCores;
+  int *cpus; /* CPU number of each core */
+  int *nodes; /* NUMA node of each core, 0 without NUMA information */
+  char *inUse; /* non-zero while a job holds the core */
+  int numFree;
+  int numNodes; /* nodes are numbered 0 to numNodes - 1 */
+} CorePool;
+
+
+/* set up a pool from a CPU list like "0-3,8,10-11", or "all" for every
+   CPU this process may run on
+   returns 0 on success, -1 on failure */
+int initCorePool( CorePool *pool, const char *spec );
+
+/* take count free cores, storing their indices in cores
+   returns 0 on success, -1 if there aren't count free cores */
+int corePoolTake( CorePool *pool, const int count, int *cores );
+
+/* give back cores taken by corePoolTake */
+void corePoolRelease( CorePool *pool, const int count, const int *cores );
+
+/* restrict process pid (0 for the caller) to the given cores
+   returns 0 on success, -1 on failure */
+int corePoolPin( const CorePool *pool,
+		 const int count,
+		 const int *cores,
+		 const pid_t pid );
+
+/* write the CPU numbers of the given cores, and the nodes they are on,
+   as "cpus 2,3 node 0" into buf
+   returns the number of characters written */
+int corePoolDescribe( const CorePool *pool,
+		      const int count,
+		      const int *cores,
+		      char *buf,
+		      const size_t bufSize );
+
+#endif
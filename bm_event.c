@@ -0,0 +1,219 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "bm_event.h"
+
+
+static int timerLess( const void *a, const void *b )
+{
+  return ( (const EventTimer *)a )->dueMicros
+    < ( (const EventTimer *)b )->dueMicros;
+}
+
+uint64_t eventNowMicros()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* point the timerfd at the earliest timer, or disarm it */
+static void armTimerFD( EventLoop *loop )
+{
+  EventTimer *first;
+  struct itimerspec its;
+
+  memset( &its, 0, sizeof( its ) );
+  first = (EventTimer *)heapTop( &loop->timers );
+  if( first ) {
+
+    /* absolute time, and never 0, which would disarm the timer */
+    its.it_value.tv_sec = first->dueMicros / 1000000;
+    its.it_value.tv_nsec = ( first->dueMicros % 1000000 ) * 1000 + 1;
+  }
+  timerfd_settime( loop->timerFD, TFD_TIMER_ABSTIME, &its, NULL );
+}
+
+static void handleTimerFD( EventLoop *loop,
+			   EventWatch *watch,
+			   const uint32_t events )
+{
+  uint64_t expirations, now;
+  EventTimer *timer;
+
+  if( read( loop->timerFD, &expirations, sizeof( expirations ) ) < 0 ) {
+    /* spurious wakeup, timers are checked against the clock anyway */
+  }
+
+  now = eventNowMicros();
+  while( ( timer = (EventTimer *)heapTop( &loop->timers ) ) != NULL
+	 && timer->dueMicros <= now ) {
+
+    heapRemove( &loop->timers, timer );
+    if( timer->intervalMicros ) {
+
+      timer->dueMicros = now + timer->intervalMicros;
+      heapPush( &loop->timers, timer );
+    }
+
+    /* the handler is free to restart or stop the timer */
+    timer->handler( loop, timer );
+  }
+
+  armTimerFD( loop );
+}
+
+int initEventLoop( EventLoop *loop )
+{
+  loop->epollFD = epoll_create1( EPOLL_CLOEXEC );
+  if( loop->epollFD < 0 ) {
+
+    return -1;
+  }
+
+  loop->timerFD = timerfd_create( CLOCK_MONOTONIC,
+				  TFD_NONBLOCK | TFD_CLOEXEC );
+  if( loop->timerFD < 0 ) {
+
+    close( loop->epollFD );
+    return -1;
+  }
+
+  initHeap( &loop->timers, timerLess, offsetof( EventTimer, heapIndex ) );
+  loop->data = NULL;
+  loop->timerWatch.active = 0;
+  return eventWatchAdd( loop,
+			&loop->timerWatch,
+			loop->timerFD,
+			EPOLLIN,
+			handleTimerFD,
+			NULL );
+}
+
+int eventWatchAdd( EventLoop *loop,
+		   EventWatch *watch,
+		   const int fd,
+		   const uint32_t events,
+		   EventHandler handler,
+		   void *data )
+{
+  struct epoll_event ev;
+
+  watch->fd = fd;
+  watch->handler = handler;
+  watch->data = data;
+
+  memset( &ev, 0, sizeof( ev ) );
+  ev.events = events;
+  ev.data.ptr = watch;
+  if( epoll_ctl( loop->epollFD, EPOLL_CTL_ADD, fd, &ev ) < 0 ) {
+
+    watch->active = 0;
+    return -1;
+  }
+
+  watch->active = 1;
+  return 0;
+}
+
+int eventWatchModify( EventLoop *loop,
+		      EventWatch *watch,
+		      const uint32_t events )
+{
+  struct epoll_event ev;
+
+  assert( watch->active );
+  memset( &ev, 0, sizeof( ev ) );
+  ev.events = events;
+  ev.data.ptr = watch;
+  return epoll_ctl( loop->epollFD, EPOLL_CTL_MOD, watch->fd, &ev );
+}
+
+void eventWatchRemove( EventLoop *loop, EventWatch *watch )
+{
+  if( !watch->active ) {
+
+    return;
+  }
+
+  epoll_ctl( loop->epollFD, EPOLL_CTL_DEL, watch->fd, NULL );
+  watch->active = 0;
+}
+
+void initEventTimer( EventTimer *timer )
+{
+  timer->heapIndex = -1;
+}
+
+void eventTimerStart( EventLoop *loop,
+		      EventTimer *timer,
+		      const uint64_t delayMicros,
+		      const uint64_t intervalMicros,
+		      TimerHandler handler,
+		      void *data )
+{
+  timer->dueMicros = eventNowMicros() + delayMicros;
+  timer->intervalMicros = intervalMicros;
+  timer->handler = handler;
+  timer->data = data;
+
+  if( timer->heapIndex >= 0 ) {
+
+    heapFix( &loop->timers, timer );
+  } else {
+
+    heapPush( &loop->timers, timer );
+  }
+  armTimerFD( loop );
+}
+
+void eventTimerStop( EventLoop *loop, EventTimer *timer )
+{
+  if( timer->heapIndex < 0 ) {
+
+    return;
+  }
+
+  heapRemove( &loop->timers, timer );
+  armTimerFD( loop );
+}
+
+int eventTimerIsRunning( const EventTimer *timer )
+{
+  return timer->heapIndex >= 0;
+}
+
+int runEventLoopOnce( EventLoop *loop )
+{
+  int n, i;
+  EventWatch *watch;
+  struct epoll_event events[ EVENT_MAX_BATCH ];
+
+  n = epoll_wait( loop->epollFD, events, EVENT_MAX_BATCH, -1 );
+  if( n < 0 ) {
+
+    return errno == EINTR ? 0 : -1;
+  }
+
+  for( i = 0; i < n; ++i ) {
+    watch = (EventWatch *)events[ i ].data.ptr;
+
+    /* an earlier handler in this batch may have removed the watch */
+    if( watch->active ) {
+
+      watch->handler( loop, watch, events[ i ].events );
+    }
+  }
+
+  return n;
+}
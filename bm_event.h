@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_EVENT_H
+#define _BM_EVENT_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include "bm_heap.h"
+
+
+#define EVENT_MAX_BATCH 64
+
+
+/* epoll based event loop
+
+   file descriptors are watched with an EventWatch, and timers are kept
+   in a heap behind a single timerfd.  handlers are called from
+   runEventLoopOnce, which blocks until something happens, so an idle
+   loop uses no CPU.  watches and timers are owned by the caller, and
+   must stay put while they are registered */
+
+typedef struct EventLoop_struct EventLoop;
+typedef struct EventWatch_struct EventWatch;
+typedef struct EventTimer_struct EventTimer;
+
+/* events is the set of EPOLLIN/EPOLLOUT/... flags which are ready */
+typedef void (*EventHandler)( EventLoop *loop,
+			      EventWatch *watch,
+			      const uint32_t events );
+typedef void (*TimerHandler)( EventLoop *loop, EventTimer *timer );
+
+struct EventWatch_struct {
+  int fd;
+  EventHandler handler;
+  void *data;
+  int active; /* 1 while registered */
+};
+
+struct EventTimer_struct {
+  uint64_t dueMicros; /* monotonic time the timer fires at */
+  uint64_t intervalMicros; /* 0 for a one shot timer */
+  TimerHandler handler;
+  void *data;
+  int heapIndex; /* position in loop->timers, -1 when stopped */
+};
+
+struct EventLoop_struct {
+  int epollFD;
+  int timerFD;
+  EventWatch timerWatch;
+  Heap timers;
+  void *data; /* owner of the loop, for use by handlers */
+};
+
+
+/* returns 0 on success, -1 on failure */
+int initEventLoop( EventLoop *loop );
+
+/* current time on the clock used for timers, in microseconds */
+uint64_t eventNowMicros();
+
+/* start watching fd for events, calling handler when they are ready
+   returns 0 on success, -1 on failure */
+int eventWatchAdd( EventLoop *loop,
+		   EventWatch *watch,
+		   const int fd,
+		   const uint32_t events,
+		   EventHandler handler,
+		   void *data );
+
+/* change the events a registered watch is waiting for */
+int eventWatchModify( EventLoop *loop,
+		      EventWatch *watch,
+		      const uint32_t events );
+
+/* stop watching - safe to call on a watch which isn't registered
+   must be called before the watched descriptor is closed */
+void eventWatchRemove( EventLoop *loop, EventWatch *watch );
+
+void initEventTimer( EventTimer *timer );
+
+/* call handler in delayMicros, and then every intervalMicros if that
+   is non-zero.  restarts the timer if it is already running */
+void eventTimerStart( EventLoop *loop,
+		      EventTimer *timer,
+		      const uint64_t delayMicros,
+		      const uint64_t intervalMicros,
+		      TimerHandler handler,
+		      void *data );
+
+/* safe to call on a timer which isn't running */
+void eventTimerStop( EventLoop *loop, EventTimer *timer );
+
+int eventTimerIsRunning( const EventTimer *timer );
+
+/* wait for at least one event and run the handlers for everything ready
+   returns number of handlers run, or -1 on failure */
+int runEventLoopOnce( EventLoop *loop );
+
+#endif
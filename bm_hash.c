@@ -0,0 +1,267 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "bm_hash.h"
+
+
+static HashTable *internTable = NULL;
+
+
+uint64_t hashBytes( uint64_t hash, const void *data, const size_t len )
+{
+  size_t i;
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  for( i = 0; i < len; ++i ) {
+
+    hash ^= bytes[ i ];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+static uint64_t hashString( const char *key )
+{
+  return hashBytes( HASH_FNV_OFFSET, key, strlen( key ) );
+}
+
+/* integer keys (PIDs, file descriptors) are often sequential, so mix
+   the bits before using the low ones to pick a bucket */
+static uint64_t hashInt( uint64_t key )
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+HashTable *newHashTable( int numBuckets )
+{
+  int n;
+  HashTable *table;
+
+  n = 1;
+  while( n < numBuckets ) {
+
+    n <<= 1;
+  }
+
+  table = (HashTable*)malloc( sizeof( HashTable ) );
+  assert( table != 0 );
+  table->buckets = (HashEntry**)calloc( n, sizeof( HashEntry * ) );
+  assert( table->buckets != 0 );
+  table->numBuckets = n;
+  table->numEntries = 0;
+  return table;
+}
+
+void destroyHashTable( HashTable *table )
+{
+  int b;
+  HashEntry *cur, *next;
+
+  for( b = 0; b < table->numBuckets; ++b ) {
+
+    for( cur = table->buckets[ b ]; cur != NULL; cur = next ) {
+      next = cur->next;
+
+      free( cur );
+    }
+  }
+  free( table->buckets );
+  free( table );
+}
+
+/* double the number of buckets once the average chain is longer than 1 */
+static void growTable( HashTable *table )
+{
+  int b, n;
+  HashEntry **buckets, *cur, *next;
+
+  if( table->numEntries <= table->numBuckets ) {
+
+    return;
+  }
+
+  n = table->numBuckets * 2;
+  buckets = (HashEntry**)calloc( n, sizeof( HashEntry * ) );
+  assert( buckets != 0 );
+  for( b = 0; b < table->numBuckets; ++b ) {
+
+    for( cur = table->buckets[ b ]; cur != NULL; cur = next ) {
+      next = cur->next;
+
+      cur->next = buckets[ cur->hash & ( n - 1 ) ];
+      buckets[ cur->hash & ( n - 1 ) ] = cur;
+    }
+  }
+  free( table->buckets );
+  table->buckets = buckets;
+  table->numBuckets = n;
+}
+
+/* returns pointer to the link pointing at the entry for the key,
+   or the NULL link at the end of the chain if the key is not present */
+static HashEntry **findLink( const HashTable *table,
+			     const uint64_t hash,
+			     const char *strKey,
+			     const uint64_t intKey )
+{
+  HashEntry **link;
+
+  for( link = &table->buckets[ hash & ( table->numBuckets - 1 ) ];
+       *link != NULL; link = &( *link )->next ) {
+
+    if( ( *link )->hash != hash ) {
+
+      continue;
+    }
+    if( strKey ? !strcmp( ( *link )->strKey, strKey )
+	: ( *link )->intKey == intKey ) {
+
+      break;
+    }
+  }
+
+  return link;
+}
+
+static void addEntry( HashTable *table,
+		      const uint64_t hash,
+		      const char *strKey,
+		      const uint64_t intKey,
+		      void *value )
+{
+  HashEntry **link, *entry;
+
+  link = findLink( table, hash, strKey, intKey );
+  if( *link ) {
+
+    ( *link )->value = value;
+    return;
+  }
+
+  entry = (HashEntry*)malloc( sizeof( HashEntry ) );
+  assert( entry != 0 );
+  entry->next = NULL;
+  entry->hash = hash;
+  entry->strKey = strKey;
+  entry->intKey = intKey;
+  entry->value = value;
+  *link = entry;
+
+  ++table->numEntries;
+  growTable( table );
+}
+
+static void *removeEntry( HashTable *table,
+			  const uint64_t hash,
+			  const char *strKey,
+			  const uint64_t intKey )
+{
+  void *value;
+  HashEntry **link, *entry;
+
+  link = findLink( table, hash, strKey, intKey );
+  if( *link == NULL ) {
+
+    return NULL;
+  }
+
+  entry = *link;
+  *link = entry->next;
+  value = entry->value;
+  free( entry );
+  --table->numEntries;
+
+  return value;
+}
+
+void *hashFindString( const HashTable *table, const char *key )
+{
+  HashEntry *entry = *findLink( table, hashString( key ), key, 0 );
+
+  return entry ? entry->value : NULL;
+}
+
+void *hashFindInt( const HashTable *table, const uint64_t key )
+{
+  HashEntry *entry = *findLink( table, hashInt( key ), NULL, key );
+
+  return entry ? entry->value : NULL;
+}
+
+void hashAddString( HashTable *table, const char *key, void *value )
+{
+  addEntry( table, hashString( key ), key, 0, value );
+}
+
+void hashAddInt( HashTable *table, const uint64_t key, void *value )
+{
+  addEntry( table, hashInt( key ), NULL, key, value );
+}
+
+void *hashRemoveString( HashTable *table, const char *key )
+{
+  return removeEntry( table, hashString( key ), key, 0 );
+}
+
+void *hashRemoveInt( HashTable *table, const uint64_t key )
+{
+  return removeEntry( table, hashInt( key ), NULL, key );
+}
+
+HashEntry *hashNextEntry( const HashTable *table, HashEntry *cur )
+{
+  int b;
+
+  if( cur ) {
+
+    if( cur->next ) {
+
+      return cur->next;
+    }
+    b = ( cur->hash & ( table->numBuckets - 1 ) ) + 1;
+  } else {
+
+    b = 0;
+  }
+
+  for( ; b < table->numBuckets; ++b ) {
+
+    if( table->buckets[ b ] ) {
+
+      return table->buckets[ b ];
+    }
+  }
+
+  return NULL;
+}
+
+const char *internString( const char *string )
+{
+  char *copy;
+
+  if( internTable == NULL ) {
+
+    internTable = newHashTable( HASH_DEFAULT_BUCKETS );
+  }
+
+  copy = (char *)hashFindString( internTable, string );
+  if( copy == NULL ) {
+
+    copy = strdup( string );
+    assert( copy != 0 );
+    hashAddString( internTable, copy, copy );
+  }
+
+  return copy;
+}
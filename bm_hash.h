@@ -0,0 +1,69 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_HASH_H
+#define _BM_HASH_H
+
+#include <stdlib.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+#define HASH_DEFAULT_BUCKETS 64
+
+
+/* chained hash table mapping either strings or integers to pointers
+
+   string keys are not copied, so they must live at least as long as
+   their entry - interned strings or names owned by the value work well.
+   a table should only be used with one kind of key */
+typedef struct HashEntry_struct {
+  struct HashEntry_struct *next;
+  uint64_t hash;
+  const char *strKey; /* NULL for integer keys */
+  uint64_t intKey;
+  void *value;
+} HashEntry;
+
+typedef struct {
+  HashEntry **buckets;
+  int numBuckets; /* always a power of two */
+  int numEntries;
+} HashTable;
+
+
+/* create an empty table with at least numBuckets buckets */
+HashTable *newHashTable( int numBuckets );
+
+/* free the table and its entries, but not the keys or values */
+void destroyHashTable( HashTable *table );
+
+/* returns value for key, or NULL if key is not in the table */
+void *hashFindString( const HashTable *table, const char *key );
+void *hashFindInt( const HashTable *table, const uint64_t key );
+
+/* add key -> value, replacing any existing value for key */
+void hashAddString( HashTable *table, const char *key, void *value );
+void hashAddInt( HashTable *table, const uint64_t key, void *value );
+
+/* remove key from the table
+   returns the value it mapped to, or NULL if it wasn't in the table */
+void *hashRemoveString( HashTable *table, const char *key );
+void *hashRemoveInt( HashTable *table, const uint64_t key );
+
+/* iterate over all entries: start with cur = NULL, stops at NULL
+   the table must not be changed while iterating */
+HashEntry *hashNextEntry( const HashTable *table, HashEntry *cur );
+
+/* 64 bit FNV-1a hash of len bytes of data, continuing from hash
+   start with HASH_FNV_OFFSET */
+#define HASH_FNV_OFFSET 14695981039346656037ULL
+uint64_t hashBytes( uint64_t hash, const void *data, const size_t len );
+
+/* return the single shared copy of string, creating it if needed
+   interned strings are never freed, and equal interned strings
+   can be compared by pointer */
+const char *internString( const char *string );
+
+#endif
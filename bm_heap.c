@@ -0,0 +1,142 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include "bm_heap.h"
+
+
+#define HEAP_INITIAL_CAPACITY 16
+
+
+static int *indexPtr( const Heap *heap, const void *item )
+{
+  return (int *)( (char *)item + heap->indexOffset );
+}
+
+static void setItem( Heap *heap, const int i, void *item )
+{
+  heap->items[ i ] = item;
+  *indexPtr( heap, item ) = i;
+}
+
+static void siftUp( Heap *heap, int i )
+{
+  int parent;
+  void *item = heap->items[ i ];
+
+  while( i > 0 ) {
+
+    parent = ( i - 1 ) / 2;
+    if( !heap->less( item, heap->items[ parent ] ) ) {
+
+      break;
+    }
+    setItem( heap, i, heap->items[ parent ] );
+    i = parent;
+  }
+  setItem( heap, i, item );
+}
+
+static void siftDown( Heap *heap, int i )
+{
+  int child;
+  void *item = heap->items[ i ];
+
+  while( 1 ) {
+
+    child = i * 2 + 1;
+    if( child >= heap->size ) {
+
+      break;
+    }
+    if( child + 1 < heap->size
+	&& heap->less( heap->items[ child + 1 ], heap->items[ child ] ) ) {
+
+      ++child;
+    }
+    if( !heap->less( heap->items[ child ], item ) ) {
+
+      break;
+    }
+    setItem( heap, i, heap->items[ child ] );
+    i = child;
+  }
+  setItem( heap, i, item );
+}
+
+void initHeap( Heap *heap, HeapLessFunc less, size_t indexOffset )
+{
+  heap->items = NULL;
+  heap->size = 0;
+  heap->capacity = 0;
+  heap->indexOffset = indexOffset;
+  heap->less = less;
+}
+
+void freeHeap( Heap *heap )
+{
+  free( heap->items );
+  heap->items = NULL;
+  heap->size = 0;
+  heap->capacity = 0;
+}
+
+void *heapTop( const Heap *heap )
+{
+  return heap->size ? heap->items[ 0 ] : NULL;
+}
+
+void heapPush( Heap *heap, void *item )
+{
+  if( heap->size == heap->capacity ) {
+
+    heap->capacity
+      = heap->capacity ? heap->capacity * 2 : HEAP_INITIAL_CAPACITY;
+    heap->items
+      = (void **)realloc( heap->items, sizeof( void * ) * heap->capacity );
+    assert( heap->items != 0 );
+  }
+
+  heap->items[ heap->size ] = item;
+  ++heap->size;
+  siftUp( heap, heap->size - 1 );
+}
+
+void heapRemove( Heap *heap, void *item )
+{
+  int i = *indexPtr( heap, item );
+
+  assert( i >= 0 && i < heap->size && heap->items[ i ] == item );
+  *indexPtr( heap, item ) = -1;
+
+  --heap->size;
+  if( i == heap->size ) {
+
+    return;
+  }
+
+  /* move the last item into the hole, then let it find its place */
+  setItem( heap, i, heap->items[ heap->size ] );
+  heapFix( heap, heap->items[ i ] );
+}
+
+void heapFix( Heap *heap, void *item )
+{
+  int i = *indexPtr( heap, item );
+
+  assert( i >= 0 && i < heap->size && heap->items[ i ] == item );
+  if( i > 0 && heap->less( item, heap->items[ ( i - 1 ) / 2 ] ) ) {
+
+    siftUp( heap, i );
+  } else {
+
+    siftDown( heap, i );
+  }
+}
+
+int heapIndexOf( const Heap *heap, const void *item )
+{
+  return *indexPtr( heap, item );
+}
@@ -0,0 +1,48 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_HEAP_H
+#define _BM_HEAP_H
+
+#include <stddef.h>
+
+
+/* returns non-zero if a should come out of the heap before b */
+typedef int (*HeapLessFunc)( const void *a, const void *b );
+
+/* binary min-heap of pointers
+
+   every item stores its own position in the heap in an int at
+   indexOffset bytes from the start of the item, which lets items be
+   removed or re-positioned after their key changes in O(log n).
+   the position is -1 when the item is not in a heap */
+typedef struct {
+  void **items;
+  int size;
+  int capacity;
+  size_t indexOffset;
+  HeapLessFunc less;
+} Heap;
+
+
+void initHeap( Heap *heap, HeapLessFunc less, size_t indexOffset );
+
+/* free the storage used by the heap, but not the items */
+void freeHeap( Heap *heap );
+
+/* returns the first item, or NULL if the heap is empty */
+void *heapTop( const Heap *heap );
+
+void heapPush( Heap *heap, void *item );
+
+/* remove item, which must be in the heap */
+void heapRemove( Heap *heap, void *item );
+
+/* restore the heap order after the key for item has changed */
+void heapFix( Heap *heap, void *item );
+
+/* returns the position of item, or -1 if it isn't in a heap */
+int heapIndexOf( const Heap *heap, const void *item );
+
+#endif
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "bm_journal.h"
+
+
+int openJournal( Journal *journal,
+		 const char *path,
+		 JournalReplayHandler handler,
+		 void *data )
+{
+  FILE *file;
+  off_t goodEnd;
+  size_t len;
+  char record[ JOURNAL_MAX_RECORD + 1 ];
+
+  journal->path = strdup( path );
+  assert( journal->path != 0 );
+  journal->numRecords = 0;
+  journal->sync = 1;
+
+  journal->fd = open( path, O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+  if( journal->fd < 0 ) {
+
+    return -1;
+  }
+
+  /* replay everything up to the last complete record */
+  file = fdopen( dup( journal->fd ), "r" );
+  if( file == NULL ) {
+
+    close( journal->fd );
+    return -1;
+  }
+  goodEnd = 0;
+  while( fgets( record, sizeof( record ), file ) != NULL ) {
+
+    len = strlen( record );
+    if( record[ len - 1 ] != '\n' ) {
+      /* torn write, or a record too long to have been written by us */
+
+      break;
+    }
+    goodEnd += len;
+    record[ len - 1 ] = 0;
+
+    handler( record, data );
+    ++journal->numRecords;
+  }
+  fclose( file );
+
+  /* new records go after the last good one */
+  if( ftruncate( journal->fd, goodEnd ) < 0
+      || lseek( journal->fd, 0, SEEK_END ) < 0 ) {
+
+    close( journal->fd );
+    return -1;
+  }
+
+  return 0;
+}
+
+int journalAppend( Journal *journal, const char *format, ... )
+{
+  int len;
+  va_list ap;
+  char record[ JOURNAL_MAX_RECORD + 1 ];
+
+  va_start( ap, format );
+  len = vsnprintf( record, JOURNAL_MAX_RECORD, format, ap );
+  va_end( ap );
+  if( len < 0 || len >= JOURNAL_MAX_RECORD ) {
+
+    return -1;
+  }
+  record[ len ] = '\n';
+  ++len;
+
+  if( write( journal->fd, record, len ) < len ) {
+
+    return -1;
+  }
+  if( journal->sync && fdatasync( journal->fd ) < 0 ) {
+
+    return -1;
+  }
+
+  ++journal->numRecords;
+  return 0;
+}
+
+int journalCompact( Journal *journal, JournalWriter writer, void *data )
+{
+  Journal compacted;
+  char tmpPath[ strlen( journal->path ) + 8 ];
+
+  sprintf( tmpPath, "%s.tmp", journal->path );
+  compacted.fd = open( tmpPath,
+		       O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+		       0644 );
+  if( compacted.fd < 0 ) {
+
+    return -1;
+  }
+  compacted.path = tmpPath;
+  compacted.numRecords = 0;
+  /* one sync at the end is enough, since nothing uses the file yet */
+  compacted.sync = 0;
+
+  if( writer( &compacted, data ) < 0
+      || fsync( compacted.fd ) < 0
+      || rename( tmpPath, journal->path ) < 0 ) {
+
+    close( compacted.fd );
+    unlink( tmpPath );
+    return -1;
+  }
+
+  close( journal->fd );
+  journal->fd = compacted.fd;
+  journal->numRecords = compacted.numRecords;
+  return 0;
+}
@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_JOURNAL_H
+#define _BM_JOURNAL_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* longest record, including the newline */
+#define JOURNAL_MAX_RECORD 8192
+
+
+/* Append-only journal of text records
+
+   each record is one line, written with a single write() and synced to
+   disk before journalAppend returns, so a crash loses at most a record
+   which was never acknowledged.  a torn record at the end of the file is
+   dropped when the journal is opened.  the owner compacts the journal by
+   writing a fresh set of records describing its current state, which
+   atomically replaces the old file, so replay time tracks the size of
+   the state rather than its history */
+
+typedef struct {
+  int fd;
+  char *path;
+  uint32_t numRecords; /* records in the file */
+  int sync; /* non-zero to sync after every record */
+} Journal;
+
+/* handler is called with each record, without its newline */
+typedef void (*JournalReplayHandler)( const char *record, void *data );
+/* writer appends records describing the current state to journal */
+typedef int (*JournalWriter)( Journal *journal, void *data );
+
+
+/* open the journal at path, creating it if needed, and call handler
+   with every record already in it
+   returns 0 on success, -1 on failure */
+int openJournal( Journal *journal,
+		 const char *path,
+		 JournalReplayHandler handler,
+		 void *data );
+
+/* append a printf style record - the newline is added
+   returns 0 on success, -1 on failure */
+int journalAppend( Journal *journal, const char *format, ... )
+  __attribute__ ((format (printf, 2, 3)));
+
+/* replace the journal with the records from writer
+   the old journal is left alone if anything fails
+   returns 0 on success, -1 on failure */
+int journalCompact( Journal *journal, JournalWriter writer, void *data );
+
+#endif
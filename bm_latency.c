@@ -0,0 +1,214 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "net.h"
+
+
+#define DEFAULT_ITERATIONS 20000
+#define WARMUP_ITERATIONS 1000
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: bm_latency [iterations] [profile]\n" );
+  fprintf( file, "  times dealer->player->dealer round trips over loopback,\n" );
+  fprintf( file, "  once with no socket tuning and once with profile\n" );
+  fprintf( file, "  profile defaults to \"lowlatency\"\n" );
+}
+
+static int compareUint64( const void *a, const void *b )
+{
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t nowNanos()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* act like a player: answer every state line with a call */
+static void runPlayer( uint16_t port )
+{
+  int sock, len;
+  ReadBuf *readBuf;
+  char line[ READBUF_LEN ];
+
+  sock = connectTo( "localhost", port );
+  if( sock < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  readBuf = createReadBuf( sock );
+
+  while( ( len = getLine( readBuf, READBUF_LEN - 2, line, -1 ) ) > 0 ) {
+
+    /* replace "\r\n" with the action, like a real player */
+    len -= 2;
+    len += snprintf( &line[ len ], READBUF_LEN - len, ":c\r\n" );
+    if( write( sock, line, len ) != len ) {
+
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  exit( EXIT_SUCCESS );
+}
+
+/* play iterations round trips with the given profile in effect
+   for both ends, and print the latency distribution
+   returns 0 on success, -1 on failure */
+static int measure( const char *name,
+		    const SocketProfile *profile,
+		    const int iterations )
+{
+  int listenSocket, sock, i, len, v;
+  pid_t pid;
+  uint16_t port;
+  uint64_t start, total, *samples;
+  ReadBuf *readBuf;
+  char msg[ READBUF_LEN ], line[ READBUF_LEN ];
+
+  setSocketProfile( profile );
+
+  port = 0;
+  listenSocket = getListenSocket( &port );
+  if( listenSocket < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open listen socket\n" );
+    return -1;
+  }
+
+  fflush( stdout );
+  pid = fork();
+  if( pid < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    return -1;
+  }
+  if( !pid ) {
+
+    close( listenSocket );
+    runPlayer( port );
+  }
+
+  sock = acceptSocket( listenSocket );
+  close( listenSocket );
+  if( sock < 0 ) {
+
+    fprintf( stderr, "ERROR: player could not connect\n" );
+    return -1;
+  }
+  /* the dealer always sets TCP_NODELAY */
+  v = 1;
+  setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, &v, sizeof( v ) );
+  readBuf = createReadBuf( sock );
+
+  samples = (uint64_t *)malloc( sizeof( *samples ) * iterations );
+  if( samples == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate samples\n" );
+    return -1;
+  }
+
+  total = 0;
+  for( i = -WARMUP_ITERATIONS; i < iterations; ++i ) {
+
+    len = snprintf( msg,
+		    sizeof( msg ),
+		    "MATCHSTATE:0:%d:cr:Ah2c|/Ks7d3h\r\n",
+		    i < 0 ? -i : i );
+    start = nowNanos();
+    if( write( sock, msg, len ) != len
+	|| getLine( readBuf, READBUF_LEN, line, -1 ) <= 0 ) {
+
+      fprintf( stderr, "ERROR: lost connection to player\n" );
+      return -1;
+    }
+    if( i >= 0 ) {
+
+      samples[ i ] = nowNanos() - start;
+      total += samples[ i ];
+    }
+  }
+
+  destroyReadBuf( readBuf );
+  waitpid( pid, NULL, 0 );
+
+  qsort( samples, iterations, sizeof( *samples ), compareUint64 );
+  printf( "%-12s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+	  name,
+	  total / 1000.0 / iterations,
+	  samples[ iterations / 2 ] / 1000.0,
+	  samples[ iterations * 9 / 10 ] / 1000.0,
+	  samples[ iterations * 99 / 100 ] / 1000.0,
+	  samples[ iterations - 1 ] / 1000.0 );
+
+  free( samples );
+  return 0;
+}
+
+int main( int argc, char **argv )
+{
+  int iterations, sock, failed;
+  const char *spec;
+  SocketProfile none, profile;
+
+  iterations = DEFAULT_ITERATIONS;
+  if( argc > 1
+      && ( sscanf( argv[ 1 ], "%d", &iterations ) < 1 || iterations <= 0 ) ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+  spec = argc > 2 ? argv[ 2 ] : "lowlatency";
+  if( parseSocketProfile( spec, &profile ) < 0 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+  memset( &none, 0, sizeof( none ) );
+
+  signal( SIGPIPE, SIG_IGN );
+
+  /* warn about options this host refuses, which will not be measured */
+  setSocketProfile( &profile );
+  sock = socket( AF_INET, SOCK_STREAM, 0 );
+  failed = sock < 0 ? -1 : applySocketProfile( sock );
+  close( sock );
+  if( failed ) {
+
+    fprintf( stderr,
+	     "WARNING: %d socket option(s) in \"%s\" could not be set\n",
+	     failed, spec );
+  }
+
+  printf( "round trip latency per action, microseconds, %d actions\n",
+	  iterations );
+  printf( "%-12s %10s %10s %10s %10s %10s\n",
+	  "profile", "mean", "p50", "p90", "p99", "max" );
+  if( measure( "none", &none, iterations ) < 0
+      || measure( spec, &profile, iterations ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "bm_limits.h"
+
+
+/* period of a group's CPU quota, in microseconds */
+#define LIMITS_CPU_PERIOD 100000
+
+/* seconds between SIGXCPU and SIGKILL for a bot over its CPU time */
+#define LIMITS_CPU_GRACE_SECS 5
+
+
+/* write text to the file at dir/name
+   returns 0 on success, -1 on failure */
+static int writeGroupFile( const char *dir, const char *name, const char *text )
+{
+  int fd, len, r;
+  char path[ strlen( dir ) + strlen( name ) + 2 ];
+
+  sprintf( path, "%s/%s", dir, name );
+  fd = open( path, O_WRONLY | O_CLOEXEC );
+  if( fd < 0 ) {
+
+    return -1;
+  }
+  len = strlen( text );
+  r = write( fd, text, len );
+  close( fd );
+  return r == len ? 0 : -1;
+}
+
+int botLimitsSet( const BotLimits *limits )
+{
+  return limits->cpus > 0.0 || limits->memoryMB || limits->maxPids;
+}
+
+int initLimitGroups( LimitGroups *groups, const char *dir )
+{
+  FILE *file;
+  char controllers[ 256 ];
+  char path[ dir ? strlen( dir ) + 32 : 1 ];
+
+  groups->dir = NULL;
+  groups->lastGroup = 0;
+  groups->staleGroups = NULL;
+  groups->numStaleGroups = 0;
+  if( dir == NULL ) {
+
+    return 0;
+  }
+
+  /* every controller must be there to be handed down */
+  sprintf( path, "%s/cgroup.controllers", dir );
+  file = fopen( path, "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  if( fgets( controllers, sizeof( controllers ), file ) == NULL ) {
+
+    controllers[ 0 ] = 0;
+  }
+  fclose( file );
+  if( strstr( controllers, "cpu" ) == NULL
+      || strstr( controllers, "memory" ) == NULL
+      || strstr( controllers, "pids" ) == NULL ) {
+
+    return -1;
+  }
+
+  if( writeGroupFile( dir, "cgroup.subtree_control",
+		      "+cpu +memory +pids" ) < 0 ) {
+
+    return -1;
+  }
+
+  groups->dir = strdup( dir );
+  assert( groups->dir != 0 );
+  return 0;
+}
+
+char *limitGroupCreate( LimitGroups *groups,
+			const char *name,
+			const BotLimits *limits )
+{
+  char *group, text[ 64 ];
+
+  if( groups->dir == NULL ) {
+
+    return NULL;
+  }
+
+  ++groups->lastGroup;
+  group = (char *)malloc( strlen( groups->dir ) + strlen( name ) + 16 );
+  assert( group != 0 );
+  sprintf( group, "%s/%s.%"PRIu32, groups->dir, name, groups->lastGroup );
+  if( mkdir( group, 0755 ) < 0 ) {
+
+    free( group );
+    return NULL;
+  }
+
+  if( limits->cpus > 0.0 ) {
+
+    snprintf( text, sizeof( text ), "%.0f %d",
+	      limits->cpus * LIMITS_CPU_PERIOD, LIMITS_CPU_PERIOD );
+    if( writeGroupFile( group, "cpu.max", text ) < 0 ) {
+
+      goto fail;
+    }
+  }
+  if( limits->memoryMB ) {
+
+    snprintf( text, sizeof( text ), "%"PRIu64,
+	      (uint64_t)limits->memoryMB << 20 );
+    if( writeGroupFile( group, "memory.max", text ) < 0 ) {
+
+      goto fail;
+    }
+
+    /* a bot in swap slows the whole machine - not every kernel accounts
+       for swap, in which case there is nothing to turn off */
+    writeGroupFile( group, "memory.swap.max", "0" );
+  }
+  if( limits->maxPids ) {
+
+    snprintf( text, sizeof( text ), "%"PRIu32, limits->maxPids );
+    if( writeGroupFile( group, "pids.max", text ) < 0 ) {
+
+      goto fail;
+    }
+  }
+
+  return group;
+
+ fail:
+  rmdir( group );
+  free( group );
+  return NULL;
+}
+
+int limitJoin( const char *group,
+	       const BotLimits *limits,
+	       const double cpuSecs )
+{
+  struct rlimit limit;
+
+  if( group ) {
+
+    return writeGroupFile( group, "cgroup.procs", "0" );
+  }
+
+  if( limits->memoryMB ) {
+
+    limit.rlim_cur = limit.rlim_max = (rlim_t)limits->memoryMB << 20;
+    if( setrlimit( RLIMIT_AS, &limit ) < 0 ) {
+
+      return -1;
+    }
+  }
+  if( cpuSecs > 0.0 ) {
+
+    limit.rlim_cur = (rlim_t)cpuSecs + 1;
+    limit.rlim_max = limit.rlim_cur + LIMITS_CPU_GRACE_SECS;
+    if( setrlimit( RLIMIT_CPU, &limit ) < 0 ) {
+
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int limitGroupEvents( const char *group, LimitEvents *events )
+{
+  FILE *file;
+  uint64_t value;
+  char line[ 256 ], path[ strlen( group ) + 32 ];
+
+  events->oomKills = 0;
+  events->pidsRefused = 0;
+
+  sprintf( path, "%s/memory.events", group );
+  file = fopen( path, "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  while( fgets( line, sizeof( line ), file ) ) {
+
+    if( sscanf( line, "oom_kill %"SCNu64, &value ) == 1 ) {
+
+      events->oomKills = value;
+    }
+  }
+  fclose( file );
+
+  sprintf( path, "%s/pids.events", group );
+  file = fopen( path, "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  while( fgets( line, sizeof( line ), file ) ) {
+
+    if( sscanf( line, "max %"SCNu64, &value ) == 1 ) {
+
+      events->pidsRefused = value;
+    }
+  }
+  fclose( file );
+
+  return 0;
+}
+
+int limitGroupFreeze( const char *group, const int frozen )
+{
+  return writeGroupFile( group, "cgroup.freeze", frozen ? "1" : "0" );
+}
+
+void limitGroupRemove( LimitGroups *groups, char *group )
+{
+  int i;
+
+  /* a bot's children may outlive it, so clear out the group first */
+  if( group && rmdir( group ) < 0 && errno == EBUSY ) {
+
+    writeGroupFile( group, "cgroup.kill", "1" );
+    groups->staleGroups
+      = (char **)realloc( groups->staleGroups,
+			  sizeof( char * ) * ( groups->numStaleGroups + 1 ) );
+    assert( groups->staleGroups != 0 );
+    groups->staleGroups[ groups->numStaleGroups ] = group;
+    ++groups->numStaleGroups;
+    return;
+  }
+  free( group );
+
+  for( i = 0; i < groups->numStaleGroups; ) {
+
+    if( rmdir( groups->staleGroups[ i ] ) < 0 && errno == EBUSY ) {
+
+      ++i;
+      continue;
+    }
+    free( groups->staleGroups[ i ] );
+    --groups->numStaleGroups;
+    groups->staleGroups[ i ] = groups->staleGroups[ groups->numStaleGroups ];
+  }
+}
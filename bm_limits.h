@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_LIMITS_H
+#define _BM_LIMITS_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* Resource limits for bot processes
+
+   with a delegated cgroup v2 directory, each bot process is put in a
+   group of its own under it, with the bot's CPU quota, memory limit
+   (and no swap) and process limit, so a runaway bot only hurts itself.
+   the group's event counts say afterwards whether the kernel had to
+   step in.  without cgroups, setrlimit stands in where it can: the
+   memory limit caps the bot's address space, and the CPU quota becomes
+   a cap on total CPU time, over the time the bot is allowed for its
+   match, enforced by SIGXCPU.  RLIMIT_NPROC counts every process of
+   the user, not just the bot's, so there is no process limit, and a
+   bot going over its address space only sees allocations fail */
+
+typedef struct {
+  double cpus; /* CPU quota, in CPUs, 0 for none */
+  uint32_t memoryMB; /* 0 for none */
+  uint32_t maxPids; /* processes and threads, 0 for none */
+} BotLimits;
+
+/* counts of the kernel enforcing a group's limits */
+typedef struct {
+  uint64_t oomKills; /* processes killed for going over memory */
+  uint64_t pidsRefused; /* forks refused for going over the pids limit */
+} LimitEvents;
+
+typedef struct {
+  char *dir; /* groups are made in here, NULL when using setrlimit */
+  uint32_t lastGroup; /* numbers groups */
+  char **staleGroups; /* groups whose processes hadn't all gone yet */
+  int numStaleGroups;
+} LimitGroups;
+
+
+/* non-zero if any limit is set */
+int botLimitsSet( const BotLimits *limits );
+
+/* make groups under dir, which must be a cgroup v2 directory the server
+   can write and which holds no processes itself, or use setrlimit if
+   dir is NULL
+   returns 0 on success, -1 if dir can't be used, leaving setrlimit */
+int initLimitGroups( LimitGroups *groups, const char *dir );
+
+/* make a group for one bot process, named after the bot
+   returns the group's path, to be freed by limitGroupRemove, or NULL
+   if groups aren't in use or the group couldn't be made */
+char *limitGroupCreate( LimitGroups *groups,
+			const char *name,
+			const BotLimits *limits );
+
+/* put the calling process in group, or limit it with setrlimit if group
+   is NULL - for forked children, before exec.  cpuSecs is the CPU time
+   the setrlimit fallback allows, 0 for no limit
+   returns 0 on success, -1 on failure */
+int limitJoin( const char *group,
+	       const BotLimits *limits,
+	       const double cpuSecs );
+
+/* read the group's event counts
+   returns 0 on success, -1 on failure */
+int limitGroupEvents( const char *group, LimitEvents *events );
+
+/* stop every process in group where it is, or let them carry on
+   returns 0 on success, -1 on failure */
+int limitGroupFreeze( const char *group, const int frozen );
+
+/* get rid of the group and free its path, killing anything left in it
+   - groups which aren't empty yet are retried on later calls */
+void limitGroupRemove( LimitGroups *groups, char *group );
+
+#endif
@@ -0,0 +1,724 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include "game.h"
+#include "net.h"
+#include "bm_event.h"
+
+
+/* Load generator for the benchmark server
+
+   opens many client connections to bm_server at once, logs each of
+   them in, and has each one send a number of commands, picked from
+   GAMES, QSTAT and RUNMATCHES in proportion to the --mix weights.
+   replies aren't framed, so every command is followed by "LOADPING",
+   which the server doesn't know, and the "UNKNOWN" it answers with
+   marks the end of the reply.  reports latency by command, time from
+   starting to connect to being logged in, and the overall command
+   throughput
+
+   matches are all bot matches, with the bots named by --bot.  to keep
+   the server from running real matches, run it from a scratch
+   directory where dealer is a copy of bm_load_stub, and have its
+   config name bm_load_stub as the bot command - --write_config writes
+   such a config, with the users bm_load logs in as */
+
+#define LOAD_PING "LOADPING\n"
+#define LOAD_PASSWORD "load"
+#define DEFAULT_CLIENTS 1000
+#define DEFAULT_USERS 10
+#define DEFAULT_COMMANDS 20
+#define DEFAULT_GAME "holdem.limit.2p.reverse_blinds.game"
+#define DEFAULT_BOT "stub"
+#define DEFAULT_STUB "./bm_load_stub"
+/* hands in each match of a written config, which the stub dealer
+   sleeps for as milliseconds */
+#define LOAD_MATCH_HANDS 100
+/* stub matches a written config lets run at once */
+#define LOAD_RUNNING_JOBS 16
+#define DEFAULT_BM_PORT 54000
+
+enum { CMD_GAMES, CMD_QSTAT, CMD_RUNMATCHES, NUM_LOAD_CMDS };
+static const char *loadCmdNames[ NUM_LOAD_CMDS ]
+= { "GAMES", "QSTAT", "RUNMATCHES" };
+
+enum { CLIENT_CONNECT, CLIENT_LOGON, CLIENT_COMMAND, CLIENT_IDLE, CLIENT_DONE };
+
+
+typedef struct {
+  int id;
+  int state;
+  ReadBuf *readBuf;
+  EventWatch watch;
+  EventTimer timer;
+  int cmd; /* command waiting on a reply */
+  int cmdsSent;
+  int cmdFailed; /* reply to cmd had an error in it */
+  uint64_t sentMicros;
+  unsigned int seed;
+} LoadClient;
+
+typedef struct {
+  uint64_t *micros; /* latency of each reply */
+  int count;
+  int errors;
+} LoadStats;
+
+typedef struct {
+  const char *host;
+  uint16_t port;
+  int numClients;
+  int numUsers;
+  int numCommands;
+  int mix[ NUM_LOAD_CMDS ];
+  int mixTotal;
+  uint64_t intervalMicros;
+  const char *gameFile;
+  int numPlayers;
+  const char *bot;
+
+  LoadClient *clients;
+  int numDone;
+  LoadStats stats[ NUM_LOAD_CMDS ];
+  LoadStats logons;
+  int connectFailures;
+  int disconnects; /* connections the server closed early */
+  uint64_t startMicros;
+  uint64_t endMicros;
+} LoadState;
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: bm_load [options] bm_hostname bm_port\n" );
+  fprintf( file, "       bm_load [options] --write_config file [bm_port]\n" );
+  fprintf( file, "  --clients [%d] connections open at once\n",
+	   DEFAULT_CLIENTS );
+  fprintf( file, "  --users [%d] clients log in as load0, load1, ...\n",
+	   DEFAULT_USERS );
+  fprintf( file, "  --commands [%d] commands sent by each client\n",
+	   DEFAULT_COMMANDS );
+  fprintf( file, "  --mix [4:4:2] weights of GAMES:QSTAT:RUNMATCHES\n" );
+  fprintf( file, "  --interval_ms [0] pause between a reply and the next command\n" );
+  fprintf( file, "  --game [%s] game of submitted matches\n", DEFAULT_GAME );
+  fprintf( file, "  --bot [%s] bot in each seat of submitted matches\n",
+	   DEFAULT_BOT );
+  fprintf( file, "  --stub [%s] bot command in a written config\n",
+	   DEFAULT_STUB );
+  fprintf( file, "  --write_config file - write a bm_server config for the load and exit\n" );
+}
+
+static int compareUint64( const void *a, const void *b )
+{
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* write out a server config with the game, the bot running stub, and
+   the users the clients log in as
+   returns 0 on success, -1 on failure */
+static int writeConfig( const LoadState *load,
+			const char *fileName,
+			const char *stub,
+			const uint16_t port )
+{
+  int u;
+  FILE *file;
+
+  file = fopen( fileName, "w" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open %s\n", fileName );
+    return -1;
+  }
+
+  fprintf( file, "# bm_load test config - run bm_server from a directory\n" );
+  fprintf( file, "# where dealer is a copy of bm_load_stub\n" );
+  fprintf( file, "port %"PRIu16"\n", port );
+  fprintf( file, "maxRunningBots 0\n" );
+  fprintf( file, "startupTimeoutSecs 100\n" );
+  fprintf( file, "responseTimeoutSecs 600\n" );
+  fprintf( file, "handTimeoutSecs 21000\n" );
+  fprintf( file, "avgHandTimeSecs 1\n" );
+  fprintf( file, "dealerWorkers 0\n" );
+  fprintf( file, "game %s {\n", load->gameFile );
+  fprintf( file, "     maxMatchRuns 1\n" );
+  fprintf( file, "     maxRunningJobs %d\n", LOAD_RUNNING_JOBS );
+  fprintf( file, "     matchHands %d\n", LOAD_MATCH_HANDS );
+  fprintf( file, "     bot %s %s\n", load->bot, stub );
+  fprintf( file, "}\n" );
+  for( u = 0; u < load->numUsers; ++u ) {
+
+    fprintf( file, "user load%d %s\n", u, LOAD_PASSWORD );
+  }
+
+  if( fclose( file ) ) {
+
+    fprintf( stderr, "ERROR: could not write %s\n", fileName );
+    return -1;
+  }
+  return 0;
+}
+
+static void addSample( LoadStats *stats, const uint64_t micros )
+{
+  stats->micros[ stats->count ] = micros;
+  ++stats->count;
+}
+
+static void finishClient( LoadState *load, LoadClient *client )
+{
+  if( client->state == CLIENT_DONE ) {
+
+    return;
+  }
+  client->state = CLIENT_DONE;
+  ++load->numDone;
+  load->endMicros = eventNowMicros();
+}
+
+static void closeClient( EventLoop *loop, LoadClient *client )
+{
+  eventWatchRemove( loop, &client->watch );
+  eventTimerStop( loop, &client->timer );
+  destroyReadBuf( client->readBuf );
+  client->readBuf = NULL;
+  finishClient( (LoadState *)loop->data, client );
+}
+
+/* send the client's next command, or hang up if it has sent them all */
+static void sendCommand( EventLoop *loop, LoadClient *client )
+{
+  int r, len;
+  LoadState *load = (LoadState *)loop->data;
+  char line[ READBUF_LEN ];
+
+  if( client->cmdsSent >= load->numCommands ) {
+
+    closeClient( loop, client );
+    return;
+  }
+
+  r = rand_r( &client->seed ) % load->mixTotal;
+  for( client->cmd = 0; r >= load->mix[ client->cmd ]; ++client->cmd ) {
+
+    r -= load->mix[ client->cmd ];
+  }
+
+  if( client->cmd == CMD_RUNMATCHES ) {
+    int p;
+
+    len = snprintf( line, sizeof( line ), "RUNMATCHES %s 1 l%d_%d %u",
+		    load->gameFile,
+		    client->id,
+		    client->cmdsSent,
+		    rand_r( &client->seed ) );
+    for( p = 0; p < load->numPlayers; ++p ) {
+
+      len += snprintf( &line[ len ], sizeof( line ) - len, " %s", load->bot );
+    }
+    len += snprintf( &line[ len ], sizeof( line ) - len, "\n%s", LOAD_PING );
+  } else {
+
+    len = snprintf( line, sizeof( line ), "%s\n%s",
+		    loadCmdNames[ client->cmd ], LOAD_PING );
+  }
+
+  client->state = CLIENT_COMMAND;
+  client->cmdFailed = 0;
+  client->sentMicros = eventNowMicros();
+  ++client->cmdsSent;
+  if( write( client->readBuf->fd, line, len ) != len ) {
+
+    ++load->disconnects;
+    closeClient( loop, client );
+  }
+}
+
+static void clientTimer( EventLoop *loop, EventTimer *timer )
+{
+  sendCommand( loop, (LoadClient *)timer->data );
+}
+
+static void clientEvent( EventLoop *loop,
+			 EventWatch *watch,
+			 const uint32_t events )
+{
+  int r;
+  uint64_t now;
+  LoadClient *client = (LoadClient *)watch->data;
+  LoadState *load = (LoadState *)loop->data;
+  char line[ READBUF_LEN ];
+
+  while( client->readBuf != NULL
+	 && ( r = getLine( client->readBuf, READBUF_LEN, line, 0 ) ) >= 0 ) {
+
+    if( r == 0 ) {
+
+      if( client->state == CLIENT_COMMAND ) {
+
+	++load->stats[ client->cmd ].errors;
+      }
+      ++load->disconnects;
+      closeClient( loop, client );
+      return;
+    }
+
+    now = eventNowMicros();
+    if( client->state == CLIENT_LOGON ) {
+
+      if( strncmp( line, "LOGON OKAY", 10 ) ) {
+
+	++load->logons.errors;
+	closeClient( loop, client );
+	return;
+      }
+      addSample( &load->logons, now - client->sentMicros );
+      sendCommand( loop, client );
+    } else if( client->state == CLIENT_COMMAND ) {
+
+      if( strncmp( line, "UNKNOWN", 7 ) ) {
+	/* some part of the reply, which might be a complaint */
+
+	if( strstr( line, "BAD" ) || strstr( line, "REFUSED" )
+	    || strstr( line, "FULL" ) ) {
+
+	  client->cmdFailed = 1;
+	}
+	continue;
+      }
+
+      if( client->cmdFailed ) {
+
+	++load->stats[ client->cmd ].errors;
+      }
+      addSample( &load->stats[ client->cmd ], now - client->sentMicros );
+
+      if( load->intervalMicros ) {
+
+	client->state = CLIENT_IDLE;
+	eventTimerStart( loop, &client->timer, load->intervalMicros, 0,
+			 clientTimer, client );
+      } else {
+
+	sendCommand( loop, client );
+      }
+    }
+    /* anything else is the server talking out of turn, and ignored */
+  }
+
+  /* a reset connection reads as an error rather than end of file */
+  if( client->readBuf != NULL && ( events & ( EPOLLERR | EPOLLHUP ) ) ) {
+
+    if( client->state == CLIENT_COMMAND ) {
+
+      ++load->stats[ client->cmd ].errors;
+    }
+    ++load->disconnects;
+    closeClient( loop, client );
+  }
+}
+
+/* make room for a descriptor per client */
+static void raiseFileLimit( const int numClients )
+{
+  struct rlimit limit;
+
+  if( getrlimit( RLIMIT_NOFILE, &limit ) < 0 ) {
+
+    return;
+  }
+  if( limit.rlim_cur < limit.rlim_max ) {
+
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit( RLIMIT_NOFILE, &limit );
+  }
+  if( limit.rlim_cur < (rlim_t)numClients + 16 ) {
+
+    fprintf( stderr, "WARNING: only %lu file descriptors for %d clients\n",
+	     (unsigned long)limit.rlim_cur, numClients );
+  }
+}
+
+/* the connection to the server is up, so log in */
+static void clientConnected( EventLoop *loop,
+			     EventWatch *watch,
+			     const uint32_t events )
+{
+  int err, len;
+  socklen_t errLen;
+  LoadClient *client = (LoadClient *)watch->data;
+  LoadState *load = (LoadState *)loop->data;
+  char line[ READBUF_LEN ];
+
+  errLen = sizeof( err );
+  if( getsockopt( client->readBuf->fd, SOL_SOCKET, SO_ERROR, &err, &errLen ) < 0
+      || err ) {
+
+    ++load->connectFailures;
+    closeClient( loop, client );
+    return;
+  }
+
+  eventWatchRemove( loop, watch );
+  eventWatchAdd( loop, watch, client->readBuf->fd, EPOLLIN,
+		 clientEvent, client );
+  client->state = CLIENT_LOGON;
+  len = snprintf( line, sizeof( line ), "load%d %s\n",
+		  client->id % load->numUsers, LOAD_PASSWORD );
+  if( write( client->readBuf->fd, line, len ) != len ) {
+
+    ++load->disconnects;
+    closeClient( loop, client );
+  }
+}
+
+/* start connecting every client - connections are made without
+   waiting, so a server slow to accept shows up in the logon times
+   rather than holding up the clients which are already in
+   returns 0 on success, -1 on failure */
+static int startClients( EventLoop *loop,
+			 LoadState *load,
+			 const struct sockaddr_in *addr )
+{
+  int i, sock;
+  LoadClient *client;
+
+  for( i = 0; i < load->numClients; ++i ) {
+    client = &load->clients[ i ];
+
+    client->id = i;
+    client->seed = i + 1;
+    client->cmdsSent = 0;
+    client->readBuf = NULL;
+    initEventTimer( &client->timer );
+    client->state = CLIENT_CONNECT;
+    client->sentMicros = eventNowMicros();
+
+    sock = socket( AF_INET, SOCK_STREAM, 0 );
+    if( sock < 0 ) {
+
+      ++load->connectFailures;
+      finishClient( load, client );
+      continue;
+    }
+    applySocketProfile( sock );
+    fcntl( sock, F_SETFL, O_NONBLOCK );
+    if( connect( sock, (const struct sockaddr *)addr, sizeof( *addr ) ) < 0
+	&& errno != EINPROGRESS ) {
+
+      close( sock );
+      ++load->connectFailures;
+      finishClient( load, client );
+      continue;
+    }
+
+    client->readBuf = createReadBuf( sock );
+    if( client->readBuf == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate read buffer\n" );
+      return -1;
+    }
+    if( eventWatchAdd( loop, &client->watch, sock, EPOLLOUT,
+		       clientConnected, client ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not watch client %d\n", i );
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void printStats( const char *name, LoadStats *stats )
+{
+  int i;
+  uint64_t total;
+
+  if( stats->count == 0 ) {
+
+    printf( "%-12s %8d %8d\n", name, 0, stats->errors );
+    return;
+  }
+
+  total = 0;
+  for( i = 0; i < stats->count; ++i ) {
+
+    total += stats->micros[ i ];
+  }
+  qsort( stats->micros, stats->count, sizeof( *stats->micros ),
+	 compareUint64 );
+  printf( "%-12s %8d %8d %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+	  name,
+	  stats->count,
+	  stats->errors,
+	  total / 1000.0 / stats->count,
+	  stats->micros[ stats->count / 2 ] / 1000.0,
+	  stats->micros[ stats->count * 95 / 100 ] / 1000.0,
+	  stats->micros[ stats->count * 99 / 100 ] / 1000.0,
+	  stats->micros[ stats->count - 1 ] / 1000.0 );
+}
+
+static void printReport( LoadState *load )
+{
+  int c, numCommands;
+  double secs;
+
+  secs = ( load->endMicros - load->startMicros ) / 1000000.0;
+  numCommands = 0;
+  for( c = 0; c < NUM_LOAD_CMDS; ++c ) {
+
+    numCommands += load->stats[ c ].count;
+  }
+
+  printf( "%d clients as %d users, %d failed to connect, %d disconnected\n",
+	  load->numClients, load->numUsers,
+	  load->connectFailures, load->disconnects );
+  printf( "%d commands in %.3f seconds, %.1f commands/sec\n",
+	  numCommands, secs, secs > 0 ? numCommands / secs : 0.0 );
+  printf( "latency in milliseconds\n" );
+  printf( "%-12s %8s %8s %10s %10s %10s %10s %10s\n",
+	  "command", "count", "errors", "mean", "p50", "p95", "p99", "max" );
+  printStats( "LOGON", &load->logons );
+  for( c = 0; c < NUM_LOAD_CMDS; ++c ) {
+
+    printStats( loadCmdNames[ c ], &load->stats[ c ] );
+  }
+}
+
+/* parse weights like 4:4:2 into load->mix
+   returns 0 on success, -1 on failure */
+static int parseMix( LoadState *load, const char *spec )
+{
+  int c, len;
+
+  load->mixTotal = 0;
+  for( c = 0; c < NUM_LOAD_CMDS; ++c ) {
+
+    if( sscanf( spec, c ? ":%d%n" : "%d%n", &load->mix[ c ], &len ) < 1
+	|| load->mix[ c ] < 0 ) {
+
+      return -1;
+    }
+    spec += len;
+    load->mixTotal += load->mix[ c ];
+  }
+  return *spec || load->mixTotal == 0 ? -1 : 0;
+}
+
+int main( int argc, char **argv )
+{
+  int i, c, longOpt, intervalMs;
+  const char *configFile, *stub;
+  FILE *file;
+  Game *game;
+  LoadState load;
+  EventLoop loop;
+  struct hostent *hostent;
+  struct sockaddr_in addr;
+  static struct option longOptions[] = {
+    { "clients", 1, 0, 0 },
+    { "users", 1, 0, 0 },
+    { "commands", 1, 0, 0 },
+    { "mix", 1, 0, 0 },
+    { "interval_ms", 1, 0, 0 },
+    { "game", 1, 0, 0 },
+    { "bot", 1, 0, 0 },
+    { "stub", 1, 0, 0 },
+    { "write_config", 1, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+
+  memset( &load, 0, sizeof( load ) );
+  load.numClients = DEFAULT_CLIENTS;
+  load.numUsers = DEFAULT_USERS;
+  load.numCommands = DEFAULT_COMMANDS;
+  parseMix( &load, "4:4:2" );
+  load.gameFile = DEFAULT_GAME;
+  load.bot = DEFAULT_BOT;
+  stub = DEFAULT_STUB;
+  configFile = NULL;
+
+  while( ( i = getopt_long( argc, argv, "", longOptions, &longOpt ) ) >= 0 ) {
+
+    if( i != 0 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+
+    switch( longOpt ) {
+    case 0:
+      if( sscanf( optarg, "%d", &load.numClients ) < 1
+	  || load.numClients <= 0 ) {
+
+	fprintf( stderr, "ERROR: invalid number of clients %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 1:
+      if( sscanf( optarg, "%d", &load.numUsers ) < 1 || load.numUsers <= 0 ) {
+
+	fprintf( stderr, "ERROR: invalid number of users %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 2:
+      if( sscanf( optarg, "%d", &load.numCommands ) < 1
+	  || load.numCommands < 0 ) {
+
+	fprintf( stderr, "ERROR: invalid number of commands %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 3:
+      if( parseMix( &load, optarg ) < 0 ) {
+
+	fprintf( stderr, "ERROR: invalid command mix %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 4:
+      if( sscanf( optarg, "%d", &intervalMs ) < 1 || intervalMs < 0 ) {
+
+	fprintf( stderr, "ERROR: invalid interval %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      load.intervalMicros = (uint64_t)intervalMs * 1000;
+      break;
+
+    case 5:
+      load.gameFile = optarg;
+      break;
+
+    case 6:
+      load.bot = optarg;
+      break;
+
+    case 7:
+      stub = optarg;
+      break;
+
+    case 8:
+      configFile = optarg;
+      break;
+    }
+  }
+
+  if( configFile != NULL ) {
+
+    load.port = 0;
+    if( optind < argc && sscanf( argv[ optind ], "%"SCNu16, &load.port ) < 1 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+    if( writeConfig( &load, configFile, stub,
+		     load.port ? load.port : DEFAULT_BM_PORT ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if( optind + 2 > argc
+      || sscanf( argv[ optind + 1 ], "%"SCNu16, &load.port ) < 1 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+  load.host = argv[ optind ];
+  hostent = gethostbyname( load.host );
+  if( hostent == NULL ) {
+
+    fprintf( stderr, "ERROR: could not look up address for %s\n", load.host );
+    exit( EXIT_FAILURE );
+  }
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons( load.port );
+  memcpy( &addr.sin_addr, hostent->h_addr_list[ 0 ], hostent->h_length );
+
+  /* matches need a bot for every seat */
+  file = fopen( load.gameFile, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game %s\n", load.gameFile );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  fclose( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", load.gameFile );
+    exit( EXIT_FAILURE );
+  }
+  load.numPlayers = game->numPlayers;
+  free( game );
+
+  load.clients = (LoadClient *)calloc( load.numClients, sizeof( LoadClient ) );
+  load.logons.micros = (uint64_t *)malloc( sizeof( uint64_t )
+					   * load.numClients );
+  for( c = 0; c < NUM_LOAD_CMDS; ++c ) {
+
+    load.stats[ c ].micros = (uint64_t *)
+      malloc( sizeof( uint64_t ) * load.numClients * load.numCommands + 1 );
+    if( load.stats[ c ].micros == NULL ) {
+
+      load.clients = NULL;
+    }
+  }
+  if( load.clients == NULL || load.logons.micros == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate clients\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  signal( SIGPIPE, SIG_IGN );
+  raiseFileLimit( load.numClients );
+
+  if( initEventLoop( &loop ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create event loop\n" );
+    exit( EXIT_FAILURE );
+  }
+  loop.data = &load;
+
+  load.startMicros = eventNowMicros();
+  load.endMicros = load.startMicros;
+  if( startClients( &loop, &load, &addr ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  while( load.numDone < load.numClients ) {
+
+    if( runEventLoopOnce( &loop ) < 0 ) {
+
+      fprintf( stderr, "ERROR: event loop failed\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  printReport( &load );
+  return EXIT_SUCCESS;
+}
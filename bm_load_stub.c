@@ -0,0 +1,159 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "net.h"
+
+
+/* Stand-in dealer and bot for load testing bm_server with bm_load
+
+   run as "dealer" (a copy or link named dealer in the server's working
+   directory), it takes the real dealer's arguments, opens the players'
+   ports if the server didn't hand it any, sleeps for #Hands
+   milliseconds and appends a one hand run with a zero score to the
+   match log.  the players are never talked to.  run under any other
+   name, it is a bot which connects to its port and leaves straight
+   away.  there is no --worker mode, so the server's config must have
+   dealerWorkers 0 */
+
+#define MAX_STUB_PLAYERS 10
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: dealer matchName gameDefFile #Hands rngSeed p1name p2name ... [options]\n" );
+  fprintf( file, "   or: bm_load_stub bm_hostname port position\n" );
+}
+
+static int runDealer( int argc, char **argv )
+{
+  int i, numPlayers, hasPorts, fd, len;
+  uint32_t hands;
+  uint16_t port;
+  char *names[ MAX_STUB_PLAYERS ];
+  char line[ READBUF_LEN ];
+  struct timespec pause;
+
+  if( argc < 6 || sscanf( argv[ 3 ], "%"SCNu32, &hands ) < 1 ) {
+
+    printUsage( stderr );
+    return EXIT_FAILURE;
+  }
+  if( !strcmp( argv[ 1 ], "--worker" ) ) {
+
+    fprintf( stderr, "ERROR: stub dealer can't be a worker, set dealerWorkers 0\n" );
+    return EXIT_FAILURE;
+  }
+
+  numPlayers = 0;
+  hasPorts = 0;
+  for( i = 5; i < argc; ++i ) {
+
+    if( argv[ i ][ 0 ] == '-' ) {
+
+      if( !strcmp( argv[ i ], "--listen_fds" ) ) {
+
+	hasPorts = 1;
+      }
+    } else if( numPlayers < MAX_STUB_PLAYERS
+	       && ( i < 6 || argv[ i - 1 ][ 0 ] != '-' ) ) {
+      /* the players come before any option and its value */
+
+      names[ numPlayers ] = argv[ i ];
+      ++numPlayers;
+    }
+  }
+
+  /* tell the server where the players would connect */
+  if( !hasPorts ) {
+
+    len = 0;
+    for( i = 0; i < numPlayers; ++i ) {
+
+      port = 0;
+      if( getListenSocket( &port ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not open a port\n" );
+	return EXIT_FAILURE;
+      }
+      len += snprintf( &line[ len ], sizeof( line ) - len,
+		       i ? " %"PRIu16 : "%"PRIu16, port );
+    }
+    printf( "%s\n", line );
+    fflush( stdout );
+  }
+
+  pause.tv_sec = hands / 1000;
+  pause.tv_nsec = ( hands % 1000 ) * 1000000L;
+  nanosleep( &pause, NULL );
+
+  /* one hand, which nobody won */
+  snprintf( line, sizeof( line ), "%s.log", argv[ 1 ] );
+  fd = open( line, O_WRONLY | O_CREAT | O_APPEND, 0644 );
+  if( fd < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open %s\n", line );
+    return EXIT_FAILURE;
+  }
+  len = snprintf( line, sizeof( line ), "STATE:0:stub\nSCORE:" );
+  for( i = 0; i < numPlayers; ++i ) {
+
+    len += snprintf( &line[ len ], sizeof( line ) - len, i ? "|0" : "0" );
+  }
+  for( i = 0; i < numPlayers; ++i ) {
+
+    len += snprintf( &line[ len ], sizeof( line ) - len, "%c%s",
+		     i ? '|' : ':', names[ i ] );
+  }
+  len += snprintf( &line[ len ], sizeof( line ) - len, "\n" );
+  if( write( fd, line, len ) < len ) {
+
+    fprintf( stderr, "ERROR: could not write the match log\n" );
+    close( fd );
+    return EXIT_FAILURE;
+  }
+  close( fd );
+
+  return EXIT_SUCCESS;
+}
+
+static int runBot( int argc, char **argv )
+{
+  int sock;
+  uint16_t port;
+
+  if( argc < 3 || sscanf( argv[ 2 ], "%"SCNu16, &port ) < 1 ) {
+
+    printUsage( stderr );
+    return EXIT_FAILURE;
+  }
+
+  /* the dealer may already have gone, which is fine */
+  sock = connectTo( argv[ 1 ], port );
+  if( sock >= 0 ) {
+
+    close( sock );
+  }
+  return EXIT_SUCCESS;
+}
+
+int main( int argc, char **argv )
+{
+  const char *name;
+
+  name = strrchr( argv[ 0 ], '/' );
+  name = name ? name + 1 : argv[ 0 ];
+  if( !strcmp( name, "dealer" ) ) {
+
+    return runDealer( argc, argv );
+  }
+  return runBot( argc, argv );
+}
@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <string.h>
+#include "bm_metrics.h"
+
+
+#define METRICS_INITIAL_SIZE 4096
+
+
+void initHistogram( Histogram *hist,
+		    const int numBuckets,
+		    const double *bounds )
+{
+  hist->numBuckets = numBuckets;
+  hist->bounds = bounds;
+  hist->counts = (uint64_t *)calloc( numBuckets, sizeof( uint64_t ) );
+  assert( hist->counts != 0 );
+  hist->count = 0;
+  hist->sum = 0.0;
+}
+
+void histogramObserve( Histogram *hist, const double value )
+{
+  int b;
+
+  for( b = 0; b < hist->numBuckets; ++b ) {
+
+    if( value <= hist->bounds[ b ] ) {
+
+      ++hist->counts[ b ];
+      break;
+    }
+  }
+  ++hist->count;
+  hist->sum += value;
+}
+
+void initMetricsText( MetricsText *text )
+{
+  text->size = METRICS_INITIAL_SIZE;
+  text->buf = (char *)malloc( text->size );
+  assert( text->buf != 0 );
+  text->buf[ 0 ] = 0;
+  text->len = 0;
+}
+
+void freeMetricsText( MetricsText *text )
+{
+  free( text->buf );
+  text->buf = NULL;
+  text->len = 0;
+  text->size = 0;
+}
+
+void metricsPrintf( MetricsText *text, const char *format, ... )
+{
+  int len;
+  va_list ap;
+
+  while( 1 ) {
+
+    va_start( ap, format );
+    len = vsnprintf( &text->buf[ text->len ],
+		     text->size - text->len,
+		     format,
+		     ap );
+    va_end( ap );
+    assert( len >= 0 );
+
+    if( text->len + len < text->size ) {
+
+      text->len += len;
+      return;
+    }
+
+    /* didn't fit - grow the buffer and try again */
+    text->size = ( text->len + len + 1 ) * 2;
+    text->buf = (char *)realloc( text->buf, text->size );
+    assert( text->buf != 0 );
+  }
+}
+
+void metricsHeader( MetricsText *text,
+		    const char *name,
+		    const char *type,
+		    const char *help )
+{
+  metricsPrintf( text, "# HELP %s %s\n# TYPE %s %s\n",
+		 name, help, name, type );
+}
+
+void metricsHistogram( MetricsText *text,
+		       const char *name,
+		       const char *labels,
+		       const Histogram *hist )
+{
+  int b;
+  uint64_t cumulative;
+  const char *sep = labels ? "," : "";
+
+  if( labels == NULL ) {
+
+    labels = "";
+  }
+
+  /* buckets in the exposition format count everything up to their bound */
+  cumulative = 0;
+  for( b = 0; b < hist->numBuckets; ++b ) {
+
+    cumulative += hist->counts[ b ];
+    metricsPrintf( text, "%s_bucket{%s%sle=\"%g\"} %"PRIu64"\n",
+		   name, labels, sep, hist->bounds[ b ], cumulative );
+  }
+  metricsPrintf( text, "%s_bucket{%s%sle=\"+Inf\"} %"PRIu64"\n",
+		 name, labels, sep, hist->count );
+
+  if( labels[ 0 ] ) {
+
+    metricsPrintf( text, "%s_sum{%s} %.17g\n", name, labels, hist->sum );
+    metricsPrintf( text, "%s_count{%s} %"PRIu64"\n",
+		   name, labels, hist->count );
+  } else {
+
+    metricsPrintf( text, "%s_sum %.17g\n", name, hist->sum );
+    metricsPrintf( text, "%s_count %"PRIu64"\n", name, hist->count );
+  }
+}
@@ -0,0 +1,63 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_METRICS_H
+#define _BM_METRICS_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/* Metrics in the Prometheus text exposition format
+
+   the server keeps counters and histograms as it runs, and writes them
+   out along with gauges read from its own state each time it is
+   scraped.  the text is built up in a MetricsText, which grows as
+   needed, so nothing about the output size has to be known up front */
+
+typedef struct {
+  int numBuckets;
+  const double *bounds; /* upper bound of each bucket, increasing */
+  uint64_t *counts; /* observations in each bucket, not cumulative */
+  uint64_t count; /* all observations, including those above the bounds */
+  double sum;
+} Histogram;
+
+typedef struct {
+  char *buf;
+  size_t len;
+  size_t size;
+} MetricsText;
+
+
+/* bounds must stay put while the histogram is used */
+void initHistogram( Histogram *hist,
+		    const int numBuckets,
+		    const double *bounds );
+
+void histogramObserve( Histogram *hist, const double value );
+
+void initMetricsText( MetricsText *text );
+
+void freeMetricsText( MetricsText *text );
+
+/* append printf style text */
+void metricsPrintf( MetricsText *text, const char *format, ... )
+  __attribute__ ((format (printf, 2, 3)));
+
+/* append the HELP and TYPE lines which go before a metric's samples */
+void metricsHeader( MetricsText *text,
+		    const char *name,
+		    const char *type,
+		    const char *help );
+
+/* append the bucket, sum and count samples for hist
+   labels is a list like game="x",user="y", or NULL for none */
+void metricsHistogram( MetricsText *text,
+		       const char *name,
+		       const char *labels,
+		       const Histogram *hist );
+
+#endif
@@ -11,12 +11,19 @@
 #include <netinet/tcp.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "net.h"
 
 #define ARG_SERVERNAME 1
 #define ARG_SERVERPORT 2
+#define ARG_USERNAME 3
+#define ARG_PASSWORD 4
+#define ARG_COMMAND 5
 #define ARG_BOT_COMMAND 7
+#define ARG_TAG 9
 #define ARG_MIN_ARGS 6
+#define ARG_GETLOG_TAG 6
+#define ARG_GETLOG_DIR 7
 
 static void printUsage( FILE *file )
 {
@@ -40,6 +47,12 @@ static void printUsage( FILE *file )
 	   "rerun 2pl <local script> <match index> <tag> <seed> <player1> "
 	   "<player2> (<player3>)\n" );
   fprintf( file, "    Rerun a match that failed\n" );
+  fprintf( file, "  bm_run_matches <bm_hostname> <bm_port> <username> <pw> "
+	   "getlog <tag> <dir>\n" );
+  fprintf( file, "    Download the logs of a set of matches into <dir>\n" );
+  fprintf( file, "  bm_run_matches -d <dir> <bm_hostname> <bm_port> ...\n" );
+  fprintf( file, "    Run matches as above, downloading their logs into <dir> "
+	   "once they are finished\n" );
   fprintf( file, "\n" );
   fprintf( file, "<username> is your benchmark server username assigned to "
 	   "you by the competition chair\n" );
@@ -66,20 +79,159 @@ static void printUsage( FILE *file )
 	   "seed 0 and match index 19.\n" );
 }
 
+/* copy len bytes of the server's reply to fd, starting with anything
+   already read into fromServer
+   returns 0 on success, -1 on failure */
+static int copyFromServer( ReadBuf *fromServer, int fd, off_t len )
+{
+  ssize_t r;
+
+  while( len > 0 ) {
+
+    if( fromServer->bufStart >= fromServer->bufEnd ) {
+
+      r = read( fromServer->fd, fromServer->buf, READBUF_LEN );
+      if( r <= 0 ) {
+
+	return -1;
+      }
+      fromServer->bufStart = 0;
+      fromServer->bufEnd = r;
+    }
+
+    r = fromServer->bufEnd - fromServer->bufStart;
+    if( r > len ) {
+
+      r = len;
+    }
+    if( write( fd, &fromServer->buf[ fromServer->bufStart ], r ) < r ) {
+
+      return -1;
+    }
+    fromServer->bufStart += r;
+    len -= r;
+  }
+
+  return 0;
+}
+
+/* fetch the logs of tag into dir with GETLOG - compressed and plain
+   parts of a log go to separate files, the compressed one holding the
+   older runs
+   returns 0 on success, -1 on failure */
+static int downloadLogs( int sock,
+			 ReadBuf *fromServer,
+			 const char *tag,
+			 const char *dir )
+{
+  int s, fd[ 2 ], isCompressed;
+  intmax_t len;
+  char line[ READBUF_LEN ], kind[ 16 ], suffix[ 16 ];
+  char name[ READBUF_LEN * 2 ];
+  static const char *suffixes[] = { "log", "stderr" };
+
+  for( s = 0; s < 2; ++s ) {
+
+    snprintf( line, sizeof( line ), "GETLOG %s %s\n", tag, suffixes[ s ] );
+    if( write( sock, line, strlen( line ) ) < 0 ) {
+
+      fprintf( stderr, "ERROR: failed while sending to server\n" );
+      return -1;
+    }
+
+    fd[ 0 ] = -1;
+    fd[ 1 ] = -1;
+    while( 1 ) {
+
+      if( getLine( fromServer, READBUF_LEN, line, -1 ) <= 0 ) {
+
+	fprintf( stderr, "ERROR: server closed connection during download\n" );
+	return -1;
+      }
+      if( !strcmp( line, "NO LOG\n" ) || !strcmp( line, "LOG END\n" ) ) {
+
+	break;
+      }
+      if( sscanf( line, "LOG %15s %15s %jd", suffix, kind, &len ) < 3 ) {
+	/* the server turned the request down */
+
+	fprintf( stderr, "ERROR: could not get logs: %s", line );
+	return -1;
+      }
+
+      isCompressed = !strcmp( kind, "gzip" );
+      if( fd[ isCompressed ] < 0 ) {
+
+	snprintf( name, sizeof( name ), "%s/%s.%s%s",
+		  dir, tag, suffix, isCompressed ? ".gz" : "" );
+	fd[ isCompressed ] = open( name, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( fd[ isCompressed ] < 0 ) {
+
+	  fprintf( stderr, "ERROR: could not create %s\n", name );
+	  return -1;
+	}
+	printf( "downloading %s\n", name );
+	fflush( stdout );
+      }
+      if( copyFromServer( fromServer, fd[ isCompressed ], len ) < 0 ) {
+
+	fprintf( stderr, "ERROR: failed while downloading %s\n", name );
+	return -1;
+      }
+    }
+
+    if( fd[ 0 ] >= 0 ) {
+
+      close( fd[ 0 ] );
+    }
+    if( fd[ 1 ] >= 0 ) {
+
+      close( fd[ 1 ] );
+    }
+  }
+
+  return 0;
+}
+
 int main( int argc, char **argv )
 {
-  int sock, i;
+  int sock, i, isGetLog;
   pid_t childPID;
   uint16_t port;
   ReadBuf *fromServer;
   fd_set readfds;
   char line[ READBUF_LEN ];
+  const char *downloadDir;
+
+  /* -d <dir> comes before everything else, so the positions of the
+     remaining arguments don't change */
+  downloadDir = NULL;
+  if( argc > 2 && !strcmp( argv[ 1 ], "-d" ) ) {
+
+    downloadDir = argv[ 2 ];
+    argv[ 2 ] = argv[ 0 ];
+    argv += 2;
+    argc -= 2;
+  }
 
   if( argc < ARG_MIN_ARGS ) {
 
     printUsage( stderr );
     exit( EXIT_FAILURE );
   }
+  isGetLog = !strcasecmp( argv[ ARG_COMMAND ], "getlog" );
+  if( isGetLog ) {
+
+    if( argc <= ARG_GETLOG_DIR ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+  } else if( downloadDir && argc <= ARG_TAG ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
 
   /* connect to the server */
   if( sscanf( argv[ ARG_SERVERPORT ], "%"SCNu16, &port ) < 1 ) {
@@ -128,6 +280,29 @@ int main( int argc, char **argv )
   /* set up read buffers */
   fromServer = createReadBuf( sock );
 
+  if( isGetLog ) {
+    /* log on, then ask for the logs */
+
+    snprintf( line, sizeof( line ), "%s %s\n",
+	      argv[ ARG_USERNAME ], argv[ ARG_PASSWORD ] );
+    if( write( sock, line, strlen( line ) ) < 0 ) {
+
+      fprintf( stderr, "ERROR: failed while sending to server\n" );
+      exit( EXIT_FAILURE );
+    }
+    if( getLine( fromServer, READBUF_LEN, line, -1 ) <= 0
+	|| strncmp( line, "LOGON OKAY", 10 ) ) {
+
+      fprintf( stderr, "ERROR: could not log on to server\n" );
+      exit( EXIT_FAILURE );
+    }
+    exit( downloadLogs( sock,
+			fromServer,
+			argv[ ARG_GETLOG_TAG ],
+			argv[ ARG_GETLOG_DIR ] ) < 0
+	  ? EXIT_FAILURE : EXIT_SUCCESS );
+  }
+
   /* write to server */
   line[0] = 0;
   for( i = 3; i < argc; ++i ) {
@@ -227,6 +402,15 @@ int main( int argc, char **argv )
 	  fflush( stdout );
 
 	  if( ! strcmp( line, "Matches finished\n") ) {
+
+	    if( downloadDir
+		&& downloadLogs( sock,
+				 fromServer,
+				 argv[ ARG_TAG ],
+				 downloadDir ) < 0 ) {
+
+	      exit( EXIT_FAILURE );
+	    }
 	    exit( EXIT_SUCCESS );
 	  }
 	}
@@ -0,0 +1,362 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+#include "bm_sched.h"
+
+
+int timeIsEarlier( const struct timeval *a, const struct timeval *b )
+{
+  if( a->tv_sec < b->tv_sec ) {
+    return 1;
+  } else if( a->tv_sec == b->tv_sec
+	     && a->tv_usec < b->tv_usec ) {
+    return 1;
+  }
+  return 0;
+}
+
+/* returns >0 if a should run before b because of its priority, or
+   because it has been paused, <0 if b should, and 0 if neither */
+static int entryRank( const SchedEntry *a, const SchedEntry *b )
+{
+  if( a->priority != b->priority ) {
+
+    return a->priority - b->priority;
+  }
+  return a->isPaused - b->isPaused;
+}
+
+static int entryLess( const void *a, const void *b )
+{
+  int rank = entryRank( (const SchedEntry *)a, (const SchedEntry *)b );
+
+  if( rank ) {
+
+    return rank > 0;
+  }
+  return timeIsEarlier( &( (const SchedEntry *)a )->queueTime,
+			&( (const SchedEntry *)b )->queueTime );
+}
+
+/* is the user for queue a more deserving than the user for queue b? */
+static int queueLess( const void *a, const void *b )
+{
+  const SchedQueue *qa = (const SchedQueue *)a;
+  const SchedQueue *qb = (const SchedQueue *)b;
+  int rank;
+
+  /* the policy only orders users with equally urgent work */
+  rank = entryRank( (const SchedEntry *)heapTop( &qa->entries ),
+		    (const SchedEntry *)heapTop( &qb->entries ) );
+  if( rank ) {
+
+    return rank > 0;
+  }
+
+  if( qa->game->sched->policy == SCHED_POLICY_FAIR_SHARE
+      && qa->user->usageSecs != qb->user->usageSecs ) {
+
+    return qa->user->usageSecs < qb->user->usageSecs;
+  }
+
+  if( timeIsEarlier( &qa->user->waitStart, &qb->user->waitStart ) ) {
+
+    return 1;
+  }
+  if( timeIsEarlier( &qb->user->waitStart, &qa->user->waitStart ) ) {
+
+    return 0;
+  }
+
+  return entryLess( heapTop( &qa->entries ), heapTop( &qb->entries ) );
+}
+
+void initScheduler( Scheduler *sched,
+		    const int policy,
+		    const uint16_t maxRunningBots )
+{
+  sched->policy = policy;
+  sched->maxRunningBots = maxRunningBots;
+  sched->curRunningBots = 0;
+  sched->numQueued = 0;
+  sched->games = NULL;
+  sched->numGames = 0;
+}
+
+void initSchedUser( SchedUser *user )
+{
+  user->usageSecs = 0.0;
+  gettimeofday( &user->waitStart, NULL );
+  user->queues = NULL;
+}
+
+void schedAddGame( Scheduler *sched,
+		   SchedGame *game,
+		   const uint16_t maxRunningJobs )
+{
+  game->sched = sched;
+  game->maxRunningJobs = maxRunningJobs;
+  game->curRunningJobs = 0;
+  game->numQueued = 0;
+  initHeap( &game->queues, queueLess, offsetof( SchedQueue, heapIndex ) );
+  game->userQueues = newHashTable( HASH_DEFAULT_BUCKETS );
+
+  sched->games = (SchedGame **)realloc( sched->games,
+					sizeof( SchedGame * )
+					* ( sched->numGames + 1 ) );
+  assert( sched->games != 0 );
+  sched->games[ sched->numGames ] = game;
+  ++sched->numGames;
+}
+
+void initSchedEntry( SchedEntry *entry,
+		     SchedUser *user,
+		     SchedGame *game,
+		     const int numBots,
+		     void *data )
+{
+  entry->user = user;
+  entry->game = game;
+  entry->queue = NULL;
+  gettimeofday( &entry->queueTime, NULL );
+  entry->numBots = numBots;
+  entry->chargedBots = 0;
+  entry->priority = 0;
+  entry->isPaused = 0;
+  entry->heapIndex = -1;
+  entry->data = data;
+}
+
+/* get the queue for user in game, creating it if necessary */
+static SchedQueue *getQueue( SchedGame *game, SchedUser *user )
+{
+  SchedQueue *queue;
+
+  queue = (SchedQueue *)hashFindInt( game->userQueues, (uintptr_t)user );
+  if( queue == NULL ) {
+
+    queue = (SchedQueue *)malloc( sizeof( SchedQueue ) );
+    assert( queue != 0 );
+    queue->user = user;
+    queue->game = game;
+    initHeap( &queue->entries, entryLess, offsetof( SchedEntry, heapIndex ) );
+    queue->heapIndex = -1;
+    queue->nextForUser = user->queues;
+    user->queues = queue;
+    hashAddInt( game->userQueues, (uintptr_t)user, queue );
+  }
+
+  return queue;
+}
+
+/* the position of the user's queues depends on the user, so they
+   need to be fixed whenever the user's usage or wait time changes */
+static void fixUserQueues( SchedUser *user )
+{
+  SchedQueue *queue;
+
+  for( queue = user->queues; queue != NULL; queue = queue->nextForUser ) {
+
+    if( queue->heapIndex >= 0 ) {
+
+      heapFix( &queue->game->queues, queue );
+    }
+  }
+}
+
+void schedEnqueue( Scheduler *sched, SchedEntry *entry )
+{
+  SchedQueue *queue;
+
+  assert( entry->heapIndex < 0 );
+  queue = getQueue( entry->game, entry->user );
+  entry->queue = queue;
+  heapPush( &queue->entries, entry );
+  if( queue->heapIndex < 0 ) {
+
+    heapPush( &entry->game->queues, queue );
+  } else {
+
+    heapFix( &entry->game->queues, queue );
+  }
+
+  ++entry->game->numQueued;
+  ++sched->numQueued;
+}
+
+void schedDequeue( Scheduler *sched, SchedEntry *entry )
+{
+  SchedQueue *queue = entry->queue;
+
+  assert( entry->heapIndex >= 0 );
+  heapRemove( &queue->entries, entry );
+  if( queue->entries.size == 0 ) {
+
+    heapRemove( &entry->game->queues, queue );
+  } else {
+
+    heapFix( &entry->game->queues, queue );
+  }
+
+  --entry->game->numQueued;
+  --sched->numQueued;
+}
+
+int schedIsQueued( const SchedEntry *entry )
+{
+  return entry->heapIndex >= 0;
+}
+
+int schedGameHasRoom( const SchedGame *game )
+{
+  return !game->maxRunningJobs || game->curRunningJobs < game->maxRunningJobs;
+}
+
+SchedEntry *schedPeekNext( const Scheduler *sched )
+{
+  int g;
+  SchedGame *game;
+  SchedQueue *queue, *best;
+
+  /* pick the best user among games which have room for another job */
+  best = NULL;
+  for( g = 0; g < sched->numGames; ++g ) {
+    game = sched->games[ g ];
+
+    if( !schedGameHasRoom( game ) ) {
+      /* game is currently too busy */
+
+      continue;
+    }
+
+    queue = (SchedQueue *)heapTop( &game->queues );
+    if( queue && ( best == NULL || queueLess( queue, best ) ) ) {
+
+      best = queue;
+    }
+  }
+
+  if( best == NULL ) {
+
+    return NULL;
+  }
+  return (SchedEntry *)heapTop( &best->entries );
+}
+
+SchedEntry *schedPeekBest( const Scheduler *sched )
+{
+  int g;
+  SchedQueue *queue, *best;
+
+  best = NULL;
+  for( g = 0; g < sched->numGames; ++g ) {
+
+    queue = (SchedQueue *)heapTop( &sched->games[ g ]->queues );
+    if( queue && ( best == NULL || queueLess( queue, best ) ) ) {
+
+      best = queue;
+    }
+  }
+
+  if( best == NULL ) {
+
+    return NULL;
+  }
+  return (SchedEntry *)heapTop( &best->entries );
+}
+
+int schedHasBotRoom( const Scheduler *sched, const SchedEntry *entry )
+{
+  return !sched->maxRunningBots
+    || entry->numBots + sched->curRunningBots <= sched->maxRunningBots;
+}
+
+SchedEntry *schedPickNext( const Scheduler *sched )
+{
+  SchedEntry *entry;
+
+  entry = schedPeekNext( sched );
+
+  /* check if we have the space to run the bots */
+  if( entry == NULL || !schedHasBotRoom( sched, entry ) ) {
+
+    return NULL;
+  }
+
+  return entry;
+}
+
+void schedStart( Scheduler *sched,
+		 SchedEntry *entry,
+		 const int isLocal,
+		 const struct timeval *now )
+{
+  schedDequeue( sched, entry );
+
+  ++entry->game->curRunningJobs;
+  entry->chargedBots = isLocal ? entry->numBots : 0;
+  sched->curRunningBots += entry->chargedBots;
+
+  entry->user->waitStart = *now;
+  fixUserQueues( entry->user );
+
+  entry->queueTime = *now;
+}
+
+void schedPause( Scheduler *sched, SchedEntry *entry )
+{
+  assert( !entry->isPaused && entry->heapIndex < 0 );
+
+  --entry->game->curRunningJobs;
+  sched->curRunningBots -= entry->chargedBots;
+
+  /* the entry keeps its start time as its queue time, so it carries on
+     ahead of anything of its priority which started later */
+  entry->isPaused = 1;
+  schedEnqueue( sched, entry );
+}
+
+void schedResume( Scheduler *sched, SchedEntry *entry )
+{
+  assert( entry->isPaused );
+
+  schedDequeue( sched, entry );
+  entry->isPaused = 0;
+
+  ++entry->game->curRunningJobs;
+  sched->curRunningBots += entry->chargedBots;
+}
+
+void schedFinish( Scheduler *sched,
+		  SchedEntry *entry,
+		  const double usageSecs )
+{
+  --entry->game->curRunningJobs;
+  sched->curRunningBots -= entry->chargedBots;
+  assert( entry->game->curRunningJobs >= 0 && sched->curRunningBots >= 0 );
+
+  entry->user->usageSecs += usageSecs;
+  if( sched->policy == SCHED_POLICY_FAIR_SHARE ) {
+
+    fixUserQueues( entry->user );
+  }
+}
+
+int schedPolicyFromName( const char *name )
+{
+  if( !strcasecmp( name, "waittime" ) ) {
+
+    return SCHED_POLICY_WAIT_TIME;
+  }
+  if( !strcasecmp( name, "fairshare" ) ) {
+
+    return SCHED_POLICY_FAIR_SHARE;
+  }
+  return -1;
+}
@@ -0,0 +1,159 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_SCHED_H
+#define _BM_SCHED_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <sys/time.h>
+#include "bm_heap.h"
+#include "bm_hash.h"
+
+
+/* users are ordered by the time since they last had a job started */
+#define SCHED_POLICY_WAIT_TIME 0
+/* users are ordered by CPU seconds used, then by wait time */
+#define SCHED_POLICY_FAIR_SHARE 1
+
+
+/* Job scheduler for the benchmark server
+
+   every game has a run queue, which is a heap of per-user queues
+   ordered by the scheduling policy.  each per-user queue is a heap of
+   that user's waiting entries, oldest first.  an entry's priority comes
+   before all of that: a higher priority entry goes ahead of every
+   lower one, whoever it belongs to, and a running entry can be paused
+   to make room for one.  paused entries wait in the run queue again,
+   ahead of entries of the same priority which haven't started.
+   picking the next entry looks at the top of every game's heap, so it
+   costs O(#games), and queueing, starting and finishing entries cost
+   O(log n).
+
+   none of these structures are allocated by the scheduler: users,
+   games and entries are embedded in the caller's own records, and
+   must not move while they are known to the scheduler */
+
+typedef struct SchedQueue_struct SchedQueue;
+typedef struct Scheduler_struct Scheduler;
+
+typedef struct {
+  double usageSecs; /* CPU seconds charged to the user */
+  struct timeval waitStart; /* when the user last had a job started */
+  SchedQueue *queues; /* the user's queues, one per game used */
+} SchedUser;
+
+typedef struct {
+  Scheduler *sched;
+  uint16_t maxRunningJobs; /* 0 disables the check */
+  int curRunningJobs;
+  int numQueued;
+  Heap queues; /* SchedQueues with waiting entries, next user first */
+  HashTable *userQueues; /* SchedUser -> SchedQueue */
+} SchedGame;
+
+struct SchedQueue_struct {
+  SchedUser *user;
+  SchedGame *game;
+  Heap entries; /* waiting SchedEntries, oldest first */
+  int heapIndex; /* position in game->queues, -1 when empty */
+  SchedQueue *nextForUser;
+};
+
+typedef struct {
+  SchedUser *user;
+  SchedGame *game;
+  SchedQueue *queue;
+  struct timeval queueTime; /* entries are run oldest first */
+  int numBots; /* bots the entry needs while running */
+  int chargedBots; /* bots counted against maxRunningBots while running */
+  int priority; /* higher runs first, 0 by default */
+  int isPaused; /* started, then paused, and waiting to carry on */
+  int heapIndex; /* position in queue->entries, -1 when not waiting */
+  void *data; /* owner of the entry */
+} SchedEntry;
+
+struct Scheduler_struct {
+  int policy;
+  uint16_t maxRunningBots; /* 0 disables the check */
+  int curRunningBots;
+  int numQueued;
+
+  SchedGame **games;
+  int numGames;
+};
+
+
+/* returns non-zero if a is earlier than b */
+int timeIsEarlier( const struct timeval *a, const struct timeval *b );
+
+void initScheduler( Scheduler *sched,
+		    const int policy,
+		    const uint16_t maxRunningBots );
+
+void initSchedUser( SchedUser *user );
+
+/* add a game to the scheduler */
+void schedAddGame( Scheduler *sched,
+		   SchedGame *game,
+		   const uint16_t maxRunningJobs );
+
+void initSchedEntry( SchedEntry *entry,
+		     SchedUser *user,
+		     SchedGame *game,
+		     const int numBots,
+		     void *data );
+
+/* add entry to the run queue for its game, ordered by entry->queueTime */
+void schedEnqueue( Scheduler *sched, SchedEntry *entry );
+
+/* take a waiting entry out of its run queue */
+void schedDequeue( Scheduler *sched, SchedEntry *entry );
+
+/* returns non-zero if entry is waiting in a run queue */
+int schedIsQueued( const SchedEntry *entry );
+
+/* returns non-zero if game has room for another job */
+int schedGameHasRoom( const SchedGame *game );
+
+/* returns the entry which should run next among games with room for
+   another job, without checking maxRunningBots, or NULL if none */
+SchedEntry *schedPeekNext( const Scheduler *sched );
+
+/* returns the entry which should run next if every game had room, or
+   NULL if nothing is waiting */
+SchedEntry *schedPeekBest( const Scheduler *sched );
+
+/* returns non-zero if entry's bots fit under maxRunningBots */
+int schedHasBotRoom( const Scheduler *sched, const SchedEntry *entry );
+
+/* returns the entry which should run next, or NULL if nothing can run
+   because the queues are empty or there is no capacity */
+SchedEntry *schedPickNext( const Scheduler *sched );
+
+/* note that a waiting entry has started running at time now
+   the entry leaves its run queue, and its queueTime is set to now
+   its bots only count against maxRunningBots if isLocal is non-zero */
+void schedStart( Scheduler *sched,
+		 SchedEntry *entry,
+		 const int isLocal,
+		 const struct timeval *now );
+
+/* note that a running entry has been paused - it gives back its room,
+   and waits in its run queue to carry on */
+void schedPause( Scheduler *sched, SchedEntry *entry );
+
+/* note that a paused entry is running again, taking back its room */
+void schedResume( Scheduler *sched, SchedEntry *entry );
+
+/* note that a running entry has finished, using usageSecs of CPU */
+void schedFinish( Scheduler *sched,
+		  SchedEntry *entry,
+		  const double usageSecs );
+
+/* parse a policy name ("waittime" or "fairshare")
+   returns the policy, or -1 if the name is unknown */
+int schedPolicyFromName( const char *name );
+
+#endif
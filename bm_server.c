@@ -10,6 +10,7 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
@@ -19,48 +20,201 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <netinet/tcp.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <signal.h>
+#include <sys/signalfd.h>
 #include <fcntl.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <stddef.h>
+#include <dirent.h>
 #include "game.h"
 #include "net.h"
 #include "rng.h"
+#include "bm_hash.h"
+#include "bm_sched.h"
+#include "bm_event.h"
+#include "bm_cores.h"
+#include "bm_journal.h"
+#include "bm_metrics.h"
+#include "bm_cache.h"
+#include "bm_adapt.h"
+#include "bm_limits.h"
+#include "bm_slab.h"
 
 
 #define STATUS_CLOSED 0
 #define STATUS_UNVALIDATED 1
 #define STATUS_OKAY 2
+#define STATUS_AGENT 3
 
 #define BM_DEALER "dealer"
 #define BM_LOGDIR "logs"
+/* each job writes its output to files of its own in here, named
+   tag.runID.suffix, which are added to the tag's logs when it finishes */
+#define BM_RUN_LOGDIR BM_LOGDIR "/running"
 #define BM_DEALER_WAIT_SECS 5
-#define BM_MAX_IOWAIT_SECS 1
+
+/* where a job is in its life */
+#define JOB_LAUNCHING 0 /* dealer started, waiting for its ports */
+#define JOB_RUNNING 1 /* players have been told where to connect */
+#define JOB_FINISHED 2 /* everything has exited */
+#define BM_PORT_POOL_RETRY_SECS 1
+/* how soon a dealer worker which has gone away is replaced */
+#define BM_WORKER_RESPAWN_SECS 1
+/* how often warm bots are checked for being idle or stuck */
+#define BM_WARM_BOT_CHECK_SECS 1
+/* how long a warm bot has to finish once its match's dealer is gone */
+#define BM_WARM_BOT_GRACE_SECS 10
+/* the journal is compacted once it has this many records, and more
+   than BM_JOURNAL_COMPACT_FACTOR per queued match */
+#define BM_JOURNAL_MIN_RECORDS 1024
+#define BM_JOURNAL_COMPACT_FACTOR 4
+/* how much of the end of a match log is searched for the final score */
+#define BM_RESULT_TAIL_BYTES 16384
+/* size of the buffer a finished run's output is added to its logs with */
+#define BM_PUBLISH_COPY_LEN 65536
+
+/* metrics scrapes are short lived, so only a few are served at once */
+#define BM_METRICS_MAX_CLIENTS 16
+#define BM_METRICS_REQUEST_LEN 2048
+
+/* finished logs are compressed by gzip in the background, appending to
+   BM_LOGDIR/tag.suffix.gz */
+#define BM_LOG_COMPRESSOR "gzip"
+#define BM_LOG_COMPRESSOR_NICE 10
+/* bytes of a log sent to one GETLOG client before others get a turn */
+#define BM_LOG_SEND_CHUNK ( 1 << 20 )
+
+/* output which a job writes to files of its own while it runs, rather
+   than straight to its tag's logs */
+#define BM_NUM_RUN_LOGS 2
+
+static const char *runLogSuffixes[ BM_NUM_RUN_LOGS ] = { "log", "stderr" };
+
+/* ways a dealer gets started, for counting failures */
+#define BM_LAUNCH_LOCAL 0
+#define BM_LAUNCH_WORKER 1
+#define BM_LAUNCH_AGENT 2
+#define BM_NUM_LAUNCH_KINDS 3
+
+static const char *launchKindNames[ BM_NUM_LAUNCH_KINDS ]
+= { "local", "worker", "agent" };
+
+/* memory with a configurable cap - strings are match and job tags */
+#define BM_MEMORY_CONNS 0
+#define BM_MEMORY_MATCHES 1
+#define BM_MEMORY_JOBS 2
+#define BM_MEMORY_STRINGS 3
+#define BM_NUM_MEMORY_POOLS 4
+
+static const char *memoryPoolNames[ BM_NUM_MEMORY_POOLS ]
+= { "conns", "matches", "jobs", "strings" };
+
+/* how a finished job ended */
+#define BM_OUTCOME_SCORED 0 /* the log ends with a score */
+#define BM_OUTCOME_UNSCORED 1 /* it doesn't */
+#define BM_OUTCOME_LIMIT 2 /* a bot went over its resource limits */
+#define BM_NUM_OUTCOMES 3
+
+static const char *outcomeNames[ BM_NUM_OUTCOMES ]
+= { "scored", "unscored", "limit" };
+
+/* classes of match - every queued match of a class goes ahead of
+   those of lower classes, and with preemption a running job of a lower
+   class is paused to make room */
+#define BM_PRIORITY_BULK 0
+#define BM_PRIORITY_NORMAL 1
+#define BM_PRIORITY_INTERACTIVE 2
+#define BM_NUM_PRIORITIES 3
+
+static const char *priorityNames[ BM_NUM_PRIORITIES ]
+= { "bulk", "normal", "interactive" };
+
+/* limits a bot can go over */
+#define BM_LIMIT_MEMORY 0
+#define BM_LIMIT_PIDS 1
+#define BM_LIMIT_CPU 2 /* only with setrlimit, cgroups throttle instead */
+#define BM_NUM_LIMITS 3
+
+static const char *limitNames[ BM_NUM_LIMITS ] = { "memory", "pids", "cpu" };
+
+/* with adaptiveConcurrency, how often the bot limit is reconsidered,
+   how many hands dealers report response times over, and how far a
+   bot's best response time drifts towards each new report, so an old
+   best is slowly forgotten */
+#define BM_ADAPT_PERIOD_SECS 5
+#define BM_LATENCY_REPORT_HANDS 100
+#define BM_LATENCY_BEST_DRIFT 0.01
+/* stderr log read for latency reports on each pass, at most */
+#define BM_LATENCY_SCAN_BYTES 65536
+
+/* most matches one RUNTOURNAMENT command may expand into */
+#define BM_MAX_TOURNAMENT_MATCHES 10000
+
+/* weight the newest job gets in a throughput average - earlier jobs
+   are averaged evenly until there are enough of them */
+#define BM_THROUGHPUT_WEIGHT 0.1
+
+/* histogram bucket bounds for finished jobs */
+static const double jobSecsBounds[]
+= { 1, 5, 15, 30, 60, 120, 300, 600, 1800, 3600, 7200, 21600 };
+static const double handsPerSecBounds[]
+= { 1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
 
 
 typedef struct LLPoolEntry_struct {
   struct LLPoolEntry_struct *next;
   struct LLPoolEntry_struct *prev;
+  const void *pool; /* pool the entry is in use by, NULL when free */
   char data[ 0 ];
 } LLPoolEntry;
 
 typedef struct {
   LLPoolEntry *head;
-  LLPoolEntry *free;
+  SlabCache slab; /* entries come from here */
   int dataSize;
   int numEntries;
 } LLPool;
 
+/* average speed of finished jobs, in hands per second of wall clock
+   time from the start of the dealer to the exit of the last player */
+typedef struct {
+  double handsPerSec;
+  uint32_t numJobs; /* 0 until a job has finished */
+} Throughput;
+
+/* resources used by a process, or summed over several */
+typedef struct {
+  double userSecs;
+  double sysSecs;
+  uint64_t maxRSSKB; /* largest peak of any of the processes */
+  uint64_t volCtxSwitches; /* gave up the CPU, mostly to wait for input */
+  uint64_t involCtxSwitches; /* had the CPU taken away */
+  uint32_t numProcs; /* 0 if nothing has been counted */
+} ProcUsage;
+
 /* structure giving the specification for a local bot */
 typedef struct {
-  char *name;
+  const char *name; /* interned */
   char *command;
+  int persistent; /* 1: started once, and handed matches as a WarmBot */
+  Throughput throughput; /* of jobs the bot played in */
+  double bestLatencyMicros; /* best mean response time reported by a
+			       dealer, 0 until there is a report */
+  ProcUsage usage; /* of the bot in finished jobs on this machine */
+  const BotLimits *limits; /* of the bot's game */
+  uint64_t limitHits[ BM_NUM_LIMITS ]; /* jobs where it went over each */
 } BotSpec;
 
 /* structure giving the specification for a user */
 typedef struct {
-  char *name;
+  const char *name; /* interned */
   char *passwd;
-  struct timeval waitStart;
+  int isAgent; /* may register the connection as a bm_agent */
+  SchedUser sched;
 } UserSpec;
 
 typedef struct {
@@ -68,11 +222,20 @@ typedef struct {
   uint16_t maxRunningJobs; /* maximum simultaneous jobs at a time for game
 			      0 disables the check */
   uint32_t matchHands; /* number of hands in a match */
+  uint32_t botMemoryMB; /* memory an agent needs free for each bot
+			   0 disables the check */
   Game *game;
-  char *gameFile;
+  const char *gameFile; /* interned */
   LLPool *bots;
-
-  int curRunningJobs;
+  HashTable *botIndex; /* bot name -> entry in bots */
+
+  SchedGame sched; /* run queue for the game */
+  Histogram jobSecs; /* wall clock time of finished jobs */
+  Histogram handsPerSec; /* speed of finished jobs with a score */
+  Throughput throughput; /* of all jobs for the game */
+  ProcUsage dealerUsage; /* of dealers of finished jobs on this machine */
+  BotLimits botLimits; /* for each local bot process */
+  uint64_t outcomes[ BM_NUM_OUTCOMES ]; /* finished jobs by outcome */
 } GameConfig;
 
 typedef struct {
@@ -85,55 +248,321 @@ typedef struct {
                                    with an action */
   uint16_t handTimeoutSecs; /* maximum time to allowed per hand of play */
   uint16_t avgHandTimeSecs; /* average time per hand allowed for the match */
+  char *socketProfile; /* socket tuning spec for dealers and bots,
+			  NULL leaves the environment alone */
+  uint16_t portPoolSize; /* number of listening sockets kept bound and
+			    handed to new dealers, 0 disables the pool */
+  int schedPolicy; /* how users waiting for jobs are ordered */
+  uint16_t dealerWorkers; /* number of pre-forked dealer processes which
+			     run matches without an exec, 0 disables them */
+  char *jobCores; /* CPUs local jobs are pinned to, NULL disables pinning */
+  char *journalFile; /* where the queue is journaled, NULL disables it */
+  char *traceFile; /* where submitted matches and finished runs are
+		      traced for bm_sim, NULL disables the trace */
+  char *resultCacheDir; /* where runs are cached, NULL disables the cache */
+  char *botCgroup; /* cgroup v2 directory bots get their own groups
+		      in, NULL to limit bots with setrlimit */
+  int journalRequeue; /* 1: rerun runs which were running at a restart
+			 0: count them as done */
+  uint16_t warmBotIdleSecs; /* how long an unused warm bot is kept */
+  uint16_t metricsPort; /* port metrics are served over HTTP on
+			   0 disables the listener */
+  uint16_t compressLogs; /* gzip level finished logs are compressed with
+			    0 leaves them uncompressed */
+  int adaptiveConcurrency; /* 1: maxRunningBots is a ceiling for a limit
+			      which follows the load on the machine */
+  size_t memoryLimits[ BM_NUM_MEMORY_POOLS ]; /* bytes each pool may hold
+						 0 disables the cap */
+  int preemption; /* 1: local jobs of a lower class are paused for
+		     matches of a higher one */
+  uint32_t interactiveMaxHands; /* most hands over all runs of an
+				   interactive match, 0 disables the check */
 
   LLPool *games;
+  HashTable *gameIndex; /* game file name -> entry in games */
   LLPool *users;
+  HashTable *userIndex; /* user name -> entry in users */
 } Config;
 
+/* one file, or the leading part of one, in a GETLOG reply */
+typedef struct {
+  int fd;
+  off_t size; /* bytes sent from the start of the file */
+  int isCompressed;
+} LogPiece;
+
+/* a GETLOG reply going out - each piece is announced by a header line
+   and then sent straight from its file with sendfile, so the log is
+   never read into the server */
+typedef struct {
+  const char *suffix; /* "log" or "stderr" */
+  int numPieces;
+  LogPiece *pieces;
+  int piece; /* piece being sent, numPieces for the closing line */
+  off_t offset; /* bytes of the piece sent */
+  char header[ 64 ];
+  int headerLen;
+  int headerSent;
+} LogTransfer;
+
 typedef struct {
   int status;
   UserSpec *user; /* NULL when status is STATUS_UNVALIDATED */
   ReadBuf *connBuf;
+  EventWatch watch; /* data is the connection's pool entry */
+  LLPoolEntry *agentEntry; /* entry in agents when status is STATUS_AGENT */
+  LogTransfer *transfer; /* reply being sent while commands are held off,
+			    NULL when there is none */
 } Connection;
 
+/* a bm_agent, which runs dealers and bots for jobs placed on it */
+typedef struct {
+  const char *name; /* interned */
+  char *host; /* address network players connect to */
+  LLPoolEntry *connEntry;
+  uint16_t cores;
+  uint32_t memoryMB;
+  int freeCores; /* cores not used by bots of running jobs */
+  int64_t freeMemoryMB;
+  HashTable *bots; /* names of bots the agent can run, NULL for any */
+  HashTable *jobs; /* agent job ID -> entry in jobs */
+} Agent;
+
 typedef struct {
+  uint32_t id; /* names the match in the journal */
   GameConfig *gameConf;
   UserSpec *user;
   int numRuns;
+  uint32_t numHands; /* hands in each run */
+  uint32_t groupID; /* ID of the first match of the tournament the match
+		       came from, 0 if it was submitted alone */
   rng_state_t rng;
   uint32_t rngSeed;
+  uint32_t rngInitSeed; /* seed rng was initialised with */
   int useRngForSeed; /* 0: use rngSeed as seed for each dealer run
 			1: use genrand_int32( match->rng ) */
+  int runsStarted; /* draws taken from rng */
+  int isJournaled; /* matches with network players die with their
+		      connections, so only bot matches are journaled */
+  LLPoolEntry *gangEntry; /* entry in serv->gangs while the next run
+			     should start straight away on warm bots */
   char *tag;
-  struct timeval queueTime;
   struct {
     int isNetworkPlayer;
     LLPoolEntry *entry; /* connection if network player, bot otherwise */
   } players[ MAX_PLAYERS ];
   int isRunning;
+  int priority; /* BM_PRIORITY_ class */
+  SchedEntry sched; /* queueing state, data is the match's pool entry */
 } Match;
 
+/* a persistent bot process, which plays one match after another - it
+   is told where to connect by "RUN host port position" lines on its
+   standard input, and answers "DONE" on its standard output after each */
+typedef struct {
+  const BotSpec *bot;
+  pid_t pid;
+  int ctrlFD; /* -1 once the bot is being shut down */
+  ReadBuf *ctrlBuf;
+  EventWatch watch; /* data is the bot's pool entry */
+  LLPoolEntry *owner; /* match the bot is kept for, NULL when it's free */
+  LLPoolEntry *jobEntry; /* job being played, NULL when waiting */
+  int seat; /* seat in jobEntry's match */
+  ProcUsage runStart; /* bot's usage when the current match started */
+  char *limitGroup; /* cgroup holding the bot, NULL if none */
+  LimitEvents runStartEvents; /* group's counts when the match started */
+  uint64_t idleSinceMicros;
+  uint64_t doneByMicros; /* kill deadline once the job's dealer is gone */
+} WarmBot;
+
+/* a pre-forked "dealer --worker" process, which runs one match at a
+   time in a fork of itself */
+typedef struct {
+  pid_t pid;
+  int sock; /* local socket jobs are sent over, -1 once the worker is gone */
+  EventWatch watch;
+  pid_t dealerPID; /* process running the current match, 0 when idle */
+  int isStarting; /* sent a job, waiting for the worker's STARTED */
+  LLPoolEntry *jobEntry; /* job for the current match */
+} DealerWorker;
+
 typedef struct {
+  int state; /* JOB_LAUNCHING, JOB_RUNNING or JOB_FINISHED */
   pid_t dealerPID;
+  DealerWorker *worker; /* worker running the dealer, NULL if none */
+  LLPoolEntry *agentEntry; /* agent running the job, NULL if none */
+  uint32_t agentJobID;
+  int logFD; /* log files written with output streamed from an agent */
+  int errFD;
   pid_t botPID[ MAX_PLAYERS ];
+  LLPoolEntry *warmBots[ MAX_PLAYERS ]; /* warm bot in each seat, or NULL */
   LLPoolEntry *matchEntry;
   char *tag; /* based on tag from the match for this job */
   uint16_t ports[ MAX_PLAYERS ];
+  double cpuSecs; /* CPU time used by reaped dealer and bots */
+  ProcUsage dealerUsage; /* of the local dealer, once it has exited */
+  ProcUsage botUsage[ MAX_PLAYERS ]; /* of each seat's local bot */
+  char *limitGroups[ MAX_PLAYERS ]; /* cgroup of each seat's bot, or NULL */
+  int limitHits[ MAX_PLAYERS ]; /* bit for each limit a seat went over */
+  uint32_t runID; /* names the job's own output files */
+  off_t errScanned; /* error log read for latency reports up to here */
+  char cacheKey[ CACHE_DIGEST_LEN + 1 ]; /* empty if the run isn't cached */
+  uint64_t startMicros; /* event loop time the job was set up */
+  int portPipe; /* dealer's standard output while waiting for the port
+		   line from a local dealer, -1 otherwise */
+  EventWatch portWatch; /* data is the job's pool entry */
+  EventTimer launchTimer; /* gives up on a dealer which never reports */
+  char portString[ READBUF_LEN ];
+  int portStringLen;
+  int numCores; /* cores in serv->cores held by the job, 0 if not pinned */
+  int cores[ MAX_PLAYERS ];
+  int isPaused; /* processes stopped to make room for another job */
+  uint64_t pausedAtMicros; /* event loop time of the latest pause */
+  uint64_t pausedMicros; /* total of earlier pauses */
 } MatchJob;
 
+/* running statistics for one pairing of players in one of a user's
+   tags, built from the SCORE line at the end of each run's log */
+typedef struct {
+  char *key; /* "user tag pairing", key in serv->resultIndex */
+  const char *user; /* interned */
+  char *tag;
+  char *pairing; /* player names in seat order, separated by '|' */
+  int numPlayers;
+  uint32_t runs;
+  uint64_t hands;
+  double mean[ MAX_PLAYERS ]; /* of each run's value per hand */
+  double m2[ MAX_PLAYERS ]; /* squared differences from the mean, summed */
+} ResultStats;
+
+/* an HTTP client scraping metrics - the request is read, and then the
+   response is written out as the socket allows */
+typedef struct {
+  int sock;
+  EventWatch watch; /* data is the client's pool entry */
+  char request[ BM_METRICS_REQUEST_LEN ];
+  int requestLen;
+  MetricsText response; /* buf is NULL until the request has been read */
+  size_t sent;
+} MetricsClient;
+
+/* a finished log waiting to be compressed - it is moved aside to
+   partName, so later runs with the same tag start a new file */
+typedef struct {
+  char *tag; /* job tag the log was written under */
+  const char *suffix;
+  char *partName;
+} PendingLog;
+
+/* a finished run whose own output is waiting to be added to its tag's
+   logs, and stored in the cache if cacheKey isn't empty */
+typedef struct {
+  char *tag; /* job tag of the run */
+  uint32_t runID;
+  char cacheKey[ CACHE_DIGEST_LEN + 1 ];
+} PendingRun;
+
+/* a bound, listening socket waiting to be inherited by a dealer */
+typedef struct {
+  int sock;
+  uint16_t port;
+} PooledPort;
+
 typedef struct {
+  Config *conf;
+  EventLoop events;
+  int needSchedule; /* queue or capacity changed since the last pass */
+
   int listenSocket;
+  EventWatch listenWatch;
   LLPool *conns;
+  int numClosedConns; /* closed connections waiting to be freed */
   LLPool *matches;
   LLPool *jobs;
+  HashTable *pidJobs; /* dealer/bot PID -> entry in jobs */
+  int sigchldFD; /* signalfd reporting SIGCHLD */
+  EventWatch sigchldWatch;
+
+  Scheduler sched;
 
   rng_state_t rng;
 
   char *hostname;
 
   int devnullfd;
+
+  PooledPort *portPool;
+  int portPoolCount;
+  EventTimer portPoolTimer; /* retries filling a short pool */
+  EventTimer workerTimer; /* replaces dealer workers which have gone away */
+
+  DealerWorker *workers;
+  int numWorkers;
+
+  LLPool *agents;
+  uint32_t lastAgentJobID;
+
+  CorePool cores; /* numCores is 0 when jobs aren't pinned */
+
+  LLPool *results;
+  HashTable *resultIndex; /* "user tag pairing" -> entry in results */
+
+  LLPool *warmBots;
+  HashTable *warmBotPIDs; /* PID -> entry in warmBots */
+  EventTimer warmBotTimer; /* runs while there are warm bots */
+  LLPool *gangs; /* entries of matches which should run next */
+
+  Journal journal; /* fd is -1 when the queue isn't journaled */
+  int numJournaledMatches;
+  uint32_t lastMatchID;
+
+  int metricsSocket; /* -1 when metrics aren't served */
+  EventWatch metricsWatch;
+  LLPool *metricsClients;
+  uint64_t launchFailures[ BM_NUM_LAUNCH_KINDS ];
+
+  ResultCache cache; /* dir is NULL when runs aren't cached */
+  uint64_t cacheHits;
+  uint64_t cacheMisses;
+
+  LLPool *pendingLogs; /* logs waiting to be compressed, newest first */
+  LLPool *pendingRuns; /* runs waiting to be added to logs, newest first */
+  pid_t publishPID; /* process adding a run, 0 when none is running */
+  LLPoolEntry *publishEntry; /* run being added */
+  off_t publishStart[ BM_NUM_RUN_LOGS ]; /* size of each of the run's tag
+					    logs when publishPID started */
+  uint32_t lastPendingLog; /* numbers part files */
+  uint32_t lastRunID; /* names each job's own output files */
+  pid_t compressPID; /* compressor process, 0 when none is running */
+  LLPoolEntry *compressEntry; /* log being compressed */
+  off_t compressStart; /* size of the compressed file before the
+			  compressor started appending to it */
+
+  AdaptiveLimit adapt; /* sets sched.maxRunningBots with
+			  adaptiveConcurrency */
+
+  LimitGroups limitGroups; /* dir is NULL when bots use setrlimit */
+
+  FILE *trace; /* NULL when nothing is traced */
+
+  StringArena strings; /* match and job tags */
+  uint64_t memoryRefusals[ BM_NUM_MEMORY_POOLS ]; /* requests turned
+						     away by each cap */
+  uint64_t preemptions; /* jobs paused for a match of a higher class */
+  EventTimer adaptTimer;
 } ServerState;
 
+/* arguments for running a dealer, see setDealerArgs */
+typedef struct {
+  int argc;
+  char *argv[ MAX_PLAYERS + 64 ];
+  char matchName[ READBUF_LEN ];
+  char handsString[ 16 ], rngString[ 16 ];
+  char startupTimeoutString[ 16 ], responseTimeoutString[ 16 ];
+  char handTimeoutString[ 16 ], avgHandTimeString[ 16 ];
+  char reportLatencyString[ 16 ];
+} DealerArgs;
+
 
 LLPool *newLLPool( const int dataSize )
 {
@@ -142,45 +571,32 @@ LLPool *newLLPool( const int dataSize )
   pool = (LLPool*)malloc( sizeof( LLPool ) );
   assert( pool != 0 );
   pool->head = NULL;
-  pool->free = NULL;
+  initSlabCache( &pool->slab, sizeof( LLPoolEntry ) + dataSize, 0 );
   pool->dataSize = dataSize;
   pool->numEntries = 0;
   return pool;
 }
 
-int entryInList( LLPoolEntry *list, LLPoolEntry *entry )
+/* cap the memory the pool's entries take up, 0 for no cap */
+void LLPoolSetLimit( LLPool *pool, const size_t maxBytes )
 {
-  while( list ) {
-
-    if( entry == list ) {
-
-      return 1;
-    }
-    if( list->next ) {
+  pool->slab.maxBytes = maxBytes;
+}
 
-      assert( list->next->prev == list );
-    }
-    list = list->next;
-  }
-  return 0;
+/* returns how many more entries fit under the pool's cap */
+size_t LLPoolRoom( const LLPool *pool )
+{
+  return slabRoom( &pool->slab );
 }
 
-/* add an object to the pool.  data must have a size of pool->dataSize */
+/* add an object to the pool.  data must have a size of pool->dataSize
+   adding always works, so check LLPoolRoom first to keep to the cap */
 LLPoolEntry *LLPoolAddItem( LLPool *pool, void *item )
 {
   LLPoolEntry *entry;
 
-  if( pool->free ) {
-
-    entry = pool->free;
-    pool->free = entry->next;
-  } else {
-
-    entry = (LLPoolEntry*)malloc( sizeof( LLPoolEntry ) + pool->dataSize );
-    assert( entry != 0 );
-  }
-
-assert( !entryInList( pool->head, entry ) );
+  entry = (LLPoolEntry *)slabAlloc( &pool->slab );
+  entry->pool = pool;
   entry->next = pool->head;
   entry->prev = NULL;
   memcpy( entry->data, item, pool->dataSize );
@@ -195,12 +611,14 @@ assert( !entryInList( pool->head, entry ) );
   return entry;
 }
 
-/* remove an item from the pool, placing it in the free list.
+/* remove an item from the pool, giving it back to the pool's slabs.
    entry must have been generated by LLPoolAddItem( pool, ... )
    (that is, calling LLPoolRemoveEntry on an entry from another pool
-   is potentially a very bad idea...) */
+   is potentially a very bad idea...)
+   the entry's data stays readable until the next add to the pool */
 void LLPoolRemoveEntry( LLPool *pool, LLPoolEntry *entry )
 {
+assert( entry->pool == pool );
   if( entry->prev ) {
 
 assert( entry->prev->next == entry );
@@ -216,17 +634,24 @@ assert( entry->next->prev == entry );
     entry->next->prev = entry->prev;
   }
 
-assert( !entryInList( pool->free, entry ) );
-  if( pool->free ) {
-
-    pool->free->prev = entry;
-  }
-  entry->next = pool->free;
-  pool->free = entry;
+  entry->pool = NULL;
+  slabFree( &pool->slab, entry );
 
   --pool->numEntries;
 }
 
+/* bytes held for the pool's entries, in use or not */
+size_t LLPoolBytesHeld( const LLPool *pool )
+{
+  return slabBytesHeld( &pool->slab );
+}
+
+/* give memory held for removed entries back to the system */
+void LLPoolTrim( LLPool *pool )
+{
+  slabTrim( &pool->slab );
+}
+
 /* LLPool iterator start */
 LLPoolEntry *LLPoolFirstEntry( LLPool *pool )
 {
@@ -260,11 +685,18 @@ void setGameDefaults( GameConfig *gameConf )
   gameConf->maxMatchRuns = 10;
   gameConf->maxRunningJobs = 1;
   gameConf->matchHands = 5000;
+  gameConf->botMemoryMB = 0;
   gameConf->game = NULL;
   gameConf->gameFile = NULL;
   gameConf->bots = newLLPool( sizeof( BotSpec ) );
-
-  gameConf->curRunningJobs = 0;
+  gameConf->botIndex = newHashTable( HASH_DEFAULT_BUCKETS );
+  gameConf->throughput.handsPerSec = 0.0;
+  gameConf->throughput.numJobs = 0;
+  memset( &gameConf->dealerUsage, 0, sizeof( gameConf->dealerUsage ) );
+  gameConf->botLimits.cpus = 0.0;
+  gameConf->botLimits.memoryMB = 0;
+  gameConf->botLimits.maxPids = 0;
+  memset( gameConf->outcomes, 0, sizeof( gameConf->outcomes ) );
 }
 
 void setDefaults( Config *conf )
@@ -275,35 +707,46 @@ void setDefaults( Config *conf )
   conf->responseTimeoutSecs = 600; /* Value from 2011 ACPC */
   conf->handTimeoutSecs = 3000 * 7; /* Not enforced for 2011 ACPC */
   conf->avgHandTimeSecs = 7; /* Value from 2011 ACPC */
+  conf->socketProfile = NULL;
+  conf->portPoolSize = 0;
+  conf->schedPolicy = SCHED_POLICY_WAIT_TIME;
+  conf->dealerWorkers = 0;
+  conf->jobCores = NULL;
+  conf->journalFile = NULL;
+  conf->traceFile = NULL;
+  conf->resultCacheDir = NULL;
+  conf->botCgroup = NULL;
+  conf->journalRequeue = 1;
+  conf->warmBotIdleSecs = 60;
+  conf->metricsPort = 0;
+  memset( conf->memoryLimits, 0, sizeof( conf->memoryLimits ) );
+  conf->compressLogs = 0;
+  conf->adaptiveConcurrency = 0;
+  conf->preemption = 0;
+  conf->interactiveMaxHands = 0;
   conf->games = newLLPool( sizeof( GameConfig ) );
+  conf->gameIndex = newHashTable( HASH_DEFAULT_BUCKETS );
   conf->users = newLLPool( sizeof( UserSpec ) );
+  conf->userIndex = newHashTable( HASH_DEFAULT_BUCKETS );
 }
 
 /* returns entry for bot on success, NULL on failure */
 LLPoolEntry *findBot( const GameConfig *game, const char *name )
 {
-  LLPoolEntry *cur;
-
-  for( cur = LLPoolFirstEntry( game->bots );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-
-    if( !strcmp( ( (BotSpec *)LLPoolGetItem( cur ) )->name, name ) ) {
-
-      return cur;
-    }
-  }
-
-  return NULL;
+  return (LLPoolEntry *)hashFindString( game->botIndex, name );
 }
 
 void addBot( GameConfig *gameConf, const char *spec )
 {
+  int r;
   BotSpec bot;
   char name[ READBUF_LEN ];
   char command[ READBUF_LEN ];
+  char mode[ READBUF_LEN ];
 
-  /* split the line into name and command */
-  if( sscanf( spec, " %s %s", name, command ) < 2 ) {
+  /* split the line into name, command and an optional mode */
+  r = sscanf( spec, " %s %s %s", name, command, mode );
+  if( r < 2 ) {
 
     fprintf( stderr, "BM_ERROR: could not get bot name and command from: %s",
 	     spec );
@@ -323,29 +766,36 @@ void addBot( GameConfig *gameConf, const char *spec )
   }
 
   /* add the bot */
-  bot.name = strdup( name );
+  bot.persistent = 0;
+  bot.throughput.handsPerSec = 0.0;
+  bot.throughput.numJobs = 0;
+  bot.bestLatencyMicros = 0.0;
+  memset( &bot.usage, 0, sizeof( bot.usage ) );
+  bot.limits = &gameConf->botLimits;
+  memset( bot.limitHits, 0, sizeof( bot.limitHits ) );
+  if( r > 2 ) {
+
+    if( strcasecmp( mode, "persistent" ) ) {
+
+      fprintf( stderr, "BM_ERROR: unknown mode %s for bot %s\n", mode, name );
+      exit( EXIT_FAILURE );
+    }
+    bot.persistent = 1;
+  }
+  bot.name = internString( name );
   bot.command = strdup( command );
-  LLPoolAddItem( gameConf->bots, &bot );
+  hashAddString( gameConf->botIndex,
+		 bot.name,
+		 LLPoolAddItem( gameConf->bots, &bot ) );
 }
 
 /* returns entry for user on success, NULL on failure */
 LLPoolEntry *findUser( const Config *conf, const char *name )
 {
-  LLPoolEntry *cur;
-
-  for( cur = LLPoolFirstEntry( conf->users );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-
-    if( !strcmp( ( (UserSpec *)LLPoolGetItem( cur ) )->name, name ) ) {
-
-      return cur;
-    }
-  }
-
-  return NULL;
+  return (LLPoolEntry *)hashFindString( conf->userIndex, name );
 }
 
-void addUser( Config *conf, const char *spec )
+void addUser( Config *conf, const char *spec, const int isAgent )
 {
   UserSpec user;
   char name[ READBUF_LEN ];
@@ -367,34 +817,27 @@ void addUser( Config *conf, const char *spec )
   }
 
   /* add the user */
-  user.name = strdup( name );
+  user.name = internString( name );
   user.passwd = strdup( passwd );
-  gettimeofday( &user.waitStart, NULL );
-  LLPoolAddItem( conf->users, &user );
+  user.isAgent = isAgent;
+  initSchedUser( &user.sched );
+  hashAddString( conf->userIndex,
+		 user.name,
+		 LLPoolAddItem( conf->users, &user ) );
 }
 
 /* returns entry for game on success, NULL on failure */
 LLPoolEntry *findGame( const Config *conf, const char *name )
 {
-  LLPoolEntry *cur;
-
-  for( cur = LLPoolFirstEntry( conf->games );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-
-    if( !strcmp( ( (GameConfig *)LLPoolGetItem( cur ) )->gameFile, name ) ) {
-
-      return cur;
-    }
-  }
-
-  return NULL;
+  return (LLPoolEntry *)hashFindString( conf->gameIndex, name );
 }
 
 /* validate a logon request
    returns user on success, or NULL on failure */
 UserSpec *validateLogon( const Config *conf, const char *line )
 {
-  LLPoolEntry *cur;
+  LLPoolEntry *entry;
+  UserSpec *user;
   char name[ READBUF_LEN ];
   char passwd[ READBUF_LEN ];
 
@@ -403,21 +846,18 @@ UserSpec *validateLogon( const Config *conf, const char *line )
     return NULL;
   }
 
-  for( cur = LLPoolFirstEntry( conf->users );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-    UserSpec *user = (UserSpec *)LLPoolGetItem( cur );
+  entry = findUser( conf, name );
+  if( entry == NULL ) {
 
-    if( !strcmp( user->name, name ) ) {
+    return NULL;
+  }
 
-      if( !strcmp( user->passwd, passwd ) ) {
+  user = (UserSpec *)LLPoolGetItem( entry );
+  if( strcmp( user->passwd, passwd ) ) {
 
-	return user;
-      }
-      return NULL;
-    }
+    return NULL;
   }
-
-  return NULL;
+  return user;
 }
 
 void readConfig( const char *filename, Config *conf )
@@ -448,7 +888,20 @@ void readConfig( const char *filename, Config *conf )
       continue;
     }
 
-    if( strncasecmp( line, "port", 4 ) == 0 ) {
+    if( strncasecmp( line, "portPoolSize", 12 ) == 0 ) {
+      /* must be checked before port, which is a prefix */
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: portPoolSize must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 12 ], "%"SCNu16, &conf->portPoolSize ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get port pool size from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "port", 4 ) == 0 ) {
 
       if( gameConf != NULL ) {
 
@@ -463,6 +916,7 @@ void readConfig( const char *filename, Config *conf )
     } else if( strncasecmp( line, "game", 4 ) == 0 ) {
       FILE *file;
       GameConfig gc;
+      LLPoolEntry *entry;
       char game[ READBUF_LEN ];
 
       if( gameConf != NULL ) {
@@ -482,7 +936,7 @@ void readConfig( const char *filename, Config *conf )
       }
 
       setGameDefaults( &gc );
-      gc.gameFile = strdup( game );
+      gc.gameFile = internString( game );
 
       file = fopen( gc.gameFile, "r" );
       if( file == NULL ) {
@@ -498,8 +952,9 @@ void readConfig( const char *filename, Config *conf )
 	fprintf( stderr, "BM_ERROR: could not read game %s", gc.gameFile );
 	exit( EXIT_FAILURE );
       }
-      gameConf
-	= (GameConfig *)LLPoolGetItem( LLPoolAddItem( conf->games, &gc ) );
+      entry = LLPoolAddItem( conf->games, &gc );
+      hashAddString( conf->gameIndex, gc.gameFile, entry );
+      gameConf = (GameConfig *)LLPoolGetItem( entry );
     } else if( strncmp( line, "}", 1 ) == 0 ) {
       /* finished game definition */
 
@@ -564,956 +1019,7268 @@ void readConfig( const char *filename, Config *conf )
 	fprintf( stderr, "BM_ERROR: could not get dealer average hand time: %s", line );
 	exit( EXIT_FAILURE );
       }
-    } else if( strncasecmp( line, "maxMatchRuns", 12 ) == 0 ) {
+    } else if( strncasecmp( line, "socketProfile", 13 ) == 0 ) {
+      SocketProfile profile;
+      char spec[ READBUF_LEN ];
 
-      if( gameConf == NULL ) {
+      if( gameConf != NULL ) {
 
-	fprintf( stderr, "BM_ERROR: maxMatchRuns must be defined within a game block\n" );
+	fprintf( stderr, "BM_ERROR: socketProfile must be defined outside of game blocks\n" );
 	exit( EXIT_FAILURE );
       }
-      if( sscanf( &line[ 12 ], "%"SCNu16, &gameConf->maxMatchRuns ) < 1 ) {
+      if( sscanf( &line[ 13 ], " %s", spec ) < 1
+	  || parseSocketProfile( spec, &profile ) < 0 ) {
 
-	fprintf( stderr, "BM_ERROR: could not get maximum number of runs in a match from: %s", line );
+	fprintf( stderr, "BM_ERROR: could not get socket profile from: %s", line );
 	exit( EXIT_FAILURE );
       }
-    } else if( strncasecmp( line, "maxRunningJobs", 14 ) == 0 ) {
+      conf->socketProfile = strdup( spec );
+    } else if( strncasecmp( line, "schedPolicy", 11 ) == 0 ) {
+      char policy[ READBUF_LEN ];
 
-      if( gameConf == NULL ) {
+      if( gameConf != NULL ) {
 
-	fprintf( stderr, "BM_ERROR: maxRunningJobs must be defined within a game block\n" );
+	fprintf( stderr, "BM_ERROR: schedPolicy must be defined outside of game blocks\n" );
 	exit( EXIT_FAILURE );
       }
-      if( sscanf( &line[ 14 ], "%"SCNu16, &gameConf->maxRunningJobs ) < 1 ) {
+      if( sscanf( &line[ 11 ], " %s", policy ) < 1
+	  || ( conf->schedPolicy = schedPolicyFromName( policy ) ) < 0 ) {
 
-	fprintf( stderr, "BM_ERROR: could not get maximum number of running jobs from: %s", line );
+	fprintf( stderr, "BM_ERROR: could not get scheduling policy from: %s", line );
 	exit( EXIT_FAILURE );
       }
-    } else if( strncasecmp( line, "matchHands", 10 ) == 0 ) {
+    } else if( strncasecmp( line, "dealerWorkers", 13 ) == 0 ) {
 
-      if( gameConf == NULL ) {
+      if( gameConf != NULL ) {
 
-	fprintf( stderr, "BM_ERROR: matchHands must be defined within a game block\n" );
+	fprintf( stderr, "BM_ERROR: dealerWorkers must be defined outside of game blocks\n" );
 	exit( EXIT_FAILURE );
       }
-      if( sscanf( &line[ 10 ], "%"SCNu32, &gameConf->matchHands ) < 1 ) {
+      if( sscanf( &line[ 13 ], "%"SCNu16, &conf->dealerWorkers ) < 1 ) {
 
-	fprintf( stderr, "BM_ERROR: could not get number of hands in a match from: %s", line );
+	fprintf( stderr, "BM_ERROR: could not get number of dealer workers from: %s", line );
 	exit( EXIT_FAILURE );
       }
-    } else if( strncasecmp( line, "bot", 3 ) == 0 ) {
+    } else if( strncasecmp( line, "traceFile", 9 ) == 0 ) {
+      char path[ READBUF_LEN ];
 
-      if( gameConf == NULL ) {
+      if( gameConf != NULL ) {
 
-	fprintf( stderr, "BM_ERROR: matchHands must be defined within a game block\n" );
+	fprintf( stderr, "BM_ERROR: traceFile must be defined outside of game blocks\n" );
 	exit( EXIT_FAILURE );
       }
-      addBot( gameConf, &line[ 3 ] );
-    } else if( strncasecmp( line, "user", 4 ) == 0 ) {
+      if( sscanf( &line[ 9 ], " %s", path ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get trace file name from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      conf->traceFile = strdup( path );
+    } else if( strncasecmp( line, "journalFile", 11 ) == 0 ) {
+      char path[ READBUF_LEN ];
 
       if( gameConf != NULL ) {
 
-	fprintf( stderr,
-		 "BM_ERROR: users must be defined outside of game blocks\n" );
+	fprintf( stderr, "BM_ERROR: journalFile must be defined outside of game blocks\n" );
 	exit( EXIT_FAILURE );
       }
-      addUser( conf, &line[ 4 ] );
-    } else {
+      if( sscanf( &line[ 11 ], " %s", path ) < 1 ) {
 
-      fprintf( stderr, "BM_ERROR: unknown configuration option %s", line );
-      exit( EXIT_FAILURE );
-    }
-  }
+	fprintf( stderr, "BM_ERROR: could not get journal file from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      conf->journalFile = strdup( path );
+    } else if( strncasecmp( line, "botCgroup", 9 ) == 0 ) {
+      char path[ READBUF_LEN ];
 
-  fclose( file );
-}
+      if( gameConf != NULL ) {
 
-void addConnection( ServerState *serv, const int sock )
-{
-  Connection conn;
+	fprintf( stderr, "BM_ERROR: botCgroup must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 9 ], " %s", path ) < 1 ) {
 
-  /* add the connection */
-  conn.status = STATUS_UNVALIDATED;
-  conn.user = NULL;
-  conn.connBuf = createReadBuf( sock );
-  if( conn.connBuf == 0 ) {
+	fprintf( stderr, "BM_ERROR: could not get bot cgroup directory from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      conf->botCgroup = strdup( path );
+    } else if( strncasecmp( line, "resultCacheDir", 14 ) == 0 ) {
+      char path[ READBUF_LEN ];
 
-    fprintf( stderr, "BM_ERROR: could not create read buffer for socket\n" );
-    exit( EXIT_FAILURE );
-  }
-  LLPoolAddItem( serv->conns, &conn );
-}
+      if( gameConf != NULL ) {
 
-int matchUsesConnection( const Match *match, const LLPoolEntry *connEntry )
-{
-  int p;
+	fprintf( stderr, "BM_ERROR: resultCacheDir must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 14 ], " %s", path ) < 1 ) {
 
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+	fprintf( stderr, "BM_ERROR: could not get result cache directory from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      conf->resultCacheDir = strdup( path );
+    } else if( strncasecmp( line, "journalRecovery", 15 ) == 0 ) {
+      char policy[ READBUF_LEN ];
 
-    if( match->players[ p ].isNetworkPlayer
-	&& match->players[ p ].entry == connEntry ) {
+      if( gameConf != NULL ) {
 
-      return 1;
-    }
-  }
+	fprintf( stderr, "BM_ERROR: journalRecovery must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 15 ], " %s", policy ) < 1 ) {
 
-  return 0;
-}
+	fprintf( stderr, "BM_ERROR: could not get journal recovery policy from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      if( !strcasecmp( policy, "requeue" ) ) {
 
-void closeConnection( ServerState *serv, LLPoolEntry *connEntry )
-{
-  Connection *conn = (Connection*)LLPoolGetItem( connEntry );
-  LLPoolEntry *cur, *next;
+	conf->journalRequeue = 1;
+      } else if( !strcasecmp( policy, "drop" ) ) {
 
-  destroyReadBuf( conn->connBuf );
-  conn->status = STATUS_CLOSED;
+	conf->journalRequeue = 0;
+      } else {
 
-  /* remove any pending matches which relied on the connection */
-  for( cur = LLPoolFirstEntry( serv->matches ); cur != NULL; cur = next ) {
-    next = LLPoolNextEntry( cur );
-    Match *match = (Match *)LLPoolGetItem( cur );
+	fprintf( stderr, "BM_ERROR: unknown journal recovery policy: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "adaptiveConcurrency", 19 ) == 0 ) {
+      char mode[ READBUF_LEN ];
 
-    if( matchUsesConnection( match, connEntry ) ) {
+      if( gameConf != NULL ) {
 
-      match->numRuns = 0;
-    }
-  }
-}
+	fprintf( stderr, "BM_ERROR: adaptiveConcurrency must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 19 ], " %s", mode ) < 1 ) {
 
-void handleListenSocket( const Config *conf, ServerState *serv )
-{
-  int sock;
-  struct sockaddr_in addr;
-  socklen_t addrLen;
+	fprintf( stderr, "BM_ERROR: could not get adaptive concurrency mode from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      if( !strcasecmp( mode, "on" ) ) {
 
-  addrLen = sizeof( addr );
-  sock = accept( serv->listenSocket, (struct sockaddr *)&addr, &addrLen );
-  if( sock < 0 ) {
+	conf->adaptiveConcurrency = 1;
+      } else if( !strcasecmp( mode, "off" ) ) {
 
-    fprintf( stderr, "WARNING: failed to accept incoming connection\n" );
-    return;
-  }
+	conf->adaptiveConcurrency = 0;
+      } else {
 
-  addConnection( serv, sock );
-}
+	fprintf( stderr, "BM_ERROR: unknown adaptive concurrency mode: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "preemption", 10 ) == 0 ) {
+      char mode[ READBUF_LEN ];
 
-/* -1 on failure, 0 on success */
-int parseMatchSpec( const Config *conf,
-		    ServerState *serv,
-		    const char *spec,
-		    LLPoolEntry *connEntry,
-		    Match *match )
-{
-  uint32_t rngSeed;
-  int pos, t, p;
-  LLPoolEntry *entry;
-  char tag[ READBUF_LEN ];
-  char name[ READBUF_LEN ];
+      if( gameConf != NULL ) {
 
-  pos = 0;
+	fprintf( stderr, "BM_ERROR: preemption must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 10 ], " %s", mode ) < 1 ) {
 
-  if( sscanf( &spec[ pos ], " %s%n", name, &t ) < 1 ) {
+	fprintf( stderr, "BM_ERROR: could not get preemption mode from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      if( !strcasecmp( mode, "on" ) ) {
 
-    return -1;
-  }
-  pos += t;
+	conf->preemption = 1;
+      } else if( !strcasecmp( mode, "off" ) ) {
 
-  entry = findGame( conf, name );
-  if( entry == NULL ) {
+	conf->preemption = 0;
+      } else {
 
-    return -1;
-  }
-  match->gameConf = (GameConfig *)LLPoolGetItem( entry );
+	fprintf( stderr, "BM_ERROR: unknown preemption mode: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "interactiveMaxHands", 19 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: interactiveMaxHands must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 19 ], "%"SCNu32, &conf->interactiveMaxHands ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get interactive hand limit from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "warmBotIdleSecs", 15 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: warmBotIdleSecs must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 15 ], "%"SCNu16, &conf->warmBotIdleSecs ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get warm bot idle time from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "metricsPort", 11 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: metricsPort must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 11 ], "%"SCNu16, &conf->metricsPort ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get metrics port from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "memoryLimitMB", 13 ) == 0 ) {
+      char name[ READBUF_LEN ];
+      uint32_t mb;
+      int k;
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: memoryLimitMB must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 13 ], " %s %"SCNu32, name, &mb ) < 2 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get memory limit from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      for( k = 0; k < BM_NUM_MEMORY_POOLS; ++k ) {
+
+	if( !strcasecmp( name, memoryPoolNames[ k ] ) ) {
+
+	  break;
+	}
+      }
+      if( k == BM_NUM_MEMORY_POOLS ) {
+
+	fprintf( stderr, "BM_ERROR: unknown memory pool %s\n", name );
+	exit( EXIT_FAILURE );
+      }
+      conf->memoryLimits[ k ] = (size_t)mb << 20;
+    } else if( strncasecmp( line, "compressLogs", 12 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: compressLogs must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 12 ], "%"SCNu16, &conf->compressLogs ) < 1
+	  || conf->compressLogs > 9 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get log compression level from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "jobCores", 8 ) == 0 ) {
+      char spec[ READBUF_LEN ];
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: jobCores must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 8 ], " %s", spec ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get job cores from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      conf->jobCores = strdup( spec );
+    } else if( strncasecmp( line, "maxMatchRuns", 12 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: maxMatchRuns must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 12 ], "%"SCNu16, &gameConf->maxMatchRuns ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get maximum number of runs in a match from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "maxRunningJobs", 14 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: maxRunningJobs must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 14 ], "%"SCNu16, &gameConf->maxRunningJobs ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get maximum number of running jobs from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "botCpuLimit", 11 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: botCpuLimit must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 11 ], "%lf", &gameConf->botLimits.cpus ) < 1
+	  || gameConf->botLimits.cpus < 0.0 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get bot CPU limit from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "botMemoryLimitMB", 16 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: botMemoryLimitMB must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 16 ], "%"SCNu32, &gameConf->botLimits.memoryMB ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get bot memory limit from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "botPidsLimit", 12 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: botPidsLimit must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 12 ], "%"SCNu32, &gameConf->botLimits.maxPids ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get bot process limit from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "botMemoryMB", 11 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: botMemoryMB must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 11 ], "%"SCNu32, &gameConf->botMemoryMB ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get bot memory from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "matchHands", 10 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: matchHands must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 10 ], "%"SCNu32, &gameConf->matchHands ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get number of hands in a match from: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "bot", 3 ) == 0 ) {
+
+      if( gameConf == NULL ) {
+
+	fprintf( stderr, "BM_ERROR: matchHands must be defined within a game block\n" );
+	exit( EXIT_FAILURE );
+      }
+      addBot( gameConf, &line[ 3 ] );
+    } else if( strncasecmp( line, "agentUser", 9 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr,
+		 "BM_ERROR: agent users must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      addUser( conf, &line[ 9 ], 1 );
+    } else if( strncasecmp( line, "user", 4 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr,
+		 "BM_ERROR: users must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      addUser( conf, &line[ 4 ], 0 );
+    } else {
+
+      fprintf( stderr, "BM_ERROR: unknown configuration option %s", line );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  fclose( file );
+}
+
+LLPoolEntry *addConnection( ServerState *serv, const int sock )
+{
+  Connection conn;
+
+  /* add the connection */
+  conn.status = STATUS_UNVALIDATED;
+  conn.user = NULL;
+  conn.connBuf = createReadBuf( sock );
+  if( conn.connBuf == 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create read buffer for socket\n" );
+    exit( EXIT_FAILURE );
+  }
+  conn.watch.active = 0;
+  conn.agentEntry = NULL;
+  conn.transfer = NULL;
+  return LLPoolAddItem( serv->conns, &conn );
+}
+
+int matchUsesConnection( const Match *match, const LLPoolEntry *connEntry )
+{
+  int p;
+
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( match->players[ p ].isNetworkPlayer
+	&& match->players[ p ].entry == connEntry ) {
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* does the match use any persistent bots? */
+int matchUsesWarmBots( const Match *match )
+{
+  int p;
+
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( !match->players[ p ].isNetworkPlayer
+	&& ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )
+	->persistent ) {
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* how many bots will match start? */
+int botsInMatch( const Match *match )
+{
+  int p, num;
+
+  num = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( !match->players[ p ].isNetworkPlayer ) {
+
+      ++num;
+    }
+  }
+
+  return num;
+}
+
+/* write a record which recreates match, as it was before any run which
+   is currently going started - "SUBMIT id user rngInitSeed useRngForSeed
+   runsStarted game runsLeft tag rngSeed bot... numHands groupID class"
+   returns 0 on success, -1 on failure */
+int journalSubmit( Journal *journal, const Match *match )
+{
+  int p, len;
+  char players[ READBUF_LEN ];
+
+  len = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    len += snprintf( &players[ len ], sizeof( players ) - len, " %s",
+		     ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )
+		     ->name );
+    if( len >= sizeof( players ) ) {
+
+      return -1;
+    }
+  }
+
+  /* hands, group and class come after the players, so older records
+     without them still read */
+  return journalAppend( journal,
+			"SUBMIT %"PRIu32" %s %"PRIu32" %d %d %s %d %s %"PRIu32"%s %"PRIu32" %"PRIu32" %s",
+			match->id,
+			match->user->name,
+			match->rngInitSeed,
+			match->useRngForSeed,
+			match->runsStarted - match->isRunning,
+			match->gameConf->gameFile,
+			match->numRuns + match->isRunning,
+			match->tag,
+			match->rngSeed,
+			players,
+			match->numHands,
+			match->groupID,
+			priorityNames[ match->priority ] );
+}
+
+/* journal writer recreating every journaled match */
+int writeQueueSnapshot( Journal *journal, void *data )
+{
+  ServerState *serv = (ServerState *)data;
+  LLPoolEntry *cur;
+
+  for( cur = LLPoolFirstEntry( serv->matches );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    Match *match = (Match *)LLPoolGetItem( cur );
+
+    if( !match->isJournaled ) {
+
+      continue;
+    }
+    if( journalSubmit( journal, match ) < 0
+	|| ( match->isRunning
+	     && journalAppend( journal, "START %"PRIu32, match->id ) < 0 ) ) {
+
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* rewrite the journal if it has grown much larger than the queue */
+void checkJournalSize( ServerState *serv )
+{
+  if( serv->journal.numRecords < BM_JOURNAL_MIN_RECORDS
+      || serv->journal.numRecords
+      < BM_JOURNAL_COMPACT_FACTOR * ( serv->numJournaledMatches + 1 ) ) {
+
+    return;
+  }
+
+  if( journalCompact( &serv->journal, writeQueueSnapshot, serv ) < 0 ) {
+
+    fprintf( stderr, "BM_WARNING: could not compact journal\n" );
+  }
+}
+
+/* record that event (START, FINISH or CANCEL) happened to match */
+void journalMatch( ServerState *serv, const Match *match, const char *event )
+{
+  if( journalAppend( &serv->journal, "%s %"PRIu32, event, match->id ) < 0 ) {
+
+    fprintf( stderr, "BM_WARNING: could not journal %s of match %"PRIu32"\n",
+	     event, match->id );
+  }
+  checkJournalSize( serv );
+}
+
+void queueMatchLogs( ServerState *serv, const Match *match );
+void queueTagLogs( ServerState *serv,
+		   const char *tag,
+		   const Match *except,
+		   const LLPoolEntry *publishing );
+void runPublished( ServerState *serv, const int failed );
+
+/* take a match which is not running out of the queue and free it */
+void removeMatch( ServerState *serv, LLPoolEntry *matchEntry )
+{
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+  LLPoolEntry *cur;
+
+  assert( !match->isRunning );
+  if( schedIsQueued( &match->sched ) ) {
+
+    /* the match may have been blocking smaller matches behind it */
+    schedDequeue( &serv->sched, &match->sched );
+    serv->needSchedule = 1;
+  }
+  if( match->isJournaled ) {
+    /* leave the match out of any compaction the record triggers */
+
+    match->isJournaled = 0;
+    --serv->numJournaledMatches;
+    journalMatch( serv, match, "CANCEL" );
+  }
+  if( match->gangEntry ) {
+
+    LLPoolRemoveEntry( serv->gangs, match->gangEntry );
+    match->gangEntry = NULL;
+  }
+
+  /* warm bots kept for the match are free for other matches */
+  for( cur = LLPoolFirstEntry( serv->warmBots );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    WarmBot *warm = (WarmBot *)LLPoolGetItem( cur );
+
+    if( warm->owner == matchEntry ) {
+
+      warm->owner = NULL;
+      warm->idleSinceMicros = eventNowMicros();
+    }
+  }
+
+  queueMatchLogs( serv, match );
+  arenaStrfree( &serv->strings, match->tag );
+  LLPoolRemoveEntry( serv->matches, matchEntry );
+}
+
+void freeLogTransfer( LogTransfer *transfer )
+{
+  int i;
+
+  for( i = 0; i < transfer->numPieces; ++i ) {
+
+    if( transfer->pieces[ i ].fd >= 0 ) {
+
+      close( transfer->pieces[ i ].fd );
+    }
+  }
+  free( transfer->pieces );
+  free( transfer );
+}
+
+void removeAgent( ServerState *serv, LLPoolEntry *agentEntry );
+
+void closeConnection( ServerState *serv, LLPoolEntry *connEntry )
+{
+  Connection *conn = (Connection*)LLPoolGetItem( connEntry );
+  LLPoolEntry *cur, *next;
+
+  if( conn->agentEntry ) {
+
+    removeAgent( serv, conn->agentEntry );
+    conn->agentEntry = NULL;
+  }
+  if( conn->transfer ) {
+
+    freeLogTransfer( conn->transfer );
+    conn->transfer = NULL;
+  }
+
+  /* the entry is freed once the current batch of events is handled,
+     as later events in the batch may still refer to it */
+  eventWatchRemove( &serv->events, &conn->watch );
+  destroyReadBuf( conn->connBuf );
+  conn->status = STATUS_CLOSED;
+  ++serv->numClosedConns;
+
+  /* remove any pending matches which relied on the connection */
+  for( cur = LLPoolFirstEntry( serv->matches ); cur != NULL; cur = next ) {
+    next = LLPoolNextEntry( cur );
+    Match *match = (Match *)LLPoolGetItem( cur );
+
+    if( matchUsesConnection( match, connEntry ) ) {
+
+      match->numRuns = 0;
+      if( !match->isRunning ) {
+	/* running matches are removed when their job finishes */
+
+	removeMatch( serv, cur );
+      } else {
+	/* the entry is about to be reused, so a job which hasn't told
+	   the player where to connect yet must not find it */
+	int p;
+
+	for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+	  if( match->players[ p ].isNetworkPlayer
+	      && match->players[ p ].entry == connEntry ) {
+
+	    match->players[ p ].entry = NULL;
+	  }
+	}
+      }
+    }
+  }
+}
+
+/* returns the new connection, or NULL on failure */
+LLPoolEntry *handleListenSocket( const Config *conf, ServerState *serv )
+{
+  int sock;
+
+  sock = acceptSocket( serv->listenSocket );
+  if( sock < 0 ) {
+
+    fprintf( stderr, "WARNING: failed to accept incoming connection\n" );
+    return NULL;
+  }
+
+  if( LLPoolRoom( serv->conns ) == 0 ) {
+
+    ++serv->memoryRefusals[ BM_MEMORY_CONNS ];
+    if( write( sock, "SERVER FULL\n", 12 ) < 12 ) {
+      /* the client finds out either way when the socket closes */
+    }
+    close( sock );
+    return NULL;
+  }
+
+  return addConnection( serv, sock );
+}
+
+/* free the entries of connections closed by the last batch of events */
+void freeClosedConnections( ServerState *serv )
+{
+  LLPoolEntry *cur, *next;
+
+  if( serv->numClosedConns == 0 ) {
+
+    return;
+  }
+
+  for( cur = LLPoolFirstEntry( serv->conns ); cur != NULL; cur = next ) {
+    next = LLPoolNextEntry( cur );
+
+    if( ( (Connection *)LLPoolGetItem( cur ) )->status == STATUS_CLOSED ) {
+
+      LLPoolRemoveEntry( serv->conns, cur );
+    }
+  }
+  serv->numClosedConns = 0;
+}
+
+/* seed the match's random number generator, which picks each run's
+   deck - a seed of 0 asks for a random one */
+void setMatchSeed( ServerState *serv, Match *match, const uint32_t rngSeed )
+{
+  match->rngSeed = rngSeed;
+  if( rngSeed ) {
+
+    match->rngInitSeed = rngSeed;
+    if( match->numRuns == 1 ) {
+
+      match->useRngForSeed = 0;
+    } else {
+
+      match->useRngForSeed = 1;
+    }
+  } else {
+
+    match->rngInitSeed = genrand_int32( &serv->rng );
+    match->useRngForSeed = 1;
+  }
+  init_genrand( &match->rng, match->rngInitSeed );
+  match->runsStarted = 0;
+}
+
+/* returns the BM_PRIORITY_ class called name, or -1 if there isn't one */
+int priorityFromName( const char *name )
+{
+  int c;
+
+  for( c = 0; c < BM_NUM_PRIORITIES; ++c ) {
+
+    if( !strcasecmp( name, priorityNames[ c ] ) ) {
+
+      return c;
+    }
+  }
+  return -1;
+}
+
+/* -1 on failure, otherwise the length of spec which was used */
+int parseMatchSpec( const Config *conf,
+		    ServerState *serv,
+		    const char *spec,
+		    LLPoolEntry *connEntry,
+		    Match *match )
+{
+  uint32_t rngSeed;
+  int pos, t, p;
+  LLPoolEntry *entry;
+  char tag[ READBUF_LEN ];
+  char name[ READBUF_LEN ];
+
+  pos = 0;
+
+  if( sscanf( &spec[ pos ], " %s%n", name, &t ) < 1 ) {
+
+    return -1;
+  }
+  pos += t;
+
+  entry = findGame( conf, name );
+  if( entry == NULL ) {
+
+    return -1;
+  }
+  match->gameConf = (GameConfig *)LLPoolGetItem( entry );
+
+  if( sscanf( &spec[ pos ],
+	      " %d %s %"SCNu32" %n",
+	      &match->numRuns,
+	      tag,
+	      &rngSeed,
+	      &t ) < 3 ) {
+
+    return -1;
+  }
+  pos += t;
+  if( match->numRuns < 0 || match->numRuns > match->gameConf->maxMatchRuns ) {
+
+    return -1;
+  }
+
+  /* make sure tag has no characters in it */
+  if( strchr( tag, '/' ) != NULL ) {
+
+    return -1;
+  }
+
+  /* get bots */
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    /* get the name */
+    if( sscanf( &spec[ pos ], " %s%n", name, &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+
+    /* translate the name into an index */
+    if( !strcmp( name, "LOCAL" ) ) {
+
+      match->players[ p ].isNetworkPlayer = 1;
+      match->players[ p ].entry = connEntry;
+    } else {
+
+      match->players[ p ].isNetworkPlayer = 0;
+      match->players[ p ].entry = findBot( match->gameConf, name );
+      if( match->players[ p ].entry == NULL ) {
+
+	return -1;
+      }
+    }
+  }
+
+  match->tag = arenaStrdup( &serv->strings, tag );
+  match->numHands = match->gameConf->matchHands;
+  match->groupID = 0;
+  match->priority = BM_PRIORITY_NORMAL;
+  setMatchSeed( serv, match, rngSeed );
+  match->isJournaled = 0;
+  match->gangEntry = NULL;
+
+  return pos;
+}
+
+/* state while replaying the journal */
+typedef struct {
+  ServerState *serv;
+  HashTable *matches; /* match ID -> entry in serv->matches */
+  int numBadRecords;
+} JournalReplay;
+
+/* forget a replayed match which hasn't been given to the scheduler */
+void dropReplayedMatch( JournalReplay *replay, const uint32_t id )
+{
+  LLPoolEntry *entry;
+
+  entry = (LLPoolEntry *)hashRemoveInt( replay->matches, id );
+  if( entry ) {
+
+    arenaStrfree( &replay->serv->strings,
+		  ( (Match *)LLPoolGetItem( entry ) )->tag );
+    LLPoolRemoveEntry( replay->serv->matches, entry );
+  }
+}
+
+void replayJournalRecord( const char *record, void *data )
+{
+  JournalReplay *replay = (JournalReplay *)data;
+  ServerState *serv = replay->serv;
+  int pos, t, len, useRngForSeed, runsStarted, priority;
+  uint32_t id, rngInitSeed, numHands, groupID;
+  LLPoolEntry *entry;
+  Match match, *m;
+  char event[ 16 ], name[ READBUF_LEN ];
+
+  if( sscanf( record, "%15s %"SCNu32"%n", event, &id, &pos ) < 2 ) {
+
+    ++replay->numBadRecords;
+    return;
+  }
+  if( id > serv->lastMatchID ) {
+
+    serv->lastMatchID = id;
+  }
+
+  if( !strcmp( event, "SUBMIT" ) ) {
+
+    if( sscanf( &record[ pos ], " %s %"SCNu32" %d %d%n",
+		name, &rngInitSeed, &useRngForSeed, &runsStarted, &t ) < 4
+	|| ( entry = findUser( serv->conf, name ) ) == NULL ) {
+
+      ++replay->numBadRecords;
+      return;
+    }
+    len = parseMatchSpec( serv->conf, serv, &record[ pos + t ], NULL, &match );
+    if( len < 0 ) {
+      /* the config has changed since the match was queued */
+
+      ++replay->numBadRecords;
+      return;
+    }
+    name[ 0 ] = 0;
+    if( sscanf( &record[ pos + t + len ], " %"SCNu32" %"SCNu32" %s",
+		&numHands, &groupID, name ) >= 2 ) {
+
+      match.numHands = numHands;
+      match.groupID = groupID;
+      if( ( priority = priorityFromName( name ) ) >= 0 ) {
+
+	match.priority = priority;
+      }
+    }
+    if( botsInMatch( &match ) < match.gameConf->game->numPlayers ) {
+
+      ++replay->numBadRecords;
+      arenaStrfree( &serv->strings, match.tag );
+      return;
+    }
+    match.user = (UserSpec *)LLPoolGetItem( entry );
+    match.rngInitSeed = rngInitSeed;
+    match.useRngForSeed = useRngForSeed;
+    match.runsStarted = runsStarted;
+    match.id = id;
+    match.isJournaled = 1;
+    match.isRunning = 0;
+
+    dropReplayedMatch( replay, id );
+    hashAddInt( replay->matches, id, LLPoolAddItem( serv->matches, &match ) );
+    return;
+  }
+
+  entry = (LLPoolEntry *)hashFindInt( replay->matches, id );
+  if( entry == NULL ) {
+
+    ++replay->numBadRecords;
+    return;
+  }
+  m = (Match *)LLPoolGetItem( entry );
+
+  if( !strcmp( event, "START" ) ) {
+
+    m->isRunning = 1;
+    --m->numRuns;
+    ++m->runsStarted;
+  } else if( !strcmp( event, "FINISH" ) ) {
+
+    m->isRunning = 0;
+  } else if( !strcmp( event, "CANCEL" ) ) {
+
+    dropReplayedMatch( replay, id );
+  } else {
+
+    ++replay->numBadRecords;
+  }
+}
+
+int compareMatchIDs( const void *a, const void *b )
+{
+  const Match *ma = (const Match *)LLPoolGetItem( *(LLPoolEntry **)a );
+  const Match *mb = (const Match *)LLPoolGetItem( *(LLPoolEntry **)b );
+
+  return ma->id < mb->id ? -1 : ma->id > mb->id;
+}
+
+/* open the journal, and put every match it describes back in the queue
+   runs which were going when the server stopped can't be reattached,
+   since their processes belonged to the old server, so they are either
+   run again with the same seed or counted as done */
+void recoverQueue( const Config *conf, ServerState *serv )
+{
+  int i, r, numMatches, numInterrupted;
+  LLPoolEntry *cur, **entries;
+  JournalReplay replay;
+
+  serv->journal.fd = -1;
+  if( conf->journalFile == NULL ) {
+
+    return;
+  }
+
+  replay.serv = serv;
+  replay.matches = newHashTable( HASH_DEFAULT_BUCKETS );
+  replay.numBadRecords = 0;
+  if( openJournal( &serv->journal,
+		   conf->journalFile,
+		   replayJournalRecord,
+		   &replay ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not open journal %s\n",
+	     conf->journalFile );
+    exit( EXIT_FAILURE );
+  }
+  if( replay.numBadRecords ) {
+
+    fprintf( stderr, "BM_WARNING: skipped %d bad records in journal\n",
+	     replay.numBadRecords );
+  }
+
+  /* queue the matches in the order they were submitted */
+  numMatches = replay.matches->numEntries;
+  entries = (LLPoolEntry **)malloc( sizeof( LLPoolEntry * )
+				    * ( numMatches + 1 ) );
+  assert( entries != 0 );
+  i = 0;
+  for( cur = LLPoolFirstEntry( serv->matches );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+    entries[ i ] = cur;
+    ++i;
+  }
+  assert( i == numMatches );
+  qsort( entries, numMatches, sizeof( LLPoolEntry * ), compareMatchIDs );
+
+  numInterrupted = 0;
+  for( i = 0; i < numMatches; ++i ) {
+    Match *m = (Match *)LLPoolGetItem( entries[ i ] );
+
+    if( m->isRunning ) {
+
+      ++numInterrupted;
+      m->isRunning = 0;
+      if( conf->journalRequeue ) {
+
+	++m->numRuns;
+	--m->runsStarted;
+      }
+    }
+    if( m->numRuns <= 0 ) {
+
+      arenaStrfree( &serv->strings, m->tag );
+      LLPoolRemoveEntry( serv->matches, entries[ i ] );
+      continue;
+    }
+
+    /* pick the random state up where the last run left it */
+    init_genrand( &m->rng, m->rngInitSeed );
+    if( m->useRngForSeed ) {
+
+      for( r = 0; r < m->runsStarted; ++r ) {
+
+	genrand_int32( &m->rng );
+      }
+    }
+
+    initSchedEntry( &m->sched,
+		    &m->user->sched,
+		    &m->gameConf->sched,
+		    botsInMatch( m ),
+		    entries[ i ] );
+    m->sched.priority = m->priority;
+    schedEnqueue( &serv->sched, &m->sched );
+    ++serv->numJournaledMatches;
+  }
+  free( entries );
+  destroyHashTable( replay.matches );
+
+  /* start the new journal from just the live queue */
+  if( journalCompact( &serv->journal, writeQueueSnapshot, serv ) < 0 ) {
+
+    fprintf( stderr, "BM_WARNING: could not compact journal\n" );
+  }
+
+  serv->needSchedule = 1;
+  printf( "recovered %d queued matches from journal, %s %d interrupted runs\n",
+	  serv->numJournaledMatches,
+	  conf->journalRequeue ? "requeued" : "dropped",
+	  numInterrupted );
+  fflush( stdout );
+}
+ 
+void writeHelpMessage( int fd )
+{
+  int r;
+
+  r = write( fd, "HELP - this message\n", 20 );
+  r = write( fd, "GAMES - list available games and players\n", 41 );
+  r = write( fd, "QSTAT - show the current queue, with estimated start and finish times\n", 70 );
+  r = write( fd, "RESULTS [tag] - per hand value of finished runs, by players\n", 60 );
+  r = write( fd, "GETLOG tag [log|stderr] - download the logs of a tag\n", 53 );
+  r = write( fd, "  - Sent as \"LOG suffix gzip|plain bytes\" lines, each followed by\n", 66 );
+  r = write( fd, "    that many bytes of the file, then \"LOG END\"\n", 48 );
+  r = write( fd, "RUNMATCHES game #runs tag rngSeed player ... [class] - submit match request\n", 76 );
+  r = write( fd, "  - Player order decides match seating\n", 39 );
+  r = write( fd, "  - \"LOCAL\" player runs the bm_widget agent (bot_command)\n", 60 );
+  r = write( fd, "  - class is bulk, normal (the default) or interactive, and every\n", 66 );
+  r = write( fd, "    queued match goes ahead of those of lower classes\n", 54 );
+  r = write( fd, "RUNTOURNAMENT game #runs tag rngSeed #hands duplicate|rotate bot ...\n", 69 );
+  r = write( fd, "  - Round robin between the bots, every set of them playing in every\n", 69 );
+  r = write( fd, "    seating (duplicate) or seat rotation, all dealt the same cards\n", 67 );
+  r = write( fd, "  - #hands 0 uses the game's match length\n", 42 );
+  r = write( fd, "CROSSTABLE tag - per hand value of each player against each other\n", 66 );
+}
+
+void writeGameList( const Config *conf, int fd )
+{
+  int r;
+  LLPoolEntry *cur, *botCur;
+  char line[ READBUF_LEN ];
+
+  for( cur = LLPoolFirstEntry( conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    GameConfig *game = (GameConfig *)LLPoolGetItem( cur );
+
+    r = snprintf( line, sizeof( line ), "\n%s\n", game->gameFile );
+    assert( r > 0 );
+    r = write( fd, line, r );
+
+    for( botCur = LLPoolFirstEntry( game->bots );
+	 botCur != NULL; botCur = LLPoolNextEntry( botCur ) ) {
+      BotSpec *bot = (BotSpec *)LLPoolGetItem( botCur );
+
+      r = snprintf( line, sizeof( line ), " %s\n", bot->name );
+      assert( r > 0 );
+      r = write( fd, line, r );
+    }
+  }
+}
+
+void throughputObserve( Throughput *throughput, const double handsPerSec )
+{
+  double weight;
+
+  ++throughput->numJobs;
+  weight = 1.0 / throughput->numJobs;
+  if( weight < BM_THROUGHPUT_WEIGHT ) {
+
+    weight = BM_THROUGHPUT_WEIGHT;
+  }
+  throughput->handsPerSec += weight * ( handsPerSec - throughput->handsPerSec );
+}
+
+/* expected wall clock seconds for one run of match - a match goes at
+   the speed of its slowest bot, and the game's speed stands in for
+   network players and bots which haven't finished a job yet
+   returns -1 if nothing for the game has finished */
+double matchRunSecs( const Match *match )
+{
+  int p;
+  double handsPerSec;
+  const BotSpec *bot;
+
+  if( match->gameConf->throughput.numJobs == 0 ) {
+
+    return -1;
+  }
+
+  handsPerSec = -1;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( match->players[ p ].isNetworkPlayer ) {
+
+      continue;
+    }
+    bot = (const BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+    if( bot->throughput.numJobs
+	&& ( handsPerSec < 0 || bot->throughput.handsPerSec < handsPerSec ) ) {
+
+      handsPerSec = bot->throughput.handsPerSec;
+    }
+  }
+  if( handsPerSec < 0 ) {
+
+    handsPerSec = match->gameConf->throughput.handsPerSec;
+  }
+  if( handsPerSec <= 0.0 ) {
+
+    return -1;
+  }
+
+  return match->numHands / handsPerSec;
+}
+
+/* microseconds the job has been going, not counting pauses */
+uint64_t jobRunMicros( const MatchJob *job )
+{
+  uint64_t now = eventNowMicros();
+
+  return now - job->startMicros - job->pausedMicros
+    - ( job->isPaused ? now - job->pausedAtMicros : 0 );
+}
+
+/* a match in a queue estimate - runs are played out on the game's job
+   slots in the order the scheduler would roughly pick them */
+typedef struct {
+  const Match *match;
+  double runSecs; /* -1 if unknown */
+  int runsLeft; /* runs still to be placed on a slot */
+  double readyAt; /* when the match can next start a run */
+  double queueTime; /* order among ready matches, oldest first */
+  int heapIndex;
+  double start; /* estimated start of the first run, -1 if running */
+  double finish; /* estimated end of the last run */
+  int shownRuns; /* runs on the match's QSTAT line, summed over its
+		    tournament, -1 if it's shown with the tournament */
+  int isShownRunning; /* a run of the line's matches is playing */
+  int isShownPaused; /* one is paused */
+} QueueEstimate;
+
+typedef struct {
+  double freeAt;
+  int heapIndex;
+} EstimateSlot;
+
+static int estimateReadyLess( const void *a, const void *b )
+{
+  const QueueEstimate *ea = (const QueueEstimate *)a;
+  const QueueEstimate *eb = (const QueueEstimate *)b;
+
+  if( ea->match->priority != eb->match->priority ) {
+
+    return ea->match->priority > eb->match->priority;
+  }
+  return ea->queueTime < eb->queueTime;
+}
+
+static int estimateWaitingLess( const void *a, const void *b )
+{
+  return ( (const QueueEstimate *)a )->readyAt
+    < ( (const QueueEstimate *)b )->readyAt;
+}
+
+static int estimateSlotLess( const void *a, const void *b )
+{
+  return ( (const EstimateSlot *)a )->freeAt
+    < ( (const EstimateSlot *)b )->freeAt;
+}
+
+/* fill in start and finish for the numEstimates matches of gameConf,
+   as seconds from now, by playing out their remaining runs on as many
+   job slots as the game can run at once */
+void estimateGameQueue( const ServerState *serv,
+			const GameConfig *gameConf,
+			QueueEstimate *estimates,
+			const int numEstimates )
+{
+  int i, numSlots, numRunning;
+  double t;
+  Heap ready, waiting, slotHeap;
+  EstimateSlot *slots;
+  QueueEstimate *est;
+  LLPoolEntry *cur;
+  uint64_t nowMicros = eventNowMicros();
+  struct timeval now;
+
+  gettimeofday( &now, NULL );
+
+  /* jobs the game can run at once, counting against maxRunningBots as
+     though no other game had bots running */
+  numSlots = gameConf->maxRunningJobs;
+  if( serv->sched.maxRunningBots ) {
+    int botSlots = serv->sched.maxRunningBots / gameConf->game->numPlayers;
+
+    if( botSlots < 1 ) {
+
+      botSlots = 1;
+    }
+    if( numSlots == 0 || botSlots < numSlots ) {
+
+      numSlots = botSlots;
+    }
+  }
+  numRunning = 0;
+  for( i = 0; i < numEstimates; ++i ) {
+
+    numRunning += estimates[ i ].match->isRunning;
+  }
+  if( numSlots == 0 || numSlots > numEstimates ) {
+
+    numSlots = numEstimates;
+  }
+  if( numSlots < numRunning ) {
+
+    numSlots = numRunning;
+  }
+
+  slots = (EstimateSlot *)malloc( sizeof( EstimateSlot ) * numSlots );
+  assert( slots != 0 );
+  initHeap( &ready, estimateReadyLess, offsetof( QueueEstimate, heapIndex ) );
+  initHeap( &waiting,
+	    estimateWaitingLess,
+	    offsetof( QueueEstimate, heapIndex ) );
+  initHeap( &slotHeap,
+	    estimateSlotLess,
+	    offsetof( EstimateSlot, heapIndex ) );
+  for( i = 0; i < numSlots; ++i ) {
+
+    slots[ i ].freeAt = 0.0;
+    slots[ i ].heapIndex = -1;
+  }
+
+  /* running matches hold a slot until their job is expected to end */
+  numRunning = 0;
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    const MatchJob *job = (const MatchJob *)LLPoolGetItem( cur );
+
+    for( i = 0; i < numEstimates; ++i ) {
+
+      if( LLPoolGetItem( job->matchEntry ) == estimates[ i ].match ) {
+
+	est = &estimates[ i ];
+	t = est->runSecs - jobRunMicros( job ) / 1e6;
+	est->readyAt = t > 0.0 ? t : 0.0;
+	est->queueTime = -( nowMicros - job->startMicros ) / 1e6;
+	est->finish = est->readyAt;
+	slots[ numRunning ].freeAt = est->readyAt;
+	++numRunning;
+	break;
+      }
+    }
+  }
+  for( i = 0; i < numSlots; ++i ) {
+
+    heapPush( &slotHeap, &slots[ i ] );
+  }
+
+  for( i = 0; i < numEstimates; ++i ) {
+
+    est = &estimates[ i ];
+    if( !est->match->isRunning ) {
+
+      est->readyAt = 0.0;
+      est->queueTime = ( est->match->sched.queueTime.tv_sec - now.tv_sec )
+	+ ( est->match->sched.queueTime.tv_usec - now.tv_usec ) / 1e6;
+    }
+    if( est->runsLeft ) {
+
+      heapPush( &waiting, est );
+    }
+  }
+
+  while( ( est = (QueueEstimate *)heapTop( &waiting ) ) != NULL
+	 || heapTop( &ready ) != NULL ) {
+    EstimateSlot *slot = (EstimateSlot *)heapTop( &slotHeap );
+
+    /* the next run goes on the first free slot, to the match which has
+       waited longest among those ready by then */
+    t = slot->freeAt;
+    if( heapTop( &ready ) == NULL && est->readyAt > t ) {
+
+      t = est->readyAt;
+    }
+    while( ( est = (QueueEstimate *)heapTop( &waiting ) ) != NULL
+	   && est->readyAt <= t ) {
+
+      heapRemove( &waiting, est );
+      heapPush( &ready, est );
+    }
+
+    est = (QueueEstimate *)heapTop( &ready );
+    heapRemove( &ready, est );
+    if( est->start < 0 && !est->match->isRunning ) {
+
+      est->start = t;
+    }
+    est->finish = t + est->runSecs;
+    slot->freeAt = est->finish;
+    heapFix( &slotHeap, slot );
+
+    --est->runsLeft;
+    if( est->runsLeft ) {
+      /* finished runs go back in the queue as of their start */
+
+      est->readyAt = est->finish;
+      est->queueTime = t;
+      heapPush( &waiting, est );
+    }
+  }
+
+  freeHeap( &ready );
+  freeHeap( &waiting );
+  freeHeap( &slotHeap );
+  free( slots );
+}
+
+/* format an estimate, seconds from now, as a local time */
+void formatEstimate( const double secs, char *buf, const size_t bufSize )
+{
+  time_t when;
+  struct tm tm;
+
+  if( secs < 0 ) {
+
+    snprintf( buf, bufSize, "?" );
+    return;
+  }
+
+  when = time( NULL ) + (time_t)( secs + 0.5 );
+  localtime_r( &when, &tm );
+  strftime( buf, bufSize, "%Y-%m-%dT%H:%M:%S", &tm );
+}
+
+/* each line is "user tag game * runs R|P|Q start finish class", where
+   start and finish are estimates from the throughput of finished jobs -
+   start is "running" or "paused" for a match with a run going, and
+   either is "?" before any job for the game has finished */
+void writeQueueStatus( const Config *conf, const ServerState *serv, int fd )
+{
+  int r, i, n, g;
+  LLPoolEntry *cur, *gameEntry;
+  QueueEstimate *estimates, *gameEstimates;
+  HashTable *groups;
+  char line[ READBUF_LEN * 4 ], start[ 32 ], finish[ 32 ];
+
+  if( serv->matches->numEntries == 0 ) {
+    r = write( fd, "Queue empty\n", 12 );
+    return;
+  }
+
+  estimates = (QueueEstimate *)malloc( sizeof( QueueEstimate )
+				       * serv->matches->numEntries );
+  gameEstimates = (QueueEstimate *)malloc( sizeof( QueueEstimate )
+					   * serv->matches->numEntries );
+  assert( estimates != 0 && gameEstimates != 0 );
+  n = 0;
+  for( cur = LLPoolFirstEntry( serv->matches );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    const Match *match = (const Match *)LLPoolGetItem( cur );
+
+    estimates[ n ].match = match;
+    estimates[ n ].runSecs = matchRunSecs( match );
+    estimates[ n ].runsLeft = match->numRuns;
+    estimates[ n ].heapIndex = -1;
+    estimates[ n ].start = -1;
+    estimates[ n ].finish = -1;
+    ++n;
+  }
+
+  /* games have their own job limits, so each is played out alone */
+  for( gameEntry = LLPoolFirstEntry( conf->games );
+       gameEntry != NULL; gameEntry = LLPoolNextEntry( gameEntry ) ) {
+    const GameConfig *gameConf
+      = (const GameConfig *)LLPoolGetItem( gameEntry );
+
+    if( gameConf->throughput.numJobs == 0 ) {
+
+      continue;
+    }
+    g = 0;
+    for( i = 0; i < n; ++i ) {
+
+      if( estimates[ i ].match->gameConf == gameConf ) {
+
+	gameEstimates[ g ] = estimates[ i ];
+	++g;
+      }
+    }
+    if( g == 0 ) {
+
+      continue;
+    }
+    estimateGameQueue( serv, gameConf, gameEstimates, g );
+    g = 0;
+    for( i = 0; i < n; ++i ) {
+
+      if( estimates[ i ].match->gameConf == gameConf ) {
+
+	estimates[ i ].start = gameEstimates[ g ].start;
+	estimates[ i ].finish = gameEstimates[ g ].finish;
+	++g;
+      }
+    }
+  }
+
+  /* a tournament is one line, with the runs of all its matches, from
+     the first start to the last finish */
+  groups = newHashTable( HASH_DEFAULT_BUCKETS );
+  for( i = 0; i < n; ++i ) {
+    const Match *match = estimates[ i ].match;
+    QueueEstimate *lead;
+
+    estimates[ i ].shownRuns = match->numRuns;
+    estimates[ i ].isShownRunning = match->isRunning && !match->sched.isPaused;
+    estimates[ i ].isShownPaused = match->sched.isPaused;
+    if( match->groupID == 0 ) {
+
+      continue;
+    }
+    lead = (QueueEstimate *)hashFindInt( groups, match->groupID );
+    if( lead == NULL ) {
+
+      hashAddInt( groups, match->groupID, &estimates[ i ] );
+      continue;
+    }
+    lead->shownRuns += match->numRuns;
+    lead->isShownRunning |= match->isRunning && !match->sched.isPaused;
+    lead->isShownPaused |= match->sched.isPaused;
+    if( estimates[ i ].start >= 0
+	&& ( lead->start < 0 || estimates[ i ].start < lead->start ) ) {
+
+      lead->start = estimates[ i ].start;
+    }
+    if( lead->finish >= 0
+	&& ( estimates[ i ].finish < 0
+	     || estimates[ i ].finish > lead->finish ) ) {
+
+      lead->finish = estimates[ i ].finish;
+    }
+    estimates[ i ].shownRuns = -1;
+  }
+
+  for( i = 0; i < n; ++i ) {
+    const Match *match = estimates[ i ].match;
+
+    if( estimates[ i ].shownRuns < 0 ) {
+
+      continue;
+    }
+    if( estimates[ i ].isShownRunning ) {
+
+      snprintf( start, sizeof( start ), "running" );
+    } else if( estimates[ i ].isShownPaused ) {
+
+      snprintf( start, sizeof( start ), "paused" );
+    } else {
+
+      formatEstimate( estimates[ i ].start, start, sizeof( start ) );
+    }
+    formatEstimate( estimates[ i ].finish, finish, sizeof( finish ) );
+    r = snprintf( line,
+		  sizeof( line ),
+		  "%s %s %s * %d %s %s %s %s\n",
+		  match->user->name,
+		  match->tag,
+		  match->gameConf->gameFile,
+		  estimates[ i ].shownRuns,
+		  estimates[ i ].isShownRunning ? "R"
+		  : estimates[ i ].isShownPaused ? "P" : "Q",
+		  start,
+		  finish,
+		  priorityNames[ match->priority ] );
+    assert( r > 0 );
+    r = write( fd, line, r );
+  }
+
+  destroyHashTable( groups );
+  free( estimates );
+  free( gameEstimates );
+}
+
+/* list the statistics for the user's tags, or just for tag if it isn't
+   NULL - each line is "tag pairing runs hands", followed by
+   "name mean variance ciLow ciHigh" for each player, where values are
+   per hand and the interval is the 95% normal interval for the mean */
+void writeResults( const ServerState *serv,
+		   const UserSpec *user,
+		   const char *tag,
+		   int fd )
+{
+  int p, len, found;
+  double variance, halfWidth;
+  LLPoolEntry *cur;
+  const char *name, *nameEnd;
+  char line[ READBUF_LEN * 4 ];
+
+  found = 0;
+  for( cur = LLPoolFirstEntry( serv->results );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    ResultStats *stats = (ResultStats *)LLPoolGetItem( cur );
+
+    if( stats->user != user->name
+	|| ( tag != NULL && strcmp( stats->tag, tag ) ) ) {
+
+      continue;
+    }
+    found = 1;
+
+    len = snprintf( line, sizeof( line ), "%s %s %"PRIu32" %"PRIu64,
+		    stats->tag, stats->pairing, stats->runs, stats->hands );
+    name = stats->pairing;
+    for( p = 0; p < stats->numPlayers && len < sizeof( line ); ++p ) {
+
+      nameEnd = strchr( name, '|' );
+      if( nameEnd == NULL ) {
+
+	nameEnd = name + strlen( name );
+      }
+      variance = stats->runs > 1 ? stats->m2[ p ] / ( stats->runs - 1 ) : 0.0;
+      halfWidth = 1.96 * sqrt( variance / stats->runs );
+      len += snprintf( &line[ len ], sizeof( line ) - len,
+		       " %.*s %f %f %f %f",
+		       (int)( nameEnd - name ), name,
+		       stats->mean[ p ], variance,
+		       stats->mean[ p ] - halfWidth,
+		       stats->mean[ p ] + halfWidth );
+      name = *nameEnd ? nameEnd + 1 : nameEnd;
+    }
+    if( len >= sizeof( line ) - 1 ) {
+
+      len = sizeof( line ) - 2;
+    }
+    line[ len ] = '\n';
+    ++len;
+    if( write( fd, line, len ) < len ) {
+
+      fprintf( stderr, "BM_ERROR: short write to connection\n" );
+      return;
+    }
+  }
+
+  if( !found && write( fd, "No results\n", 11 ) < 11 ) {
+
+    fprintf( stderr, "BM_ERROR: short write to connection\n" );
+  }
+}
+
+/* index of the name between name and nameEnd in names, adding it if it
+   isn't there yet */
+int crosstableIndex( char **names,
+		     int *numNames,
+		     const char *name,
+		     const char *nameEnd )
+{
+  int i;
+
+  for( i = 0; i < *numNames; ++i ) {
+
+    if( !strncmp( names[ i ], name, nameEnd - name )
+	&& names[ i ][ nameEnd - name ] == 0 ) {
+
+      return i;
+    }
+  }
+  names[ i ] = strndup( name, nameEnd - name );
+  assert( names[ i ] != 0 );
+  ++*numNames;
+  return i;
+}
+
+/* table of how each player in the user's tag did against each other
+   player, over every pairing and seating - a "tag name ... all" header,
+   then a "name value ... value" line for each player, where a value is
+   the player's mean per hand over runs the column player was also in,
+   or "-" if there were none, and the last column is over all runs */
+void writeCrosstable( const ServerState *serv,
+		      const UserSpec *user,
+		      const char *tag,
+		      int fd )
+{
+  int p, q, i, j, n, numNames, maxNames, len, lineSize;
+  int seats[ MAX_PLAYERS ];
+  double *sums, *weights;
+  char **names, *line;
+  const char *name, *nameEnd;
+  LLPoolEntry *cur;
+
+  maxNames = 0;
+  for( cur = LLPoolFirstEntry( serv->results );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    const ResultStats *stats = (const ResultStats *)LLPoolGetItem( cur );
+
+    if( stats->user == user->name && !strcmp( stats->tag, tag ) ) {
+
+      maxNames += stats->numPlayers;
+    }
+  }
+  if( maxNames == 0 ) {
+
+    if( write( fd, "No results\n", 11 ) < 11 ) {
+
+      fprintf( stderr, "BM_ERROR: short write to connection\n" );
+    }
+    return;
+  }
+
+  /* the last column of each row is the player against everyone */
+  names = (char **)malloc( sizeof( char * ) * maxNames );
+  sums = (double *)calloc( maxNames * ( maxNames + 1 ), sizeof( double ) );
+  weights = (double *)calloc( maxNames * ( maxNames + 1 ), sizeof( double ) );
+  assert( names != 0 && sums != 0 && weights != 0 );
+  numNames = 0;
+  lineSize = 64;
+  for( cur = LLPoolFirstEntry( serv->results );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    const ResultStats *stats = (const ResultStats *)LLPoolGetItem( cur );
+
+    if( stats->user != user->name || strcmp( stats->tag, tag ) ) {
+
+      continue;
+    }
+
+    name = stats->pairing;
+    for( p = 0; p < stats->numPlayers; ++p ) {
+
+      nameEnd = strchr( name, '|' );
+      if( nameEnd == NULL ) {
+
+	nameEnd = name + strlen( name );
+      }
+      seats[ p ] = crosstableIndex( names, &numNames, name, nameEnd );
+      if( nameEnd - name + 32 > lineSize ) {
+
+	lineSize = nameEnd - name + 32;
+      }
+      name = *nameEnd ? nameEnd + 1 : nameEnd;
+    }
+
+    /* means are over runs, so runs are the weights */
+    for( p = 0; p < stats->numPlayers; ++p ) {
+
+      i = seats[ p ] * ( maxNames + 1 );
+      for( q = 0; q < stats->numPlayers; ++q ) {
+
+	if( seats[ q ] != seats[ p ] ) {
+
+	  sums[ i + seats[ q ] ] += stats->mean[ p ] * stats->runs;
+	  weights[ i + seats[ q ] ] += stats->runs;
+	}
+      }
+      sums[ i + maxNames ] += stats->mean[ p ] * stats->runs;
+      weights[ i + maxNames ] += stats->runs;
+    }
+  }
+
+  lineSize *= numNames + 2;
+  line = (char *)malloc( lineSize );
+  assert( line != 0 );
+  len = snprintf( line, lineSize, "%s", tag );
+  for( j = 0; j < numNames; ++j ) {
+
+    len += snprintf( &line[ len ], lineSize - len, " %s", names[ j ] );
+  }
+  len += snprintf( &line[ len ], lineSize - len, " all\n" );
+  n = write( fd, line, len );
+  for( i = 0; i < numNames && n == len; ++i ) {
+
+    len = snprintf( line, lineSize, "%s", names[ i ] );
+    for( j = 0; j <= numNames; ++j ) {
+
+      q = i * ( maxNames + 1 ) + ( j < numNames ? j : maxNames );
+      if( weights[ q ] > 0.0 ) {
+
+	len += snprintf( &line[ len ], lineSize - len,
+			 " %f", sums[ q ] / weights[ q ] );
+      } else {
+
+	len += snprintf( &line[ len ], lineSize - len, " -" );
+      }
+    }
+    len += snprintf( &line[ len ], lineSize - len, "\n" );
+    n = write( fd, line, len );
+  }
+  if( n < len ) {
+
+    fprintf( stderr, "BM_ERROR: short write to connection\n" );
+  }
+
+  for( i = 0; i < numNames; ++i ) {
+
+    free( names[ i ] );
+  }
+  free( names );
+  free( sums );
+  free( weights );
+  free( line );
+}
+
+/* which part of a ProcUsage a usage metric shows */
+#define USAGE_USER_SECS 0
+#define USAGE_SYS_SECS 1
+#define USAGE_MAX_RSS 2
+#define USAGE_VOL_SWITCHES 3
+#define USAGE_INVOL_SWITCHES 4
+#define USAGE_PROCS 5
+
+double procUsageField( const ProcUsage *usage, const int field )
+{
+  switch( field ) {
+  case USAGE_USER_SECS:
+    return usage->userSecs;
+  case USAGE_SYS_SECS:
+    return usage->sysSecs;
+  case USAGE_MAX_RSS:
+    return usage->maxRSSKB;
+  case USAGE_VOL_SWITCHES:
+    return usage->volCtxSwitches;
+  case USAGE_INVOL_SWITCHES:
+    return usage->involCtxSwitches;
+  default:
+    return usage->numProcs;
+  }
+}
+
+/* one line of the metric for the dealers and each bot of every game,
+   with extra labels (which start with a ',') */
+void writeUsageMetric( const ServerState *serv,
+		       MetricsText *text,
+		       const char *name,
+		       const char *labels,
+		       const int field )
+{
+  LLPoolEntry *cur, *botCur;
+
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    const GameConfig *gameConf = (const GameConfig *)LLPoolGetItem( cur );
+
+    metricsPrintf( text, "%s{game=\"%s\",process=\"dealer\"%s} %.15g\n",
+		   name, gameConf->gameFile, labels,
+		   procUsageField( &gameConf->dealerUsage, field ) );
+    for( botCur = LLPoolFirstEntry( gameConf->bots );
+	 botCur != NULL; botCur = LLPoolNextEntry( botCur ) ) {
+      const BotSpec *bot = (const BotSpec *)LLPoolGetItem( botCur );
+
+      metricsPrintf( text,
+		     "%s{game=\"%s\",process=\"bot\",bot=\"%s\"%s} %.15g\n",
+		     name, gameConf->gameFile, bot->name, labels,
+		     procUsageField( &bot->usage, field ) );
+    }
+  }
+}
+
+/* bytes held by one of the pools with a memory cap */
+size_t memoryPoolBytes( const ServerState *serv, const int pool )
+{
+  switch( pool ) {
+  case BM_MEMORY_CONNS:
+    return LLPoolBytesHeld( serv->conns );
+  case BM_MEMORY_MATCHES:
+    return LLPoolBytesHeld( serv->matches );
+  case BM_MEMORY_JOBS:
+    return LLPoolBytesHeld( serv->jobs );
+  default:
+    return arenaBytesHeld( &serv->strings );
+  }
+}
+
+/* current state of the server in the Prometheus text format */
+void writeMetrics( const ServerState *serv, MetricsText *text )
+{
+  int k;
+  uint64_t queuedRuns;
+  LLPoolEntry *cur, *m;
+  GameConfig *gameConf;
+  int conns[ STATUS_AGENT + 1 ], jobs[ JOB_RUNNING + 1 ], pausedJobs;
+
+  metricsHeader( text, "bm_queued_matches", "gauge",
+		 "Matches waiting for a run to start" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    metricsPrintf( text, "bm_queued_matches{game=\"%s\"} %d\n",
+		   gameConf->gameFile, gameConf->sched.numQueued );
+  }
+
+  metricsHeader( text, "bm_queued_runs", "gauge",
+		 "Runs left to start, over all matches" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    queuedRuns = 0;
+    for( m = LLPoolFirstEntry( serv->matches );
+	 m != NULL; m = LLPoolNextEntry( m ) ) {
+      Match *match = (Match *)LLPoolGetItem( m );
+
+      if( match->gameConf == gameConf ) {
+
+	queuedRuns += match->numRuns;
+      }
+    }
+    metricsPrintf( text, "bm_queued_runs{game=\"%s\"} %"PRIu64"\n",
+		   gameConf->gameFile, queuedRuns );
+  }
+
+  metricsHeader( text, "bm_running_jobs", "gauge", "Jobs running" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    metricsPrintf( text, "bm_running_jobs{game=\"%s\"} %d\n",
+		   gameConf->gameFile, gameConf->sched.curRunningJobs );
+  }
+
+  metricsHeader( text, "bm_max_running_jobs", "gauge",
+		 "maxRunningJobs from the config, 0 for no limit" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    metricsPrintf( text, "bm_max_running_jobs{game=\"%s\"} %"PRIu16"\n",
+		   gameConf->gameFile, gameConf->maxRunningJobs );
+  }
+
+  for( k = 0; k <= JOB_RUNNING; ++k ) {
+
+    jobs[ k ] = 0;
+  }
+  pausedJobs = 0;
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
+
+    if( job->state <= JOB_RUNNING ) {
+
+      ++jobs[ job->state ];
+    }
+    pausedJobs += job->isPaused;
+  }
+  metricsHeader( text, "bm_jobs", "gauge",
+		 "Jobs waiting on their dealer, playing, or paused" );
+  metricsPrintf( text, "bm_jobs{state=\"launching\"} %d\n",
+		 jobs[ JOB_LAUNCHING ] );
+  metricsPrintf( text, "bm_jobs{state=\"running\"} %d\n",
+		 jobs[ JOB_RUNNING ] - pausedJobs );
+  metricsPrintf( text, "bm_jobs{state=\"paused\"} %d\n", pausedJobs );
+  metricsHeader( text, "bm_preemptions_total", "counter",
+		 "Jobs paused for a match of a higher class" );
+  metricsPrintf( text, "bm_preemptions_total %"PRIu64"\n", serv->preemptions );
+
+  metricsHeader( text, "bm_running_bots", "gauge",
+		 "Bots of running jobs on this machine" );
+  metricsPrintf( text, "bm_running_bots %d\n", serv->sched.curRunningBots );
+  metricsHeader( text, "bm_max_running_bots", "gauge",
+		 "maxRunningBots from the config, 0 for no limit" );
+  metricsPrintf( text, "bm_max_running_bots %"PRIu16"\n",
+		 serv->conf->maxRunningBots );
+
+  if( serv->conf->adaptiveConcurrency ) {
+
+    metricsHeader( text, "bm_adaptive_bot_limit", "gauge",
+		   "Running bots allowed by adaptiveConcurrency" );
+    metricsPrintf( text, "bm_adaptive_bot_limit %d\n", serv->adapt.limit );
+    metricsHeader( text, "bm_cpu_idle_ratio", "gauge",
+		   "Share of CPU time idle at the last adaptive update, -1 if unknown" );
+    metricsPrintf( text, "bm_cpu_idle_ratio %g\n", serv->adapt.idleShare );
+    metricsHeader( text, "bm_bot_latency_ratio", "gauge",
+		   "Worst running bot's mean response time over its best, -1 if unknown" );
+    metricsPrintf( text, "bm_bot_latency_ratio %g\n",
+		   serv->adapt.latencyRatio );
+  }
+
+  metricsHeader( text, "bm_job_duration_seconds", "histogram",
+		 "Wall clock time of finished jobs" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    char labels[ READBUF_LEN ];
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    snprintf( labels, sizeof( labels ), "game=\"%s\"", gameConf->gameFile );
+    metricsHistogram( text, "bm_job_duration_seconds", labels,
+		      &gameConf->jobSecs );
+  }
+
+  metricsHeader( text, "bm_job_hands_per_second", "histogram",
+		 "Hands played per second by finished jobs" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    char labels[ READBUF_LEN ];
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    snprintf( labels, sizeof( labels ), "game=\"%s\"", gameConf->gameFile );
+    metricsHistogram( text, "bm_job_hands_per_second", labels,
+		      &gameConf->handsPerSec );
+  }
+
+  for( k = 0; k <= STATUS_AGENT; ++k ) {
+
+    conns[ k ] = 0;
+  }
+  for( cur = LLPoolFirstEntry( serv->conns );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+    ++conns[ ( (Connection *)LLPoolGetItem( cur ) )->status ];
+  }
+  metricsHeader( text, "bm_connections", "gauge",
+		 "Open connections to the server port" );
+  metricsPrintf( text, "bm_connections{state=\"unvalidated\"} %d\n",
+		 conns[ STATUS_UNVALIDATED ] );
+  metricsPrintf( text, "bm_connections{state=\"user\"} %d\n",
+		 conns[ STATUS_OKAY ] );
+  metricsPrintf( text, "bm_connections{state=\"agent\"} %d\n",
+		 conns[ STATUS_AGENT ] );
+
+  if( serv->cache.dir ) {
+
+    metricsHeader( text, "bm_cache_lookups_total", "counter",
+		   "Runs looked up in the result cache" );
+    metricsPrintf( text, "bm_cache_lookups_total{result=\"hit\"} %"PRIu64"\n",
+		   serv->cacheHits );
+    metricsPrintf( text, "bm_cache_lookups_total{result=\"miss\"} %"PRIu64"\n",
+		   serv->cacheMisses );
+  }
+
+  if( serv->conf->compressLogs ) {
+
+    metricsHeader( text, "bm_pending_logs", "gauge",
+		   "Finished logs waiting to be compressed" );
+    metricsPrintf( text, "bm_pending_logs %d\n",
+		   serv->pendingLogs->numEntries );
+  }
+
+  metricsHeader( text, "bm_dealer_launch_failures_total", "counter",
+		 "Dealers which could not be started" );
+  for( k = 0; k < BM_NUM_LAUNCH_KINDS; ++k ) {
+
+    metricsPrintf( text,
+		   "bm_dealer_launch_failures_total{via=\"%s\"} %"PRIu64"\n",
+		   launchKindNames[ k ], serv->launchFailures[ k ] );
+  }
+
+  metricsHeader( text, "bm_memory_bytes", "gauge",
+		 "Memory held for connections, matches, jobs and tags" );
+  for( k = 0; k < BM_NUM_MEMORY_POOLS; ++k ) {
+
+    metricsPrintf( text, "bm_memory_bytes{pool=\"%s\"} %zu\n",
+		   memoryPoolNames[ k ], memoryPoolBytes( serv, k ) );
+  }
+  metricsHeader( text, "bm_memory_limit_bytes", "gauge",
+		 "memoryLimitMB from the config, 0 for no limit" );
+  for( k = 0; k < BM_NUM_MEMORY_POOLS; ++k ) {
+
+    metricsPrintf( text, "bm_memory_limit_bytes{pool=\"%s\"} %zu\n",
+		   memoryPoolNames[ k ], serv->conf->memoryLimits[ k ] );
+  }
+  metricsHeader( text, "bm_memory_refusals_total", "counter",
+		 "Connections, match requests and job starts held back by a full pool" );
+  for( k = 0; k < BM_NUM_MEMORY_POOLS; ++k ) {
+
+    metricsPrintf( text,
+		   "bm_memory_refusals_total{pool=\"%s\"} %"PRIu64"\n",
+		   memoryPoolNames[ k ], serv->memoryRefusals[ k ] );
+  }
+
+  metricsHeader( text, "bm_job_outcomes_total", "counter",
+		 "Finished jobs, by how they ended" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    for( k = 0; k < BM_NUM_OUTCOMES; ++k ) {
+
+      metricsPrintf( text,
+		     "bm_job_outcomes_total{game=\"%s\",outcome=\"%s\"} %"PRIu64"\n",
+		     gameConf->gameFile, outcomeNames[ k ],
+		     gameConf->outcomes[ k ] );
+    }
+  }
+
+  metricsHeader( text, "bm_bot_limit_hits_total", "counter",
+		 "Jobs in which a bot went over one of its resource limits" );
+  for( cur = LLPoolFirstEntry( serv->conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    for( m = LLPoolFirstEntry( gameConf->bots );
+	 m != NULL; m = LLPoolNextEntry( m ) ) {
+      const BotSpec *bot = (const BotSpec *)LLPoolGetItem( m );
+
+      for( k = 0; k < BM_NUM_LIMITS; ++k ) {
+
+	metricsPrintf( text,
+		       "bm_bot_limit_hits_total{game=\"%s\",bot=\"%s\",limit=\"%s\"} %"PRIu64"\n",
+		       gameConf->gameFile, bot->name, limitNames[ k ],
+		       bot->limitHits[ k ] );
+      }
+    }
+  }
+
+  /* usage of finished local jobs' dealers and bots */
+  metricsHeader( text, "bm_process_runs_total", "counter",
+		 "Dealer and bot processes of finished jobs with known usage" );
+  writeUsageMetric( serv, text, "bm_process_runs_total", "", USAGE_PROCS );
+  metricsHeader( text, "bm_process_cpu_seconds_total", "counter",
+		 "CPU time of dealers and bots of finished jobs" );
+  writeUsageMetric( serv, text, "bm_process_cpu_seconds_total",
+		    ",mode=\"user\"", USAGE_USER_SECS );
+  writeUsageMetric( serv, text, "bm_process_cpu_seconds_total",
+		    ",mode=\"system\"", USAGE_SYS_SECS );
+  metricsHeader( text, "bm_process_max_rss_kilobytes", "gauge",
+		 "Largest peak resident memory of a dealer or bot" );
+  writeUsageMetric( serv, text, "bm_process_max_rss_kilobytes", "",
+		    USAGE_MAX_RSS );
+  metricsHeader( text, "bm_process_context_switches_total", "counter",
+		 "Context switches of dealers and bots of finished jobs" );
+  writeUsageMetric( serv, text, "bm_process_context_switches_total",
+		    ",kind=\"voluntary\"", USAGE_VOL_SWITCHES );
+  writeUsageMetric( serv, text, "bm_process_context_switches_total",
+		    ",kind=\"involuntary\"", USAGE_INVOL_SWITCHES );
+}
+
+/* turn a logged on connection into a worker agent
+   line is "AGENT name host cores memoryMB [bot ...]", where host "-" is
+   the address the agent connected from, and no bots (or "*") means the
+   agent can run any bot
+   returns 0 on success, -1 on failure */
+int registerAgent( ServerState *serv,
+		   LLPoolEntry *connEntry,
+		   const char *line )
+{
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+  Agent agent;
+  int pos, t;
+  const char *botName;
+  struct sockaddr_in addr;
+  socklen_t addrLen;
+  char name[ READBUF_LEN ], host[ READBUF_LEN ], bot[ READBUF_LEN ];
+
+  if( sscanf( line,
+	      " %s %s %"SCNu16" %"SCNu32"%n",
+	      name,
+	      host,
+	      &agent.cores,
+	      &agent.memoryMB,
+	      &pos ) < 4 ) {
+
+    return -1;
+  }
+
+  if( !strcmp( host, "-" ) ) {
+
+    addrLen = sizeof( addr );
+    if( getpeername( conn->connBuf->fd, (struct sockaddr *)&addr, &addrLen ) < 0
+	|| inet_ntop( AF_INET, &addr.sin_addr, host, sizeof( host ) ) == NULL ) {
+
+      return -1;
+    }
+  }
+
+  agent.bots = NULL;
+  while( sscanf( &line[ pos ], " %s%n", bot, &t ) == 1 ) {
+    pos += t;
+
+    if( !strcmp( bot, "*" ) ) {
+
+      continue;
+    }
+    if( agent.bots == NULL ) {
+
+      agent.bots = newHashTable( HASH_DEFAULT_BUCKETS );
+    }
+    botName = internString( bot );
+    hashAddString( agent.bots, botName, (void *)botName );
+  }
+
+  agent.name = internString( name );
+  agent.host = strdup( host );
+  agent.connEntry = connEntry;
+  agent.freeCores = agent.cores;
+  agent.freeMemoryMB = agent.memoryMB;
+  agent.jobs = newHashTable( HASH_DEFAULT_BUCKETS );
+  conn->agentEntry = LLPoolAddItem( serv->agents, &agent );
+  conn->status = STATUS_AGENT;
+
+  /* more room to run jobs */
+  serv->needSchedule = 1;
+  return 0;
+}
+
+/* wall clock time, in seconds, for the trace */
+double traceNow()
+{
+  struct timeval now;
+
+  gettimeofday( &now, NULL );
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+/* trace "SUBMIT time id user game numBots numRuns priority" for a newly
+   queued match - see bm_sim */
+void traceSubmit( ServerState *serv, const Match *match )
+{
+  if( serv->trace == NULL ) {
+
+    return;
+  }
+  fprintf( serv->trace, "SUBMIT %.6f %"PRIu32" %s %s %d %d %d\n",
+	   traceNow(), match->id, match->user->name,
+	   match->gameConf->gameFile, botsInMatch( match ), match->numRuns,
+	   match->priority );
+  fflush( serv->trace );
+}
+
+/* trace "RUN time id secs cpuSecs" for a finished run of a match */
+void traceRun( ServerState *serv, const MatchJob *job, const Match *match )
+{
+  if( serv->trace == NULL ) {
+
+    return;
+  }
+  fprintf( serv->trace, "RUN %.6f %"PRIu32" %.6f %.6f\n",
+	   traceNow(), match->id, jobRunMicros( job ) / 1e6, job->cpuSecs );
+  fflush( serv->trace );
+}
+
+/* non-zero if numMatches more matches with tags up to tagLen long fit
+   under the memory caps, otherwise the refusal is counted against the
+   pool which is full */
+int hasMatchRoom( ServerState *serv,
+		  const size_t numMatches,
+		  const size_t tagLen )
+{
+  if( LLPoolRoom( serv->matches ) < numMatches ) {
+
+    ++serv->memoryRefusals[ BM_MEMORY_MATCHES ];
+    return 0;
+  }
+  if( !arenaHasRoom( &serv->strings, tagLen, numMatches ) ) {
+
+    ++serv->memoryRefusals[ BM_MEMORY_STRINGS ];
+    return 0;
+  }
+  return 1;
+}
+
+void replayCachedRuns( const Config *conf,
+		       ServerState *serv,
+		       LLPoolEntry *matchEntry );
+
+/* put match, filled in by parseMatchSpec, in the queue
+   a match with no runs is dropped straight away */
+void submitMatch( ServerState *serv, const Match *match )
+{
+  LLPoolEntry *matchEntry;
+  Match *m;
+
+  matchEntry = LLPoolAddItem( serv->matches, (void *)match );
+
+  /* the scheduler keeps pointers, so set it up in the pool copy */
+  m = (Match *)LLPoolGetItem( matchEntry );
+  m->isRunning = 0;
+  initSchedEntry( &m->sched,
+		  &m->user->sched,
+		  &m->gameConf->sched,
+		  botsInMatch( m ),
+		  matchEntry );
+  m->sched.priority = m->priority;
+  if( m->numRuns > 0 ) {
+
+    ++serv->lastMatchID;
+    m->id = serv->lastMatchID;
+    traceSubmit( serv, m );
+    if( serv->journal.fd >= 0 && botsInMatch( m ) == m->gameConf->game->numPlayers ) {
+
+      if( journalSubmit( &serv->journal, m ) < 0 ) {
+
+	fprintf( stderr, "BM_WARNING: could not journal match %"PRIu32"\n",
+		 m->id );
+      } else {
+
+	m->isJournaled = 1;
+	++serv->numJournaledMatches;
+	checkJournalSize( serv );
+      }
+    }
+
+    schedEnqueue( &serv->sched, &m->sched );
+    serv->needSchedule = 1;
+
+    /* a resubmitted match gets its cached runs back straight away */
+    replayCachedRuns( serv->conf, serv, matchEntry );
+  } else {
+
+    removeMatch( serv, matchEntry );
+  }
+}
+
+/* step perm to the next ordering of its n values, in lexicographic order
+   returns 0 once every ordering has been seen, 1 otherwise */
+int nextPermutation( int *perm, const int n )
+{
+  int i, j, t;
+
+  for( i = n - 2; i >= 0 && perm[ i ] >= perm[ i + 1 ]; --i );
+  if( i < 0 ) {
+
+    return 0;
+  }
+  for( j = n - 1; perm[ j ] <= perm[ i ]; --j );
+  t = perm[ i ];
+  perm[ i ] = perm[ j ];
+  perm[ j ] = t;
+  for( ++i, j = n - 1; i < j; ++i, --j ) {
+
+    t = perm[ i ];
+    perm[ i ] = perm[ j ];
+    perm[ j ] = t;
+  }
+  return 1;
+}
+
+/* queue a round robin between the bots in spec, which is
+   "game #runs tag rngSeed #hands duplicate|rotate bot ...", for user
+   every set of bots the size of the game plays one match in each
+   seating with duplicate, or in each rotation of the seats otherwise.
+   every match is seeded the same, so run i of each match is dealt the
+   same cards, and the matches are grouped under the first one's ID.
+   the matches share the tag and run side by side, so each run's score
+   comes from its own output in BM_RUN_LOGDIR, never the tag's log
+   returns the number of matches queued, -1 on failure, or -2 if the
+   matches don't fit under the memory caps */
+int submitTournament( const Config *conf,
+		      ServerState *serv,
+		      const char *spec,
+		      const UserSpec *user )
+{
+  int pos, t, i, k, n, numSeatings, numMatches, isDuplicate;
+  int combo[ MAX_PLAYERS ], seating[ MAX_PLAYERS ];
+  uint32_t rngSeed, numHands, groupID;
+  LLPoolEntry *entry, **bots;
+  Match match;
+  char tag[ READBUF_LEN ], name[ READBUF_LEN ];
+
+  if( sscanf( spec, " %s%n", name, &pos ) < 1
+      || ( entry = findGame( conf, name ) ) == NULL ) {
+
+    return -1;
+  }
+  memset( &match, 0, sizeof( match ) );
+  match.gameConf = (GameConfig *)LLPoolGetItem( entry );
+  match.user = (UserSpec *)user;
+  k = match.gameConf->game->numPlayers;
 
   if( sscanf( &spec[ pos ],
-	      " %d %s %"SCNu32" %n",
-	      &match->numRuns,
+	      " %d %s %"SCNu32" %"SCNu32" %s%n",
+	      &match.numRuns,
 	      tag,
 	      &rngSeed,
-	      &t ) < 3 ) {
+	      &numHands,
+	      name,
+	      &t ) < 5 ) {
+
+    return -1;
+  }
+  pos += t;
+  if( match.numRuns < 1 || match.numRuns > match.gameConf->maxMatchRuns
+      || strchr( tag, '/' ) != NULL
+      || numHands > match.gameConf->matchHands ) {
+
+    return -1;
+  }
+  if( !strcasecmp( name, "duplicate" ) ) {
+
+    isDuplicate = 1;
+  } else if( !strcasecmp( name, "rotate" ) ) {
+
+    isDuplicate = 0;
+  } else {
+
+    return -1;
+  }
+
+  /* each bot can only be entered once */
+  bots = (LLPoolEntry **)malloc( sizeof( LLPoolEntry * )
+				 * ( match.gameConf->bots->numEntries + 1 ) );
+  assert( bots != 0 );
+  n = 0;
+  while( sscanf( &spec[ pos ], " %s%n", name, &t ) == 1 ) {
+
+    pos += t;
+    entry = findBot( match.gameConf, name );
+    for( i = 0; i < n && bots[ i ] != entry; ++i );
+    if( entry == NULL || i < n ) {
+
+      free( bots );
+      return -1;
+    }
+    bots[ n ] = entry;
+    ++n;
+  }
+  if( n < k ) {
+
+    free( bots );
+    return -1;
+  }
+
+  /* n choose k sets of bots, checking the size as it goes */
+  numSeatings = k;
+  if( isDuplicate ) {
+
+    for( i = 2; i < k; ++i ) {
+
+      numSeatings *= i;
+    }
+  }
+  numMatches = numSeatings;
+  for( i = 0; i < k && numMatches <= BM_MAX_TOURNAMENT_MATCHES; ++i ) {
+
+    numMatches = (int64_t)numMatches * ( n - i ) / ( i + 1 );
+  }
+  if( numMatches > BM_MAX_TOURNAMENT_MATCHES ) {
+
+    free( bots );
+    return -1;
+  }
+  if( !hasMatchRoom( serv, numMatches, strlen( tag ) ) ) {
+
+    free( bots );
+    return -2;
+  }
+
+  /* one deck schedule for the whole group */
+  if( rngSeed == 0 ) {
+
+    do {
+
+      rngSeed = genrand_int32( &serv->rng );
+    } while( rngSeed == 0 );
+  }
+  match.numHands = numHands ? numHands : match.gameConf->matchHands;
+  match.priority = BM_PRIORITY_NORMAL;
+  groupID = serv->lastMatchID + 1;
+
+  for( i = 0; i < k; ++i ) {
+
+    combo[ i ] = i;
+  }
+  while( 1 ) {
+
+    for( i = 0; i < k; ++i ) {
+
+      seating[ i ] = i;
+    }
+    for( t = 0; t < numSeatings; ++t ) {
+
+      for( i = 0; i < k; ++i ) {
+
+	match.players[ i ].isNetworkPlayer = 0;
+	match.players[ i ].entry
+	  = bots[ combo[ isDuplicate ? seating[ i ] : ( i + t ) % k ] ];
+      }
+      match.tag = arenaStrdup( &serv->strings, tag );
+      match.groupID = groupID;
+      setMatchSeed( serv, &match, rngSeed );
+      submitMatch( serv, &match );
+
+      if( isDuplicate ) {
+
+	nextPermutation( seating, k );
+      }
+    }
+
+    /* next set of bots */
+    for( i = k - 1; i >= 0 && combo[ i ] == n - k + i; --i );
+    if( i < 0 ) {
+
+      break;
+    }
+    ++combo[ i ];
+    for( ++i; i < k; ++i ) {
+
+      combo[ i ] = combo[ i - 1 ] + 1;
+    }
+  }
+
+  free( bots );
+  return numMatches;
+}
+
+void handleAgentMessage( ServerState *serv,
+			 LLPoolEntry *connEntry,
+			 char *line );
+int startLogTransfer( ServerState *serv,
+		      LLPoolEntry *connEntry,
+		      const char *tag,
+		      const char *suffix );
+
+void handleConnection( Config *conf, ServerState *serv,
+		       LLPoolEntry *connEntry )
+{
+  int r;
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+  char line[ READBUF_LEN ];
+
+  while( ( r = getLine( conn->connBuf, READBUF_LEN, line, 0 ) ) >= 0 ) {
+
+    if( r == 0 ) {
+
+      closeConnection( serv, connEntry );
+      return;
+    }
+
+    if( conn->status == STATUS_UNVALIDATED ) {
+      UserSpec *user;
+
+      user = validateLogon( conf, line );
+      if( user == NULL ) {
+	/* couldn't authenticate */
+
+	r = write( conn->connBuf->fd, "BAD LOGON\n", 10 );
+	fprintf( stderr, "BM_ERROR: connection failed to log in\n" );
+	closeConnection( serv, connEntry );
+	return;
+      }
+
+      /* send an okay message */
+      r = write( conn->connBuf->fd, "LOGON OKAY - type help for commands\n", 36 );
+
+      /* connection status is now okay */
+      conn->user = user;
+      conn->status = STATUS_OKAY;
+      continue;
+    }
+
+    if( conn->status == STATUS_AGENT ) {
+
+      handleAgentMessage( serv, connEntry, line );
+      continue;
+    }
+
+    if( !strncasecmp( line, "HELP", 4 ) ) {
+
+      writeHelpMessage( conn->connBuf->fd );
+    } else if( !strncasecmp( line, "GAMES", 5 ) ) {
+
+      writeGameList( conf, conn->connBuf->fd );
+    } else if( !strncasecmp( line, "QSTAT", 5 ) ) {
+
+      writeQueueStatus( conf, serv, conn->connBuf->fd );
+    } else if( !strncasecmp( line, "RESULTS", 7 ) ) {
+      char tag[ READBUF_LEN ];
+
+      writeResults( serv,
+		    conn->user,
+		    sscanf( &line[ 7 ], " %s", tag ) == 1 ? tag : NULL,
+		    conn->connBuf->fd );
+    } else if( !strncasecmp( line, "GETLOG", 6 ) ) {
+      char tag[ READBUF_LEN ], suffix[ READBUF_LEN ];
+      LLPoolEntry *cur;
+
+      r = sscanf( &line[ 6 ], " %s %s", tag, suffix );
+      if( r < 1 || strchr( tag, '/' ) || tag[ 0 ] == '.'
+	  || ( r == 2 && strcmp( suffix, "log" )
+	       && strcmp( suffix, "stderr" ) ) ) {
+
+	fprintf( stderr, "BM_ERROR: bad GETLOG command: %s", line );
+	r = write( conn->connBuf->fd, "BAD GETLOG COMMAND\n", 19 );
+	continue;
+      }
+
+      /* a player's connection gets told where to connect at any time,
+	 which would land in the middle of the log */
+      for( cur = LLPoolFirstEntry( serv->matches );
+	   cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+	if( matchUsesConnection( (Match *)LLPoolGetItem( cur ), connEntry ) ) {
+
+	  break;
+	}
+      }
+      if( cur != NULL ) {
+
+	r = write( conn->connBuf->fd, "GETLOG REFUSED - connection has a match with network players\n", 61 );
+	continue;
+      }
+
+      r = startLogTransfer( serv, connEntry, tag, r == 2 ? suffix : "log" );
+      if( r > 0 ) {
+	/* hold off on further commands until the log has gone out */
+
+	return;
+      } else if( r == 0 ) {
+
+	r = write( conn->connBuf->fd, "NO LOG\n", 7 );
+      } else {
+
+	r = write( conn->connBuf->fd, "GETLOG FAILED\n", 14 );
+      }
+    } else if( !strncasecmp( line, "AGENT", 5 ) ) {
+
+      /* agents are sent every user's jobs, and report their results */
+      if( !conn->user->isAgent ) {
+
+	fprintf( stderr, "BM_ERROR: AGENT from %s, which is not an agent "
+		 "user\n", conn->user->name );
+	r = write( conn->connBuf->fd, "BAD AGENT COMMAND\n", 18 );
+	continue;
+      }
+      if( registerAgent( serv, connEntry, &line[ 5 ] ) < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad AGENT command: %s", line );
+	r = write( conn->connBuf->fd, "BAD AGENT COMMAND\n", 18 );
+	continue;
+      }
+      printf( "agent %s registered from %s\n",
+	      ( (Agent *)LLPoolGetItem( conn->agentEntry ) )->name,
+	      ( (Agent *)LLPoolGetItem( conn->agentEntry ) )->host );
+      fflush( stdout );
+      r = write( conn->connBuf->fd, "AGENT OKAY\n", 11 );
+    } else if( !strncasecmp( line, "CROSSTABLE", 10 ) ) {
+      char tag[ READBUF_LEN ];
+
+      if( sscanf( &line[ 10 ], " %s", tag ) < 1 ) {
+
+	r = write( conn->connBuf->fd, "BAD CROSSTABLE COMMAND\n", 23 );
+	continue;
+      }
+      writeCrosstable( serv, conn->user, tag, conn->connBuf->fd );
+    } else if( !strncasecmp( line, "RUNMATCHES", 10 ) ) {
+      Match match;
+      int len;
+      char className[ READBUF_LEN ];
+
+      /* the tag is somewhere in the line */
+      if( !hasMatchRoom( serv, 1, strlen( line ) ) ) {
+
+	r = write( conn->connBuf->fd, "RUNMATCHES REFUSED - server is full\n", 36 );
+	continue;
+      }
+      len = parseMatchSpec( conf, serv, &line[ 10 ], connEntry, &match );
+      if( len < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad RUNMATCHES command: %s", line );
+	r = write( conn->connBuf->fd, "BAD RUNMATCHES COMMAND\n", 23 );
+	continue;
+      }
+
+      /* an optional class follows the players */
+      if( sscanf( &line[ 10 + len ], " %s", className ) == 1
+	  && ( match.priority = priorityFromName( className ) ) < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad RUNMATCHES command: %s", line );
+	r = write( conn->connBuf->fd, "BAD RUNMATCHES COMMAND\n", 23 );
+	arenaStrfree( &serv->strings, match.tag );
+	continue;
+      }
+      if( match.priority == BM_PRIORITY_INTERACTIVE
+	  && conf->interactiveMaxHands
+	  && (uint64_t)match.numRuns * match.numHands
+	  > conf->interactiveMaxHands ) {
+
+	r = write( conn->connBuf->fd, "RUNMATCHES REFUSED - too many hands for interactive\n", 52 );
+	arenaStrfree( &serv->strings, match.tag );
+	continue;
+      }
+      match.user = conn->user;
+      submitMatch( serv, &match );
+    } else if( !strncasecmp( line, "RUNTOURNAMENT", 13 ) ) {
+      char reply[ 64 ];
+
+      r = submitTournament( conf, serv, &line[ 13 ], conn->user );
+      if( r == -2 ) {
+
+	r = write( conn->connBuf->fd, "RUNTOURNAMENT REFUSED - server is full\n", 39 );
+	continue;
+      } else if( r < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad RUNTOURNAMENT command: %s", line );
+	r = write( conn->connBuf->fd, "BAD RUNTOURNAMENT COMMAND\n", 26 );
+	continue;
+      }
+      r = snprintf( reply, sizeof( reply ), "TOURNAMENT OKAY %d matches\n", r );
+      r = write( conn->connBuf->fd, reply, r );
+    } else {
+
+      r = write( conn->connBuf->fd, "UNKNOWN\n", 8 );
+    }
+  }
+}
+
+/* top up the pool of listening sockets handed out to dealers
+   returns 0 if the pool is full, -1 on failure */
+int fillPortPool( const Config *conf, ServerState *serv )
+{
+  int sock;
+  uint16_t port;
+
+  while( serv->portPoolCount < conf->portPoolSize ) {
+
+    port = 0;
+    sock = getListenSocket( &port );
+    if( sock < 0 ) {
+
+      fprintf( stderr, "WARNING: could not add a socket to the port pool\n" );
+      return -1;
+    }
+
+    /* only the dealer the socket is handed to should inherit it */
+    fcntl( sock, F_SETFD, FD_CLOEXEC );
+
+    serv->portPool[ serv->portPoolCount ].sock = sock;
+    serv->portPool[ serv->portPoolCount ].port = port;
+    ++serv->portPoolCount;
+  }
+
+  return 0;
+}
+
+/* throw away any connections made to a pooled socket before its dealer
+   existed - nothing legitimate knew about the port yet */
+void drainListenSocket( int sock )
+{
+  int fd, flags;
+
+  flags = fcntl( sock, F_GETFL );
+  fcntl( sock, F_SETFL, flags | O_NONBLOCK );
+  while( ( fd = accept( sock, NULL, NULL ) ) >= 0 ) {
+
+    close( fd );
+  }
+  fcntl( sock, F_SETFL, flags );
+}
+
+/* take numPlayers sockets from the port pool
+   returns 0 on success, -1 if the pool does not have enough sockets */
+int takePooledPorts( ServerState *serv,
+		     const int numPlayers,
+		     int listenFD[ MAX_PLAYERS ],
+		     uint16_t ports[ MAX_PLAYERS ] )
+{
+  int p;
+
+  if( serv->portPoolCount < numPlayers ) {
+
+    return -1;
+  }
+
+  for( p = 0; p < numPlayers; ++p ) {
+
+    --serv->portPoolCount;
+    listenFD[ p ] = serv->portPool[ serv->portPoolCount ].sock;
+    ports[ p ] = serv->portPool[ serv->portPoolCount ].port;
+    drainListenSocket( listenFD[ p ] );
+  }
+
+  return 0;
+}
+
+/* the server blocks SIGCHLD to read it from a signalfd, and children
+   shouldn't inherit that */
+void resetChildSignals()
+{
+  sigset_t set;
+
+  sigemptyset( &set );
+  sigprocmask( SIG_SETMASK, &set, NULL );
+}
+
+/* the dealer's match name for run runID of tag, which the run's own
+   output files are named after */
+void runMatchName( const char *tag,
+		   const uint32_t runID,
+		   char *name,
+		   const size_t nameSize )
+{
+  snprintf( name, nameSize, "%s/%s.%"PRIu32, BM_RUN_LOGDIR, tag, runID );
+}
+
+/* name of the file run runID of tag writes its output with the given
+   suffix to */
+void runLogName( const char *tag,
+		 const uint32_t runID,
+		 const char *suffix,
+		 char *name,
+		 const size_t nameSize )
+{
+  snprintf( name, nameSize, "%s/%s.%"PRIu32".%s",
+	    BM_RUN_LOGDIR, tag, runID, suffix );
+}
+
+/* the dealer's match name for job */
+void jobRunName( const MatchJob *job, char *name, const size_t nameSize )
+{
+  runMatchName( job->tag, job->runID, name, nameSize );
+}
+
+/* fill in args with everything but the listening sockets for a dealer
+   running job for match */
+void setDealerArgs( const Config *conf,
+		    const Match *match,
+		    const MatchJob *job,
+		    const uint32_t rngSeed,
+		    DealerArgs *args )
+{
+  int p, arg;
+
+  arg = 0;
+
+  args->argv[ arg ] = BM_DEALER;
+  ++arg;
+
+  jobRunName( job, args->matchName, sizeof( args->matchName ) );
+  args->argv[ arg ] = args->matchName;
+  ++arg;
+
+  args->argv[ arg ] = (char *)match->gameConf->gameFile;
+  ++arg;
+
+  snprintf( args->handsString, 
+	    sizeof( args->handsString ), 
+	    "%"PRIu32, 
+	    match->numHands );
+  args->argv[ arg ] = args->handsString;
+  ++arg;
+
+  snprintf( args->rngString, sizeof( args->rngString ), "%"PRIu32, rngSeed );
+  args->argv[ arg ] = args->rngString;
+  ++arg;
+
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( match->players[ p ].isNetworkPlayer ) {
+
+      args->argv[ arg ] = (char *)
+	( (Connection *)LLPoolGetItem( match->players[ p ].entry ) )
+	->user->name;
+    } else {
+
+      args->argv[ arg ] = (char *)
+	( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )->name;
+    }
+    ++arg;
+  }
+
+  if( conf->startupTimeoutSecs ) {
+
+    args->argv[ arg ] = "--start_timeout";
+    ++arg;
+
+    snprintf( args->startupTimeoutString,
+	      sizeof( args->startupTimeoutString ),
+	      "%d",
+	      (int)conf->startupTimeoutSecs * 1000 );
+    args->argv[ arg ] = args->startupTimeoutString;
+    ++arg;
+  }
+
+  /* Add maximum per action timeout argument */
+  args->argv[ arg ] = "--t_response";
+  ++arg;
+
+  snprintf( args->responseTimeoutString, 
+	    sizeof( args->responseTimeoutString ),
+	    "%d",
+	    (int)conf->responseTimeoutSecs * 1000 );
+  args->argv[ arg ] = args->responseTimeoutString;
+  ++arg;
+
+  /* Add maximum per hand timeout argument */
+  args->argv[ arg ] = "--t_hand";
+  ++arg;
+
+  snprintf( args->handTimeoutString, 
+	    sizeof( args->handTimeoutString ),
+	    "%d",
+	    (int)conf->handTimeoutSecs * 1000 );
+  args->argv[ arg ] = args->handTimeoutString;
+  ++arg;
+
+  /* Add average per hand time argument */
+  args->argv[ arg ] = "--t_per_hand";
+  ++arg;
+
+  snprintf( args->avgHandTimeString, 
+	    sizeof( args->avgHandTimeString ),
+	    "%d",
+	    (int)conf->avgHandTimeSecs * 1000 );
+  args->argv[ arg ] = args->avgHandTimeString;
+  ++arg;
+
+  args->argv[ arg ] = "-q";
+  ++arg;
+
+  /* response times say when bots are being starved of CPU */
+  if( conf->adaptiveConcurrency ) {
+
+    args->argv[ arg ] = "--report_latency";
+    ++arg;
+
+    snprintf( args->reportLatencyString,
+	      sizeof( args->reportLatencyString ),
+	      "%d",
+	      BM_LATENCY_REPORT_HANDS );
+    args->argv[ arg ] = args->reportLatencyString;
+    ++arg;
+  }
+
+  /* the dealer stops its clocks while a job is paused for another */
+  if( conf->preemption ) {
+
+    args->argv[ arg ] = "--pausable";
+    ++arg;
+  }
+
+  args->argv[ arg ] = NULL;
+  args->argc = arg;
+}
+
+/* name of the job's log file with the given suffix */
+void jobLogName( const char *tag,
+		 const char *suffix,
+		 char *name,
+		 const size_t nameSize )
+{
+  snprintf( name, nameSize, "%s/%s.%s", BM_LOGDIR, tag, suffix );
+}
+
+int isRunLogSuffix( const char *suffix )
+{
+  int s;
+
+  for( s = 0; s < BM_NUM_RUN_LOGS; ++s ) {
+
+    if( !strcmp( suffix, runLogSuffixes[ s ] ) ) {
+
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* name of the file the job writes its output with the given suffix to */
+void jobOutputName( const MatchJob *job,
+		    const char *suffix,
+		    char *name,
+		    const size_t nameSize )
+{
+  if( !isRunLogSuffix( suffix ) ) {
+
+    jobLogName( job->tag, suffix, name, nameSize );
+    return;
+  }
+
+  runLogName( job->tag, job->runID, suffix, name, nameSize );
+}
+
+/* open the file the job writes its output with the given suffix to, for
+   appending
+   returns the file descriptor, or -1 on failure */
+int openJobLog( const MatchJob *job, const char *suffix )
+{
+  int fd;
+  char name[ READBUF_LEN ];
+
+  jobOutputName( job, suffix, name, sizeof( name ) );
+  fd = open( name, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644 );
+  if( fd < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create log %s\n", name );
+  }
+  return fd;
+}
+
+/* copy a dealer's log from from to to, with the match name in the
+   dealer's header line changed to matchName
+   returns 0 on success, -1 on failure */
+int copyDealerLog( FILE *from, FILE *to, const char *matchName )
+{
+  int atLineStart;
+  char *rest;
+  static const char header[] = "# name/game/hands/seed ";
+  char line[ READBUF_LEN ];
+
+  /* header is "# name/game/hands/seed name game hands seed" */
+  atLineStart = 1;
+  while( fgets( line, sizeof( line ), from ) ) {
+
+    if( atLineStart && !strncmp( line, header, sizeof( header ) - 1 )
+	&& ( rest = strchr( &line[ sizeof( header ) - 1 ], ' ' ) ) ) {
+
+      fprintf( to, "%s%s%s", header, matchName, rest );
+    } else {
+
+      fputs( line, to );
+    }
+    atLineStart = line[ strlen( line ) - 1 ] == '\n';
+  }
+
+  return ferror( from ) || ferror( to ) ? -1 : 0;
+}
+
+/* add the output of a run in name to the end of the tag's log in
+   logName, and remove it - a log which doesn't exist yet is just the
+   run's file renamed.  a failed copy is cut off again, so the run can
+   be added later
+   returns 0 on success, or if the run wrote nothing, -1 on failure */
+int publishRunLog( const char *name, const char *logName )
+{
+  int in, out;
+  ssize_t r;
+  struct stat st;
+  char buf[ BM_PUBLISH_COPY_LEN ];
+
+  if( link( name, logName ) == 0 ) {
+
+    unlink( name );
+    return 0;
+  }
+
+  in = open( name, O_RDONLY | O_CLOEXEC );
+  if( in < 0 ) {
+
+    return errno == ENOENT ? 0 : -1;
+  }
+  out = open( logName, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644 );
+  if( out < 0 || fstat( out, &st ) < 0 ) {
+
+    if( out >= 0 ) {
+
+      close( out );
+    }
+    close( in );
+    return -1;
+  }
+
+  while( ( r = read( in, buf, sizeof( buf ) ) ) > 0 ) {
+
+    if( write( out, buf, r ) < r ) {
+
+      r = -1;
+      break;
+    }
+  }
+  close( in );
+  if( r < 0 ) {
+
+    if( ftruncate( out, st.st_size ) < 0 ) {
+
+      fprintf( stderr, "BM_WARNING: could not truncate %s\n", logName );
+    }
+    close( out );
+    return -1;
+  }
+  if( close( out ) < 0 ) {
+
+    return -1;
+  }
+
+  unlink( name );
+  return 0;
+}
+
+/* remove the output of a job which never ran */
+void removeJobLogs( const MatchJob *job )
+{
+  int s;
+  char name[ READBUF_LEN ];
+
+  for( s = 0; s < BM_NUM_RUN_LOGS; ++s ) {
+
+    jobOutputName( job, runLogSuffixes[ s ], name, sizeof( name ) );
+    unlink( name );
+  }
+}
+
+/* add output left in BM_RUN_LOGDIR by runs which were going when the
+   server stopped to their tags' logs, and make sure later runs don't
+   reuse the names of any which are left
+   returns the highest run ID still in use */
+uint32_t recoverRunLogs()
+{
+  int count, s;
+  uint32_t runID, lastRunID;
+  DIR *dir;
+  struct dirent *ent;
+  char *suffix, *id, *end;
+  char tag[ READBUF_LEN ];
+  char name[ sizeof( BM_RUN_LOGDIR ) + READBUF_LEN + 16 ];
+  char logName[ sizeof( BM_LOGDIR ) + READBUF_LEN + 16 ];
+
+  if( mkdir( BM_RUN_LOGDIR, 0755 ) < 0 && errno != EEXIST ) {
+
+    fprintf( stderr, "BM_ERROR: could not create %s\n", BM_RUN_LOGDIR );
+    exit( EXIT_FAILURE );
+  }
+  dir = opendir( BM_RUN_LOGDIR );
+  if( dir == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not read %s\n", BM_RUN_LOGDIR );
+    exit( EXIT_FAILURE );
+  }
+
+  /* names are tag.runID.suffix */
+  count = 0;
+  lastRunID = 0;
+  while( ( ent = readdir( dir ) ) != NULL ) {
+
+    if( ent->d_name[ 0 ] == '.'
+	|| snprintf( tag, sizeof( tag ), "%s", ent->d_name )
+	>= (int)sizeof( tag )
+	|| ( suffix = strrchr( tag, '.' ) ) == NULL ) {
+
+      continue;
+    }
+    *suffix = 0;
+    ++suffix;
+    if( ( id = strrchr( tag, '.' ) ) == NULL ) {
+
+      continue;
+    }
+    *id = 0;
+    ++id;
+    runID = strtoul( id, &end, 10 );
+    for( s = 0; s < BM_NUM_RUN_LOGS; ++s ) {
+
+      if( !strcmp( suffix, runLogSuffixes[ s ] ) ) {
+
+	break;
+      }
+    }
+    if( *id == 0 || *end != 0 || s == BM_NUM_RUN_LOGS ) {
+
+      continue;
+    }
+
+    snprintf( name, sizeof( name ), "%s/%s", BM_RUN_LOGDIR, ent->d_name );
+    jobLogName( tag, suffix, logName, sizeof( logName ) );
+    if( publishRunLog( name, logName ) < 0 ) {
+
+      fprintf( stderr, "BM_WARNING: could not add %s to %s\n",
+	       name, logName );
+      if( runID > lastRunID ) {
+
+	lastRunID = runID;
+      }
+      continue;
+    }
+    ++count;
+  }
+  closedir( dir );
+
+  if( count ) {
+
+    printf( "added %d logs of interrupted runs\n", count );
+  }
+  return lastRunID;
+}
+
+/* start compressing the oldest pending log, unless a compressor is
+   already running - the output is appended to the compressed file as a
+   separate gzip member, so earlier runs under the tag are kept */
+void startLogCompression( ServerState *serv )
+{
+  int in, out;
+  pid_t pid;
+  LLPoolEntry *cur;
+  PendingLog *log;
+  struct stat st;
+  char name[ READBUF_LEN ], suffix[ 16 ], level[ 8 ];
+
+  while( serv->compressPID == 0 && serv->pendingLogs->numEntries ) {
+
+    /* entries are added at the head, so the oldest is last */
+    for( cur = LLPoolFirstEntry( serv->pendingLogs );
+	 LLPoolNextEntry( cur ) != NULL; cur = LLPoolNextEntry( cur ) );
+    log = (PendingLog *)LLPoolGetItem( cur );
+
+    snprintf( suffix, sizeof( suffix ), "%s.gz", log->suffix );
+    jobLogName( log->tag, suffix, name, sizeof( name ) );
+    in = open( log->partName, O_RDONLY | O_CLOEXEC );
+    out = open( name, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644 );
+    if( in < 0 || out < 0 || fstat( out, &st ) < 0 ) {
+
+      fprintf( stderr, "BM_WARNING: could not compress %s into %s\n",
+	       log->partName, name );
+      if( in >= 0 ) {
+
+	close( in );
+      }
+      if( out >= 0 ) {
+
+	close( out );
+      }
+      free( log->tag );
+      free( log->partName );
+      LLPoolRemoveEntry( serv->pendingLogs, cur );
+      continue;
+    }
+
+    pid = fork();
+    if( pid == 0 ) {
+      /* child - stay out of the way of running matches */
+
+      resetChildSignals();
+      if( nice( BM_LOG_COMPRESSOR_NICE ) < 0 ) {
+	/* not worth failing over */
+      }
+      dup2( in, 0 );
+      dup2( out, 1 );
+      snprintf( level, sizeof( level ), "-%d", (int)serv->conf->compressLogs );
+      execlp( BM_LOG_COMPRESSOR, BM_LOG_COMPRESSOR, "-c", level, NULL );
+      _exit( EXIT_FAILURE );
+    }
+    close( in );
+    close( out );
+    if( pid < 0 ) {
+      /* try again when the next log is queued */
+
+      fprintf( stderr, "BM_WARNING: could not start log compressor\n" );
+      return;
+    }
+
+    serv->compressPID = pid;
+    serv->compressEntry = cur;
+    serv->compressStart = st.st_size;
+  }
+}
+
+/* the compressor has exited - drop the uncompressed copy if it worked,
+   otherwise cut off whatever it left behind and keep the copy */
+void logCompressed( ServerState *serv, const int status )
+{
+  PendingLog *log = (PendingLog *)LLPoolGetItem( serv->compressEntry );
+  char name[ READBUF_LEN ], suffix[ 16 ];
+
+  if( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 ) {
+
+    unlink( log->partName );
+  } else {
+
+    snprintf( suffix, sizeof( suffix ), "%s.gz", log->suffix );
+    jobLogName( log->tag, suffix, name, sizeof( name ) );
+    if( truncate( name, serv->compressStart ) < 0 ) {
+
+      fprintf( stderr, "BM_WARNING: could not truncate %s\n", name );
+    }
+    fprintf( stderr, "BM_WARNING: log compression failed, leaving %s\n",
+	     log->partName );
+  }
+
+  free( log->tag );
+  free( log->partName );
+  LLPoolRemoveEntry( serv->pendingLogs, serv->compressEntry );
+  serv->compressPID = 0;
+  serv->compressEntry = NULL;
+  startLogCompression( serv );
+}
+
+/* queue the logs of tag for compression, unless a match other than
+   except will still write under the tag, or a finished run other than
+   publishing is still to be added to them */
+void queueTagLogs( ServerState *serv,
+		   const char *tag,
+		   const Match *except,
+		   const LLPoolEntry *publishing )
+{
+  int s;
+  size_t nameLen;
+  LLPoolEntry *cur;
+  PendingLog log;
+  char name[ sizeof( BM_LOGDIR ) + READBUF_LEN + 16 ];
+
+  if( serv->conf->compressLogs == 0 ) {
+
+    return;
+  }
+
+  for( cur = LLPoolFirstEntry( serv->matches );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    const Match *other = (const Match *)LLPoolGetItem( cur );
+
+    nameLen = strlen( other->user->name );
+    if( other != except && !strncmp( tag, other->user->name, nameLen )
+	&& tag[ nameLen ] == '.' && !strcmp( &tag[ nameLen + 1 ], other->tag ) ) {
+
+      return;
+    }
+  }
+  for( cur = LLPoolFirstEntry( serv->pendingRuns );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+    if( cur != publishing
+	&& !strcmp( ( (PendingRun *)LLPoolGetItem( cur ) )->tag, tag ) ) {
+
+      return;
+    }
+  }
+
+  for( s = 0; s < BM_NUM_RUN_LOGS; ++s ) {
+
+    jobLogName( tag, runLogSuffixes[ s ], name, sizeof( name ) );
+    ++serv->lastPendingLog;
+    log.tag = strdup( tag );
+    assert( log.tag != 0 );
+    log.suffix = runLogSuffixes[ s ];
+    log.partName = (char *)malloc( strlen( name ) + 24 );
+    assert( log.partName != 0 );
+    sprintf( log.partName, "%s.%"PRIu32".part", name, serv->lastPendingLog );
+
+    if( rename( name, log.partName ) < 0 ) {
+      /* nothing was written, or the log is gone */
+
+      free( log.tag );
+      free( log.partName );
+      continue;
+    }
+    LLPoolAddItem( serv->pendingLogs, &log );
+  }
+
+  startLogCompression( serv );
+}
+
+/* queue the logs of a match which is being removed for compression */
+void queueMatchLogs( ServerState *serv, const Match *match )
+{
+  char tag[ READBUF_LEN ];
+
+  snprintf( tag, sizeof( tag ), "%s.%s", match->user->name, match->tag );
+  queueTagLogs( serv, tag, match, NULL );
+}
+
+/* start a "dealer --worker" process
+   returns 0 on success, -1 on failure */
+int spawnDealerWorker( ServerState *serv, DealerWorker *worker )
+{
+  int sv[ 2 ];
+  char fdString[ 16 ];
+
+  worker->sock = -1;
+  worker->dealerPID = 0;
+  worker->isStarting = 0;
+  worker->jobEntry = NULL;
+  worker->watch.active = 0;
+
+  if( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create socket for dealer worker\n" );
+    return -1;
+  }
+
+  worker->pid = fork();
+  if( worker->pid < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: fork() failed\n" );
+    close( sv[ 0 ] );
+    close( sv[ 1 ] );
+    return -1;
+  }
+  if( !worker->pid ) {
+    /* child runs the worker, which only needs its end of the socket */
+
+    resetChildSignals();
+    dup2( serv->devnullfd, 1 );
+    fcntl( sv[ 1 ], F_SETFD, 0 );
+    snprintf( fdString, sizeof( fdString ), "%d", sv[ 1 ] );
+
+    execl( BM_DEALER, BM_DEALER, "--worker", fdString, NULL );
+
+    fprintf( stderr, "BM_ERROR: could not start dealer worker\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  close( sv[ 1 ] );
+  worker->sock = sv[ 0 ];
+
+  return 0;
+}
+
+void workerTimerEvent( EventLoop *loop, EventTimer *timer );
+
+/* replace dead workers soon, unless that is already planned */
+void scheduleWorkerRespawn( ServerState *serv )
+{
+  if( !eventTimerIsRunning( &serv->workerTimer ) ) {
+
+    eventTimerStart( &serv->events,
+		     &serv->workerTimer,
+		     (uint64_t)BM_WORKER_RESPAWN_SECS * 1000000,
+		     0,
+		     workerTimerEvent,
+		     NULL );
+  }
+}
+
+/* stop using a worker which failed or exited, and have it replaced -
+   its process is reaped along with any other unknown children */
+void closeDealerWorker( ServerState *serv, DealerWorker *worker )
+{
+  fprintf( stderr, "BM_WARNING: dealer worker %d has gone away\n",
+	   (int)worker->pid );
+  eventWatchRemove( &serv->events, &worker->watch );
+  close( worker->sock );
+  worker->sock = -1;
+  worker->dealerPID = 0;
+  worker->isStarting = 0;
+  scheduleWorkerRespawn( serv );
+}
+
+/* hand job to an idle dealer worker, passing it the listening sockets -
+   the worker's STARTED reply is read by dealerWorkerEvent
+   returns 0 on success, or -1 if no worker could take the job */
+int startWorkerDealer( const Config *conf,
+		       ServerState *serv,
+		       const Match *match,
+		       MatchJob *job,
+		       const uint32_t rngSeed,
+		       const int listenFD[ MAX_PLAYERS ] )
+{
+  int w, p, fds[ MAX_PLAYERS + 1 ], numFDs;
+  ssize_t len, r;
+  DealerWorker *worker;
+  DealerArgs args;
+  char msg[ READBUF_LEN ];
+
+  worker = NULL;
+  for( w = 0; w < serv->numWorkers; ++w ) {
+
+    if( serv->workers[ w ].sock >= 0 && !serv->workers[ w ].dealerPID
+	&& !serv->workers[ w ].isStarting ) {
+
+      worker = &serv->workers[ w ];
+      break;
+    }
+  }
+  if( worker == NULL ) {
+
+    return -1;
+  }
+
+  /* message is the game file and the dealer's arguments */
+  setDealerArgs( conf, match, job, rngSeed, &args );
+  len = snprintf( msg, sizeof( msg ), "%s", match->gameConf->gameFile ) + 1;
+  for( p = 0; p < args.argc && len < sizeof( msg ); ++p ) {
+
+    len += snprintf( &msg[ len ], sizeof( msg ) - len, "%s", args.argv[ p ] )
+      + 1;
+  }
+  if( p < args.argc || len > sizeof( msg ) ) {
+
+    fprintf( stderr, "BM_ERROR: dealer arguments too long for worker\n" );
+    return -1;
+  }
+
+  /* descriptors are the error log, then one listening socket per seat */
+  fds[ 0 ] = openJobLog( job, "stderr" );
+  if( fds[ 0 ] < 0 ) {
+
+    return -1;
+  }
+  numFDs = 1;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    fds[ numFDs ] = listenFD[ p ];
+    ++numFDs;
+  }
+
+  r = sendWithFDs( worker->sock, msg, len, fds, numFDs );
+  close( fds[ 0 ] );
+  if( r < 0 ) {
+
+    ++serv->launchFailures[ BM_LAUNCH_WORKER ];
+    closeDealerWorker( serv, worker );
+    return -1;
+  }
+
+  worker->isStarting = 1;
+  job->worker = worker;
+  return 0;
+}
+
+/* start the dealer for job - a dealer without pooled ports reports
+   them on job->portPipe, and a worker says when it has started the
+   dealer, both of which are read from the event loop
+   returns 0 if the dealer is running with known ports, 1 if the job is
+   still launching, or -1 if the dealer could not be started */
+int startDealer( const Config *conf,
+		 ServerState *serv,
+		 const Match *match,
+		 MatchJob *job,
+		 const uint32_t rngSeed )
+{
+  int stdoutPipe[ 2 ], p, usePool;
+  int listenFD[ MAX_PLAYERS ];
+  char listenFDString[ MAX_PLAYERS * 12 ];
+  DealerArgs args;
+
+  /* use pre-bound sockets if we have them, so there is nothing to wait for,
+     otherwise the dealer picks its own ports and tells us through a pipe */
+  usePool = takePooledPorts( serv,
+			     match->gameConf->game->numPlayers,
+			     listenFD,
+			     job->ports ) == 0;
+  if( usePool
+      && startWorkerDealer( conf, serv, match, job, rngSeed, listenFD ) == 0 ) {
+    /* the worker has its own copies of the sockets now */
+
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+      close( listenFD[ p ] );
+    }
+    return 1;
+  }
+  if( !usePool && pipe( stdoutPipe ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create pipe for new dealer\n" );
+    return -1;
+  }
+
+  job->dealerPID = fork();
+  if( job->dealerPID < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: fork() failed\n" );
+    job->dealerPID = 0;
+    if( usePool ) {
+
+      for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+	close( listenFD[ p ] );
+      }
+    } else {
+
+      close( stdoutPipe[ 0 ] );
+      close( stdoutPipe[ 1 ] );
+    }
+    return -1;
+  }
+  if( !job->dealerPID ) {
+    /* child runs the dealer command */
+    int stderrfd;
+
+    resetChildSignals();
+
+    if( job->numCores ) {
+
+      corePoolPin( &serv->cores, job->numCores, job->cores, 0 );
+    }
+
+    stderrfd = openJobLog( job, "stderr" );
+    if( stderrfd < 0 ) {
+
+      _exit( EXIT_FAILURE );
+    }
+    dup2( stderrfd, 2 );
+
+    if( usePool ) {
+      /* ports are already known, so the dealer's output isn't needed */
+
+      dup2( serv->devnullfd, 1 );
+    } else {
+      /* change stdout to be the write end of the pipe */
+
+      close( stdoutPipe[ 0 ] );
+      dup2( stdoutPipe[ 1 ], 1 );
+    }
+
+    setDealerArgs( conf, match, job, rngSeed, &args );
+
+    if( usePool ) {
+      /* let the dealer inherit the listening sockets */
+      int pos = 0;
+
+      for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+	fcntl( listenFD[ p ], F_SETFD, 0 );
+	pos += snprintf( &listenFDString[ pos ],
+			 sizeof( listenFDString ) - pos,
+			 p ? ",%d" : "%d",
+			 listenFD[ p ] );
+      }
+
+      args.argv[ args.argc ] = "--listen_fds";
+      ++args.argc;
+
+      args.argv[ args.argc ] = listenFDString;
+      ++args.argc;
+
+      args.argv[ args.argc ] = NULL;
+    }
+
+    execv( BM_DEALER, args.argv );
+
+    /* _exit, so the server's buffered output doesn't go down the pipe */
+    fprintf( stderr, "BM_ERROR: could not start dealer\n" );
+    _exit( EXIT_FAILURE );
+  }
+
+  if( usePool ) {
+    /* the dealer has its own copies of the sockets now */
+
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+      close( listenFD[ p ] );
+    }
+    return 0;
+  }
+
+  /* the port line is picked up by dealerPortsEvent */
+  close( stdoutPipe[ 1 ] );
+  fcntl( stdoutPipe[ 0 ], F_SETFD, FD_CLOEXEC );
+  fcntl( stdoutPipe[ 0 ], F_SETFL, O_NONBLOCK );
+  job->portPipe = stdoutPipe[ 0 ];
+  return 1;
+}
+
+/* put a freshly forked bot in its cgroup, or give it rlimits, before it
+   runs anything - cpuSecs is the CPU time rlimits allow, 0 for none */
+void limitBotChild( const BotSpec *bot,
+		    const char *limitGroup,
+		    const double cpuSecs )
+{
+  if( !botLimitsSet( bot->limits ) ) {
+
+    return;
+  }
+  if( limitJoin( limitGroup, bot->limits, cpuSecs ) < 0
+      && ( limitGroup == NULL
+	   || limitJoin( NULL, bot->limits, cpuSecs ) < 0 ) ) {
+
+    fprintf( stderr, "BM_WARNING: could not limit bot %s\n", bot->name );
+  }
+}
+
+/* bit for each limit the bot in cgroup group has gone over since the
+   group's counts were taken */
+int limitEventHits( const char *group, const LimitEvents *start )
+{
+  int hits;
+  LimitEvents events;
+
+  if( limitGroupEvents( group, &events ) < 0 ) {
+
+    return 0;
+  }
+  hits = 0;
+  if( events.oomKills > start->oomKills ) {
+
+    hits |= 1 << BM_LIMIT_MEMORY;
+  }
+  if( events.pidsRefused > start->pidsRefused ) {
+
+    hits |= 1 << BM_LIMIT_PIDS;
+  }
+  return hits;
+}
+
+/* CPU time a bot without a cgroup is allowed for the match: its CPU
+   quota for as long as the match may take, 0 for no limit */
+double botCpuSecs( const Config *conf, const BotSpec *bot, const Match *match )
+{
+  return bot->limits->cpus * conf->avgHandTimeSecs * match->numHands;
+}
+
+/* core is the bot's core in serv->cores, or -1 to leave it unpinned
+   limitGroup is the cgroup to put the bot in, or NULL, and cpuSecs the
+   CPU time it gets without one
+   returns the bot's PID, or -1 on failure */
+pid_t startBot( const ServerState *serv,
+		const BotSpec *bot,
+		const uint16_t port,
+		const int botPosition,
+		const int core,
+		const char *limitGroup,
+		const double cpuSecs )
+{
+  pid_t pid;
+
+  pid = fork();
+  if( pid < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: fork() failed\n" );
+    return -1;
+  }
+  if( !pid ) {
+    /* child runs the bot command */
+    char portString[ 8 ];
+    char posString[ 16 ];
+
+    resetChildSignals();
+    limitBotChild( bot, limitGroup, cpuSecs );
+
+    if( core >= 0 ) {
+
+      corePoolPin( &serv->cores, 1, &core, 0 );
+    }
+
+    snprintf( portString, sizeof( portString ), "%"PRIu16, port );
+    snprintf( posString, sizeof( posString ), "%d", botPosition );
+
+    /* throw away bot output */
+    dup2( serv->devnullfd, 1 );
+    dup2( serv->devnullfd, 2 );
+
+    execl( bot->command,
+	   bot->command,
+	   serv->hostname,
+	   portString,
+	   posString,
+	   NULL );
+
+    fprintf( stderr, "BM_ERROR: could not start bot %s\n", bot->command );
+    exit( EXIT_FAILURE );
+  }
+
+  return pid;
+}
+
+/* usage of an exited process, from wait4 */
+void rusageToProcUsage( const struct rusage *ru, ProcUsage *usage )
+{
+  usage->userSecs = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+  usage->sysSecs = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+  usage->maxRSSKB = ru->ru_maxrss;
+  usage->volCtxSwitches = ru->ru_nvcsw;
+  usage->involCtxSwitches = ru->ru_nivcsw;
+  usage->numProcs = 1;
+}
+
+/* add usage to the running total in sum */
+void addProcUsage( ProcUsage *sum, const ProcUsage *usage )
+{
+  sum->userSecs += usage->userSecs;
+  sum->sysSecs += usage->sysSecs;
+  if( usage->maxRSSKB > sum->maxRSSKB ) {
+
+    sum->maxRSSKB = usage->maxRSSKB;
+  }
+  sum->volCtxSwitches += usage->volCtxSwitches;
+  sum->involCtxSwitches += usage->involCtxSwitches;
+  sum->numProcs += usage->numProcs;
+}
+
+/* usage so far of the running process pid itself
+   returns 0 on success, -1 if the process is gone */
+int readProcUsage( const pid_t pid, ProcUsage *usage )
+{
+  FILE *file;
+  unsigned long utime, stime;
+  uint64_t value;
+  char name[ 64 ], line[ 1024 ], *pos;
+
+  snprintf( name, sizeof( name ), "/proc/%d/stat", (int)pid );
+  file = fopen( name, "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  pos = fgets( line, sizeof( line ), file );
+  fclose( file );
+  if( pos == NULL ) {
+
+    return -1;
+  }
+
+  /* the command name can hold anything, so skip past its last ')'
+     utime and stime are fields 14 and 15, counting from 1 */
+  pos = strrchr( line, ')' );
+  if( pos == NULL
+      || sscanf( pos + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+		 &utime, &stime ) < 2 ) {
+
+    return -1;
+  }
+  memset( usage, 0, sizeof( *usage ) );
+  usage->userSecs = (double)utime / sysconf( _SC_CLK_TCK );
+  usage->sysSecs = (double)stime / sysconf( _SC_CLK_TCK );
+  usage->numProcs = 1;
+
+  /* the rest is only in the longer form */
+  snprintf( name, sizeof( name ), "/proc/%d/status", (int)pid );
+  file = fopen( name, "r" );
+  if( file == NULL ) {
+
+    return 0;
+  }
+  while( fgets( line, sizeof( line ), file ) ) {
+
+    if( sscanf( line, "VmHWM: %"SCNu64, &value ) == 1 ) {
+
+      usage->maxRSSKB = value;
+    } else if( sscanf( line, "voluntary_ctxt_switches: %"SCNu64,
+		       &value ) == 1 ) {
+
+      usage->volCtxSwitches = value;
+    } else if( sscanf( line, "nonvoluntary_ctxt_switches: %"SCNu64,
+		       &value ) == 1 ) {
+
+      usage->involCtxSwitches = value;
+    }
+  }
+  fclose( file );
+  return 0;
+}
+
+int jobIsFinished( const MatchJob *job );
+void finishedJob( ServerState *serv, LLPoolEntry *jobEntry );
+void warmBotEvent( EventLoop *loop, EventWatch *watch, const uint32_t events );
+void warmBotTimerEvent( EventLoop *loop, EventTimer *timer );
+
+/* start a persistent bot, with a socket on its standard input and output
+   returns the bot's entry in serv->warmBots, or NULL on failure */
+LLPoolEntry *spawnWarmBot( ServerState *serv, const BotSpec *bot )
+{
+  int sv[ 2 ];
+  WarmBot warm;
+  LLPoolEntry *entry;
+
+  if( socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create socket for warm bot %s\n",
+	     bot->name );
+    return NULL;
+  }
+
+  /* the group lasts as long as the bot, over all its matches */
+  warm.limitGroup = botLimitsSet( bot->limits )
+    ? limitGroupCreate( &serv->limitGroups, bot->name, bot->limits ) : NULL;
+  warm.pid = fork();
+  if( warm.pid < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: fork() failed\n" );
+    close( sv[ 0 ] );
+    close( sv[ 1 ] );
+    limitGroupRemove( &serv->limitGroups, warm.limitGroup );
+    return NULL;
+  }
+  if( !warm.pid ) {
+    /* child runs the bot command with no arguments */
+
+    resetChildSignals();
+    /* CPU time adds up over all its matches, so there is no cap */
+    limitBotChild( bot, warm.limitGroup, 0.0 );
+    dup2( sv[ 1 ], 0 );
+    dup2( sv[ 1 ], 1 );
+    dup2( serv->devnullfd, 2 );
+
+    execl( bot->command, bot->command, NULL );
+
+    fprintf( stderr, "BM_ERROR: could not start bot %s\n", bot->command );
+    exit( EXIT_FAILURE );
+  }
+  close( sv[ 1 ] );
+
+  warm.bot = bot;
+  warm.ctrlFD = sv[ 0 ];
+  warm.ctrlBuf = createReadBuf( sv[ 0 ] );
+  warm.owner = NULL;
+  warm.jobEntry = NULL;
+  warm.seat = 0;
+  memset( &warm.runStart, 0, sizeof( warm.runStart ) );
+  memset( &warm.runStartEvents, 0, sizeof( warm.runStartEvents ) );
+  warm.idleSinceMicros = eventNowMicros();
+  warm.doneByMicros = 0;
+  entry = LLPoolAddItem( serv->warmBots, &warm );
+  hashAddInt( serv->warmBotPIDs, warm.pid, entry );
+
+  if( eventWatchAdd( &serv->events,
+		     &( (WarmBot *)LLPoolGetItem( entry ) )->watch,
+		     sv[ 0 ],
+		     EPOLLIN,
+		     warmBotEvent,
+		     entry ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not watch warm bot %s\n", bot->name );
+  }
+  if( !eventTimerIsRunning( &serv->warmBotTimer ) ) {
+
+    eventTimerStart( &serv->events,
+		     &serv->warmBotTimer,
+		     BM_WARM_BOT_CHECK_SECS * 1000000,
+		     BM_WARM_BOT_CHECK_SECS * 1000000,
+		     warmBotTimerEvent,
+		     NULL );
+  }
+
+  return entry;
+}
+
+/* find a warm bot which isn't playing to use for a match, preferring
+   one already kept for the match, then a free one, then a new one
+   returns the bot's entry, or NULL on failure */
+LLPoolEntry *claimWarmBot( ServerState *serv,
+			   const BotSpec *bot,
+			   LLPoolEntry *matchEntry )
+{
+  LLPoolEntry *cur, *freeBot;
+  WarmBot *warm;
+
+  freeBot = NULL;
+  for( cur = LLPoolFirstEntry( serv->warmBots );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    warm = (WarmBot *)LLPoolGetItem( cur );
+
+    if( warm->bot != bot || warm->ctrlFD < 0 || warm->jobEntry ) {
+
+      continue;
+    }
+    if( warm->owner == matchEntry ) {
+
+      return cur;
+    }
+    if( warm->owner == NULL && freeBot == NULL ) {
+
+      freeBot = cur;
+    }
+  }
+
+  if( freeBot == NULL ) {
+
+    freeBot = spawnWarmBot( serv, bot );
+    if( freeBot == NULL ) {
+
+      return NULL;
+    }
+  }
+  ( (WarmBot *)LLPoolGetItem( freeBot ) )->owner = matchEntry;
+  return freeBot;
+}
+
+/* tell a warm bot to play a match
+   returns 0 on success, -1 on failure */
+int runWarmBot( const ServerState *serv,
+		LLPoolEntry *warmEntry,
+		const uint16_t port,
+		const int botPosition,
+		const int core )
+{
+  int len;
+  WarmBot *warm = (WarmBot *)LLPoolGetItem( warmEntry );
+  char msg[ READBUF_LEN ];
+
+  /* the bot plays on whatever cores the job has */
+  if( core >= 0 ) {
+
+    corePoolPin( &serv->cores, 1, &core, warm->pid );
+  }
+
+  len = snprintf( msg, sizeof( msg ), "RUN %s %"PRIu16" %d\n",
+		  serv->hostname, port, botPosition );
+  if( write( warm->ctrlFD, msg, len ) < len ) {
+
+    return -1;
+  }
+
+  if( readProcUsage( warm->pid, &warm->runStart ) < 0 ) {
+
+    memset( &warm->runStart, 0, sizeof( warm->runStart ) );
+  }
+  if( warm->limitGroup
+      && limitGroupEvents( warm->limitGroup, &warm->runStartEvents ) < 0 ) {
+
+    memset( &warm->runStartEvents, 0, sizeof( warm->runStartEvents ) );
+  }
+  warm->doneByMicros = 0;
+  return 0;
+}
+
+/* the warm bot has finished playing its current match, or is gone */
+void releaseWarmBotJob( ServerState *serv, WarmBot *warm )
+{
+  LLPoolEntry *jobEntry = warm->jobEntry;
+  MatchJob *job;
+  ProcUsage now, *usage;
+
+  if( jobEntry == NULL ) {
+
+    return;
+  }
+  job = (MatchJob *)LLPoolGetItem( jobEntry );
+  if( readProcUsage( warm->pid, &now ) == 0 ) {
+    /* nothing to charge once the bot has been reaped - the peak memory
+       is over the bot's whole life, since it can't be split by match */
+
+    usage = &job->botUsage[ warm->seat ];
+    usage->userSecs = now.userSecs - warm->runStart.userSecs;
+    usage->sysSecs = now.sysSecs - warm->runStart.sysSecs;
+    usage->maxRSSKB = now.maxRSSKB;
+    usage->volCtxSwitches = now.volCtxSwitches - warm->runStart.volCtxSwitches;
+    usage->involCtxSwitches
+      = now.involCtxSwitches - warm->runStart.involCtxSwitches;
+    usage->numProcs = 1;
+    job->cpuSecs += usage->userSecs + usage->sysSecs;
+  }
+  if( warm->limitGroup ) {
+
+    job->limitHits[ warm->seat ]
+      |= limitEventHits( warm->limitGroup, &warm->runStartEvents );
+  }
+  job->warmBots[ warm->seat ] = NULL;
+  warm->jobEntry = NULL;
+  warm->doneByMicros = 0;
+  warm->idleSinceMicros = eventNowMicros();
+
+  if( jobIsFinished( job ) ) {
+
+    finishedJob( serv, jobEntry );
+  }
+}
+
+/* stop using a warm bot - it is freed once it has been reaped */
+void closeWarmBot( ServerState *serv, LLPoolEntry *warmEntry, const int sig )
+{
+  WarmBot *warm = (WarmBot *)LLPoolGetItem( warmEntry );
+
+  if( warm->ctrlFD < 0 ) {
+
+    return;
+  }
+  eventWatchRemove( &serv->events, &warm->watch );
+  destroyReadBuf( warm->ctrlBuf );
+  warm->ctrlFD = -1;
+  warm->owner = NULL;
+  if( sig ) {
+
+    kill( warm->pid, sig );
+  }
+  releaseWarmBotJob( serv, warm );
+}
+
+/* the dealer for job is gone, so its warm bots should be done soon */
+void dealerExited( ServerState *serv, MatchJob *job )
+{
+  int p;
+  uint64_t doneBy;
+
+  doneBy = eventNowMicros() + BM_WARM_BOT_GRACE_SECS * 1000000ULL;
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    if( job->warmBots[ p ] ) {
+
+      ( (WarmBot *)LLPoolGetItem( job->warmBots[ p ] ) )->doneByMicros
+	= doneBy;
+    }
+  }
+}
+
+/* tell a network player to connect to the dealer at host/port */
+int sendStartMessage( const char *host,
+		      const MatchJob *job,
+		      const Connection *conn,
+		      const uint16_t port )
+{
+  int len;
+  char msg[ strlen( host ) + 12 + READBUF_LEN ];
+
+  len = snprintf( msg, sizeof( msg ), "# RUNNING %s\n", job->tag );
+  assert( len > 0 );
+  if( write( conn->connBuf->fd, msg, len ) < len ) {
+
+    fprintf( stderr, "BM_ERROR: short write to connection\n" );
+    return -1;
+  }
+
+  len = snprintf( msg,
+                  sizeof( msg ), 
+                  "RUN %s %"PRIu16"\n", 
+                  host, port );
+  assert( len > 0 );
+  if( write( conn->connBuf->fd, msg, len ) < len ) {
+
+    fprintf( stderr, "BM_ERROR: short write to connection\n" );
+    return -1;
+  }
+
+  return 0;
+}
+
+/* set up a job for the match in matchEntry, with nothing running */
+void initMatchJob( ServerState *serv, MatchJob *job, LLPoolEntry *matchEntry )
+{
+  int p;
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+  char tag[ READBUF_LEN ];
+
+  job->state = JOB_LAUNCHING;
+  job->matchEntry = matchEntry;
+  job->cpuSecs = 0.0;
+  memset( &job->dealerUsage, 0, sizeof( job->dealerUsage ) );
+  memset( job->botUsage, 0, sizeof( job->botUsage ) );
+  job->startMicros = eventNowMicros();
+  job->portPipe = -1;
+  job->portWatch.active = 0;
+  initEventTimer( &job->launchTimer );
+  job->portStringLen = 0;
+
+  /* make the tag from the match tag */
+  snprintf( tag, sizeof( tag ), "%s.%s", match->user->name, match->tag );
+  job->tag = arenaStrdup( &serv->strings, tag );
+
+  /* initialise all PIDs to 0 */
+  job->dealerPID = 0;
+  job->worker = NULL;
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    job->botPID[ p ] = 0;
+    job->warmBots[ p ] = NULL;
+    job->limitGroups[ p ] = NULL;
+    job->limitHits[ p ] = 0;
+  }
+
+  job->agentEntry = NULL;
+  job->agentJobID = 0;
+  job->logFD = -1;
+  job->errFD = -1;
+  job->numCores = 0;
+  job->isPaused = 0;
+  job->pausedAtMicros = 0;
+  job->pausedMicros = 0;
+
+  job->runID = ++serv->lastRunID;
+  job->errScanned = 0;
+  job->cacheKey[ 0 ] = 0;
+}
+
+/* runs are only repeatable when every player is a bot which starts
+   afresh for each match */
+int matchIsCacheable( const ServerState *serv, const Match *match )
+{
+  return serv->cache.dir != NULL
+    && botsInMatch( match ) == match->gameConf->game->numPlayers
+    && !matchUsesWarmBots( match );
+}
+
+/* set job->cacheKey for running match with rngSeed - everything which
+   can change what the dealer writes goes in, apart from the match name,
+   which replayCachedRun puts back
+   returns 0 on success, -1 if an input file can't be read */
+int jobCacheKey( const Config *conf,
+		 ServerState *serv,
+		 const Match *match,
+		 MatchJob *job,
+		 const uint32_t rngSeed )
+{
+  int p, len;
+  const BotSpec *bot;
+  DealerArgs args;
+  char digest[ CACHE_DIGEST_LEN + 1 ];
+  char text[ READBUF_LEN * 4 ];
+
+  if( cacheFileDigest( &serv->cache, BM_DEALER, digest ) < 0 ) {
+
+    return -1;
+  }
+  len = snprintf( text, sizeof( text ), "dealer %s\n", digest );
+
+  if( cacheFileDigest( &serv->cache, match->gameConf->gameFile, digest ) < 0 ) {
+
+    return -1;
+  }
+  len += snprintf( &text[ len ], sizeof( text ) - len, "game %s\n", digest );
+
+  /* dealer arguments after the match name: game, hands, seed, player
+     names and the timeouts */
+  setDealerArgs( conf, match, job, rngSeed, &args );
+  for( p = 2; p < args.argc && len < sizeof( text ); ++p ) {
+
+    len += snprintf( &text[ len ], sizeof( text ) - len,
+		     "arg %s\n", args.argv[ p ] );
+  }
+
+  for( p = 0; p < match->gameConf->game->numPlayers && len < sizeof( text );
+       ++p ) {
+    bot = (const BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+
+    if( cacheFileDigest( &serv->cache, bot->command, digest ) < 0 ) {
+
+      return -1;
+    }
+    len += snprintf( &text[ len ], sizeof( text ) - len,
+		     "seat %d %s %s\n", p, bot->name, digest );
+  }
+  if( len >= sizeof( text ) ) {
+
+    return -1;
+  }
+
+  cacheDigest( text, len, job->cacheKey );
+  return 0;
+}
+
+/* append the cache entry for job with the given suffix to the job's
+   output, with the match name in the dealer's header line changed to
+   the job's own run
+   returns 0 on success, -1 on failure */
+int copyCachedLog( const ServerState *serv,
+		   const MatchJob *job,
+		   const char *suffix )
+{
+  int in, out, failed;
+  FILE *from, *to;
+  char matchName[ READBUF_LEN ];
+
+  in = cacheOpen( &serv->cache, job->cacheKey, suffix );
+  if( in < 0 ) {
+
+    return -1;
+  }
+  from = fdopen( in, "r" );
+  if( from == NULL ) {
+
+    close( in );
+    return -1;
+  }
+  out = openJobLog( job, suffix );
+  to = out < 0 ? NULL : fdopen( out, "a" );
+  if( to == NULL ) {
+
+    if( out >= 0 ) {
+
+      close( out );
+    }
+    fclose( from );
+    return -1;
+  }
+
+  jobRunName( job, matchName, sizeof( matchName ) );
+  failed = copyDealerLog( from, to, matchName );
+  fclose( from );
+  if( fclose( to ) != 0 ) {
+
+    failed = -1;
+  }
+  return failed;
+}
+
+/* fill in the logs for job from the cache, if the run has been played
+   before - the log entry is written last, so its presence means the
+   error log is there too
+   returns 0 if the run was found, -1 otherwise */
+int replayCachedRun( ServerState *serv, MatchJob *job )
+{
+  int fd;
+
+  fd = cacheOpen( &serv->cache, job->cacheKey, "log" );
+  if( fd < 0 ) {
+
+    ++serv->cacheMisses;
+    return -1;
+  }
+  close( fd );
+
+  if( copyCachedLog( serv, job, "stderr" ) < 0
+      || copyCachedLog( serv, job, "log" ) < 0 ) {
+
+    fprintf( stderr, "BM_WARNING: could not copy cached run for %s\n",
+	     job->tag );
+    removeJobLogs( job );
+    ++serv->cacheMisses;
+    return -1;
+  }
+
+  ++serv->cacheHits;
+  job->state = JOB_FINISHED;
+  return 0;
+}
+
+/* check that nothing but the run's own dealer wrote a dealer's output
+   to the run's file with the given suffix - there must be exactly one
+   header line, naming the run
+   returns 1 if so, 0 otherwise */
+int runOutputIsOwn( const PendingRun *run, const char *suffix )
+{
+  int headers, isOwn, atLineStart;
+  size_t runLen;
+  FILE *file;
+  static const char header[] = "# name/game/hands/seed ";
+  char name[ READBUF_LEN ], runName[ READBUF_LEN ], line[ READBUF_LEN ];
+
+  runLogName( run->tag, run->runID, suffix, name, sizeof( name ) );
+  file = fopen( name, "re" );
+  if( file == NULL ) {
+
+    return 0;
+  }
+  runMatchName( run->tag, run->runID, runName, sizeof( runName ) );
+  runLen = strlen( runName );
+
+  headers = 0;
+  isOwn = 1;
+  atLineStart = 1;
+  while( fgets( line, sizeof( line ), file ) ) {
+
+    if( atLineStart && !strncmp( line, header, sizeof( header ) - 1 ) ) {
+
+      ++headers;
+      if( strncmp( &line[ sizeof( header ) - 1 ], runName, runLen )
+	  || line[ sizeof( header ) - 1 + runLen ] != ' ' ) {
+
+	isOwn = 0;
+      }
+    }
+    atLineStart = line[ strlen( line ) - 1 ] == '\n';
+  }
+  if( ferror( file ) ) {
+
+    isOwn = 0;
+  }
+  fclose( file );
+
+  return isOwn && headers == 1;
+}
+
+/* put the output of a finished run in the cache - every cache hit
+   replays it, so it is only stored if nothing else wrote to it */
+void storeCachedRun( const ResultCache *cache, const PendingRun *run )
+{
+  int logFD, errFD;
+  char name[ READBUF_LEN ];
+
+  if( !runOutputIsOwn( run, "log" ) || !runOutputIsOwn( run, "stderr" ) ) {
+
+    fprintf( stderr, "BM_WARNING: not caching run for %s, its output "
+	     "was not all its own\n", run->tag );
+    return;
+  }
+
+  runLogName( run->tag, run->runID, "log", name, sizeof( name ) );
+  logFD = open( name, O_RDONLY | O_CLOEXEC );
+  runLogName( run->tag, run->runID, "stderr", name, sizeof( name ) );
+  errFD = open( name, O_RDONLY | O_CLOEXEC );
+
+  if( logFD < 0 || errFD < 0
+      || cacheStore( cache, run->cacheKey, "stderr", errFD, 0 ) < 0
+      || cacheStore( cache, run->cacheKey, "log", logFD, 0 ) < 0 ) {
+
+    fprintf( stderr, "BM_WARNING: could not cache run for %s\n", run->tag );
+  }
+
+  if( logFD >= 0 ) {
+
+    close( logFD );
+  }
+  if( errFD >= 0 ) {
+
+    close( errFD );
+  }
+}
+
+/* cache a finished run if it has a key, then add its output to its
+   tag's logs - this reads the whole run, so it is done in a child
+   returns 0 on success, -1 if any of the output couldn't be added */
+int publishRun( const ResultCache *cache, const PendingRun *run )
+{
+  int s, failed;
+  char name[ READBUF_LEN ], logName[ READBUF_LEN ];
+
+  if( run->cacheKey[ 0 ] ) {
+
+    storeCachedRun( cache, run );
+  }
+
+  failed = 0;
+  for( s = 0; s < BM_NUM_RUN_LOGS; ++s ) {
+
+    runLogName( run->tag, run->runID, runLogSuffixes[ s ],
+		name, sizeof( name ) );
+    jobLogName( run->tag, runLogSuffixes[ s ], logName, sizeof( logName ) );
+    if( publishRunLog( name, logName ) < 0 ) {
+
+      failed = -1;
+    }
+  }
+  return failed;
+}
+
+/* start adding the oldest finished run to its tag's logs, unless that
+   is already being done */
+void startRunPublish( ServerState *serv )
+{
+  int s;
+  pid_t pid;
+  LLPoolEntry *cur;
+  PendingRun *run;
+  struct stat st;
+  char logName[ READBUF_LEN ];
+
+  if( serv->publishPID != 0 || serv->pendingRuns->numEntries == 0 ) {
+
+    return;
+  }
+
+  /* entries are added at the head, so the oldest is last */
+  for( cur = LLPoolFirstEntry( serv->pendingRuns );
+       LLPoolNextEntry( cur ) != NULL; cur = LLPoolNextEntry( cur ) );
+  run = (PendingRun *)LLPoolGetItem( cur );
+
+  /* GETLOG only sends the part of the tag's logs written before now */
+  for( s = 0; s < BM_NUM_RUN_LOGS; ++s ) {
+
+    jobLogName( run->tag, runLogSuffixes[ s ], logName, sizeof( logName ) );
+    serv->publishStart[ s ] = stat( logName, &st ) < 0 ? 0 : st.st_size;
+  }
+
+  pid = fork();
+  if( pid == 0 ) {
+    /* child */
+
+    resetChildSignals();
+    _exit( publishRun( &serv->cache, run ) < 0 ? EXIT_FAILURE : 0 );
+  }
+  if( pid < 0 ) {
+    /* do it here rather than leave the run unpublished */
+
+    fprintf( stderr, "BM_WARNING: could not fork to add run for %s\n",
+	     run->tag );
+    serv->publishEntry = cur;
+    runPublished( serv, publishRun( &serv->cache, run ) < 0 );
+    return;
+  }
+
+  serv->publishPID = pid;
+  serv->publishEntry = cur;
+}
+
+/* a run has been added to its tag's logs - anything left behind is added
+   by recoverRunLogs at the next startup.  once nothing more will be
+   written under the tag, its logs can be compressed */
+void runPublished( ServerState *serv, const int failed )
+{
+  PendingRun *run = (PendingRun *)LLPoolGetItem( serv->publishEntry );
+
+  if( failed ) {
+
+    fprintf( stderr, "BM_WARNING: could not add run %"PRIu32
+	     " to the logs for %s\n", run->runID, run->tag );
+  }
+
+  queueTagLogs( serv, run->tag, NULL, serv->publishEntry );
+  free( run->tag );
+  LLPoolRemoveEntry( serv->pendingRuns, serv->publishEntry );
+  serv->publishPID = 0;
+  serv->publishEntry = NULL;
+  startRunPublish( serv );
+}
+
+/* queue a finished job's output to be added to its tag's logs, and
+   stored in the cache under the job's key if cacheRun is set */
+void publishJobLogs( ServerState *serv,
+		     const MatchJob *job,
+		     const int cacheRun )
+{
+  PendingRun run;
+
+  run.tag = strdup( job->tag );
+  assert( run.tag != 0 );
+  run.runID = job->runID;
+  if( cacheRun ) {
+
+    strcpy( run.cacheKey, job->cacheKey );
+  } else {
+
+    run.cacheKey[ 0 ] = 0;
+  }
+  LLPoolAddItem( serv->pendingRuns, &run );
+
+  startRunPublish( serv );
+}
+
+/* number of cores a local job for match is pinned to
+   each bot gets its own core, and the dealer shares the job's cores,
+   since it mostly waits on the players.  a job never needs more than
+   the whole pool, so big matches share cores rather than never run */
+int jobCoreCount( const ServerState *serv, const Match *match )
+{
+  int count;
+
+  if( serv->cores.numCores == 0 ) {
+
+    return 0;
+  }
+
+  count = match->sched.numBots ? match->sched.numBots : 1;
+  return count < serv->cores.numCores ? count : serv->cores.numCores;
+}
+
+/* returns non-zero if the local machine has room for the bots and
+   cores of a job for match */
+int hasLocalRoom( const ServerState *serv, const Match *match )
+{
+  return schedHasBotRoom( &serv->sched, &match->sched )
+    && jobCoreCount( serv, match ) <= serv->cores.numFree;
+}
+
+/* add a line describing where the job's processes run to its log */
+void logJobPlacement( const ServerState *serv,
+		      const Match *match,
+		      const MatchJob *job )
+{
+  int fd, p, botPosition, core, len;
+  char msg[ READBUF_LEN ];
+
+  len = snprintf( msg, sizeof( msg ), "# placement dealer " );
+  len += corePoolDescribe( &serv->cores, job->numCores, job->cores,
+			   &msg[ len ], sizeof( msg ) - len );
+  botPosition = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( !match->players[ p ].isNetworkPlayer && len < sizeof( msg ) ) {
+
+      core = job->cores[ botPosition % job->numCores ];
+      len += snprintf( &msg[ len ], sizeof( msg ) - len, ", %s ",
+		       ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )
+		       ->name );
+      if( len < sizeof( msg ) ) {
+
+	len += corePoolDescribe( &serv->cores, 1, &core,
+				 &msg[ len ], sizeof( msg ) - len );
+      }
+      ++botPosition;
+    }
+  }
+  if( len >= sizeof( msg ) - 1 ) {
+
+    len = sizeof( msg ) - 2;
+  }
+  msg[ len ] = '\n';
+  ++len;
+
+  fd = openJobLog( job, "stderr" );
+  if( fd < 0 ) {
+
+    return;
+  }
+  if( write( fd, msg, len ) < len ) {
+
+    fprintf( stderr, "BM_WARNING: could not log placement of %s\n",
+	     job->tag );
+  }
+  close( fd );
+}
+
+/* stop the dealer of a job whose players couldn't all be started, and
+   the bots started before player p - reaping them finishes the job */
+void abortJobPlayers( MatchJob *job, int p )
+{
+  fprintf( stderr, "BM_ERROR: aborting job\n" );
+
+  if( job->dealerPID ) {
+
+    kill( job->dealerPID, SIGTERM );
+  } else {
+
+    kill( job->worker->dealerPID, SIGTERM );
+  }
+  while( p > 0 ) {
+    --p;
+
+    if( job->botPID[ p ] ) {
+
+      kill( job->botPID[ p ], SIGTERM );
+    }
+  }
+}
+
+/* tell the network players of job where to connect, and start its bots
+   - the dealer's ports must be known */
+void startJobPlayers( ServerState *serv, MatchJob *job )
+{
+  int p, botPosition;
+  pid_t pid;
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  job->state = JOB_RUNNING;
+  botPosition = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( match->players[ p ].isNetworkPlayer ) {
+      /* send message with port to network player to start up */
+
+      if( match->players[ p ].entry == NULL
+	  || sendStartMessage( serv->hostname,
+			       job,
+			       (Connection *)
+			       LLPoolGetItem( match->players[ p ].entry ),
+			       job->ports[ p ] ) < 0 ) {
+	/* abort the job... */
+
+	abortJobPlayers( job, p );
+	return;
+      }
+    } else {
+      BotSpec *bot = (BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+      int core = job->numCores ? job->cores[ botPosition % job->numCores ] : -1;
+
+      if( bot->persistent ) {
+	/* hand the match to a warm bot, replacing it if it has broken */
+
+	job->warmBots[ p ] = claimWarmBot( serv, bot, job->matchEntry );
+	if( job->warmBots[ p ]
+	    && runWarmBot( serv, job->warmBots[ p ], job->ports[ p ],
+			   botPosition, core ) < 0 ) {
+
+	  closeWarmBot( serv, job->warmBots[ p ], SIGKILL );
+	  job->warmBots[ p ] = claimWarmBot( serv, bot, job->matchEntry );
+	  if( job->warmBots[ p ]
+	      && runWarmBot( serv, job->warmBots[ p ], job->ports[ p ],
+			     botPosition, core ) < 0 ) {
+
+	    closeWarmBot( serv, job->warmBots[ p ], SIGKILL );
+	    job->warmBots[ p ] = NULL;
+	  }
+	}
+	if( job->warmBots[ p ] == NULL ) {
+
+	  fprintf( stderr, "BM_ERROR: could not run warm bot %s\n",
+		   bot->name );
+	}
+      } else {
+	/* start up bot */
+
+	if( botLimitsSet( bot->limits ) ) {
+
+	  job->limitGroups[ p ]
+	    = limitGroupCreate( &serv->limitGroups, bot->name, bot->limits );
+	}
+	pid = startBot( serv, bot, job->ports[ p ],
+			botPosition, core, job->limitGroups[ p ],
+			botCpuSecs( serv->conf, bot, match ) );
+	if( pid < 0 ) {
+	  /* only this job fails, the way it would for a network player */
+
+	  fprintf( stderr, "BM_ERROR: could not start bot %s\n", bot->name );
+	  limitGroupRemove( &serv->limitGroups, job->limitGroups[ p ] );
+	  job->limitGroups[ p ] = NULL;
+	  abortJobPlayers( job, p );
+	  return;
+	}
+	job->botPID[ p ] = pid;
+      }
+      ++botPosition;
+    }
+  }
+}
+
+/* start a local job for the match in matchEntry - the players are only
+   started here if the dealer's ports are already known, otherwise the
+   job is left launching until dealerPortsEvent reads them */
+MatchJob runMatchJob( const Config *conf,
+		      ServerState *serv,
+		      LLPoolEntry *matchEntry,
+		      const uint32_t rngSeed )
+{
+  int p;
+  MatchJob job;
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+
+  initMatchJob( serv, &job, matchEntry );
+
+  /* give the job its own cores */
+  job.numCores = jobCoreCount( serv, match );
+  if( job.numCores ) {
+
+    p = corePoolTake( &serv->cores, job.numCores, job.cores );
+    assert( p == 0 );
+    logJobPlacement( serv, match, &job );
+  }
+
+  /* start the dealer */
+  p = startDealer( conf, serv, match, &job, rngSeed );
+  if( p < 0 ) {
+    /* nothing was started, so the job is over before it began */
+
+    fprintf( stderr, "BM_ERROR: could not start dealer for %s\n", job.tag );
+    return job;
+  }
+  if( p == 0 ) {
+
+    startJobPlayers( serv, &job );
+  }
+
+  return job;
+}
+
+/* remember which job each of the job's bots belongs to */
+void addJobBotPIDs( ServerState *serv, LLPoolEntry *jobEntry )
+{
+  int p;
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    if( job->botPID[ p ] ) {
+
+      hashAddInt( serv->pidJobs, job->botPID[ p ], jobEntry );
+    }
+    if( job->warmBots[ p ] ) {
+      WarmBot *warm = (WarmBot *)LLPoolGetItem( job->warmBots[ p ] );
+
+      warm->jobEntry = jobEntry;
+      warm->seat = p;
+    }
+  }
+}
+
+/* remember which job each of the job's processes belongs to */
+void addJobPIDs( ServerState *serv, LLPoolEntry *jobEntry )
+{
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+  if( job->agentEntry ) {
+    /* the agent reports when the whole job is done */
+
+    hashAddInt( ( (Agent *)LLPoolGetItem( job->agentEntry ) )->jobs,
+		job->agentJobID,
+		jobEntry );
+    return;
+  }
+  if( job->worker ) {
+    /* the worker reports when its dealer is done */
+
+    job->worker->jobEntry = jobEntry;
+  } else if( job->dealerPID ) {
+
+    hashAddInt( serv->pidJobs, job->dealerPID, jobEntry );
+  }
+  addJobBotPIDs( serv, jobEntry );
+}
+
+/* stop waiting on a local dealer's port line, or its worker's reply */
+void endJobLaunch( ServerState *serv, MatchJob *job )
+{
+  eventTimerStop( &serv->events, &job->launchTimer );
+  if( job->portPipe < 0 ) {
+
+    return;
+  }
+  eventWatchRemove( &serv->events, &job->portWatch );
+  close( job->portPipe );
+  job->portPipe = -1;
+}
+
+/* give up on a job whose dealer didn't start properly - nothing else
+   has been started for it, so only the dealer needs to go */
+void failJobLaunch( ServerState *serv, LLPoolEntry *jobEntry, const char *why )
+{
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+  fprintf( stderr, "BM_ERROR: dealer for %s %s\n", job->tag, why );
+  endJobLaunch( serv, job );
+
+  if( job->worker ) {
+    /* a worker which doesn't answer can't be trusted with more jobs */
+
+    ++serv->launchFailures[ BM_LAUNCH_WORKER ];
+    kill( job->worker->pid, SIGKILL );
+    job->worker->jobEntry = NULL;
+    closeDealerWorker( serv, job->worker );
+    job->worker = NULL;
+  }
+  if( job->dealerPID ) {
+    /* the job finishes when the dealer is reaped */
+
+    kill( job->dealerPID, SIGKILL );
+  } else if( jobIsFinished( job ) ) {
+
+    finishedJob( serv, jobEntry );
+  }
+}
+
+/* read the port line from a launching dealer, and start the players
+   once it has all arrived */
+void dealerPortsEvent( EventLoop *loop,
+		       EventWatch *watch,
+		       const uint32_t events )
+{
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *jobEntry = (LLPoolEntry *)watch->data;
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  ssize_t r;
+  int p, pos, t;
+
+  r = read( job->portPipe,
+	    &job->portString[ job->portStringLen ],
+	    sizeof( job->portString ) - 1 - job->portStringLen );
+  if( r < 0 && ( errno == EAGAIN || errno == EINTR ) ) {
+
+    return;
+  }
+  if( r <= 0 ) {
+
+    failJobLaunch( serv, jobEntry, "exited before reporting its ports" );
+    return;
+  }
+  job->portStringLen += r;
+  job->portString[ job->portStringLen ] = 0;
+  if( strchr( job->portString, '\n' ) == NULL ) {
+
+    if( job->portStringLen < sizeof( job->portString ) - 1 ) {
+
+      return;
+    }
+    failJobLaunch( serv, jobEntry, "sent a port line which is too long" );
+    return;
+  }
+
+  /* parse the port string */
+  pos = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( sscanf( &job->portString[ pos ],
+		" %"SCNu16"%n",
+		&job->ports[ p ],
+		&t ) < 1 ) {
+
+      failJobLaunch( serv, jobEntry, "sent a bad port line" );
+      return;
+    }
+    pos += t;
+  }
+
+  endJobLaunch( serv, job );
+  startJobPlayers( serv, job );
+  addJobBotPIDs( serv, jobEntry );
+}
+
+void dealerLaunchTimerEvent( EventLoop *loop, EventTimer *timer )
+{
+  LLPoolEntry *jobEntry = (LLPoolEntry *)timer->data;
+
+  failJobLaunch( (ServerState *)loop->data,
+		 jobEntry,
+		 ( (MatchJob *)LLPoolGetItem( jobEntry ) )->worker
+		 ? "was not started by its worker in time"
+		 : "did not report its ports in time" );
+}
+
+/* wait for a launching local dealer from the event loop */
+void watchJobLaunch( ServerState *serv, LLPoolEntry *jobEntry )
+{
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+  if( job->portPipe >= 0
+      && eventWatchAdd( &serv->events,
+			&job->portWatch,
+			job->portPipe,
+			EPOLLIN,
+			dealerPortsEvent,
+			jobEntry ) < 0 ) {
+
+    failJobLaunch( serv, jobEntry, "could not be watched" );
+    return;
+  }
+  eventTimerStart( &serv->events,
+		   &job->launchTimer,
+		   BM_DEALER_WAIT_SECS * 1000000ULL,
+		   0,
+		   dealerLaunchTimerEvent,
+		   jobEntry );
+}
+
+/* find the agent with the most free cores which has room for match
+   returns NULL if no agent can run it */
+LLPoolEntry *pickAgent( const ServerState *serv, const Match *match )
+{
+  int p;
+  int64_t memoryMB;
+  LLPoolEntry *cur, *best;
+  Agent *agent, *bestAgent;
+
+  memoryMB = (int64_t)match->sched.numBots * match->gameConf->botMemoryMB;
+  best = NULL;
+  bestAgent = NULL;
+  for( cur = LLPoolFirstEntry( serv->agents );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    agent = (Agent *)LLPoolGetItem( cur );
+
+    if( agent->freeCores < match->sched.numBots
+	|| agent->freeMemoryMB < memoryMB
+	|| ( bestAgent && agent->freeCores <= bestAgent->freeCores ) ) {
+
+      continue;
+    }
+
+    if( agent->bots ) {
+
+      for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+	if( !match->players[ p ].isNetworkPlayer
+	    && !hashFindString( agent->bots,
+				( (BotSpec *)LLPoolGetItem
+				  ( match->players[ p ].entry ) )->name ) ) {
+
+	  break;
+	}
+      }
+      if( p < match->gameConf->game->numPlayers ) {
+	/* missing one of the bots */
+
+	continue;
+      }
+    }
+
+    best = cur;
+    bestAgent = agent;
+  }
+
+  return best;
+}
+
+/* start a job for match on an agent - network players are told where
+   to connect when the agent reports the dealer's ports
+   returns 0 on success, -1 on failure */
+int runAgentJob( const Config *conf,
+		 ServerState *serv,
+		 LLPoolEntry *matchEntry,
+		 LLPoolEntry *agentEntry,
+		 const uint32_t rngSeed,
+		 MatchJob *job )
+{
+  int p, a, len, botPosition;
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+  Agent *agent = (Agent *)LLPoolGetItem( agentEntry );
+  Connection *conn = (Connection *)LLPoolGetItem( agent->connEntry );
+  DealerArgs args;
+  char msg[ READBUF_LEN ];
+
+  initMatchJob( serv, job, matchEntry );
+  job->agentEntry = agentEntry;
+  ++serv->lastAgentJobID;
+  job->agentJobID = serv->lastAgentJobID;
+
+  /* message is "JOB id #args dealerArgs... #bots (seat position command)..."
+     with the dealer's argv[ 0 ] left off */
+  setDealerArgs( conf, match, job, rngSeed, &args );
+  len = snprintf( msg, sizeof( msg ),
+		  "JOB %"PRIu32" %d", job->agentJobID, args.argc - 1 );
+  for( a = 1; a < args.argc && len < sizeof( msg ); ++a ) {
+
+    len += snprintf( &msg[ len ], sizeof( msg ) - len, " %s", args.argv[ a ] );
+  }
+  if( len < sizeof( msg ) ) {
+
+    len += snprintf( &msg[ len ], sizeof( msg ) - len,
+		     " %d", match->sched.numBots );
+  }
+  botPosition = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers && len < sizeof( msg );
+       ++p ) {
+
+    if( !match->players[ p ].isNetworkPlayer ) {
+
+      len += snprintf( &msg[ len ], sizeof( msg ) - len,
+		       " %d %d %s",
+		       p,
+		       botPosition,
+		       ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )
+		       ->command );
+      ++botPosition;
+    }
+  }
+  if( len + 1 >= sizeof( msg ) ) {
+
+    fprintf( stderr, "BM_ERROR: job for %s is too long to send to agent %s\n",
+	     job->tag, agent->name );
+    ++serv->launchFailures[ BM_LAUNCH_AGENT ];
+    arenaStrfree( &serv->strings, job->tag );
+    return -1;
+  }
+  msg[ len ] = '\n';
+  ++len;
+
+  /* the agent streams the dealer's output back to these */
+  job->logFD = openJobLog( job, "log" );
+  job->errFD = openJobLog( job, "stderr" );
+
+  if( write( conn->connBuf->fd, msg, len ) < len ) {
+
+    fprintf( stderr, "BM_ERROR: could not send job to agent %s\n",
+	     agent->name );
+    ++serv->launchFailures[ BM_LAUNCH_AGENT ];
+    if( job->logFD >= 0 ) {
+
+      close( job->logFD );
+    }
+    if( job->errFD >= 0 ) {
+
+      close( job->errFD );
+    }
+    removeJobLogs( job );
+    arenaStrfree( &serv->strings, job->tag );
+    return -1;
+  }
+
+  agent->freeCores -= match->sched.numBots;
+  agent->freeMemoryMB
+    -= (int64_t)match->sched.numBots * match->gameConf->botMemoryMB;
+  return 0;
+}
+
+/* the process running job's local dealer, or 0 if there is none */
+pid_t jobDealerPID( const MatchJob *job )
+{
+  return job->worker ? job->worker->dealerPID : job->dealerPID;
+}
+
+/* stop the processes of a running local job, giving its place in the
+   scheduler and its cores to other jobs until resumeJob */
+void pauseJob( ServerState *serv, MatchJob *job )
+{
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  int p;
+
+  /* the dealer stops its clocks before the bots stop answering */
+  kill( jobDealerPID( job ), SIGTSTP );
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    /* freezing the bot's group stops any children it has too */
+    if( job->botPID[ p ]
+	&& ( job->limitGroups[ p ] == NULL
+	     || limitGroupFreeze( job->limitGroups[ p ], 1 ) < 0 ) ) {
+
+      kill( job->botPID[ p ], SIGSTOP );
+    }
+  }
+
+  if( job->numCores ) {
+
+    corePoolRelease( &serv->cores, job->numCores, job->cores );
+  }
+  job->isPaused = 1;
+  job->pausedAtMicros = eventNowMicros();
+  schedPause( &serv->sched, &match->sched );
+  ++serv->preemptions;
+  serv->needSchedule = 1;
+}
+
+/* let a paused job carry on, on whichever cores are free now */
+void resumeJob( ServerState *serv, MatchJob *job )
+{
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  int p;
+  pid_t dealerPID;
+
+  /* without the cores, the job runs unpinned rather than not at all */
+  if( job->numCores
+      && corePoolTake( &serv->cores, job->numCores, job->cores ) < 0 ) {
+
+    job->numCores = 0;
+  }
+
+  /* bots first, so they are there when the dealer asks for actions -
+     their children keep the cores they had */
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    if( job->limitGroups[ p ] ) {
+
+      limitGroupFreeze( job->limitGroups[ p ], 0 );
+    }
+    if( job->botPID[ p ] ) {
+
+      if( job->numCores ) {
+
+	corePoolPin( &serv->cores, 1, &job->cores[ p % job->numCores ],
+		     job->botPID[ p ] );
+      }
+      kill( job->botPID[ p ], SIGCONT );
+    }
+  }
+  dealerPID = jobDealerPID( job );
+  if( dealerPID ) {
+
+    if( job->numCores ) {
+
+      corePoolPin( &serv->cores, job->numCores, job->cores, dealerPID );
+    }
+    kill( dealerPID, SIGCONT );
+  }
+
+  job->pausedMicros += eventNowMicros() - job->pausedAtMicros;
+  job->isPaused = 0;
+  schedResume( &serv->sched, &match->sched );
+}
+
+/* the paused job of the match in matchEntry */
+MatchJob *findPausedJob( ServerState *serv, const LLPoolEntry *matchEntry )
+{
+  LLPoolEntry *cur;
+  MatchJob *job;
+
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    job = (MatchJob *)LLPoolGetItem( cur );
+
+    if( job->isPaused && job->matchEntry == matchEntry ) {
+
+      return job;
+    }
+  }
+  return NULL;
+}
+
+/* non-zero if job can be paused for a match of class priority - only
+   local jobs whose processes all belong to the server are paused */
+int jobIsPreemptible( const MatchJob *job, const int priority )
+{
+  const Match *match = (const Match *)LLPoolGetItem( job->matchEntry );
+  int p;
+
+  if( job->state != JOB_RUNNING || job->isPaused || job->agentEntry
+      || jobDealerPID( job ) == 0 || match->priority >= priority ) {
+
+    return 0;
+  }
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( match->players[ p ].isNetworkPlayer || job->warmBots[ p ] ) {
+
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* pause a running job of a lower class for the most urgent waiting
+   match, if it can't start for want of room here and pausing enough
+   jobs would give it that room
+   returns 1 if a job was paused, 0 otherwise */
+int preemptForNext( const Config *conf, ServerState *serv )
+{
+  SchedEntry *next;
+  const Match *match, *m;
+  MatchJob *job, *victim;
+  LLPoolEntry *cur;
+  int gameFull, botsShort, coresShort, bots, cores, canFreeGame;
+
+  next = conf->preemption ? schedPeekBest( &serv->sched ) : NULL;
+  if( next == NULL ) {
+
+    return 0;
+  }
+  match = (const Match *)LLPoolGetItem( (LLPoolEntry *)next->data );
+
+  /* what the match is short of */
+  gameFull = !schedGameHasRoom( next->game );
+  botsShort = serv->sched.maxRunningBots
+    ? serv->sched.curRunningBots + next->numBots - serv->sched.maxRunningBots
+    : 0;
+  coresShort = jobCoreCount( serv, match ) - serv->cores.numFree;
+  if( !gameFull && botsShort <= 0 && coresShort <= 0 ) {
+    /* something else, like a memory cap, is holding it back */
+
+    return 0;
+  }
+
+  /* don't stop anything unless stopping everything would be enough */
+  bots = botsShort;
+  cores = coresShort;
+  canFreeGame = 0;
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    job = (MatchJob *)LLPoolGetItem( cur );
+
+    if( jobIsPreemptible( job, next->priority ) ) {
+
+      m = (const Match *)LLPoolGetItem( job->matchEntry );
+      canFreeGame |= &m->gameConf->sched == next->game;
+      bots -= m->sched.chargedBots;
+      cores -= job->numCores;
+    }
+  }
+  if( ( gameFull && !canFreeGame ) || bots > 0 || cores > 0 ) {
+
+    return 0;
+  }
+
+  /* pause the least urgent job which helps, newest first */
+  victim = NULL;
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    job = (MatchJob *)LLPoolGetItem( cur );
+
+    if( !jobIsPreemptible( job, next->priority ) ) {
+
+      continue;
+    }
+    m = (const Match *)LLPoolGetItem( job->matchEntry );
+    if( gameFull ? &m->gameConf->sched != next->game
+	: !( ( botsShort > 0 && m->sched.chargedBots )
+	     || ( coresShort > 0 && job->numCores ) ) ) {
+
+      continue;
+    }
+    if( victim == NULL
+	|| m->priority
+	< ( (const Match *)LLPoolGetItem( victim->matchEntry ) )->priority
+	|| ( m->priority
+	     == ( (const Match *)LLPoolGetItem( victim->matchEntry ) )->priority
+	     && job->startMicros > victim->startMicros ) ) {
+
+      victim = job;
+    }
+  }
+  if( victim == NULL ) {
+
+    return 0;
+  }
+
+  fprintf( stderr, "BM_WARNING: pausing job %s for match %s of %s\n",
+	   victim->tag, match->tag, match->user->name );
+  pauseJob( serv, victim );
+  return 1;
+}
+
+/* the seed for the next run of match, with the match's generator state
+   after it in rng - the state is only kept if the job starts */
+uint32_t nextRunSeed( const Match *match, rng_state_t *rng )
+{
+  *rng = match->rng;
+  return match->useRngForSeed ? genrand_int32( rng ) : match->rngSeed;
+}
+
+/* check there is memory for another job of match
+   returns 1 if so, 0 otherwise */
+int hasJobMemory( ServerState *serv, const Match *match )
+{
+  if( LLPoolRoom( serv->jobs ) == 0 ) {
+
+    ++serv->memoryRefusals[ BM_MEMORY_JOBS ];
+    return 0;
+  }
+  if( !arenaHasRoom( &serv->strings,
+		     strlen( match->user->name ) + 1 + strlen( match->tag ),
+		     1 ) ) {
+
+    ++serv->memoryRefusals[ BM_MEMORY_STRINGS ];
+    return 0;
+  }
+  return 1;
+}
+
+/* record job as the next run of the match for entry, which leaves the
+   match's generator in rng, and finish the job if it already is */
+void addMatchRun( ServerState *serv,
+		  SchedEntry *entry,
+		  MatchJob *job,
+		  const rng_state_t *rng,
+		  const int isLocal )
+{
+  LLPoolEntry *matchEntry, *jobEntry;
+  Match *match;
+  MatchJob *newJob;
+  struct timeval now;
+
+  matchEntry = (LLPoolEntry *)entry->data;
+  match = (Match *)LLPoolGetItem( matchEntry );
+
+  match->rng = *rng;
+  jobEntry = LLPoolAddItem( serv->jobs, job );
+  addJobPIDs( serv, jobEntry );
+
+  /* update status about running jobs, the user, and the match */
+  match->isRunning = 1;
+  gettimeofday( &now, NULL );
+  schedStart( &serv->sched, entry, isLocal, &now );
+  --match->numRuns;
+  ++match->runsStarted;
+  if( match->isJournaled ) {
+
+    journalMatch( serv, match, "START" );
+  }
+  if( match->gangEntry ) {
+
+    LLPoolRemoveEntry( serv->gangs, match->gangEntry );
+    match->gangEntry = NULL;
+  }
+
+  /* the job's watch has to be set up in its pool copy */
+  newJob = (MatchJob *)LLPoolGetItem( jobEntry );
+  if( newJob->portPipe >= 0 || newJob->worker ) {
+
+    watchJobLaunch( serv, jobEntry );
+  } else if( jobIsFinished( newJob ) ) {
+    /* the run came from the cache, or the dealer couldn't be started */
+
+    finishedJob( serv, jobEntry );
+  }
+}
+
+/* copy the next run of the match for entry from the cache, if it has
+   been played before - this doesn't need room anywhere, so it is done
+   without waiting for the match's turn.  on a miss, cacheKey is set to
+   the key the run should be stored under, or emptied
+   returns 1 if the run was copied, 0 otherwise */
+int replayMatchRun( const Config *conf,
+		    ServerState *serv,
+		    SchedEntry *entry,
+		    char *cacheKey )
+{
+  LLPoolEntry *matchEntry;
+  Match *match;
+  MatchJob job;
+  uint32_t rngSeed;
+  rng_state_t rng;
+
+  matchEntry = (LLPoolEntry *)entry->data;
+  match = (Match *)LLPoolGetItem( matchEntry );
+
+  cacheKey[ 0 ] = 0;
+  if( !matchIsCacheable( serv, match ) || !hasJobMemory( serv, match ) ) {
+
+    return 0;
+  }
+
+  rngSeed = nextRunSeed( match, &rng );
+  initMatchJob( serv, &job, matchEntry );
+  if( jobCacheKey( conf, serv, match, &job, rngSeed ) < 0
+      || replayCachedRun( serv, &job ) < 0 ) {
+
+    strcpy( cacheKey, job.cacheKey );
+    arenaStrfree( &serv->strings, job.tag );
+    return 0;
+  }
+
+  addMatchRun( serv, entry, &job, &rng, 0 );
+  return 1;
+}
+
+/* replay the queued match in matchEntry from the cache for as long as
+   its runs have been played before, which may remove the match */
+void replayCachedRuns( const Config *conf,
+		       ServerState *serv,
+		       LLPoolEntry *matchEntry )
+{
+  int isLast;
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+  char cacheKey[ CACHE_DIGEST_LEN + 1 ];
+
+  do {
+
+    if( !schedIsQueued( &match->sched ) || match->sched.isPaused ) {
+
+      return;
+    }
+    isLast = match->numRuns == 1;
+  } while( replayMatchRun( conf, serv, &match->sched, cacheKey ) && !isLast );
+}
+
+/* start the next run of the match for entry, on an agent or locally
+   returns 1 if a job was started, 0 if there was no room for it */
+int startMatchRun( const Config *conf, ServerState *serv, SchedEntry *entry )
+{
+  LLPoolEntry *matchEntry, *agentEntry;
+  Match *match;
+  MatchJob job;
+  uint32_t rngSeed;
+  rng_state_t rng;
+  char cacheKey[ CACHE_DIGEST_LEN + 1 ];
+
+  matchEntry = (LLPoolEntry *)entry->data;
+  match = (Match *)LLPoolGetItem( matchEntry );
+
+  /* a paused job carries on where it was once there is room for it */
+  if( entry->isPaused ) {
+
+    if( !hasLocalRoom( serv, match ) ) {
+
+      return 0;
+    }
+    resumeJob( serv, findPausedJob( serv, matchEntry ) );
+    return 1;
+  }
+
+  /* with no memory for another job, wait for one to finish */
+  if( !hasJobMemory( serv, match ) ) {
+
+    return 0;
+  }
+
+  /* runs are mostly replayed when they are submitted, but a match with
+     a run which wasn't cached then may have later ones which are */
+  if( replayMatchRun( conf, serv, entry, cacheKey ) ) {
+
+    return 1;
+  }
+
+  /* find somewhere with room to run it, trying agents before the local
+     machine - warm bots only live here, so their matches stay local */
+  rngSeed = nextRunSeed( match, &rng );
+  agentEntry = matchUsesWarmBots( match ) ? NULL : pickAgent( serv, match );
+  if( agentEntry == NULL && !hasLocalRoom( serv, match ) ) {
+
+    return 0;
+  }
+
+  if( agentEntry == NULL
+      || runAgentJob( conf, serv, matchEntry, agentEntry,
+		      rngSeed, &job ) < 0 ) {
+
+    if( !hasLocalRoom( serv, match ) ) {
+
+      return 0;
+    }
+    agentEntry = NULL;
+    job = runMatchJob( conf, serv, matchEntry, rngSeed );
+  }
+  strcpy( job.cacheKey, cacheKey );
+  addMatchRun( serv, entry, &job, &rng, agentEntry == NULL );
+
+  return 1;
+}
+
+int startMatchJob( const Config *conf, ServerState *serv )
+{
+  SchedEntry *next;
+  LLPoolEntry *cur;
+  Match *match;
+
+  /* matches running back to back on warm bots go first, so nothing else
+     takes the room their last run just gave back - unless a match of a
+     higher class is waiting for it */
+  next = schedPeekBest( &serv->sched );
+  for( cur = LLPoolFirstEntry( serv->gangs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    match = (Match *)LLPoolGetItem( *(LLPoolEntry **)LLPoolGetItem( cur ) );
+
+    if( schedGameHasRoom( &match->gameConf->sched )
+	&& ( next == NULL || match->priority >= next->priority )
+	&& startMatchRun( conf, serv, &match->sched ) ) {
+
+      return 1;
+    }
+  }
+
+  /* then the best match by the scheduling policy */
+  next = schedPeekNext( &serv->sched );
+  if( next && startMatchRun( conf, serv, next ) ) {
+
+    return 1;
+  }
+
+  /* nothing can start, so make room by pausing a less urgent job */
+  return preemptForNext( conf, serv );
+}
+
+void initServerState( const Config *conf, ServerState *serv )
+{
+  struct addrinfo hints, *info;
+  uint16_t port;
+  int hnm, r, w, maxPlayers;
+  char *hn;
+  char ipstr[ INET6_ADDRSTRLEN ];
+
+  LLPoolEntry *cur;
+
+  sigset_t sigchld;
+
+  serv->conns = newLLPool( sizeof( Connection ) );
+  LLPoolSetLimit( serv->conns, conf->memoryLimits[ BM_MEMORY_CONNS ] );
+  serv->matches = newLLPool( sizeof( Match ) );
+  LLPoolSetLimit( serv->matches, conf->memoryLimits[ BM_MEMORY_MATCHES ] );
+  serv->jobs = newLLPool( sizeof( MatchJob ) );
+  LLPoolSetLimit( serv->jobs, conf->memoryLimits[ BM_MEMORY_JOBS ] );
+  initStringArena( &serv->strings, conf->memoryLimits[ BM_MEMORY_STRINGS ] );
+
+  serv->trace = NULL;
+  if( conf->traceFile
+      && ( serv->trace = fopen( conf->traceFile, "ae" ) ) == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not open trace file %s\n",
+	     conf->traceFile );
+    exit( EXIT_FAILURE );
+  }
+  memset( serv->memoryRefusals, 0, sizeof( serv->memoryRefusals ) );
+  serv->preemptions = 0;
+  serv->agents = newLLPool( sizeof( Agent ) );
+  serv->lastAgentJobID = 0;
+  serv->results = newLLPool( sizeof( ResultStats ) );
+  serv->resultIndex = newHashTable( HASH_DEFAULT_BUCKETS );
+  serv->warmBots = newLLPool( sizeof( WarmBot ) );
+  serv->warmBotPIDs = newHashTable( HASH_DEFAULT_BUCKETS );
+  initEventTimer( &serv->warmBotTimer );
+  serv->gangs = newLLPool( sizeof( LLPoolEntry * ) );
+  serv->journal.fd = -1;
+  serv->numJournaledMatches = 0;
+  serv->lastMatchID = 0;
+  serv->pidJobs = newHashTable( HASH_DEFAULT_BUCKETS );
+
+  /* children exiting are reported through a file descriptor, so the
+     main loop notices finished jobs as soon as they happen */
+  sigemptyset( &sigchld );
+  sigaddset( &sigchld, SIGCHLD );
+  if( sigprocmask( SIG_BLOCK, &sigchld, NULL ) < 0
+      || ( serv->sigchldFD
+	   = signalfd( -1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC ) ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create signalfd for SIGCHLD\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  /* give every game a run queue */
+  initScheduler( &serv->sched, conf->schedPolicy, conf->maxRunningBots );
+  maxPlayers = 1;
+  for( cur = LLPoolFirstEntry( conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    GameConfig *gameConf = (GameConfig *)LLPoolGetItem( cur );
+
+    if( gameConf->game->numPlayers > maxPlayers ) {
+
+      maxPlayers = gameConf->game->numPlayers;
+    }
+
+    schedAddGame( &serv->sched, &gameConf->sched, gameConf->maxRunningJobs );
+    initHistogram( &gameConf->jobSecs,
+		   sizeof( jobSecsBounds ) / sizeof( jobSecsBounds[ 0 ] ),
+		   jobSecsBounds );
+    initHistogram( &gameConf->handsPerSec,
+		   sizeof( handsPerSecBounds )
+		   / sizeof( handsPerSecBounds[ 0 ] ),
+		   handsPerSecBounds );
+  }
+
+  /* the adaptive limit always leaves room for a job of any game, and
+     moves a job's worth of bots at a time */
+  initEventTimer( &serv->adaptTimer );
+  if( conf->adaptiveConcurrency ) {
+
+    initAdaptiveLimit( &serv->adapt,
+		       maxPlayers,
+		       conf->maxRunningBots,
+		       maxPlayers );
+    serv->sched.maxRunningBots = serv->adapt.limit;
+    printf( "adaptive bot limit %d, between %d and %d\n",
+	    serv->adapt.limit, serv->adapt.floor, serv->adapt.ceiling );
+  }
+
+  /* create the socket clients will connect to */
+  port = conf->port;
+  serv->listenSocket = getListenSocket( &port );
+  if( serv->listenSocket < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not open socket for listening\n" );
+    exit( EXIT_FAILURE );
+  }
+  printf( "starting server on port %"PRIu16"\n", conf->port );
+
+  /* metrics get their own port, so scrapers never see the user protocol */
+  serv->metricsClients = newLLPool( sizeof( MetricsClient ) );
+  serv->pendingLogs = newLLPool( sizeof( PendingLog ) );
+  serv->lastPendingLog = 0;
+  serv->lastRunID = recoverRunLogs();
+  serv->compressPID = 0;
+  serv->compressEntry = NULL;
+  serv->pendingRuns = newLLPool( sizeof( PendingRun ) );
+  serv->publishPID = 0;
+  serv->publishEntry = NULL;
+  for( w = 0; w < BM_NUM_LAUNCH_KINDS; ++w ) {
+
+    serv->launchFailures[ w ] = 0;
+  }
+  serv->metricsSocket = -1;
+  if( conf->metricsPort ) {
+
+    port = conf->metricsPort;
+    serv->metricsSocket = getListenSocket( &port );
+    if( serv->metricsSocket < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: could not open metrics port %"PRIu16"\n",
+	       conf->metricsPort );
+      exit( EXIT_FAILURE );
+    }
+    fcntl( serv->metricsSocket, F_SETFD, FD_CLOEXEC );
+    printf( "serving metrics on port %"PRIu16"\n", conf->metricsPort );
+    fflush( stdout );
+  }
+
+  init_genrand( &serv->rng, time( NULL ) );
+
+  hnm = sysconf( _SC_HOST_NAME_MAX );
+  hn = (char*)malloc( hnm );
+  assert( hn != 0 );
+  if( gethostname( hn, hnm + 1 ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not get hostname\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if( ( r = getaddrinfo( hn, NULL, &hints, &info ) ) != 0 ) {
+
+    fprintf( stderr,
+	     "BM_ERROR: could not get address info for host %s\n",
+	     hn );
+    exit( 1 );
+  }
+  free( hn );
+
+  /* Get an address for the server */
+  void *addr;
+
+  /* get the pointer to the address itself,
+   * different fields in IPv4 and IPv6: */
+  if ( info->ai_family == AF_INET ) {
+    /* IPv4 */
+    struct sockaddr_in *ipv4 = ( struct sockaddr_in * ) info->ai_addr;
+    addr = &( ipv4->sin_addr );
+  } else {
+    /* IPv6 */
+    struct sockaddr_in6 *ipv6 = ( struct sockaddr_in6 * ) info->ai_addr;
+    addr = &( ipv6->sin6_addr );
+  }
+
+  /* convert the IP to a string and store it:*/
+  inet_ntop( info->ai_family, addr, ipstr, sizeof( ipstr ) );
+  serv->hostname = strdup( ipstr );
+
+  freeaddrinfo( info ); /* free the linked list */
+
+  serv->devnullfd = open( "/dev/null", O_WRONLY );
+  if( serv->devnullfd < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not open /dev/null\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  serv->portPool = (PooledPort*)malloc( sizeof( PooledPort )
+					* ( conf->portPoolSize + 1 ) );
+  assert( serv->portPool != 0 );
+  serv->portPoolCount = 0;
+  fillPortPool( conf, serv );
+
+  /* workers are only handed jobs with pooled ports */
+  serv->numWorkers = conf->portPoolSize ? conf->dealerWorkers : 0;
+  serv->workers = (DealerWorker *)malloc( sizeof( DealerWorker )
+					  * ( serv->numWorkers + 1 ) );
+  assert( serv->workers != 0 );
+  for( w = 0; w < serv->numWorkers; ++w ) {
 
-    return -1;
+    spawnDealerWorker( serv, &serv->workers[ w ] );
   }
-  pos += t;
-  if( match->numRuns < 0 || match->numRuns > match->gameConf->maxMatchRuns ) {
 
-    return -1;
+  serv->cache.dir = NULL;
+  serv->cacheHits = 0;
+  serv->cacheMisses = 0;
+  if( conf->resultCacheDir
+      && initResultCache( &serv->cache, conf->resultCacheDir ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not use result cache %s\n",
+	     conf->resultCacheDir );
+    exit( EXIT_FAILURE );
   }
 
-  /* make sure tag has no characters in it */
-  if( strchr( tag, '/' ) != NULL ) {
+  if( initLimitGroups( &serv->limitGroups, conf->botCgroup ) < 0 ) {
 
-    return -1;
+    fprintf( stderr, "BM_WARNING: could not use cgroup %s for bots\n",
+	     conf->botCgroup );
   }
+  if( serv->limitGroups.dir == NULL ) {
 
-  /* get bots */
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+    for( cur = LLPoolFirstEntry( conf->games );
+	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+      GameConfig *gameConf = (GameConfig *)LLPoolGetItem( cur );
 
-    /* get the name */
-    if( sscanf( &spec[ pos ], " %s%n", name, &t ) < 1 ) {
+      if( gameConf->botLimits.maxPids ) {
 
-      return -1;
+	fprintf( stderr, "BM_WARNING: bot process limit for %s needs botCgroup, it is ignored\n",
+		 gameConf->gameFile );
+      }
     }
-    pos += t;
+  }
 
-    /* translate the name into an index */
-    if( !strcmp( name, "LOCAL" ) ) {
+  serv->cores.numCores = 0;
+  serv->cores.numFree = 0;
+  if( conf->jobCores ) {
 
-      match->players[ p ].isNetworkPlayer = 1;
-      match->players[ p ].entry = connEntry;
+    if( initCorePool( &serv->cores, conf->jobCores ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: could not use job cores %s\n",
+	       conf->jobCores );
+      exit( EXIT_FAILURE );
+    }
+    printf( "pinning jobs to %d cores on %d nodes\n",
+	    serv->cores.numCores, serv->cores.numNodes );
+    fflush( stdout );
+  }
+}
+
+/* record the usage of the job's dealer or bot process pid */
+void addJobUsage( MatchJob *job, const pid_t pid, const ProcUsage *usage )
+{
+  int p;
+
+  job->cpuSecs += usage->userSecs + usage->sysSecs;
+  if( job->dealerPID == pid ) {
+
+    job->dealerUsage = *usage;
+  }
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    if( job->botPID[ p ] == pid ) {
+
+      job->botUsage[ p ] = *usage;
+    }
+  }
+}
+
+/* append the usage of each of the job's local processes to its error
+   log as "# USAGE who userSecs sysSecs maxRSSKB voluntary involuntary"
+   lines, where who is "dealer" or "seat p name", and add them to the
+   totals for the game and bots */
+void reportJobUsage( MatchJob *job, Match *match )
+{
+  int fd, p, len;
+  BotSpec *bot;
+  ProcUsage *usage;
+  char line[ READBUF_LEN * 2 ];
+
+  fd = -1;
+  for( p = -1; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( p < 0 ) {
+
+      usage = &job->dealerUsage;
+      bot = NULL;
     } else {
 
-      match->players[ p ].isNetworkPlayer = 0;
-      match->players[ p ].entry = findBot( match->gameConf, name );
-      if( match->players[ p ].entry == NULL ) {
+      usage = &job->botUsage[ p ];
+      bot = match->players[ p ].isNetworkPlayer ? NULL
+	: (BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+    }
+    if( usage->numProcs == 0 || ( p >= 0 && bot == NULL ) ) {
 
-	return -1;
+      continue;
+    }
+    if( fd < 0 && ( fd = openJobLog( job, "stderr" ) ) < 0 ) {
+
+      return;
+    }
+
+    if( bot ) {
+
+      len = snprintf( line, sizeof( line ), "# USAGE seat %d %s", p, bot->name );
+      addProcUsage( &bot->usage, usage );
+    } else {
+
+      len = snprintf( line, sizeof( line ), "# USAGE dealer" );
+      addProcUsage( &match->gameConf->dealerUsage, usage );
+    }
+    len += snprintf( &line[ len ], sizeof( line ) - len,
+		     " %.3f %.3f %"PRIu64" %"PRIu64" %"PRIu64"\n",
+		     usage->userSecs, usage->sysSecs, usage->maxRSSKB,
+		     usage->volCtxSwitches, usage->involCtxSwitches );
+    if( write( fd, line, len ) < len ) {
+
+      fprintf( stderr, "BM_ERROR: could not write usage of job %s\n",
+	       job->tag );
+    }
+  }
+  if( fd >= 0 ) {
+
+    close( fd );
+  }
+}
+
+/* returns 1 if all of the job's processes have exited */
+int jobIsFinished( const MatchJob *job )
+{
+  int p;
+
+  if( job->dealerPID || job->worker || job->agentEntry ) {
+
+    return 0;
+  }
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    if( job->botPID[ p ] || job->warmBots[ p ] ) {
+
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* find the SCORE line for the run of job in its log, and add it to the
+   statistics for the match's tag and players
+   returns the number of hands in the run, or 0 if it has no score */
+uint64_t addJobResults( ServerState *serv,
+			const MatchJob *job,
+			const Match *match )
+{
+  int fd, numPlayers, pos, t;
+  uint32_t lastHand;
+  uint64_t hands;
+  ssize_t len;
+  off_t start;
+  double values[ MAX_PLAYERS ], delta;
+  char *line, *next, *score, *pairing, *end;
+  LLPoolEntry *entry;
+  ResultStats *stats, newStats;
+  struct stat st;
+  char name[ READBUF_LEN ], key[ READBUF_LEN ];
+  char buf[ BM_RESULT_TAIL_BYTES + 1 ];
+
+  jobOutputName( job, "log", name, sizeof( name ) );
+  fd = open( name, O_RDONLY | O_CLOEXEC );
+  if( fd < 0 ) {
+
+    return 0;
+  }
+  if( fstat( fd, &st ) < 0 || st.st_size == 0 ) {
+
+    close( fd );
+    return 0;
+  }
+
+  /* the score is at the very end of a run, so only read the tail */
+  start = st.st_size > BM_RESULT_TAIL_BYTES
+    ? st.st_size - BM_RESULT_TAIL_BYTES : 0;
+  len = pread( fd, buf, st.st_size - start, start );
+  close( fd );
+  if( len <= 0 ) {
+
+    return 0;
+  }
+  buf[ len ] = 0;
+
+  /* hands are counted from the last STATE before the SCORE */
+  line = buf;
+  if( start > 0 ) {
+    /* skip the partial line at the start of the tail */
+
+    line = strchr( buf, '\n' );
+    line = line ? line + 1 : &buf[ len ];
+  }
+  score = NULL;
+  hands = match->numHands;
+  for( ; *line; line = next ) {
+
+    next = strchr( line, '\n' );
+    if( next == NULL ) {
+      /* run was cut off in the middle of a line */
+
+      break;
+    }
+    *next = 0;
+    ++next;
+
+    if( !strncmp( line, "SCORE:", 6 ) ) {
+
+      score = line;
+    } else if( score == NULL
+	       && sscanf( line, "STATE:%"SCNu32":", &lastHand ) == 1 ) {
+
+      hands = (uint64_t)lastHand + 1;
+    }
+  }
+  if( score == NULL || hands == 0 ) {
+
+    return 0;
+  }
+
+  /* SCORE:value|value...:name|name... */
+  pos = 6;
+  for( numPlayers = 0; numPlayers < MAX_PLAYERS; ) {
+
+    values[ numPlayers ] = strtod( &score[ pos ], &end );
+    if( end == &score[ pos ] ) {
+
+      return 0;
+    }
+    pos = end - score;
+    ++numPlayers;
+    if( score[ pos ] != '|' ) {
+
+      break;
+    }
+    ++pos;
+  }
+  if( score[ pos ] != ':' ) {
+
+    return 0;
+  }
+  pairing = &score[ pos + 1 ];
+
+  t = snprintf( key, sizeof( key ), "%s %s %s",
+		match->user->name, match->tag, pairing );
+  if( t >= sizeof( key ) ) {
+
+    return 0;
+  }
+  entry = (LLPoolEntry *)hashFindString( serv->resultIndex, key );
+  if( entry == NULL ) {
+
+    memset( &newStats, 0, sizeof( newStats ) );
+    newStats.key = strdup( key );
+    newStats.user = match->user->name;
+    newStats.tag = strdup( match->tag );
+    newStats.pairing = strdup( pairing );
+    newStats.numPlayers = numPlayers;
+    entry = LLPoolAddItem( serv->results, &newStats );
+    stats = (ResultStats *)LLPoolGetItem( entry );
+    hashAddString( serv->resultIndex, stats->key, entry );
+  }
+  stats = (ResultStats *)LLPoolGetItem( entry );
+  if( stats->numPlayers != numPlayers ) {
+
+    return 0;
+  }
+
+  /* each run's value per hand is one sample (Welford's update) */
+  ++stats->runs;
+  stats->hands += hands;
+  for( t = 0; t < numPlayers; ++t ) {
+
+    delta = values[ t ] / hands - stats->mean[ t ];
+    stats->mean[ t ] += delta / stats->runs;
+    stats->m2[ t ] += delta * ( values[ t ] / hands - stats->mean[ t ] );
+  }
+
+  return hands;
+}
+
+/* append a "# LIMIT seat p name limit" line to the job's error log for
+   each limit a bot went over, and count them against the bots
+   returns non-zero if any bot went over a limit */
+int reportJobLimits( MatchJob *job, Match *match )
+{
+  int fd, p, k, len, hit;
+  BotSpec *bot;
+  char line[ READBUF_LEN * 2 ];
+
+  fd = -1;
+  hit = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( job->limitHits[ p ] == 0 || match->players[ p ].isNetworkPlayer ) {
+
+      continue;
+    }
+    bot = (BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+    for( k = 0; k < BM_NUM_LIMITS; ++k ) {
+
+      if( !( job->limitHits[ p ] & ( 1 << k ) ) ) {
+
+	continue;
+      }
+      hit = 1;
+      ++bot->limitHits[ k ];
+      printf( "job %s: bot %s in seat %d went over its %s limit\n",
+	      job->tag, bot->name, p, limitNames[ k ] );
+      fflush( stdout );
+
+      if( fd < 0 && ( fd = openJobLog( job, "stderr" ) ) < 0 ) {
+
+	continue;
+      }
+      len = snprintf( line, sizeof( line ), "# LIMIT seat %d %s %s\n",
+		      p, bot->name, limitNames[ k ] );
+      if( write( fd, line, len ) < len ) {
+
+	fprintf( stderr, "BM_ERROR: could not write limits of job %s\n",
+		 job->tag );
       }
     }
   }
+  if( fd >= 0 ) {
 
-  match->tag = strdup( tag );
-  match->rngSeed = rngSeed;
-  if( rngSeed ) {
+    close( fd );
+  }
 
-    init_genrand( &match->rng, rngSeed );
-    if( match->numRuns == 1 ) {
+  return hit;
+}
 
-      match->useRngForSeed = 0;
-    } else {
+void finishedJob( ServerState *serv, LLPoolEntry *jobEntry )
+{
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  int cacheRun;
+  uint64_t hands;
+  double secs;
 
-      match->useRngForSeed = 1;
+  endJobLaunch( serv, job );
+  if( job->state == JOB_LAUNCHING ) {
+    /* the dealer went away without ever reporting its ports */
+
+    ++serv->launchFailures[ job->agentJobID ? BM_LAUNCH_AGENT
+			    : BM_LAUNCH_LOCAL ];
+  }
+  if( reportJobLimits( job, match ) ) {
+    /* the bot was stopped or starved by the kernel, so the run says
+       nothing about how the players play, whatever the log ends with */
+
+    hands = 0;
+    ++match->gameConf->outcomes[ BM_OUTCOME_LIMIT ];
+  } else {
+
+    hands = addJobResults( serv, job, match );
+    ++match->gameConf->outcomes[ hands ? BM_OUTCOME_SCORED
+				 : BM_OUTCOME_UNSCORED ];
+  }
+  cacheRun = 0;
+  if( job->state == JOB_RUNNING ) {
+    /* jobs which never got going would only skew the timings */
+
+    secs = jobRunMicros( job ) / 1e6;
+    histogramObserve( &match->gameConf->jobSecs, secs );
+    if( hands && secs > 0.0 ) {
+      int p;
+
+      histogramObserve( &match->gameConf->handsPerSec, hands / secs );
+
+      /* remembered for estimating when queued matches will run */
+      throughputObserve( &match->gameConf->throughput, hands / secs );
+      for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+	if( !match->players[ p ].isNetworkPlayer ) {
+
+	  throughputObserve( &( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )->throughput,
+			     hands / secs );
+	}
+      }
+    }
+
+    /* agents run their own copies of the bots, which the key can't
+       vouch for, so only local runs are cached */
+    cacheRun = hands && job->cacheKey[ 0 ] && job->agentJobID == 0;
+  }
+  reportJobUsage( job, match );
+  traceRun( serv, job, match );
+  publishJobLogs( serv, job, cacheRun );
+  job->state = JOB_FINISHED;
+
+  /* charge the user for the job, and put the match back in the queue */
+  schedFinish( &serv->sched, &match->sched, job->cpuSecs );
+  match->isRunning = 0;
+  if( match->isJournaled ) {
+
+    journalMatch( serv, match, "FINISH" );
+  }
+  if( match->numRuns > 0 ) {
+
+    schedEnqueue( &serv->sched, &match->sched );
+
+    /* gang the match's runs together while its warm bots are ready */
+    if( match->gangEntry == NULL && matchUsesWarmBots( match ) ) {
+
+      match->gangEntry = LLPoolAddItem( serv->gangs, &job->matchEntry );
     }
   } else {
 
-    init_genrand( &match->rng, genrand_int32( &serv->rng ) );
+    removeMatch( serv, job->matchEntry );
   }
+  serv->needSchedule = 1;
 
-  return 0;
+  if( job->numCores ) {
+
+    corePoolRelease( &serv->cores, job->numCores, job->cores );
+  }
+  if( job->logFD >= 0 ) {
+
+    close( job->logFD );
+  }
+  if( job->errFD >= 0 ) {
+
+    close( job->errFD );
+  }
+  arenaStrfree( &serv->strings, job->tag );
+  LLPoolRemoveEntry( serv->jobs, jobEntry );
 }
- 
-void writeHelpMessage( int fd )
+
+/* give back the capacity job was using on its agent */
+void releaseAgentJob( Agent *agent, const MatchJob *job )
 {
-  int r;
+  const Match *match = (const Match *)LLPoolGetItem( job->matchEntry );
 
-  r = write( fd, "HELP - this message\n", 20 );
-  r = write( fd, "GAMES - list available games and players\n", 41 );
-  r = write( fd, "QSTAT - show the current queue\n", 31 );
-  r = write( fd, "RUNMATCHES game #runs tag rngSeed player ... - submit match request\n", 68 );
-  r = write( fd, "  - Player order decides match seating\n", 39 );
-  r = write( fd, "  - \"LOCAL\" player runs the bm_widget agent (bot_command)\n", 60 );
+  agent->freeCores += match->sched.numBots;
+  agent->freeMemoryMB
+    += (int64_t)match->sched.numBots * match->gameConf->botMemoryMB;
 }
 
-void writeGameList( const Config *conf, int fd )
+/* handle a line from an agent:
+   "PORTS id port ..." once the dealer is listening,
+   "LOG id kind text" with dealer output - kind is L for the log file
+   or E for standard error, or l/e if text continues on the next line,
+   "DONE id status cpuMicros" once the dealer and bots have exited */
+void handleAgentMessage( ServerState *serv,
+			 LLPoolEntry *connEntry,
+			 char *line )
 {
-  int r;
-  LLPoolEntry *cur, *botCur;
-  char line[ READBUF_LEN ];
+  int p, pos, t, fd, status, len;
+  uint32_t id;
+  int64_t cpuMicros;
+  char kind;
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+  Agent *agent = (Agent *)LLPoolGetItem( conn->agentEntry );
+  LLPoolEntry *jobEntry;
+  MatchJob *job;
+  Match *match;
 
-  for( cur = LLPoolFirstEntry( conf->games );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-    GameConfig *game = (GameConfig *)LLPoolGetItem( cur );
+  if( sscanf( line, "%*s %"SCNu32"%n", &id, &pos ) < 1 ) {
 
-    r = snprintf( line, sizeof( line ), "\n%s\n", game->gameFile );
-    assert( r > 0 );
-    r = write( fd, line, r );
+    fprintf( stderr, "BM_ERROR: bad message from agent %s: %s",
+	     agent->name, line );
+    return;
+  }
+  jobEntry = (LLPoolEntry *)hashFindInt( agent->jobs, id );
+  if( jobEntry == NULL ) {
+    /* job already gone, aborted for example */
+
+    return;
+  }
+  job = (MatchJob *)LLPoolGetItem( jobEntry );
+  match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  if( !strncmp( line, "LOG ", 4 ) ) {
+
+    if( sscanf( &line[ pos ], " %c %n", &kind, &t ) < 1 ) {
+
+      return;
+    }
+    pos += t;
+
+    fd = ( kind == 'L' || kind == 'l' ) ? job->logFD : job->errFD;
+    len = strlen( &line[ pos ] );
+    if( ( kind == 'l' || kind == 'e' ) && len && line[ pos + len - 1 ] == '\n' ) {
+      /* the text carries on in the next message */
+
+      --len;
+    }
+    if( fd >= 0 && write( fd, &line[ pos ], len ) < len ) {
+
+      fprintf( stderr, "BM_ERROR: could not write log for %s\n", job->tag );
+    }
+  } else if( !strncmp( line, "PORTS ", 6 ) ) {
+
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+      if( sscanf( &line[ pos ], " %"SCNu16"%n", &job->ports[ p ], &t ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: bad port string from agent %s: %s",
+		 agent->name, line );
+	return;
+      }
+      pos += t;
+    }
+
+    /* the dealer is listening, so start the network players */
+    job->state = JOB_RUNNING;
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+      if( !match->players[ p ].isNetworkPlayer ) {
+
+	continue;
+      }
+
+      if( match->players[ p ].entry == NULL
+	  || sendStartMessage( agent->host,
+			       job,
+			       (Connection *)
+			       LLPoolGetItem( match->players[ p ].entry ),
+			       job->ports[ p ] ) < 0 ) {
+	char msg[ 32 ];
+
+	fprintf( stderr, "BM_ERROR: aborting job\n" );
+	len = snprintf( msg, sizeof( msg ), "KILL %"PRIu32"\n", id );
+	if( write( conn->connBuf->fd, msg, len ) < len ) {
+
+	  fprintf( stderr, "BM_ERROR: could not abort job on agent %s\n",
+		   agent->name );
+	}
+	break;
+      }
+    }
+  } else if( !strncmp( line, "DONE ", 5 ) ) {
+
+    if( sscanf( &line[ pos ], " %d %"SCNd64, &status, &cpuMicros ) < 2 ) {
+
+      fprintf( stderr, "BM_ERROR: bad message from agent %s: %s",
+	       agent->name, line );
+      return;
+    }
+
+    hashRemoveInt( agent->jobs, id );
+    releaseAgentJob( agent, job );
+    job->cpuSecs += cpuMicros / 1e6;
+    job->agentEntry = NULL;
+    if( jobIsFinished( job ) ) {
+
+      finishedJob( serv, jobEntry );
+    }
+    serv->needSchedule = 1;
+  } else {
+
+    fprintf( stderr, "BM_ERROR: unknown message from agent %s: %s",
+	     agent->name, line );
+  }
+}
+
+/* forget about an agent whose connection has closed - its jobs can't
+   report back any more, so they are finished as they stand */
+void removeAgent( ServerState *serv, LLPoolEntry *agentEntry )
+{
+  Agent *agent = (Agent *)LLPoolGetItem( agentEntry );
+  HashEntry *cur;
+  LLPoolEntry *jobEntry;
+  MatchJob *job;
+
+  fprintf( stderr, "WARNING: agent %s has gone away\n", agent->name );
+  while( ( cur = hashNextEntry( agent->jobs, NULL ) ) != NULL ) {
 
-    for( botCur = LLPoolFirstEntry( game->bots );
-	 botCur != NULL; botCur = LLPoolNextEntry( botCur ) ) {
-      BotSpec *bot = (BotSpec *)LLPoolGetItem( botCur );
+    jobEntry = (LLPoolEntry *)hashRemoveInt( agent->jobs, cur->intKey );
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+    job->agentEntry = NULL;
+    if( jobIsFinished( job ) ) {
 
-      r = snprintf( line, sizeof( line ), " %s\n", bot->name );
-      assert( r > 0 );
-      r = write( fd, line, r );
+      finishedJob( serv, jobEntry );
     }
   }
+
+  destroyHashTable( agent->jobs );
+  if( agent->bots ) {
+
+    destroyHashTable( agent->bots );
+  }
+  free( agent->host );
+  LLPoolRemoveEntry( serv->agents, agentEntry );
 }
 
-void writeQueueStatus( const Config *conf, const ServerState *serv, int fd )
+/* non-zero if the bot in the job's seat p, which exited with status
+   after using usage, was killed for going over its CPU time rlimit -
+   SIGKILL only comes once the hard limit is passed too */
+int botOverCpuTime( const ServerState *serv,
+		    const MatchJob *job,
+		    const int p,
+		    const int status,
+		    const ProcUsage *usage )
 {
-  int r;
-  LLPoolEntry *cur;
-  char line[ READBUF_LEN * 4 ];
+  const Match *match = (const Match *)LLPoolGetItem( job->matchEntry );
+  double cpuSecs;
 
-  if( serv->matches->numEntries == 0 ) {
-    r = write( fd, "Queue empty\n", 12 );
-  }
+  if( job->limitGroups[ p ] || !WIFSIGNALED( status )
+      || match->players[ p ].isNetworkPlayer ) {
 
-  for( cur = LLPoolFirstEntry( serv->matches );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-    Match *match = (Match *)LLPoolGetItem( cur );
+    return 0;
+  }
+  cpuSecs = botCpuSecs( serv->conf,
+			(const BotSpec *)
+			LLPoolGetItem( match->players[ p ].entry ),
+			match );
+  if( cpuSecs <= 0.0 ) {
 
-    r = snprintf( line,
-		  sizeof( line ),
-		  "%s %s %s * %d %s\n",
-		  match->user->name,
-		  match->tag,
-		  match->gameConf->gameFile,
-		  match->numRuns,
-		  match->isRunning ? "R" : "Q" );
-    assert( r > 0 );
-    r = write( fd, line, r );
+    return 0;
   }
+  return WTERMSIG( status ) == SIGXCPU
+    || ( WTERMSIG( status ) == SIGKILL
+	 && usage->userSecs + usage->sysSecs >= cpuSecs );
 }
 
-void handleConnection( Config *conf, ServerState *serv,
-		       LLPoolEntry *connEntry )
+/* reap all exited children, and finish any jobs they completed */
+void reapChildren( ServerState *serv )
 {
-  int r;
-  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
-  char line[ READBUF_LEN ];
+  int status, p;
+  pid_t pid;
+  LLPoolEntry *jobEntry, *warmEntry;
+  MatchJob *job;
+  struct rusage ru;
+  ProcUsage usage;
+  struct signalfd_siginfo info;
 
-  while( ( r = getLine( conn->connBuf, READBUF_LEN, line, 0 ) ) >= 0 ) {
+  /* empty the signalfd - signals are merged, so one read may stand for
+     several exits, and wait4 finds them all */
+  while( read( serv->sigchldFD, &info, sizeof( info ) ) == sizeof( info ) );
 
-    if( r == 0 ) {
+  while( ( pid = wait4( -1, &status, WNOHANG, &ru ) ) > 0 ) {
 
-      closeConnection( serv, connEntry );
-      return;
+    if( pid == serv->compressPID ) {
+
+      logCompressed( serv, status );
+      continue;
     }
+    if( pid == serv->publishPID ) {
 
-    if( conn->status == STATUS_UNVALIDATED ) {
-      UserSpec *user;
+      runPublished( serv, !WIFEXITED( status ) || WEXITSTATUS( status ) );
+      continue;
+    }
 
-      user = validateLogon( conf, line );
-      if( user == NULL ) {
-	/* couldn't authenticate */
+    warmEntry = (LLPoolEntry *)hashRemoveInt( serv->warmBotPIDs, pid );
+    if( warmEntry ) {
+      /* the bot can't be reused, whether or not it was asked to go */
 
-	r = write( conn->connBuf->fd, "BAD LOGON\n", 10 );
-	fprintf( stderr, "BM_ERROR: connection failed to log in\n" );
-	closeConnection( serv, connEntry );
-	return;
+      closeWarmBot( serv, warmEntry, 0 );
+      limitGroupRemove( &serv->limitGroups,
+			( (WarmBot *)LLPoolGetItem( warmEntry ) )->limitGroup );
+      LLPoolRemoveEntry( serv->warmBots, warmEntry );
+      if( serv->warmBots->numEntries == 0 ) {
+
+	eventTimerStop( &serv->events, &serv->warmBotTimer );
       }
+      continue;
+    }
 
-      /* send an okay message */
-      r = write( conn->connBuf->fd, "LOGON OKAY - type help for commands\n", 36 );
+    jobEntry = (LLPoolEntry *)hashRemoveInt( serv->pidJobs, pid );
+    if( jobEntry == NULL ) {
 
-      /* connection status is now okay */
-      conn->user = user;
-      conn->status = STATUS_OKAY;
-      return;
+      continue;
     }
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
 
-    if( !strncasecmp( line, "HELP", 4 ) ) {
+    rusageToProcUsage( &ru, &usage );
+    addJobUsage( job, pid, &usage );
+    if( job->dealerPID == pid ) {
 
-      writeHelpMessage( conn->connBuf->fd );
-    } else if( !strncasecmp( line, "GAMES", 5 ) ) {
+      job->dealerPID = 0;
+      dealerExited( serv, job );
+    }
+    for( p = 0; p < MAX_PLAYERS; ++p ) {
 
-      writeGameList( conf, conn->connBuf->fd );
-    } else if( !strncasecmp( line, "QSTAT", 5 ) ) {
+      if( job->botPID[ p ] == pid ) {
 
-      writeQueueStatus( conf, serv, conn->connBuf->fd );
-    } else if( !strncasecmp( line, "RUNMATCHES", 10 ) ) {
-      Match match;
+	job->botPID[ p ] = 0;
+	if( botOverCpuTime( serv, job, p, status, &usage ) ) {
 
-      if( parseMatchSpec( conf, serv, &line[ 10 ], connEntry, &match ) < 0 ) {
+	  job->limitHits[ p ] |= 1 << BM_LIMIT_CPU;
+	}
+	if( job->limitGroups[ p ] ) {
+	  LimitEvents none = { 0, 0 };
 
-	fprintf( stderr, "BM_ERROR: bad RUNMATCHES command: %s", line );
-	r = write( conn->connBuf->fd, "BAD RUNMATCHES COMMAND\n", 23 );
-	return;
+	  job->limitHits[ p ] |= limitEventHits( job->limitGroups[ p ], &none );
+	  limitGroupRemove( &serv->limitGroups, job->limitGroups[ p ] );
+	  job->limitGroups[ p ] = NULL;
+	}
       }
-      match.user = ( (Connection *)LLPoolGetItem( connEntry ) )->user;
-      match.isRunning = 0;
-      gettimeofday( &match.queueTime, NULL );
-      LLPoolAddItem( serv->matches, &match );
-      return;
-    } else {
+    }
 
-      r = write( conn->connBuf->fd, "UNKNOWN\n", 8 );
-      return;
+    /* the rest of a paused job has to run to notice, and exit too */
+    if( job->isPaused ) {
+
+      resumeJob( serv, job );
+    }
+
+    if( jobIsFinished( job ) ) {
+
+      finishedJob( serv, jobEntry );
     }
   }
 }
 
-int timeIsEarlier( struct timeval *a, struct timeval *b )
+void portPoolTimerEvent( EventLoop *loop, EventTimer *timer );
+
+void refillPortPool( const Config *conf, ServerState *serv )
 {
-  if( a->tv_sec < b->tv_sec ) {
-    return 1;
-  } else if( a->tv_sec == b->tv_sec
-	     && a->tv_usec < b->tv_usec ) {
-    return 1;
+  if( fillPortPool( conf, serv ) < 0
+      && !eventTimerIsRunning( &serv->portPoolTimer ) ) {
+
+    eventTimerStart( &serv->events,
+		     &serv->portPoolTimer,
+		     (uint64_t)BM_PORT_POOL_RETRY_SECS * 1000000,
+		     0,
+		     portPoolTimerEvent,
+		     NULL );
   }
-  return 0;
 }
 
-/* how many bots will match start? */
-int botsInMatch( const Match *match )
+/* retry filling the port pool after a failure */
+void portPoolTimerEvent( EventLoop *loop, EventTimer *timer )
 {
-  int p, num;
+  ServerState *serv = (ServerState *)loop->data;
 
-  num = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+  refillPortPool( serv->conf, serv );
+}
 
-    if( !match->players[ p ].isNetworkPlayer ) {
+/* start jobs, up to the maximum - only needed after the queue or the
+   running capacity has changed */
+void runScheduler( const Config *conf, ServerState *serv )
+{
+  serv->needSchedule = 0;
+  while( startMatchJob( conf, serv ) );
 
-      ++num;
-    }
+  /* replace any pooled ports the new jobs used */
+  refillPortPool( conf, serv );
+}
+
+/* add the first size bytes of the open file fd to transfer, which
+   takes over the descriptor, if there is anything to send - size < 0
+   sends the whole file */
+void addLogPieceFD( LogTransfer *transfer,
+		    const int fd,
+		    off_t size,
+		    const int isCompressed )
+{
+  struct stat st;
+
+  if( fstat( fd, &st ) < 0 ) {
+
+    close( fd );
+    return;
   }
+  if( size < 0 || size > st.st_size ) {
 
-  return num;
+    size = st.st_size;
+  }
+  if( size == 0 ) {
+
+    close( fd );
+    return;
+  }
+
+  transfer->pieces = (LogPiece *)realloc( transfer->pieces,
+					  sizeof( LogPiece )
+					  * ( transfer->numPieces + 1 ) );
+  assert( transfer->pieces != 0 );
+  transfer->pieces[ transfer->numPieces ].fd = fd;
+  transfer->pieces[ transfer->numPieces ].size = size;
+  transfer->pieces[ transfer->numPieces ].isCompressed = isCompressed;
+  ++transfer->numPieces;
 }
 
-void startDealer( const Config *conf,
-		  const Match *match,
-		  MatchJob *job,
-		  const uint32_t rngSeed )
+/* add the first size bytes of the file at name to transfer, as with
+   addLogPieceFD */
+void addLogPiece( LogTransfer *transfer,
+		  const char *name,
+		  off_t size,
+		  const int isCompressed )
 {
-  int stdoutPipe[ 2 ], p, arg;
-  char handsString[ 16 ], rngString[ 16 ];
-  char startupTimeoutString[ 16 ], responseTimeoutString[ 16 ];
-  char handTimeoutString[ 16 ], avgHandTimeString[ 16 ];
-  char *argv[ MAX_PLAYERS + 64 ];
+  int fd;
 
-  if( pipe( stdoutPipe ) < 0 ) {
+  fd = open( name, O_RDONLY | O_CLOEXEC );
+  if( fd >= 0 ) {
 
-    fprintf( stderr, "BM_ERROR: could not create pipe for new dealer\n" );
-    exit( EXIT_FAILURE );
+    addLogPieceFD( transfer, fd, size, isCompressed );
   }
+}
 
-  job->dealerPID = fork();
-  if( job->dealerPID < 0 ) {
+/* set the header line for the transfer's current piece */
+void setLogHeader( LogTransfer *transfer )
+{
+  if( transfer->piece < transfer->numPieces ) {
+    const LogPiece *piece = &transfer->pieces[ transfer->piece ];
+
+    transfer->headerLen
+      = snprintf( transfer->header, sizeof( transfer->header ),
+		  "LOG %s %s %jd\n", transfer->suffix,
+		  piece->isCompressed ? "gzip" : "plain",
+		  (intmax_t)piece->size );
+  } else {
 
-    fprintf( stderr, "BM_ERROR: fork() failed\n" );
-    exit( EXIT_FAILURE );
+    transfer->headerLen = snprintf( transfer->header,
+				    sizeof( transfer->header ),
+				    "LOG END\n" );
   }
-  if( !job->dealerPID ) {
-    /* child runs the dealer command */
-    int stderrfd;
-    char tag[ READBUF_LEN ];
+  transfer->headerSent = 0;
+  transfer->offset = 0;
+}
 
-    snprintf( tag, sizeof( tag ), "%s/%s.stderr", BM_LOGDIR, job->tag );
-    stderrfd = open( tag, O_WRONLY | O_APPEND | O_CREAT, 0644 );
-    if( stderrfd < 0 ) {
+/* start sending everything logged under the connection's tag with the
+   given suffix, oldest first: the compressed file, logs still waiting
+   to be compressed, the current log, the output of finished runs which
+   is still to be added to it, and then the output so far of runs which
+   are still going
+   returns 1 if a transfer was started, 0 if there is nothing logged
+   under the tag, -1 on failure */
+int startLogTransfer( ServerState *serv,
+		      LLPoolEntry *connEntry,
+		      const char *tag,
+		      const char *suffix )
+{
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+  LogTransfer *transfer;
+  LLPoolEntry *cur, *last;
+  const PendingLog *log;
+  const PendingRun *run;
+  char jobTag[ READBUF_LEN ], gzSuffix[ 16 ];
+  char name[ sizeof( BM_LOGDIR ) + READBUF_LEN + 16 ];
+  int flags, s, publishFD;
+  off_t logSize;
+
+  transfer = (LogTransfer *)malloc( sizeof( LogTransfer ) );
+  assert( transfer != 0 );
+  transfer->suffix = strcmp( suffix, "stderr" ) ? "log" : "stderr";
+  transfer->numPieces = 0;
+  transfer->pieces = NULL;
+  transfer->piece = 0;
+
+  snprintf( jobTag, sizeof( jobTag ), "%s.%s", conn->user->name, tag );
+  snprintf( gzSuffix, sizeof( gzSuffix ), "%s.gz", suffix );
+
+  /* the compressed file is only whole up to where a running
+     compressor started appending */
+  log = serv->compressEntry
+    ? (const PendingLog *)LLPoolGetItem( serv->compressEntry ) : NULL;
+  jobLogName( jobTag, gzSuffix, name, sizeof( name ) );
+  addLogPiece( transfer,
+	       name,
+	       log && !strcmp( log->tag, jobTag )
+	       && !strcmp( log->suffix, suffix ) ? serv->compressStart : -1,
+	       1 );
+
+  /* pending logs are kept newest first */
+  last = NULL;
+  while( last != LLPoolFirstEntry( serv->pendingLogs ) ) {
+
+    for( cur = LLPoolFirstEntry( serv->pendingLogs );
+	 LLPoolNextEntry( cur ) != last; cur = LLPoolNextEntry( cur ) );
+    log = (const PendingLog *)LLPoolGetItem( cur );
+    if( !strcmp( log->tag, jobTag ) && !strcmp( log->suffix, suffix ) ) {
+
+      addLogPiece( transfer, log->partName, -1, 0 );
+    }
+    last = cur;
+  }
 
-      fprintf( stderr,
-	       "BM_ERROR: could not create error log %s\n",
-	       tag );
-      exit( EXIT_FAILURE );
+  /* while a run is being added to the log, only the part of the log
+     from before then is sent, and then the whole run - once the run's
+     own file is gone, the log has all of it */
+  logSize = -1;
+  publishFD = -1;
+  for( s = 0; s < BM_NUM_RUN_LOGS
+	 && strcmp( runLogSuffixes[ s ], transfer->suffix ); ++s );
+  run = serv->publishEntry
+    ? (const PendingRun *)LLPoolGetItem( serv->publishEntry ) : NULL;
+  if( s < BM_NUM_RUN_LOGS && run && !strcmp( run->tag, jobTag ) ) {
+
+    runLogName( run->tag, run->runID, transfer->suffix,
+		name, sizeof( name ) );
+    publishFD = open( name, O_RDONLY | O_CLOEXEC );
+    if( publishFD >= 0 ) {
+
+      logSize = serv->publishStart[ s ];
     }
-    dup2( stderrfd, 2 );
+  }
 
-    /* change stdout to be the write end of the pipe */
-    close( stdoutPipe[ 0 ] );
-    dup2( stdoutPipe[ 1 ], 1 );
+  jobLogName( jobTag, suffix, name, sizeof( name ) );
+  addLogPiece( transfer, name, logSize, 0 );
+  if( publishFD >= 0 ) {
 
-    arg = 0;
+    addLogPieceFD( transfer, publishFD, -1, 0 );
+  }
 
-    argv[ arg ] = BM_DEALER;
-    ++arg;
+  if( s < BM_NUM_RUN_LOGS ) {
 
-    snprintf( tag, sizeof( tag ), "%s/%s", BM_LOGDIR, job->tag );
-    argv[ arg ] = tag;
-    ++arg;
+    /* finished runs are kept newest first */
+    last = serv->publishEntry;
+    while( last != LLPoolFirstEntry( serv->pendingRuns ) ) {
 
-    argv[ arg ] = match->gameConf->gameFile;
-    ++arg;
+      for( cur = LLPoolFirstEntry( serv->pendingRuns );
+	   LLPoolNextEntry( cur ) != last; cur = LLPoolNextEntry( cur ) );
+      run = (const PendingRun *)LLPoolGetItem( cur );
+      if( !strcmp( run->tag, jobTag ) ) {
 
-    snprintf( handsString, 
-	      sizeof( handsString ), 
-	      "%"PRIu32, 
-	      match->gameConf->matchHands );
-    argv[ arg ] = handsString;
-    ++arg;
+	runLogName( run->tag, run->runID, transfer->suffix,
+		    name, sizeof( name ) );
+	addLogPiece( transfer, name, -1, 0 );
+      }
+      last = cur;
+    }
 
-    snprintf( rngString, sizeof( rngString ), "%"PRIu32, rngSeed );
-    argv[ arg ] = rngString;
-    ++arg;
+    for( cur = LLPoolFirstEntry( serv->jobs );
+	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+      const MatchJob *job = (const MatchJob *)LLPoolGetItem( cur );
 
-    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+      if( !strcmp( job->tag, jobTag ) ) {
 
-      if( match->players[ p ].isNetworkPlayer ) {
+	jobOutputName( job, transfer->suffix, name, sizeof( name ) );
+	addLogPiece( transfer, name, -1, 0 );
+      }
+    }
+  }
 
-	argv[ arg ]
-	  = ( (Connection *)LLPoolGetItem( match->players[ p ].entry ) )
-	  ->user->name;
-      } else {
+  if( transfer->numPieces == 0 ) {
+
+    freeLogTransfer( transfer );
+    return 0;
+  }
+
+  /* the socket only blocks while commands are being read, so sendfile
+     never holds up the rest of the server */
+  flags = fcntl( conn->connBuf->fd, F_GETFL );
+  if( flags < 0
+      || fcntl( conn->connBuf->fd, F_SETFL, flags | O_NONBLOCK ) < 0
+      || eventWatchModify( &serv->events, &conn->watch, EPOLLOUT ) < 0 ) {
+
+    freeLogTransfer( transfer );
+    return -1;
+  }
+  setLogHeader( transfer );
+  conn->transfer = transfer;
+  return 1;
+}
+
+/* send as much of the connection's GETLOG reply as the socket takes,
+   up to BM_LOG_SEND_CHUNK bytes, and go back to reading commands once
+   it has all gone
+   returns -1 if the connection failed, 0 otherwise */
+int sendLogTransfer( ServerState *serv, LLPoolEntry *connEntry )
+{
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+  LogTransfer *transfer = conn->transfer;
+  LogPiece *piece;
+  ssize_t r;
+  size_t budget;
+  int flags;
+
+  budget = BM_LOG_SEND_CHUNK;
+  while( budget ) {
+
+    if( transfer->headerSent < transfer->headerLen ) {
+
+      r = send( conn->connBuf->fd,
+		&transfer->header[ transfer->headerSent ],
+		transfer->headerLen - transfer->headerSent,
+		MSG_DONTWAIT | MSG_NOSIGNAL );
+      if( r < 0 ) {
 
-	argv[ arg ]
-	  = ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )->name;
+	return errno == EAGAIN || errno == EINTR ? 0 : -1;
       }
-      ++arg;
+      transfer->headerSent += r;
+      continue;
+    }
+    if( transfer->piece == transfer->numPieces ) {
+      /* the closing line is out */
+
+      break;
     }
 
-    if( conf->startupTimeoutSecs ) {
+    piece = &transfer->pieces[ transfer->piece ];
+    if( transfer->offset < piece->size ) {
+
+      r = sendfile( conn->connBuf->fd,
+		    piece->fd,
+		    &transfer->offset,
+		    piece->size - transfer->offset < (off_t)budget
+		    ? piece->size - transfer->offset : budget );
+      if( r < 0 ) {
 
-      argv[ arg ] = "--start_timeout";
-      ++arg;
+	return errno == EAGAIN || errno == EINTR ? 0 : -1;
+      } else if( r == 0 ) {
+	/* the file was cut short under us */
 
-      snprintf( startupTimeoutString,
-                sizeof( startupTimeoutString ),
-                "%d",
-                (int)conf->startupTimeoutSecs * 1000 );
-      argv[ arg ] = startupTimeoutString;
-      ++arg;
+	return -1;
+      }
+      budget -= r;
+      continue;
     }
 
-    /* Add maximum per action timeout argument */
-    argv[ arg ] = "--t_response";
-    ++arg;
+    close( piece->fd );
+    piece->fd = -1;
+    ++transfer->piece;
+    setLogHeader( transfer );
+  }
+  if( budget == 0 ) {
+    /* more to go when the socket is next ready */
 
-    snprintf( responseTimeoutString, 
-             sizeof( responseTimeoutString ),
-             "%d",
-             (int)conf->responseTimeoutSecs * 1000 );
-    argv[ arg ] = responseTimeoutString;
-    ++arg;
+    return 0;
+  }
 
-    /* Add maximum per hand timeout argument */
-    argv[ arg ] = "--t_hand";
-    ++arg;
+  freeLogTransfer( transfer );
+  conn->transfer = NULL;
+  flags = fcntl( conn->connBuf->fd, F_GETFL );
+  if( flags < 0
+      || fcntl( conn->connBuf->fd, F_SETFL, flags & ~O_NONBLOCK ) < 0
+      || eventWatchModify( &serv->events, &conn->watch, EPOLLIN ) < 0 ) {
 
-    snprintf( handTimeoutString, 
-             sizeof( handTimeoutString ),
-             "%d",
-             (int)conf->handTimeoutSecs * 1000 );
-    argv[ arg ] = handTimeoutString;
-    ++arg;
+    return -1;
+  }
 
-    /* Add average per hand time argument */
-    argv[ arg ] = "--t_per_hand";
-    ++arg;
+  /* commands sent while the log was going out are already buffered */
+  handleConnection( serv->conf, serv, connEntry );
+  return 0;
+}
 
-    snprintf( avgHandTimeString, 
-             sizeof( avgHandTimeString ),
-             "%d",
-             (int)conf->avgHandTimeSecs * 1000 );
-    argv[ arg ] = avgHandTimeString;
-    ++arg;
+void connectionEvent( EventLoop *loop,
+		      EventWatch *watch,
+		      const uint32_t events )
+{
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *connEntry = (LLPoolEntry *)watch->data;
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
 
+  if( conn->transfer ) {
 
-    argv[ arg ] = "-q";
-    ++arg;
+    if( sendLogTransfer( serv, connEntry ) < 0 ) {
 
-    /* Restore the appending behaviour so multiple matches get appended into
-     * the same log file */
-    argv[ arg ] = "-a";
-    ++arg;
+      closeConnection( serv, connEntry );
+    }
+    return;
+  }
 
-    argv[ arg ] = NULL;
+  handleConnection( serv->conf, serv, connEntry );
 
-    execv( BM_DEALER, argv );
+  /* an error leaves nothing to read, but keeps the socket ready */
+  if( ( events & ( EPOLLERR | EPOLLHUP ) )
+      && ( (Connection *)LLPoolGetItem( connEntry ) )->status
+      != STATUS_CLOSED ) {
 
-    fprintf( stderr, "BM_ERROR: could not start dealer\n" );
-    exit( EXIT_FAILURE );
+    closeConnection( serv, connEntry );
   }
+}
 
-  /* parent has to talk to child to get ports */
-  ssize_t r;
-  int pos, t;
-  fd_set readfds;
-  struct timeval timeout;
-  char portString[ READBUF_LEN ];
+void listenSocketEvent( EventLoop *loop,
+			EventWatch *watch,
+			const uint32_t events )
+{
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *connEntry;
+  Connection *conn;
 
-  close( stdoutPipe[ 1 ] );
-  timeout.tv_sec = BM_DEALER_WAIT_SECS;
-  timeout.tv_usec = 0;
-  FD_ZERO( &readfds );
-  FD_SET( stdoutPipe[ 0 ], &readfds );
-  if( select( stdoutPipe[ 0 ] + 1, &readfds, NULL, NULL, &timeout ) < 1 ) {
+  connEntry = handleListenSocket( serv->conf, serv );
+  if( connEntry == NULL ) {
 
-    fprintf( stderr,
-	     "BM_ERROR: timed out waiting for port string from dealer\n" );
-    exit( EXIT_FAILURE );
+    return;
   }
-  r = read( stdoutPipe[ 0 ], portString, READBUF_LEN );
-  if( r <= 0 || portString[ r - 1 ] != '\n' ) {
 
-    fprintf( stderr, "BM_ERROR: could not read port string from dealer\n" );
-    exit( EXIT_FAILURE );
+  conn = (Connection *)LLPoolGetItem( connEntry );
+  if( eventWatchAdd( loop,
+		     &conn->watch,
+		     conn->connBuf->fd,
+		     EPOLLIN,
+		     connectionEvent,
+		     connEntry ) < 0 ) {
+
+    fprintf( stderr, "WARNING: could not watch new connection\n" );
+    closeConnection( serv, connEntry );
   }
-  portString[ r ] = 0;
+}
 
-  /* parse the port string */
-  pos = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+void closeMetricsClient( ServerState *serv, LLPoolEntry *clientEntry )
+{
+  MetricsClient *client = (MetricsClient *)LLPoolGetItem( clientEntry );
 
-    if( sscanf( &portString[ pos ],
-		" %"SCNu16"%n",
-		&job->ports[ p ],
-		&t ) < 1 ) {
+  eventWatchRemove( &serv->events, &client->watch );
+  close( client->sock );
+  if( client->response.buf ) {
 
-      fprintf( stderr,
-	       "BM_ERROR: could not get port for player %d from dealer\n",
-	       p + 1 );
-      exit( EXIT_FAILURE );
-    }
-    pos += t;
+    freeMetricsText( &client->response );
   }
+  LLPoolRemoveEntry( serv->metricsClients, clientEntry );
 }
 
-pid_t startBot( const ServerState *serv,
-		const BotSpec *bot,
-		const uint16_t port,
-		const int botPosition )
+/* read a scrape request, then write the metrics back as fast as the
+   client takes them - anything but a GET is turned away */
+void metricsClientEvent( EventLoop *loop,
+			 EventWatch *watch,
+			 const uint32_t events )
 {
-  pid_t pid;
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *clientEntry = (LLPoolEntry *)watch->data;
+  MetricsClient *client = (MetricsClient *)LLPoolGetItem( clientEntry );
+  MetricsText body;
+  ssize_t r;
 
-  pid = fork();
-  if( pid < 0 ) {
+  if( client->response.buf == NULL ) {
 
-    fprintf( stderr, "BM_ERROR: fork() failed\n" );
-    exit( EXIT_FAILURE );
-  }
-  if( !pid ) {
-    /* child runs the bot command */
-    char portString[ 8 ];
-    char posString[ 16 ];
+    r = recv( client->sock,
+	      &client->request[ client->requestLen ],
+	      BM_METRICS_REQUEST_LEN - 1 - client->requestLen,
+	      MSG_DONTWAIT );
+    if( r < 0 && ( errno == EAGAIN || errno == EINTR ) ) {
 
-    snprintf( portString, sizeof( portString ), "%"PRIu16, port );
-    snprintf( posString, sizeof( posString ), "%d", botPosition );
+      return;
+    }
+    if( r <= 0 ) {
 
-    /* throw away bot output */
-    dup2( serv->devnullfd, 1 );
-    dup2( serv->devnullfd, 2 );
+      closeMetricsClient( serv, clientEntry );
+      return;
+    }
+    client->requestLen += r;
+    client->request[ client->requestLen ] = 0;
 
-    execl( bot->command,
-	   bot->command,
-	   serv->hostname,
-	   portString,
-	   posString,
-	   NULL );
+    /* wait for the end of the headers, unless they'll never fit */
+    if( strstr( client->request, "\r\n\r\n" ) == NULL
+	&& strstr( client->request, "\n\n" ) == NULL
+	&& client->requestLen < BM_METRICS_REQUEST_LEN - 1 ) {
+
+      return;
+    }
+
+    initMetricsText( &client->response );
+    if( strncmp( client->request, "GET ", 4 ) ) {
+
+      metricsPrintf( &client->response,
+		     "HTTP/1.0 405 Method Not Allowed\r\n"
+		     "Allow: GET\r\n"
+		     "Content-Length: 0\r\n"
+		     "Connection: close\r\n\r\n" );
+    } else {
+
+      initMetricsText( &body );
+      writeMetrics( serv, &body );
+      metricsPrintf( &client->response,
+		     "HTTP/1.0 200 OK\r\n"
+		     "Content-Type: text/plain; version=0.0.4\r\n"
+		     "Content-Length: %zu\r\n"
+		     "Connection: close\r\n\r\n%s",
+		     body.len, body.buf );
+      freeMetricsText( &body );
+    }
+    client->sent = 0;
+  }
 
-    fprintf( stderr, "BM_ERROR: could not start bot %s\n", bot->command );
-    exit( EXIT_FAILURE );
+  r = send( client->sock,
+	    &client->response.buf[ client->sent ],
+	    client->response.len - client->sent,
+	    MSG_DONTWAIT | MSG_NOSIGNAL );
+  if( r < 0 && ( errno == EAGAIN || errno == EINTR ) ) {
+
+    r = 0;
+  } else if( r < 0 ) {
+
+    closeMetricsClient( serv, clientEntry );
+    return;
   }
+  client->sent += r;
+  if( client->sent == client->response.len ) {
 
-  return pid;
+    closeMetricsClient( serv, clientEntry );
+    return;
+  }
+
+  /* the rest goes out when the socket has room */
+  if( !( events & EPOLLOUT ) ) {
+
+    eventWatchModify( loop, &client->watch, EPOLLOUT );
+  }
 }
 
-int sendStartMessage( const ServerState *serv,
-		      const MatchJob *job,
-		      const Connection *conn,
-		      const uint16_t port )
+void metricsListenEvent( EventLoop *loop,
+			 EventWatch *watch,
+			 const uint32_t events )
 {
-  int len;
-  char msg[ strlen( serv->hostname ) + 12 + READBUF_LEN ];
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *clientEntry;
+  MetricsClient client, *newClient;
 
-  len = snprintf( msg, sizeof( msg ), "# RUNNING %s\n", job->tag );
-  assert( len > 0 );
-  if( write( conn->connBuf->fd, msg, len ) < len ) {
+  client.sock = accept( serv->metricsSocket, NULL, NULL );
+  if( client.sock < 0 ) {
 
-    fprintf( stderr, "BM_ERROR: short write to connection\n" );
-    return -1;
+    return;
   }
+  if( serv->metricsClients->numEntries >= BM_METRICS_MAX_CLIENTS ) {
+    /* scrapers retry, so there is no need to queue them */
 
-  len = snprintf( msg,
-                  sizeof( msg ), 
-                  "RUN %s %"PRIu16"\n", 
-                  serv->hostname, port );
-  assert( len > 0 );
-  if( write( conn->connBuf->fd, msg, len ) < len ) {
-
-    fprintf( stderr, "BM_ERROR: short write to connection\n" );
-    return -1;
+    close( client.sock );
+    return;
+  }
+  fcntl( client.sock, F_SETFD, FD_CLOEXEC );
+
+  client.requestLen = 0;
+  client.response.buf = NULL;
+  client.sent = 0;
+  clientEntry = LLPoolAddItem( serv->metricsClients, &client );
+  newClient = (MetricsClient *)LLPoolGetItem( clientEntry );
+  if( eventWatchAdd( loop,
+		     &newClient->watch,
+		     newClient->sock,
+		     EPOLLIN,
+		     metricsClientEvent,
+		     clientEntry ) < 0 ) {
+
+    close( newClient->sock );
+    LLPoolRemoveEntry( serv->metricsClients, clientEntry );
   }
-
-  return 0;
 }
 
-MatchJob runMatchJob( const Config *conf,
-		      const ServerState *serv,
-		      LLPoolEntry *matchEntry,
-		      const uint32_t rngSeed )
+/* handle a worker's "STARTED pid" reply to a new job, starting the
+   job's players once its dealer is running */
+void workerDealerStarted( ServerState *serv,
+			  DealerWorker *worker,
+			  const char *reply )
 {
-  int p, botPosition;
-  MatchJob job;
-  Match *match = (Match *)LLPoolGetItem( matchEntry );
-  char tag[ READBUF_LEN ];
+  LLPoolEntry *jobEntry = worker->jobEntry;
+  MatchJob *job;
+  int pid;
 
-  job.matchEntry = matchEntry;
+  if( !worker->isStarting || jobEntry == NULL ) {
 
-  /* make the tag from the match tag */
-  snprintf( tag, sizeof( tag ), "%s.%s", match->user->name, match->tag );
-  job.tag = strdup( tag );
+    fprintf( stderr, "BM_ERROR: unexpected message from dealer worker: %s",
+	     reply );
+    return;
+  }
+  worker->isStarting = 0;
+  job = (MatchJob *)LLPoolGetItem( jobEntry );
 
-  /* initialise all PIDs to 0 */
-  job.dealerPID = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+  if( sscanf( reply, "STARTED %d", &pid ) < 1 || pid <= 0 ) {
+    /* the worker couldn't fork, so it will also send DONE - it is
+       simplest to stop using it */
 
-    job.botPID[ p ] = 0;
+    failJobLaunch( serv, jobEntry, "could not be started by its worker" );
+    return;
   }
+  worker->dealerPID = pid;
 
-  /* start the dealer */
-  startDealer( conf, match, &job, rngSeed );
+  /* the worker's fork starts out wherever the worker runs */
+  if( job->numCores
+      && corePoolPin( &serv->cores, job->numCores, job->cores, pid ) < 0 ) {
 
-  /* deal with all the players */
-  botPosition = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+    fprintf( stderr, "BM_WARNING: could not pin dealer for %s\n",
+	     job->tag );
+  }
 
-    if( match->players[ p ].isNetworkPlayer ) {
-      /* send message with port to network player to start up */
-      Connection *conn = (Connection*)LLPoolGetItem( match->players[ p ].entry );
+  endJobLaunch( serv, job );
+  startJobPlayers( serv, job );
+  addJobBotPIDs( serv, jobEntry );
+}
 
-      if( sendStartMessage( serv, &job, conn, job.ports[ p ] ) < 0 ) {
-	/* abort the job... */
+void dealerWorkerEvent( EventLoop *loop,
+			EventWatch *watch,
+			const uint32_t events );
 
-	fprintf( stderr, "BM_ERROR: aborting job\n" );
+/* replace dealer workers which have gone away */
+void workerTimerEvent( EventLoop *loop, EventTimer *timer )
+{
+  ServerState *serv = (ServerState *)loop->data;
+  DealerWorker *worker;
+  int w;
 
-	kill( job.dealerPID, SIGTERM );
-	while( p > 0 ) {
-	  --p;
+  for( w = 0; w < serv->numWorkers; ++w ) {
+    worker = &serv->workers[ w ];
 
-	  if( job.botPID[ p ] ) {
+    if( worker->sock >= 0 ) {
 
-	    kill( job.botPID[ p ], SIGTERM );
-	  }
-	}
+      continue;
+    }
+    if( spawnDealerWorker( serv, worker ) < 0 ) {
 
-	return job;
-      }
-    } else {
-      /* start up bot */
+      scheduleWorkerRespawn( serv );
+    } else if( eventWatchAdd( &serv->events,
+			      &worker->watch,
+			      worker->sock,
+			      EPOLLIN,
+			      dealerWorkerEvent,
+			      worker ) < 0 ) {
 
-      job.botPID[ p ]
-	= startBot( serv,
-		    (BotSpec *)LLPoolGetItem( match->players[ p ].entry ),
-		    job.ports[ p ],
-		    botPosition );
-      ++botPosition;
+      closeDealerWorker( serv, worker );
     }
   }
-
-  return job;
 }
 
-int startMatchJob( const Config *conf, ServerState *serv )
+void dealerWorkerEvent( EventLoop *loop,
+			EventWatch *watch,
+			const uint32_t events )
 {
-  int running;
-  LLPoolEntry *cur, *next, *best;
-  Match *curMatch, *bestMatch;
-  MatchJob job;
+  ServerState *serv = (ServerState *)loop->data;
+  DealerWorker *worker = (DealerWorker *)watch->data;
+  LLPoolEntry *jobEntry = worker->jobEntry;
+  MatchJob *job;
+  ssize_t r;
+  int status;
+  int64_t userMicros, sysMicros;
+  uint64_t maxRSSKB, volCtxSwitches, involCtxSwitches;
+  char reply[ 128 ];
 
-  /* automatically done adding things if we've got no more matches */
-  if( serv->matches->numEntries == 0 ) {
+  r = recv( worker->sock, reply, sizeof( reply ) - 1, MSG_DONTWAIT );
+  if( r < 0 && ( errno == EAGAIN || errno == EINTR ) ) {
 
-    return 0;
+    return;
   }
+  if( r > 0 && !strncmp( reply, "STARTED", 7 ) ) {
 
-  /* how many bots are currently running */
-  running = 0;
-  for( cur = LLPoolFirstEntry( serv->jobs );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
-
-    running += botsInMatch( (Match*)LLPoolGetItem( job->matchEntry ) );
+    reply[ r ] = 0;
+    workerDealerStarted( serv, worker, reply );
+    return;
   }
+  if( r > 0 ) {
 
-  /* pick the best match to start */
-  best = 0;
-  bestMatch = 0;
-  for( cur = LLPoolFirstEntry( serv->matches ); cur != NULL; cur = next ) {
-    next = LLPoolNextEntry( cur );
-    curMatch = (Match *)LLPoolGetItem( cur );
+    reply[ r ] = 0;
+    r = sscanf( reply, "DONE %d %"SCNd64" %"SCNd64" %"SCNu64" %"SCNu64" %"SCNu64,
+		&status, &userMicros, &sysMicros,
+		&maxRSSKB, &volCtxSwitches, &involCtxSwitches );
+    if( r < 3 ) {
 
-    if( curMatch->isRunning ) {
+      fprintf( stderr, "BM_ERROR: bad message from dealer worker: %s",
+	       reply );
+      return;
+    } else if( r < 6 ) {
 
-      continue;
+      maxRSSKB = volCtxSwitches = involCtxSwitches = 0;
     }
+  } else {
+
+    closeDealerWorker( serv, worker );
+    userMicros = sysMicros = 0;
+    maxRSSKB = volCtxSwitches = involCtxSwitches = 0;
+  }
 
-    if( curMatch->numRuns <= 0 ) {
-      /* match is finished - clean it up */
+  /* the worker's dealer is done, one way or another */
+  worker->dealerPID = 0;
+  worker->isStarting = 0;
+  worker->jobEntry = NULL;
+  if( jobEntry ) {
 
-      free( curMatch->tag );
-      LLPoolRemoveEntry( serv->matches, cur );
-      continue;
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+    if( job->isPaused ) {
+      /* the bots have to run to see the dealer has gone */
+
+      resumeJob( serv, job );
+    }
+    job->cpuSecs += ( userMicros + sysMicros ) / 1e6;
+    if( r > 0 ) {
+
+      job->dealerUsage.userSecs = userMicros / 1e6;
+      job->dealerUsage.sysSecs = sysMicros / 1e6;
+      job->dealerUsage.maxRSSKB = maxRSSKB;
+      job->dealerUsage.volCtxSwitches = volCtxSwitches;
+      job->dealerUsage.involCtxSwitches = involCtxSwitches;
+      job->dealerUsage.numProcs = 1;
     }
+    job->worker = NULL;
+    dealerExited( serv, job );
+    if( jobIsFinished( job ) ) {
 
-    if( curMatch->gameConf->maxRunningJobs
-	&& curMatch->gameConf->curRunningJobs
-	>= curMatch->gameConf->maxRunningJobs ) {
-      /* cur refers to a match in a game which is currently too busy */
+      finishedJob( serv, jobEntry );
+    }
+  }
+}
 
-      continue;
+void warmBotEvent( EventLoop *loop,
+		   EventWatch *watch,
+		   const uint32_t events )
+{
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *warmEntry = (LLPoolEntry *)watch->data;
+  WarmBot *warm = (WarmBot *)LLPoolGetItem( warmEntry );
+  int r;
+  char line[ READBUF_LEN ];
+
+  while( ( r = getLine( warm->ctrlBuf, READBUF_LEN, line, 0 ) ) >= 0 ) {
+
+    if( r == 0 ) {
+      /* bot has gone away */
+
+      closeWarmBot( serv, warmEntry, SIGTERM );
+      return;
     }
 
-    if( best == 0
-	|| timeIsEarlier( &curMatch->user->waitStart,
-			  &bestMatch->user->waitStart )
-	|| ( !timeIsEarlier( &bestMatch->user->waitStart,
-			     &curMatch->user->waitStart )
-	     && timeIsEarlier( &curMatch->queueTime,
-			       &bestMatch->queueTime ) ) ) {
+    if( !strncasecmp( line, "DONE", 4 ) ) {
 
-      best = cur;
-      bestMatch = curMatch;
+      releaseWarmBotJob( serv, warm );
     }
   }
+}
+
+/* read the latency reports the job's dealer has added to the job's own
+   error log since the last look, keeping track of each bot's best
+   returns the worst ratio of a bot's latest mean response time to its
+   best, or -1 if there is no new report */
+double scanJobLatency( MatchJob *job )
+{
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  int fd, p, pos, t;
+  ssize_t r;
+  double worst, micros;
+  char *line, *end;
+  BotSpec *bot;
+  char name[ READBUF_LEN ], buf[ BM_LATENCY_SCAN_BYTES + 1 ];
 
-  /* return failure if we couldn't find a runnable job */
-  if( best == NULL ) {
+  jobOutputName( job, "stderr", name, sizeof( name ) );
+  fd = open( name, O_RDONLY | O_CLOEXEC );
+  if( fd < 0 ) {
 
-    return 0;
+    return -1;
   }
+  r = pread( fd, buf, BM_LATENCY_SCAN_BYTES, job->errScanned );
+  close( fd );
+  if( r <= 0 ) {
 
-  /* check if we have the space to run the bots */
-  if( conf->maxRunningBots
-      && botsInMatch( bestMatch ) + running > conf->maxRunningBots ) {
-
-    return 0;
+    return -1;
   }
+  buf[ r ] = 0;
 
-  /* create the job */
-  job = runMatchJob( conf,
-		     serv,
-		     best,
-		     bestMatch->useRngForSeed
-		     ? genrand_int32( &bestMatch->rng )
-		     : bestMatch->rngSeed );
-  assert( job.dealerPID );
-  LLPoolAddItem( serv->jobs, &job );
+  /* only whole lines are used, unless a line won't fit */
+  end = strrchr( buf, '\n' );
+  if( end == NULL ) {
 
-  /* update status about running jobs */
-  ++( bestMatch->gameConf->curRunningJobs );
-  bestMatch->isRunning = 1;
+    job->errScanned += r < BM_LATENCY_SCAN_BYTES ? 0 : r;
+    return -1;
+  }
+  *end = 0;
+  job->errScanned += end + 1 - buf;
 
-  /* update the user */
-  gettimeofday( &bestMatch->user->waitStart, NULL );
+  worst = -1;
+  for( line = buf; line != NULL; line = end ) {
 
-  /* update the match */
-  --bestMatch->numRuns;
-  gettimeofday( &bestMatch->queueTime, NULL );
+    end = strchr( line, '\n' );
+    if( end ) {
 
-  return 1;
-}
+      *end = 0;
+      ++end;
+    }
+    /* pos is only set once the hand count has been read */
+    pos = -1;
+    if( strncmp( line, "# LATENCY ", 10 )
+	|| sscanf( &line[ 10 ], "%*"SCNu32"%n", &pos ) < 0 || pos < 0 ) {
 
-void initServerState( const Config *conf, ServerState *serv )
-{
-  struct addrinfo hints, *info;
-  uint16_t port;
-  int hnm, r;
-  char *hn;
-  char ipstr[ INET6_ADDRSTRLEN ];
+      continue;
+    }
 
-  serv->conns = newLLPool( sizeof( Connection ) );
-  serv->matches = newLLPool( sizeof( Match ) );
-  serv->jobs = newLLPool( sizeof( MatchJob ) );
+    /* a newer report replaces the older ones */
+    worst = -1;
+    pos += 10;
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
 
-  /* create the socket clients will connect to */
-  port = conf->port;
-  serv->listenSocket = getListenSocket( &port );
-  if( serv->listenSocket < 0 ) {
+      if( sscanf( &line[ pos ], " %lf%n", &micros, &t ) < 1 ) {
 
-    fprintf( stderr, "BM_ERROR: could not open socket for listening\n" );
-    exit( EXIT_FAILURE );
-  }
-  printf( "starting server on port %"PRIu16"\n", conf->port );
+	break;
+      }
+      pos += t;
+      if( match->players[ p ].isNetworkPlayer || micros <= 0.0 ) {
+	/* network players are on other machines */
 
-  init_genrand( &serv->rng, time( NULL ) );
+	continue;
+      }
 
-  hnm = sysconf( _SC_HOST_NAME_MAX );
-  hn = (char*)malloc( hnm );
-  assert( hn != 0 );
-  if( gethostname( hn, hnm + 1 ) < 0 ) {
+      bot = (BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+      if( bot->bestLatencyMicros <= 0.0 || micros < bot->bestLatencyMicros ) {
 
-    fprintf( stderr, "BM_ERROR: could not get hostname\n" );
-    exit( EXIT_FAILURE );
-  }
+	bot->bestLatencyMicros = micros;
+      } else {
 
-  memset( &hints, 0, sizeof( hints ) );
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_STREAM;
-  if( ( r = getaddrinfo( hn, NULL, &hints, &info ) ) != 0 ) {
+	bot->bestLatencyMicros
+	  += BM_LATENCY_BEST_DRIFT * ( micros - bot->bestLatencyMicros );
+      }
+      if( micros / bot->bestLatencyMicros > worst ) {
 
-    fprintf( stderr,
-	     "BM_ERROR: could not get address info for host %s\n",
-	     hn );
-    exit( 1 );
+	worst = micros / bot->bestLatencyMicros;
+      }
+    }
   }
-  free( hn );
 
-  /* Get an address for the server */
-  void *addr;
+  return worst;
+}
 
-  /* get the pointer to the address itself,
-   * different fields in IPv4 and IPv6: */
-  if ( info->ai_family == AF_INET ) {
-    /* IPv4 */
-    struct sockaddr_in *ipv4 = ( struct sockaddr_in * ) info->ai_addr;
-    addr = &( ipv4->sin_addr );
-  } else {
-    /* IPv6 */
-    struct sockaddr_in6 *ipv6 = ( struct sockaddr_in6 * ) info->ai_addr;
-    addr = &( ipv6->sin6_addr );
-  }
+/* move the bot limit to fit the load on the machine */
+void adaptTimerEvent( EventLoop *loop, EventTimer *timer )
+{
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *cur;
+  SchedEntry *next;
+  double ratio, worst;
+  int oldLimit;
 
-  /* convert the IP to a string and store it:*/
-  inet_ntop( info->ai_family, addr, ipstr, sizeof( ipstr ) );
-  serv->hostname = strdup( ipstr );
+  /* only local jobs tell us about this machine */
+  worst = -1;
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
 
-  freeaddrinfo( info ); /* free the linked list */
+    if( job->state != JOB_RUNNING || job->agentEntry || job->isPaused ) {
 
-  serv->devnullfd = open( "/dev/null", O_WRONLY );
-  if( serv->devnullfd < 0 ) {
+      continue;
+    }
+    ratio = scanJobLatency( job );
+    if( ratio > worst ) {
 
-    fprintf( stderr, "BM_ERROR: could not open /dev/null\n" );
-    exit( EXIT_FAILURE );
+      worst = ratio;
+    }
+  }
+
+  next = schedPeekNext( &serv->sched );
+  oldLimit = serv->adapt.limit;
+  serv->sched.maxRunningBots
+    = adaptiveUpdate( &serv->adapt,
+		      worst,
+		      next != NULL && !schedHasBotRoom( &serv->sched, next ) );
+  if( serv->adapt.limit != oldLimit ) {
+
+    printf( "adaptive bot limit %d -> %d (idle %.2f, load/cpu %.2f, latency x%.2f)\n",
+	    oldLimit, serv->adapt.limit, serv->adapt.idleShare,
+	    serv->adapt.loadPerCPU, serv->adapt.latencyRatio );
+    fflush( stdout );
+    if( serv->adapt.limit > oldLimit ) {
+
+      serv->needSchedule = 1;
+    }
   }
 }
 
-int checkIfJobFinished( MatchJob *job )
+/* shut down warm bots which have been free for too long, or are still
+   playing long after their dealer finished */
+void warmBotTimerEvent( EventLoop *loop, EventTimer *timer )
 {
-  int status, r, p, allDone;
-  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
-
-  allDone = 1;
+  ServerState *serv = (ServerState *)loop->data;
+  LLPoolEntry *cur;
+  WarmBot *warm;
+  uint64_t now;
 
-  if( job->dealerPID ) {
+  now = eventNowMicros();
+  for( cur = LLPoolFirstEntry( serv->warmBots );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    warm = (WarmBot *)LLPoolGetItem( cur );
 
-    r = waitpid( job->dealerPID, &status, WNOHANG );
-    if( r < 0 ) {
+    if( warm->ctrlFD < 0 ) {
+      /* already waiting to be reaped */
 
-      fprintf( stderr, "BM_ERROR: could not wait on child\n" );
-      exit( EXIT_FAILURE );
+      continue;
     }
-    if( r == job->dealerPID ) {
+    if( warm->jobEntry == NULL && warm->owner == NULL
+	&& now - warm->idleSinceMicros
+	>= serv->conf->warmBotIdleSecs * 1000000ULL ) {
 
-      job->dealerPID = 0;
-    } else {
+      closeWarmBot( serv, cur, SIGTERM );
+    } else if( warm->jobEntry && warm->doneByMicros
+	       && now >= warm->doneByMicros ) {
 
-      allDone = 0;
+      fprintf( stderr, "BM_WARNING: warm bot %s did not finish its match\n",
+	       warm->bot->name );
+      closeWarmBot( serv, cur, SIGKILL );
     }
   }
+}
 
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
-    if( job->botPID[ p ] == 0 ) {
-      continue;
-    }
+void sigchldEvent( EventLoop *loop,
+		   EventWatch *watch,
+		   const uint32_t events )
+{
+  reapChildren( (ServerState *)loop->data );
+}
 
-    r = waitpid( job->botPID[ p ], &status, WNOHANG );
-    if( r < 0 ) {
+/* set up the event loop which drives the server */
+void initServerEvents( ServerState *serv )
+{
+  int w;
 
-      fprintf( stderr, "BM_ERROR: could not wait on child\n" );
-      exit( EXIT_FAILURE );
-    }
-    if( r == job->botPID[ p ] ) {
+  if( initEventLoop( &serv->events ) < 0 ) {
 
-      job->botPID[ p ] = 0;
-    } else {
+    fprintf( stderr, "BM_ERROR: could not create event loop\n" );
+    exit( EXIT_FAILURE );
+  }
+  serv->events.data = serv;
+  serv->needSchedule = 0;
+  serv->numClosedConns = 0;
+  initEventTimer( &serv->portPoolTimer );
+  initEventTimer( &serv->workerTimer );
+
+  if( eventWatchAdd( &serv->events,
+		     &serv->listenWatch,
+		     serv->listenSocket,
+		     EPOLLIN,
+		     listenSocketEvent,
+		     NULL ) < 0
+      || eventWatchAdd( &serv->events,
+			&serv->sigchldWatch,
+			serv->sigchldFD,
+			EPOLLIN,
+			sigchldEvent,
+			NULL ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not watch server sockets\n" );
+    exit( EXIT_FAILURE );
+  }
+  if( serv->conf->adaptiveConcurrency ) {
+
+    eventTimerStart( &serv->events,
+		     &serv->adaptTimer,
+		     (uint64_t)BM_ADAPT_PERIOD_SECS * 1000000,
+		     (uint64_t)BM_ADAPT_PERIOD_SECS * 1000000,
+		     adaptTimerEvent,
+		     NULL );
+  }
+  if( serv->metricsSocket >= 0
+      && eventWatchAdd( &serv->events,
+			&serv->metricsWatch,
+			serv->metricsSocket,
+			EPOLLIN,
+			metricsListenEvent,
+			NULL ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not watch metrics socket\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  for( w = 0; w < serv->numWorkers; ++w ) {
+    DealerWorker *worker = &serv->workers[ w ];
 
-      allDone = 0;
+    if( worker->sock < 0 ) {
+      /* it failed to start, so try again from the event loop */
+
+      scheduleWorkerRespawn( serv );
+    } else if( eventWatchAdd( &serv->events,
+			      &worker->watch,
+			      worker->sock,
+			      EPOLLIN,
+			      dealerWorkerEvent,
+			      worker ) < 0 ) {
+
+      closeDealerWorker( serv, worker );
     }
   }
-
-  return allDone;
 }
 
-void finishedJob( ServerState *serv, LLPoolEntry *jobEntry )
+/* give back memory held for entries and tags freed by the last batch
+   of events, which nothing can be looking at any more */
+void trimServerMemory( ServerState *serv )
 {
-  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
-  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
-
-  free( job->tag );
-  --( match->gameConf->curRunningJobs );
-  match->isRunning = 0;
-  LLPoolRemoveEntry( serv->jobs, jobEntry );
+  LLPoolTrim( serv->conns );
+  LLPoolTrim( serv->matches );
+  LLPoolTrim( serv->jobs );
+  LLPoolTrim( serv->gangs );
+  LLPoolTrim( serv->warmBots );
+  LLPoolTrim( serv->metricsClients );
+  LLPoolTrim( serv->pendingLogs );
+  LLPoolTrim( serv->pendingRuns );
+  arenaTrim( &serv->strings );
 }
 
 int main( int argc, char **argv )
 {
   Config conf;
   ServerState serv;
-  int maxfd;
-  fd_set readfds;
-  LLPoolEntry *cur, *next;
-  struct timeval tv;
 
   if( argc < 2 ) {
 
@@ -1524,79 +8291,46 @@ int main( int argc, char **argv )
   /* Ignore SIGPIPE.  It seems that SIGPIPE can be raised when the underlying
    * IO fails with a SIGPIPE.  Unfortunately this causes the entire benchmark
    * server to crash and jobs are lost.  Ignore the signal to avoid death */
-  /* ???: May also need to catch SIGCHLD */
+  /* SIGCHLD is handled through a signalfd set up in initServerState */
   signal( SIGPIPE, SIG_IGN );
 
   /* use the config file */
   setDefaults( &conf );
   readConfig( argv[ 1 ], &conf );
 
-  /* initialise server state */
-  initServerState( &conf, &serv );
-
-  /* main I/O loop */
-  while( 1 ) {
-
-    /* clean up any finished jobs */
-    for( cur = LLPoolFirstEntry( serv.jobs ); cur != NULL; cur = next ) {
-      next = LLPoolNextEntry( cur );
-      MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
-
-      if( checkIfJobFinished( job ) ) {
-
-	finishedJob( &serv, cur );
-      }
-    }
-
-    /* clean up any closed connections */
-    for( cur = LLPoolFirstEntry( serv.conns ); cur != NULL; cur = next ) {
-      next = LLPoolNextEntry( cur );
+  /* dealers and bots pick the socket profile up from the environment */
+  if( conf.socketProfile ) {
 
-      if( ( (Connection *)LLPoolGetItem( cur ) )->status == STATUS_CLOSED ) {
-
-	LLPoolRemoveEntry( serv.conns, cur );
-      }
-    }
+    setenv( SOCKET_PROFILE_ENV, conf.socketProfile, 1 );
+  }
 
-    /* start jobs, up to the maximum */
-    while( startMatchJob( &conf, &serv ) );
+  /* initialise server state */
+  serv.conf = &conf;
+  initServerState( &conf, &serv );
+  initServerEvents( &serv );
+  recoverQueue( &conf, &serv );
+  if( serv.needSchedule ) {
+    /* start recovered matches without waiting for an event */
 
-    /* wait for input */
-    FD_ZERO( &readfds );
-    FD_SET( serv.listenSocket, &readfds );
-    maxfd = serv.listenSocket;
-    tv.tv_sec = BM_MAX_IOWAIT_SECS;
-    tv.tv_usec = 0;
-    for( cur = LLPoolFirstEntry( serv.conns );
-	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-      Connection *conn = (Connection *)LLPoolGetItem( cur );
+    runScheduler( &conf, &serv );
+  }
 
-      FD_SET( conn->connBuf->fd, &readfds );
-      if( conn->connBuf->fd > maxfd ) {
+  /* main loop - everything is driven by events, so the server sleeps
+     until a connection, child exit or timer needs handling */
+  while( 1 ) {
 
-	maxfd = conn->connBuf->fd;
-      }
-    }
-    if( select( maxfd + 1, &readfds, NULL, NULL, &tv ) < 0 ) {
+    if( runEventLoopOnce( &serv.events ) < 0 ) {
 
-      fprintf( stderr, "BM_ERROR: select failed\n" );
+      fprintf( stderr, "BM_ERROR: epoll_wait failed\n" );
       exit( -1 );
     }
 
-    /* process anything that's happened */
-    if( FD_ISSET( serv.listenSocket, &readfds ) ) {
-
-      handleListenSocket( &conf, &serv );
-    }
-    for( cur = LLPoolFirstEntry( serv.conns );
-	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-      Connection *conn = (Connection *)LLPoolGetItem( cur );
-
-      if( FD_ISSET( conn->connBuf->fd, &readfds ) ) {
+    freeClosedConnections( &serv );
+    if( serv.needSchedule ) {
 
-	handleConnection( &conf, &serv, cur );
-      }
+      runScheduler( &conf, &serv );
     }
+    trimServerMemory( &serv );
   }
 
   close( serv.listenSocket );
@@ -0,0 +1,754 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "bm_heap.h"
+#include "bm_hash.h"
+#include "bm_sched.h"
+
+
+/* Offline replay of a bm_server trace through the server's scheduler
+
+   bm_server writes a trace with the traceFile option:
+     SUBMIT time id user game numBots numRuns priority
+     RUN time id secs cpuSecs
+   with one RUN line for each finished run of the match with that id.
+   the matches are submitted again at their traced times, and each run
+   takes as long as it did on the server.  runs which never finished in
+   the trace take the mean time of the game's traced runs.  starting
+   runs follows startMatchJob: the scheduler's next pick goes if its
+   bots (and cores) fit, and nothing else goes until it does.  matches
+   are ordered by their traced priority, but running ones are never
+   paused for them.  warm bot gangs, agents and the result cache aren't
+   modelled */
+
+#define SIM_LINE_LEN 4096
+
+/* run time for a game with no finished runs in the trace */
+#define SIM_DEFAULT_RUN_SECS 60.0
+
+
+typedef struct {
+  const char *name; /* interned */
+  SchedUser sched;
+  int numMatches;
+  int numRuns;
+  double waitSecs; /* total over runs */
+  double maxWaitSecs;
+  double slowdown; /* total over matches with some work */
+  int numSlowdowns;
+  double cpuSecs; /* charged to the user */
+} SimUser;
+
+typedef struct {
+  const char *name; /* interned */
+  SchedGame sched;
+  uint16_t maxRunningJobs;
+  int numMatches; /* submitted in the trace */
+  double tracedSecs; /* total of the game's traced runs */
+  int numTraced;
+  double busySecs; /* run time in the simulation */
+} SimGame;
+
+typedef struct {
+  uint32_t id;
+  SimUser *user;
+  SimGame *game;
+  int numBots;
+  int priority; /* 0 in traces from before priorities */
+  int numRuns; /* runs not yet started */
+  int runsStarted;
+  double *runSecs; /* traced time of each run, in finishing order */
+  double *runCpuSecs;
+  int numTraced;
+  double submitTime;
+  double readyTime; /* when the match last joined the queue */
+  double finishTime; /* of the running run */
+  double cpuSecs; /* charged for the running run */
+  double workSecs; /* total time of its runs */
+  int numCores; /* used by the running run */
+  int heapIndex; /* position in running, -1 when not running */
+  SchedEntry sched;
+} SimMatch;
+
+typedef struct {
+  Scheduler sched;
+  int numCores; /* 0 when jobs aren't pinned */
+  int freeCores;
+
+  SimUser **users;
+  int numUsers;
+  HashTable *userIndex; /* name -> SimUser */
+  SimGame **games;
+  int numGames;
+  HashTable *gameIndex; /* name -> SimGame */
+  SimMatch **matches; /* in submission order */
+  int numMatches;
+  HashTable *matchIndex; /* id -> SimMatch */
+
+  Heap running; /* running matches, earliest finish first */
+  double now;
+  double *waits; /* of every started run */
+  int numWaits;
+  double botSecs; /* bot time of all runs */
+} Simulation;
+
+/* a game's limit from the command line */
+typedef struct {
+  const char *game; /* interned */
+  uint16_t maxRunningJobs;
+} GameLimit;
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: bm_sim [options] trace_file\n" );
+  fprintf( file, "  replays a bm_server trace through the server's scheduler\n" );
+  fprintf( file, "  --config [file] read schedPolicy, maxRunningBots and each game's\n" );
+  fprintf( file, "    maxRunningJobs from a bm_server config\n" );
+  fprintf( file, "  --policy [waittime|fairshare] scheduling policy\n" );
+  fprintf( file, "  --max_running_bots [#] 0 for no limit\n" );
+  fprintf( file, "  --max_running_jobs [game=#] limit for one game, 0 for none\n" );
+  fprintf( file, "  --cores [#] pin jobs to this many cores, 0 for no pinning\n" );
+  fprintf( file, "  --run_secs [#] run time for games with no traced runs\n" );
+}
+
+static void secsToTimeval( const double secs, struct timeval *tv )
+{
+  tv->tv_sec = (time_t)floor( secs );
+  tv->tv_usec = (suseconds_t)( ( secs - floor( secs ) ) * 1e6 );
+}
+
+static int matchLess( const void *a, const void *b )
+{
+  return ( (const SimMatch *)a )->finishTime
+    < ( (const SimMatch *)b )->finishTime;
+}
+
+static int compareDouble( const void *a, const void *b )
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static int compareSubmit( const void *a, const void *b )
+{
+  const SimMatch *x = *(SimMatch * const *)a, *y = *(SimMatch * const *)b;
+
+  if( x->submitTime != y->submitTime ) {
+
+    return x->submitTime < y->submitTime ? -1 : 1;
+  }
+  return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static SimUser *getUser( Simulation *sim, const char *name )
+{
+  SimUser *user;
+
+  user = (SimUser *)hashFindString( sim->userIndex, name );
+  if( user == NULL ) {
+
+    user = (SimUser *)calloc( 1, sizeof( SimUser ) );
+    assert( user != 0 );
+    user->name = internString( name );
+    initSchedUser( &user->sched );
+
+    sim->users = (SimUser **)realloc( sim->users, sizeof( SimUser * )
+				      * ( sim->numUsers + 1 ) );
+    assert( sim->users != 0 );
+    sim->users[ sim->numUsers ] = user;
+    ++sim->numUsers;
+    hashAddString( sim->userIndex, user->name, user );
+  }
+  return user;
+}
+
+static SimGame *getGame( Simulation *sim, const char *name )
+{
+  SimGame *game;
+
+  game = (SimGame *)hashFindString( sim->gameIndex, name );
+  if( game == NULL ) {
+
+    game = (SimGame *)calloc( 1, sizeof( SimGame ) );
+    assert( game != 0 );
+    game->name = internString( name );
+    game->maxRunningJobs = 1; /* bm_server's default */
+
+    sim->games = (SimGame **)realloc( sim->games, sizeof( SimGame * )
+				      * ( sim->numGames + 1 ) );
+    assert( sim->games != 0 );
+    sim->games[ sim->numGames ] = game;
+    ++sim->numGames;
+    hashAddString( sim->gameIndex, game->name, game );
+  }
+  return game;
+}
+
+/* pick the scheduling settings out of a bm_server config, ignoring
+   everything else in it
+   returns 0 on success, -1 on failure */
+static int readServerConfig( Simulation *sim, const char *filename )
+{
+  FILE *file;
+  SimGame *game;
+  int policy;
+  char line[ SIM_LINE_LEN ], name[ SIM_LINE_LEN ];
+
+  file = fopen( filename, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open config file %s\n", filename );
+    return -1;
+  }
+
+  game = NULL;
+  while( fgets( line, SIM_LINE_LEN, file ) ) {
+
+    if( sscanf( line, " %s", name ) < 1 || name[ 0 ] == '#' ) {
+
+      continue;
+    }
+
+    if( !strcmp( name, "}" ) ) {
+
+      game = NULL;
+    } else if( !strcasecmp( name, "game" ) ) {
+
+      if( sscanf( line, " %*s %s", name ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get game from: %s", line );
+	fclose( file );
+	return -1;
+      }
+      game = getGame( sim, name );
+    } else if( !strcasecmp( name, "maxRunningJobs" ) && game ) {
+
+      if( sscanf( line, " %*s %"SCNu16, &game->maxRunningJobs ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get maxRunningJobs from: %s", line );
+	fclose( file );
+	return -1;
+      }
+    } else if( !strcasecmp( name, "maxRunningBots" ) && game == NULL ) {
+
+      if( sscanf( line, " %*s %"SCNu16, &sim->sched.maxRunningBots ) < 1 ) {
+
+	fprintf( stderr, "ERROR: could not get maxRunningBots from: %s", line );
+	fclose( file );
+	return -1;
+      }
+    } else if( !strcasecmp( name, "schedPolicy" ) && game == NULL ) {
+
+      if( sscanf( line, " %*s %s", name ) < 1
+	  || ( policy = schedPolicyFromName( name ) ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not get policy from: %s", line );
+	fclose( file );
+	return -1;
+      }
+      sim->sched.policy = policy;
+    }
+  }
+
+  fclose( file );
+  return 0;
+}
+
+/* returns 0 on success, -1 on failure */
+static int readTrace( Simulation *sim, const char *filename )
+{
+  FILE *file;
+  SimMatch *match;
+  uint32_t id;
+  int numBots, numRuns, priority, lineNum;
+  double t, secs, cpuSecs;
+  char line[ SIM_LINE_LEN ], user[ SIM_LINE_LEN ], game[ SIM_LINE_LEN ];
+
+  file = fopen( filename, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open trace file %s\n", filename );
+    return -1;
+  }
+
+  lineNum = 0;
+  while( fgets( line, SIM_LINE_LEN, file ) ) {
+    ++lineNum;
+
+    priority = 0;
+    if( sscanf( line, "SUBMIT %lf %"SCNu32" %s %s %d %d %d",
+		&t, &id, user, game, &numBots, &numRuns, &priority ) >= 6 ) {
+
+      if( hashFindInt( sim->matchIndex, id ) ) {
+	/* a restarted server may have requeued the match */
+
+	continue;
+      }
+      match = (SimMatch *)calloc( 1, sizeof( SimMatch ) );
+      assert( match != 0 );
+      match->id = id;
+      match->user = getUser( sim, user );
+      match->game = getGame( sim, game );
+      match->numBots = numBots;
+      match->numRuns = numRuns;
+      match->priority = priority;
+      match->submitTime = t;
+      match->heapIndex = -1;
+      ++match->game->numMatches;
+
+      sim->matches = (SimMatch **)realloc( sim->matches, sizeof( SimMatch * )
+					   * ( sim->numMatches + 1 ) );
+      assert( sim->matches != 0 );
+      sim->matches[ sim->numMatches ] = match;
+      ++sim->numMatches;
+      hashAddInt( sim->matchIndex, id, match );
+    } else if( sscanf( line, "RUN %lf %"SCNu32" %lf %lf",
+		       &t, &id, &secs, &cpuSecs ) == 4 ) {
+
+      match = (SimMatch *)hashFindInt( sim->matchIndex, id );
+      if( match == NULL ) {
+	/* submitted before the trace started */
+
+	continue;
+      }
+      match->runSecs = (double *)realloc( match->runSecs, sizeof( double )
+					  * ( match->numTraced + 1 ) );
+      match->runCpuSecs = (double *)realloc( match->runCpuSecs,
+					     sizeof( double )
+					     * ( match->numTraced + 1 ) );
+      assert( match->runSecs != 0 && match->runCpuSecs != 0 );
+      match->runSecs[ match->numTraced ] = secs;
+      match->runCpuSecs[ match->numTraced ] = cpuSecs;
+      ++match->numTraced;
+      match->game->tracedSecs += secs;
+      ++match->game->numTraced;
+    } else {
+
+      fprintf( stderr, "WARNING: skipping line %d of trace: %s",
+	       lineNum, line );
+    }
+  }
+
+  fclose( file );
+  return 0;
+}
+
+/* start the next run of match at sim->now */
+static void startRun( Simulation *sim, SimMatch *match, const double defaultSecs )
+{
+  const SimGame *game = match->game;
+  struct timeval now;
+  double secs, cpuSecs, wait;
+
+  if( match->runsStarted < match->numTraced ) {
+
+    secs = match->runSecs[ match->runsStarted ];
+    cpuSecs = match->runCpuSecs[ match->runsStarted ];
+  } else {
+
+    secs = game->numTraced ? game->tracedSecs / game->numTraced : defaultSecs;
+    cpuSecs = secs * ( match->numBots ? match->numBots : 1 );
+  }
+
+  /* the CPU time is charged when the run finishes, like the server */
+  match->cpuSecs = cpuSecs;
+
+  secsToTimeval( sim->now, &now );
+  schedStart( &sim->sched, &match->sched, 1, &now );
+  if( sim->numCores ) {
+
+    match->numCores = match->numBots ? match->numBots : 1;
+    if( match->numCores > sim->numCores ) {
+
+      match->numCores = sim->numCores;
+    }
+    sim->freeCores -= match->numCores;
+  }
+
+  wait = sim->now - match->readyTime;
+  sim->waits[ sim->numWaits ] = wait;
+  ++sim->numWaits;
+  match->user->waitSecs += wait;
+  if( wait > match->user->maxWaitSecs ) {
+
+    match->user->maxWaitSecs = wait;
+  }
+  ++match->user->numRuns;
+
+  --match->numRuns;
+  ++match->runsStarted;
+  match->finishTime = sim->now + secs;
+  match->workSecs += secs;
+  match->game->busySecs += secs;
+  sim->botSecs += secs * match->numBots;
+  heapPush( &sim->running, match );
+}
+
+static void finishRun( Simulation *sim, SimMatch *match )
+{
+  SimUser *user = match->user;
+  double turnaround;
+
+  heapRemove( &sim->running, match );
+  schedFinish( &sim->sched, &match->sched, match->cpuSecs );
+  user->cpuSecs += match->cpuSecs;
+  sim->freeCores += match->numCores;
+  match->numCores = 0;
+
+  if( match->numRuns > 0 ) {
+
+    match->readyTime = sim->now;
+    schedEnqueue( &sim->sched, &match->sched );
+  } else if( match->workSecs > 0.0 ) {
+
+    turnaround = sim->now - match->submitTime;
+    user->slowdown += turnaround / match->workSecs;
+    ++user->numSlowdowns;
+  }
+}
+
+/* start runs the way startMatchJob does, until the next pick can't go */
+static void scheduleRuns( Simulation *sim, const double defaultSecs )
+{
+  SchedEntry *next;
+  SimMatch *match;
+  int cores;
+
+  while( ( next = schedPeekNext( &sim->sched ) ) != NULL ) {
+    match = (SimMatch *)next->data;
+
+    cores = match->numBots ? match->numBots : 1;
+    if( cores > sim->numCores ) {
+
+      cores = sim->numCores;
+    }
+    if( !schedHasBotRoom( &sim->sched, next ) || cores > sim->freeCores ) {
+
+      break;
+    }
+    startRun( sim, match, defaultSecs );
+  }
+}
+
+static void runSimulation( Simulation *sim, const double defaultSecs )
+{
+  SimMatch *match;
+  struct timeval start;
+  int next, g, u, totalRuns;
+
+  /* runs can't outnumber the runs asked for */
+  totalRuns = 0;
+  for( next = 0; next < sim->numMatches; ++next ) {
+
+    totalRuns += sim->matches[ next ]->numRuns;
+  }
+  sim->waits = (double *)malloc( sizeof( double ) * ( totalRuns + 1 ) );
+  assert( sim->waits != 0 );
+  sim->numWaits = 0;
+
+  for( g = 0; g < sim->numGames; ++g ) {
+
+    schedAddGame( &sim->sched, &sim->games[ g ]->sched,
+		  sim->games[ g ]->maxRunningJobs );
+  }
+  qsort( sim->matches, sim->numMatches, sizeof( SimMatch * ), compareSubmit );
+
+  /* users have been waiting since the trace started */
+  sim->now = sim->numMatches ? sim->matches[ 0 ]->submitTime : 0.0;
+  secsToTimeval( sim->now, &start );
+  for( u = 0; u < sim->numUsers; ++u ) {
+
+    sim->users[ u ]->sched.waitStart = start;
+  }
+
+  next = 0;
+  while( next < sim->numMatches || heapTop( &sim->running ) ) {
+
+    /* move on to the next arrival or finish, finishes first */
+    match = (SimMatch *)heapTop( &sim->running );
+    if( match
+	&& ( next == sim->numMatches
+	     || match->finishTime <= sim->matches[ next ]->submitTime ) ) {
+
+      sim->now = match->finishTime;
+      finishRun( sim, match );
+    } else {
+
+      match = sim->matches[ next ];
+      ++next;
+      sim->now = match->submitTime;
+      ++match->user->numMatches;
+      if( match->numRuns <= 0 ) {
+
+	continue;
+      }
+      initSchedEntry( &match->sched, &match->user->sched,
+		      &match->game->sched, match->numBots, match );
+      match->sched.priority = match->priority;
+      secsToTimeval( sim->now, &match->sched.queueTime );
+      match->readyTime = sim->now;
+      schedEnqueue( &sim->sched, &match->sched );
+    }
+
+    /* everything happening at the same time goes in before scheduling */
+    match = (SimMatch *)heapTop( &sim->running );
+    if( ( match && match->finishTime <= sim->now )
+	|| ( next < sim->numMatches
+	     && sim->matches[ next ]->submitTime <= sim->now ) ) {
+
+      continue;
+    }
+    scheduleRuns( sim, defaultSecs );
+  }
+}
+
+static double percentile( const double *sorted, const int n, const double p )
+{
+  int i;
+
+  if( n == 0 ) {
+
+    return 0.0;
+  }
+  i = (int)ceil( p * n ) - 1;
+  return sorted[ i < 0 ? 0 : i ];
+}
+
+static void printReport( Simulation *sim )
+{
+  int u, g, n, width;
+  double makespan, sum, sumSq, x;
+  const char *policyName;
+  SimUser *user;
+  SimGame *game;
+
+  makespan = sim->numMatches ? sim->now - sim->matches[ 0 ]->submitTime : 0.0;
+  qsort( sim->waits, sim->numWaits, sizeof( double ), compareDouble );
+  sum = 0.0;
+  for( n = 0; n < sim->numWaits; ++n ) {
+
+    sum += sim->waits[ n ];
+  }
+
+  policyName = sim->sched.policy == SCHED_POLICY_FAIR_SHARE
+    ? "fairshare" : "waittime";
+  printf( "policy %s, maxRunningBots %"PRIu16", cores %d\n",
+	  policyName, sim->sched.maxRunningBots, sim->numCores );
+  printf( "%d matches, %d runs over %.1f seconds\n",
+	  sim->numMatches, sim->numWaits, makespan );
+  printf( "queue wait: mean %.1f p50 %.1f p95 %.1f max %.1f seconds\n",
+	  sim->numWaits ? sum / sim->numWaits : 0.0,
+	  percentile( sim->waits, sim->numWaits, 0.5 ),
+	  percentile( sim->waits, sim->numWaits, 0.95 ),
+	  percentile( sim->waits, sim->numWaits, 1.0 ) );
+  if( makespan > 0.0 ) {
+
+    printf( "mean running bots %.2f", sim->botSecs / makespan );
+    if( sim->sched.maxRunningBots ) {
+
+      printf( ", utilization %.1f%% of maxRunningBots",
+	      100.0 * sim->botSecs / makespan / sim->sched.maxRunningBots );
+    }
+    printf( "\n" );
+  }
+
+  width = 4;
+  for( g = 0; g < sim->numGames; ++g ) {
+
+    if( strlen( sim->games[ g ]->name ) > width ) {
+
+      width = strlen( sim->games[ g ]->name );
+    }
+  }
+  printf( "\n%-*s %8s %8s\n", width, "game", "maxJobs", "busy%" );
+  for( g = 0; g < sim->numGames; ++g ) {
+    game = sim->games[ g ];
+
+    /* share of the game's job slots which were in use */
+    x = makespan > 0.0 && game->maxRunningJobs
+      ? 100.0 * game->busySecs / makespan / game->maxRunningJobs : 0.0;
+    printf( "%-*s %8"PRIu16" %8.1f\n",
+	    width, game->name, game->maxRunningJobs, x );
+  }
+
+  printf( "\n%-16s %8s %8s %10s %10s %10s %10s\n", "user", "matches",
+	  "runs", "meanWait", "maxWait", "slowdown", "cpuSecs" );
+  sum = 0.0;
+  sumSq = 0.0;
+  n = 0;
+  for( u = 0; u < sim->numUsers; ++u ) {
+    user = sim->users[ u ];
+
+    x = user->numSlowdowns ? user->slowdown / user->numSlowdowns : 0.0;
+    printf( "%-16s %8d %8d %10.1f %10.1f %10.2f %10.1f\n", user->name,
+	    user->numMatches, user->numRuns,
+	    user->numRuns ? user->waitSecs / user->numRuns : 0.0,
+	    user->maxWaitSecs, x, user->cpuSecs );
+    if( user->numSlowdowns ) {
+
+      sum += x;
+      sumSq += x * x;
+      ++n;
+    }
+  }
+
+  /* Jain's index over the users' mean slowdowns: 1 when every user's
+     matches are stretched out by the same amount, 1/n at worst */
+  if( n && sumSq > 0.0 ) {
+
+    printf( "\nfairness (Jain's index of slowdown) %.3f over %d users\n",
+	    sum * sum / ( n * sumSq ), n );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  Simulation sim;
+  GameLimit *limits;
+  int i, g, longOpt, numLimits, policy, maxRunningBots;
+  double defaultSecs;
+  char *configFile;
+  char name[ SIM_LINE_LEN ];
+  static struct option longOptions[] = {
+    { "config", 1, 0, 0 },
+    { "policy", 1, 0, 0 },
+    { "max_running_bots", 1, 0, 0 },
+    { "max_running_jobs", 1, 0, 0 },
+    { "cores", 1, 0, 0 },
+    { "run_secs", 1, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+
+  memset( &sim, 0, sizeof( sim ) );
+  initScheduler( &sim.sched, SCHED_POLICY_WAIT_TIME, 0 );
+  sim.userIndex = newHashTable( HASH_DEFAULT_BUCKETS );
+  sim.gameIndex = newHashTable( HASH_DEFAULT_BUCKETS );
+  sim.matchIndex = newHashTable( HASH_DEFAULT_BUCKETS );
+  initHeap( &sim.running, matchLess, offsetof( SimMatch, heapIndex ) );
+
+  configFile = NULL;
+  policy = -1;
+  maxRunningBots = -1;
+  limits = NULL;
+  numLimits = 0;
+  defaultSecs = SIM_DEFAULT_RUN_SECS;
+  while( ( i = getopt_long( argc, argv, "", longOptions, &longOpt ) ) >= 0 ) {
+
+    if( i != 0 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+
+    switch( longOpt ) {
+    case 0:
+      configFile = optarg;
+      break;
+
+    case 1:
+      policy = schedPolicyFromName( optarg );
+      if( policy < 0 ) {
+
+	fprintf( stderr, "ERROR: unknown policy %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 2:
+      if( sscanf( optarg, "%d", &maxRunningBots ) < 1
+	  || maxRunningBots < 0 || maxRunningBots > UINT16_MAX ) {
+
+	fprintf( stderr, "ERROR: invalid number of bots %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 3:
+      limits = (GameLimit *)realloc( limits, sizeof( GameLimit )
+				     * ( numLimits + 1 ) );
+      assert( limits != 0 );
+      if( sscanf( optarg, "%[^=]=%"SCNu16,
+		  name, &limits[ numLimits ].maxRunningJobs ) < 2 ) {
+
+	fprintf( stderr, "ERROR: invalid game limit %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      limits[ numLimits ].game = internString( name );
+      ++numLimits;
+      break;
+
+    case 4:
+      if( sscanf( optarg, "%d", &sim.numCores ) < 1 || sim.numCores < 0 ) {
+
+	fprintf( stderr, "ERROR: invalid number of cores %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 5:
+      if( sscanf( optarg, "%lf", &defaultSecs ) < 1 || defaultSecs < 0.0 ) {
+
+	fprintf( stderr, "ERROR: invalid run time %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+    }
+  }
+  if( optind + 1 != argc ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  if( configFile && readServerConfig( &sim, configFile ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  /* the command line beats the config */
+  if( policy >= 0 ) {
+
+    sim.sched.policy = policy;
+  }
+  if( maxRunningBots >= 0 ) {
+
+    sim.sched.maxRunningBots = maxRunningBots;
+  }
+  for( i = 0; i < numLimits; ++i ) {
+
+    getGame( &sim, limits[ i ].game )->maxRunningJobs
+      = limits[ i ].maxRunningJobs;
+  }
+  free( limits );
+  sim.freeCores = sim.numCores;
+
+  if( readTrace( &sim, argv[ optind ] ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  for( g = 0; g < sim.numGames; ++g ) {
+
+    if( sim.games[ g ]->numMatches && sim.games[ g ]->numTraced == 0 ) {
+
+      fprintf( stderr, "WARNING: no finished runs of %s in the trace, runs take %.1f seconds\n",
+	       sim.games[ g ]->name, defaultSecs );
+    }
+  }
+
+  runSimulation( &sim, defaultSecs );
+  printReport( &sim );
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,339 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "bm_slab.h"
+
+
+/* slabs are at least this big, and hold at least SLAB_MIN_OBJECTS */
+#define SLAB_MIN_BYTES 16384
+#define SLAB_MIN_OBJECTS 8
+
+/* objects are aligned to this within a slab */
+#define SLAB_ALIGN 16
+
+/* size of the smallest string class, doubling with each class */
+#define SLAB_STRING_MIN 16
+
+/* class byte in front of a string which isn't in a class */
+#define SLAB_STRING_BIG 0xff
+
+
+struct Slab_struct {
+  Slab *next; /* in the cache's available list */
+  Slab *prev;
+  void *free; /* free objects, linked through their first word */
+  int numUsed;
+  int isAvailable;
+};
+
+
+static size_t roundUp( const size_t n, const size_t align )
+{
+  return ( n + align - 1 ) / align * align;
+}
+
+static Slab *slabOf( const SlabCache *cache, const void *obj )
+{
+  return (Slab *)( (uintptr_t)obj & ~( (uintptr_t)cache->slabBytes - 1 ) );
+}
+
+static void linkAvailable( SlabCache *cache, Slab *slab )
+{
+  slab->prev = NULL;
+  slab->next = cache->available;
+  if( cache->available ) {
+
+    cache->available->prev = slab;
+  }
+  cache->available = slab;
+  slab->isAvailable = 1;
+}
+
+static void unlinkAvailable( SlabCache *cache, Slab *slab )
+{
+  if( slab->prev ) {
+
+    slab->prev->next = slab->next;
+  } else {
+
+    cache->available = slab->next;
+  }
+  if( slab->next ) {
+
+    slab->next->prev = slab->prev;
+  }
+  slab->isAvailable = 0;
+}
+
+static Slab *newSlab( SlabCache *cache )
+{
+  Slab *slab;
+  char *obj;
+  int i;
+  void *mem;
+
+  if( posix_memalign( &mem, cache->slabBytes, cache->slabBytes ) ) {
+
+    mem = NULL;
+  }
+  assert( mem != 0 );
+  slab = (Slab *)mem;
+  slab->numUsed = 0;
+
+  /* link the objects up in address order */
+  slab->free = NULL;
+  for( i = cache->objsPerSlab - 1; i >= 0; --i ) {
+
+    obj = (char *)slab + cache->objOffset + i * cache->objSize;
+    *(void **)obj = slab->free;
+    slab->free = obj;
+  }
+
+  ++cache->numSlabs;
+  ++cache->numEmpty;
+  linkAvailable( cache, slab );
+  return slab;
+}
+
+void initSlabCache( SlabCache *cache,
+		    const size_t objSize,
+		    const size_t maxBytes )
+{
+  cache->objSize = roundUp( objSize < sizeof( void * )
+			    ? sizeof( void * ) : objSize, sizeof( void * ) );
+  cache->objOffset = roundUp( sizeof( Slab ), SLAB_ALIGN );
+  cache->slabBytes = SLAB_MIN_BYTES;
+  while( cache->slabBytes
+	 < cache->objOffset + SLAB_MIN_OBJECTS * cache->objSize ) {
+
+    cache->slabBytes *= 2;
+  }
+  cache->objsPerSlab
+    = ( cache->slabBytes - cache->objOffset ) / cache->objSize;
+  cache->available = NULL;
+  cache->numSlabs = 0;
+  cache->numEmpty = 0;
+  cache->maxBytes = maxBytes;
+  cache->numObjects = 0;
+}
+
+void *slabAlloc( SlabCache *cache )
+{
+  Slab *slab;
+  void *obj;
+
+  slab = cache->available ? cache->available : newSlab( cache );
+  obj = slab->free;
+  slab->free = *(void **)obj;
+  if( slab->numUsed == 0 ) {
+
+    --cache->numEmpty;
+  }
+  ++slab->numUsed;
+  if( slab->free == NULL ) {
+
+    unlinkAvailable( cache, slab );
+  }
+
+  ++cache->numObjects;
+  return obj;
+}
+
+void slabFree( SlabCache *cache, void *obj )
+{
+  Slab *slab = slabOf( cache, obj );
+
+  assert( slab->numUsed > 0 );
+  *(void **)obj = slab->free;
+  slab->free = obj;
+  --slab->numUsed;
+  if( slab->numUsed == 0 ) {
+
+    ++cache->numEmpty;
+  }
+  if( !slab->isAvailable ) {
+
+    linkAvailable( cache, slab );
+  }
+
+  --cache->numObjects;
+}
+
+size_t slabRoom( const SlabCache *cache )
+{
+  size_t numFree, maxSlabs;
+
+  if( cache->maxBytes == 0 ) {
+
+    return SIZE_MAX;
+  }
+
+  numFree = (size_t)cache->numSlabs * cache->objsPerSlab
+    - cache->numObjects;
+  /* a cap smaller than a slab still allows one */
+  maxSlabs = cache->maxBytes / cache->slabBytes;
+  if( maxSlabs == 0 ) {
+
+    maxSlabs = 1;
+  }
+  if( maxSlabs > (size_t)cache->numSlabs ) {
+
+    numFree += ( maxSlabs - cache->numSlabs ) * cache->objsPerSlab;
+  }
+  return numFree;
+}
+
+size_t slabBytesHeld( const SlabCache *cache )
+{
+  return (size_t)cache->numSlabs * cache->slabBytes;
+}
+
+void slabTrim( SlabCache *cache )
+{
+  Slab *slab, *next;
+
+  for( slab = cache->available; slab != NULL && cache->numEmpty > 1;
+       slab = next ) {
+    next = slab->next;
+
+    if( slab->numUsed == 0 ) {
+
+      unlinkAvailable( cache, slab );
+      free( slab );
+      --cache->numSlabs;
+      --cache->numEmpty;
+    }
+  }
+}
+
+
+/* returns the class holding copies of strings len characters long, or
+   SLAB_STRING_CLASSES if they are too big for any */
+static int stringClass( const size_t len )
+{
+  int c;
+  size_t size;
+
+  /* the class byte and the terminator */
+  size = len + 2;
+  for( c = 0; c < SLAB_STRING_CLASSES; ++c ) {
+
+    if( size <= (size_t)SLAB_STRING_MIN << c ) {
+
+      return c;
+    }
+  }
+  return SLAB_STRING_CLASSES;
+}
+
+void initStringArena( StringArena *arena, const size_t maxBytes )
+{
+  int c;
+
+  for( c = 0; c < SLAB_STRING_CLASSES; ++c ) {
+
+    initSlabCache( &arena->classes[ c ], (size_t)SLAB_STRING_MIN << c, 0 );
+  }
+  arena->bigBytes = 0;
+  arena->maxBytes = maxBytes;
+}
+
+char *arenaStrdup( StringArena *arena, const char *str )
+{
+  size_t len = strlen( str );
+  int c = stringClass( len );
+  unsigned char *copy;
+
+  if( c < SLAB_STRING_CLASSES ) {
+
+    copy = (unsigned char *)slabAlloc( &arena->classes[ c ] );
+  } else {
+
+    copy = (unsigned char *)malloc( len + 2 );
+    assert( copy != 0 );
+    arena->bigBytes += len + 2;
+  }
+  copy[ 0 ] = c < SLAB_STRING_CLASSES ? c : SLAB_STRING_BIG;
+  memcpy( &copy[ 1 ], str, len + 1 );
+  return (char *)&copy[ 1 ];
+}
+
+void arenaStrfree( StringArena *arena, char *str )
+{
+  unsigned char *copy;
+
+  if( str == NULL ) {
+
+    return;
+  }
+
+  copy = (unsigned char *)str - 1;
+  if( copy[ 0 ] == SLAB_STRING_BIG ) {
+
+    arena->bigBytes -= strlen( str ) + 2;
+    free( copy );
+    return;
+  }
+  assert( copy[ 0 ] < SLAB_STRING_CLASSES );
+  slabFree( &arena->classes[ copy[ 0 ] ], copy );
+}
+
+int arenaHasRoom( const StringArena *arena,
+		  const size_t len,
+		  const size_t count )
+{
+  int c;
+  size_t need, numFree;
+  const SlabCache *cache;
+
+  if( arena->maxBytes == 0 ) {
+
+    return 1;
+  }
+
+  c = stringClass( len );
+  if( c < SLAB_STRING_CLASSES ) {
+
+    cache = &arena->classes[ c ];
+    numFree = (size_t)cache->numSlabs * cache->objsPerSlab
+      - cache->numObjects;
+    if( count <= numFree ) {
+
+      return 1;
+    }
+    need = ( count - numFree + cache->objsPerSlab - 1 )
+      / cache->objsPerSlab * cache->slabBytes;
+  } else {
+
+    need = ( len + 2 ) * count;
+  }
+  return arenaBytesHeld( arena ) + need <= arena->maxBytes;
+}
+
+size_t arenaBytesHeld( const StringArena *arena )
+{
+  int c;
+  size_t bytes;
+
+  bytes = arena->bigBytes;
+  for( c = 0; c < SLAB_STRING_CLASSES; ++c ) {
+
+    bytes += slabBytesHeld( &arena->classes[ c ] );
+  }
+  return bytes;
+}
+
+void arenaTrim( StringArena *arena )
+{
+  int c;
+
+  for( c = 0; c < SLAB_STRING_CLASSES; ++c ) {
+
+    slabTrim( &arena->classes[ c ] );
+  }
+}
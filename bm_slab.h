@@ -0,0 +1,94 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_SLAB_H
+#define _BM_SLAB_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/* Slab allocation of fixed size objects, with an optional cap
+
+   objects are carved out of slabs, blocks of a power of two bytes
+   aligned to their size, so the slab holding an object is found from
+   the object's address alone.  freed objects go back to their slab,
+   and slabs which end up with nothing in them are handed back to the
+   system by slabTrim, keeping one spare, so a cache shrinks again after
+   a burst.  trimming is left to the caller so that an object stays
+   readable until the end of whatever freed it.
+
+   the cap is advisory: allocation always succeeds, and callers ask
+   slabRoom before taking on anything that would need more objects */
+
+#define SLAB_STRING_CLASSES 7 /* strings of up to 16, 32 ... 1024 bytes */
+
+typedef struct Slab_struct Slab;
+
+typedef struct {
+  size_t objSize;
+  size_t slabBytes; /* size and alignment of each slab */
+  size_t objOffset; /* start of the first object in a slab */
+  int objsPerSlab;
+  Slab *available; /* slabs with free objects */
+  int numSlabs;
+  int numEmpty; /* slabs with no objects in use */
+  size_t maxBytes; /* 0 for no cap */
+  uint64_t numObjects; /* in use */
+} SlabCache;
+
+/* copies of strings, from a slab cache for each size class and malloc
+   for anything bigger, under one cap for all of them */
+typedef struct {
+  SlabCache classes[ SLAB_STRING_CLASSES ];
+  size_t bigBytes; /* malloc'd for strings too big for a class */
+  size_t maxBytes; /* 0 for no cap */
+} StringArena;
+
+
+/* maxBytes caps the slabs the cache may hold, 0 for no cap */
+void initSlabCache( SlabCache *cache,
+		    const size_t objSize,
+		    const size_t maxBytes );
+
+/* returns a new object of cache->objSize bytes - never fails, even if
+   it takes the cache over its cap */
+void *slabAlloc( SlabCache *cache );
+
+/* obj must have come from slabAlloc( cache ) */
+void slabFree( SlabCache *cache, void *obj );
+
+/* returns how many more objects fit under the cap, or SIZE_MAX if the
+   cache isn't capped */
+size_t slabRoom( const SlabCache *cache );
+
+/* bytes held in slabs, whether in use or not */
+size_t slabBytesHeld( const SlabCache *cache );
+
+/* give back slabs with nothing in them, except for one spare */
+void slabTrim( SlabCache *cache );
+
+
+/* maxBytes caps everything the arena holds, 0 for no cap */
+void initStringArena( StringArena *arena, const size_t maxBytes );
+
+/* returns a copy of str - never fails, even if it takes the arena over
+   its cap */
+char *arenaStrdup( StringArena *arena, const char *str );
+
+/* str must have come from arenaStrdup( arena, ... ), or be NULL */
+void arenaStrfree( StringArena *arena, char *str );
+
+/* returns non-zero if count copies of strings up to len characters
+   long fit under the cap */
+int arenaHasRoom( const StringArena *arena,
+		  const size_t len,
+		  const size_t count );
+
+size_t arenaBytesHeld( const StringArena *arena );
+
+void arenaTrim( StringArena *arena );
+
+#endif
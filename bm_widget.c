@@ -14,6 +14,7 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <errno.h>
 #include "net.h"
 
@@ -21,13 +22,58 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #define ARG_SERVERNAME 1
 #define ARG_SERVERPORT 2
 #define ARG_BOT_COMMAND 3
+#define ARG_PERSISTENT 4
 #define ARG_NUM_ARGS 4
 
 
 static void printUsage( FILE *file )
 {
-  fprintf( file, "usage: bm_widget bm_hostname bm_port bot_command\n" );
+  fprintf( file, "usage: bm_widget bm_hostname bm_port bot_command"
+	   " [--persistent]\n" );
   fprintf( file, "  bot_command: agent executable, passed \"hostname port\"\n");
+  fprintf( file, "  --persistent: start bot_command once with no arguments,"
+	   " and send it\n"
+	   "    \"RUN hostname port position\" on stdin for each match."
+	   "  It answers\n"
+	   "    \"DONE\" on stdout when the match is over\n" );
+}
+
+
+/* start a persistent bot talking to us over a socket on its stdin/stdout
+   returns the socket, or -1 on failure */
+static int startPersistentBot( char *command, pid_t *pid )
+{
+  int fds[ 2 ];
+
+  if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) < 0 ) {
+
+    fprintf( stderr, "ERROR: socketpair failed\n" );
+    return -1;
+  }
+
+  *pid = fork();
+  if( *pid < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    close( fds[ 0 ] );
+    close( fds[ 1 ] );
+    return -1;
+  }
+  if( *pid == 0 ) {
+    /* child runs the command */
+
+    close( fds[ 0 ] );
+    dup2( fds[ 1 ], 0 );
+    dup2( fds[ 1 ], 1 );
+    close( fds[ 1 ] );
+
+    execl( command, command, NULL );
+    fprintf( stderr, "ERROR: could not run %s\n", command );
+    exit( EXIT_FAILURE );
+  }
+
+  close( fds[ 1 ] );
+  return fds[ 0 ];
 }
 
 
@@ -46,18 +92,31 @@ int login( char *user, char *passwd, FILE *conn )
 
 int main( int argc, char **argv )
 {
-  int sock, i;
-  pid_t childPID;
+  int sock, i, len, persistent, botSock, maxFD;
+  pid_t childPID, botPID;
   uint16_t port;
-  ReadBuf *fromUser, *fromServer;
+  ReadBuf *fromUser, *fromServer, *fromBot;
   fd_set readfds;
-  char line[ READBUF_LEN ];
+  char line[ READBUF_LEN ], runLine[ READBUF_LEN + 8 ];
 
   if( argc < ARG_NUM_ARGS ) {
 
     printUsage( stderr );
     exit( EXIT_FAILURE );
   }
+  persistent = 0;
+  if( argc > ARG_PERSISTENT ) {
+
+    if( strcmp( argv[ ARG_PERSISTENT ], "--persistent" ) ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+    persistent = 1;
+  }
+  botSock = -1;
+  botPID = -1;
+  fromBot = NULL;
 
 
   /* connect to the server */
@@ -124,13 +183,29 @@ int main( int argc, char **argv )
   while( 1 ) {
 
     /* clean up any children */
-    while( waitpid( -1, NULL, WNOHANG ) > 0 );
+    while( ( childPID = waitpid( -1, NULL, WNOHANG ) ) > 0 ) {
+
+      if( childPID == botPID ) {
+	/* persistent bot went away - start a new one at the next match */
+
+	botPID = -1;
+      }
+    }
 
     /* wait for input */
     FD_ZERO( &readfds );
     FD_SET( 0, &readfds );
     FD_SET( sock, &readfds );
-    i = select( sock + 1, &readfds, NULL, NULL, NULL );
+    maxFD = sock;
+    if( botSock >= 0 ) {
+
+      FD_SET( botSock, &readfds );
+      if( botSock > maxFD ) {
+
+	maxFD = botSock;
+      }
+    }
+    i = select( maxFD + 1, &readfds, NULL, NULL, NULL );
     if( i < 0 ) {
 
       fprintf( stderr, "ERROR: select failed\n" );
@@ -163,6 +238,33 @@ int main( int argc, char **argv )
       }
     }
 
+    /* handle persistent bot messages */
+    if( botSock >= 0 && FD_ISSET( botSock, &readfds ) ) {
+
+      while( ( i = getLine( fromBot, READBUF_LEN, line, 0 ) ) >= 0 ) {
+
+	if( i == 0 ) {
+	  /* bot closed its end, so it's no use any more */
+
+	  fprintf( stderr, "ERROR: persistent bot exited\n" );
+	  destroyReadBuf( fromBot );
+	  fromBot = NULL;
+	  botSock = -1;
+	  if( botPID > 0 ) {
+
+	    kill( botPID, SIGTERM );
+	  }
+	  break;
+	}
+
+	if( strncasecmp( line, "done", 4 ) == 0 ) {
+
+	  printf( "finished match\n" );
+	  fflush( stdout );
+	}
+      }
+    }
+
     /* handle server messages */
     if( FD_ISSET( sock, &readfds ) ) {
 
@@ -192,6 +294,31 @@ int main( int argc, char **argv )
 	  printf( "starting match %s:%s", &line[ 4 ], &line[ i + 1 ] );
 	  fflush( stdout );
 
+	  if( persistent ) {
+	    /* hand the match to the running bot, starting it if needed */
+
+	    if( botSock < 0 ) {
+
+	      botSock = startPersistentBot( argv[ ARG_BOT_COMMAND ],
+					    &botPID );
+	      if( botSock < 0 ) {
+
+		exit( EXIT_FAILURE );
+	      }
+	      fromBot = createReadBuf( botSock );
+	    }
+
+	    line[ strcspn( &line[ i + 1 ], "\r\n" ) + i + 1 ] = 0;
+	    len = snprintf( runLine, sizeof( runLine ), "RUN %s %s 0\n",
+			    &line[ 4 ], &line[ i + 1 ] );
+	    if( send( botSock, runLine, len, MSG_NOSIGNAL ) < len ) {
+	      /* the bot is dead, which we'll see on its socket */
+
+	      fprintf( stderr, "ERROR: could not send match to bot\n" );
+	    }
+	    continue;
+	  }
+
 	  /* run `command machine port` */
 	  childPID = fork();
 	  if( childPID < 0 ) {
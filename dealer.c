@@ -2,16 +2,22 @@
 Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #define __STDC_LIMIT_MACROS
 #include <getopt.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <signal.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "game.h"
@@ -34,7 +40,20 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
    standard out and standard error
 
    exit value is EXIT_SUCCESS if the match was a success,
-   or EXIT_FAILURE on any failure */
+   or EXIT_FAILURE on any failure
+
+   "dealer --worker fd" runs as a long-lived worker for bm_server,
+   reading matches from the local SOCK_SEQPACKET socket fd.  each
+   request is the game file followed by a dealer argument list
+   (argv[0] included), all 0 terminated, and carries the standard error
+   descriptor for the match followed by one listening socket per seat.
+   the worker forks a copy of itself to run each match, so there is no
+   exec and each game file is only parsed once, and replies with
+   "STARTED pid\n" as soon as the match is running and
+   "DONE status userMicros systemMicros maxRSSKB voluntary involuntary\n"
+   when it has finished, where status and the usage are from wait4, and
+   the last two are context switch counts.  the worker exits when fd is
+   closed */
 
 #define DEFAULT_MAX_INVALID_ACTIONS UINT32_MAX
 #define DEFAULT_MAX_RESPONSE_MICROS 600000000
@@ -50,8 +69,71 @@ typedef struct {
   uint32_t numInvalidActions[MAX_PLAYERS];
   uint64_t usedHandMicros[MAX_PLAYERS];
   uint64_t usedMatchMicros[MAX_PLAYERS];
+
+  /* response times since the last latency report */
+  uint32_t reportHands; /* hands between reports, 0 for no reports */
+  uint32_t intervalResponses[MAX_PLAYERS];
+  uint64_t intervalMicros[MAX_PLAYERS];
 } ErrorInfo;
 
+/* time spent paused, which isn't charged to any player
+
+   with --pausable, bm_server pauses a match to make room for a more
+   urgent one by sending the dealer SIGTSTP, and stopping its bots.  the
+   dealer waits in the handler until SIGCONT, rather than stopping, so
+   it can tell how long the pause was, and a SIGCONT which overtakes the
+   SIGTSTP doesn't leave it stopped for good */
+static volatile uint64_t pausedMicros;
+static volatile sig_atomic_t continued;
+
+static uint64_t monotonicMicros() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void handleContinue(int sig) { continued = 1; }
+
+static void handlePause(int sig) {
+  int savedErrno = errno;
+  uint64_t start;
+  sigset_t waitMask;
+
+  /* SIGCONT is blocked while in here, except while waiting */
+  start = monotonicMicros();
+  sigprocmask(SIG_SETMASK, NULL, &waitMask);
+  sigdelset(&waitMask, SIGCONT);
+  while (!continued) {
+    sigsuspend(&waitMask);
+  }
+  continued = 0;
+  pausedMicros += monotonicMicros() - start;
+
+  errno = savedErrno;
+}
+
+static void initPauseHandling() {
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handleContinue;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGCONT, &action, NULL);
+
+  action.sa_handler = handlePause;
+  sigaddset(&action.sa_mask, SIGCONT);
+  sigaction(SIGTSTP, &action, NULL);
+}
+
+/* move t later by micros */
+static void addMicros(struct timeval *t, const uint64_t micros) {
+  uint64_t usec = t->tv_usec + micros;
+
+  t->tv_sec += usec / 1000000;
+  t->tv_usec = usec % 1000000;
+}
+
 static void printUsage(FILE *file, int verbose) {
   fprintf(file,
           "usage: dealer matchName gameDefFile #Hands rngSeed p1name p2name "
@@ -73,6 +155,24 @@ static void printUsage(FILE *file, int verbose) {
           "  --start_timeout [milliseconds] maximum time to wait for players "
           "to connect\n");
   fprintf(file, "    <0 [default] is no timeout\n");
+  fprintf(file,
+          "  --listen_fds fd1,fd2,... use inherited listening sockets for "
+          "players [default is to open new ones]\n");
+  fprintf(file,
+          "  --socket_profile [spec] socket tuning for player connections\n");
+  fprintf(file, "    \"default\", \"lowlatency\", or options like "
+                "\"quickack,busy_poll=50,sndbuf=65536\"\n");
+  fprintf(file, "    [default is $" SOCKET_PROFILE_ENV ", or no tuning]\n");
+  fprintf(file,
+          "  --report_latency [hands] print \"# LATENCY hands micros...\" "
+          "to stderr every [hands] hands,\n");
+  fprintf(file, "    with the mean response time of each seat since the "
+                "last report [default is 0, no reports]\n");
+  fprintf(file, "  --pausable SIGTSTP pauses the match until SIGCONT, and "
+                "the pause isn't\n");
+  fprintf(file, "    charged to the players [default is to stop]\n");
+  fprintf(file, "\nusage: dealer --worker fd\n");
+  fprintf(file, "  run matches sent by bm_server over local socket fd\n");
 }
 
 /* returns >= 0 on success, -1 on error */
@@ -110,6 +210,83 @@ static int scanPortString(const char *string,
   return 0;
 }
 
+/* returns >= 0 on success, -1 on error */
+static int scanFDString(const char *string, int fd[MAX_PLAYERS]) {
+  int c, r, p;
+
+  c = 0;
+  for (p = 0; p < MAX_PLAYERS; ++p) {
+    if (string[c] == 0) {
+      /* finished parsing the string */
+
+      break;
+    }
+
+    if (p) {
+      /* look for separator */
+
+      if (string[c] != ',') {
+        /* numbers should be comma separated */
+
+        return -1;
+      }
+      ++c;
+    }
+
+    if (sscanf(&string[c], "%d%n", &fd[p], &r) < 1 || fd[p] < 0) {
+      /* couldn't get a number */
+
+      return -1;
+    }
+    c += r;
+  }
+
+  return 0;
+}
+
+/* parsed games, kept so a worker only reads each game file once */
+static struct {
+  char *file;
+  Game *game;
+} *gameCache = NULL;
+static int numCachedGames = 0;
+
+/* returns the game in gameFile, or NULL on failure */
+static Game *getGame(const char *gameFile) {
+  int i;
+  FILE *file;
+  Game *game;
+
+  for (i = 0; i < numCachedGames; ++i) {
+    if (!strcmp(gameCache[i].file, gameFile)) {
+      return gameCache[i].game;
+    }
+  }
+
+  file = fopen(gameFile, "r");
+  if (file == NULL) {
+    fprintf(stderr, "ERROR: could not open game definition %s\n", gameFile);
+    return NULL;
+  }
+  game = readGame(file);
+  fclose(file);
+  if (game == NULL) {
+    fprintf(stderr, "ERROR: could not read game %s\n", gameFile);
+    return NULL;
+  }
+
+  gameCache = realloc(gameCache, sizeof(*gameCache) * (numCachedGames + 1));
+  if (gameCache == NULL) {
+    fprintf(stderr, "ERROR: could not allocate game cache\n");
+    exit(EXIT_FAILURE);
+  }
+  gameCache[numCachedGames].file = strdup(gameFile);
+  gameCache[numCachedGames].game = game;
+  ++numCachedGames;
+
+  return game;
+}
+
 static void initErrorInfo(const uint32_t maxInvalidActions,
                           const uint64_t maxResponseMicros,
                           const uint64_t maxUsedHandMicros,
@@ -125,7 +302,10 @@ static void initErrorInfo(const uint32_t maxInvalidActions,
     info->numInvalidActions[s] = 0;
     info->usedHandMicros[s] = 0;
     info->usedMatchMicros[s] = 0;
+    info->intervalResponses[s] = 0;
+    info->intervalMicros[s] = 0;
   }
+  info->reportHands = 0;
 }
 
 /* update the number of invalid actions for seat
@@ -160,6 +340,8 @@ static int checkErrorTimes(const uint8_t seat, const struct timeval *sendTime,
   /* update usage counts */
   info->usedHandMicros[seat] += responseMicros;
   info->usedMatchMicros[seat] += responseMicros;
+  ++info->intervalResponses[seat];
+  info->intervalMicros[seat] += responseMicros;
 
   /* check time used for the response */
   if (responseMicros > info->maxResponseMicros) {
@@ -179,6 +361,24 @@ static int checkErrorTimes(const uint8_t seat, const struct timeval *sendTime,
   return 0;
 }
 
+/* print the mean response time of each seat since the last report,
+   for bm_server to watch for bots slowing down under load */
+static void reportLatency(const Game *game, const uint32_t numHands,
+                          ErrorInfo *info) {
+  uint8_t seat;
+
+  fprintf(stderr, "# LATENCY %" PRIu32, numHands);
+  for (seat = 0; seat < game->numPlayers; ++seat) {
+    fprintf(stderr, " %" PRIu64,
+            info->intervalResponses[seat]
+                ? info->intervalMicros[seat] / info->intervalResponses[seat]
+                : 0);
+    info->intervalResponses[seat] = 0;
+    info->intervalMicros[seat] = 0;
+  }
+  fprintf(stderr, "\n");
+}
+
 /* note that there is a new hand
    returns >= 0 if match should continue, -1 for failure */
 static int checkErrorNewHand(const Game *game, ErrorInfo *info) {
@@ -243,22 +443,34 @@ static int sendPlayerMessage(const Game *game, const MatchState *state,
 }
 
 /* returns >= 0 if action/size has been set to a valid action
-   returns -1 for failure (disconnect, timeout, too many bad actions, etc) */
+   returns -1 for failure (disconnect, timeout, too many bad actions, etc)
+   sendPaused is pausedMicros when the state was sent, and sendTime is
+   moved later by any pause since then, so the player isn't charged */
 static int readPlayerResponse(const Game *game, const MatchState *state,
                               const int quiet, const uint8_t seat,
-                              const struct timeval *sendTime,
+                              struct timeval *sendTime,
+                              const uint64_t sendPaused,
                               ErrorInfo *errorInfo, ReadBuf *readBuf,
                               Action *action, struct timeval *recvTime) {
   int c, r;
+  uint64_t shifted;
   MatchState tempState;
   char line[MAX_LINE_LEN];
 
+  shifted = sendPaused;
   while (1) {
     /* read a line of input from player */
     struct timeval start;
+    uint64_t paused = pausedMicros;
     gettimeofday(&start, NULL);
-    if (getLine(readBuf, MAX_LINE_LEN, line, errorInfo->maxResponseMicros) <=
-        0) {
+    if ((r = getLine(readBuf, MAX_LINE_LEN, line,
+                     errorInfo->maxResponseMicros)) <= 0) {
+      if (r < 0 && pausedMicros != paused) {
+        /* the wait was cut short by a pause */
+
+        continue;
+      }
+
       /* couldn't get any input from player */
 
       struct timeval after;
@@ -279,6 +491,9 @@ static int readPlayerResponse(const Game *game, const MatchState *state,
 
     /* note when the message arrived */
     gettimeofday(recvTime, NULL);
+    paused = pausedMicros;
+    addMicros(sendTime, paused - shifted);
+    shifted = paused;
 
     /* log the response */
     if (!quiet) {
@@ -670,6 +885,7 @@ static int gameLoop(const Game *game, char *seatName[MAX_PLAYERS],
   uint32_t handId;
   uint8_t seat, p, player0Seat, currentP, currentSeat;
   struct timeval t, sendTime, recvTime;
+  uint64_t sendPaused;
   Action action;
   MatchState state;
   double value[MAX_PLAYERS], totalValue[MAX_PLAYERS];
@@ -703,6 +919,7 @@ static int gameLoop(const Game *game, char *seatName[MAX_PLAYERS],
 
   /* seat 0 is player 0 in first game */
   player0Seat = 0;
+  sendPaused = 0;
 
   /* process the transaction file */
   if (transactionFile != NULL) {
@@ -739,6 +956,7 @@ static int gameLoop(const Game *game, char *seatName[MAX_PLAYERS],
         /* remember the seat and send time if player is acting */
         if (state.viewingPlayer == currentP) {
           sendTime = t;
+          sendPaused = pausedMicros;
         }
       }
 
@@ -746,8 +964,8 @@ static int gameLoop(const Game *game, char *seatName[MAX_PLAYERS],
       state.viewingPlayer = currentP;
       currentSeat = playerToSeat(game, player0Seat, currentP);
       if (readPlayerResponse(game, &state, quiet, currentSeat, &sendTime,
-                             errorInfo, readBuf[currentSeat], &action,
-                             &recvTime) < 0) {
+                             sendPaused, errorInfo, readBuf[currentSeat],
+                             &action, &recvTime) < 0) {
         /* error messages already handled in function */
 
         return -1;
@@ -793,6 +1011,10 @@ static int gameLoop(const Game *game, char *seatName[MAX_PLAYERS],
       }
     }
 
+    if (errorInfo->reportHands && (handId + 1) % errorInfo->reportHands == 0) {
+      reportLatency(game, handId + 1, errorInfo);
+    }
+
     if (!quiet) {
       if (handId % 100 == 0) {
         for (seat = 0; seat < game->numPlayers; ++seat) {
@@ -832,32 +1054,36 @@ finishedGameLoop:
   return 0;
 }
 
-int main(int argc, char **argv) {
-  int i, listenSocket[MAX_PLAYERS], v, longOpt;
+static int runDealer(int argc, char **argv) {
+  int i, r, listenSocket[MAX_PLAYERS], v, longOpt;
   int fixedSeats, quiet, append;
   int seatFD[MAX_PLAYERS];
-  FILE *file, *logFile, *transactionFile;
+  FILE *logFile, *transactionFile;
   ReadBuf *readBuf[MAX_PLAYERS];
   Game *game;
   rng_state_t rng;
   ErrorInfo errorInfo;
-  struct sockaddr_in addr;
-  socklen_t addrLen;
+  SocketProfile socketProfile;
   char *seatName[MAX_PLAYERS];
 
   int useLogFile, useTransactionFile;
   uint64_t maxResponseMicros, maxUsedHandMicros, maxUsedPerHandMicros;
   int64_t startTimeoutMicros;
-  uint32_t numHands, seed, maxInvalidActions;
+  uint32_t numHands, seed, maxInvalidActions, reportLatencyHands;
   uint16_t listenPort[MAX_PLAYERS];
 
   struct timeval startTime, tv;
+  uint64_t startPaused;
 
   char name[MAX_LINE_LEN];
   static struct option longOptions[] = {{"t_response", 1, 0, 0},
                                         {"t_hand", 1, 0, 0},
                                         {"t_per_hand", 1, 0, 0},
                                         {"start_timeout", 1, 0, 0},
+                                        {"socket_profile", 1, 0, 0},
+                                        {"listen_fds", 1, 0, 0},
+                                        {"report_latency", 1, 0, 0},
+                                        {"pausable", 0, 0, 0},
                                         {0, 0, 0, 0}};
 
   /* set defaults */
@@ -868,9 +1094,10 @@ int main(int argc, char **argv) {
   maxUsedHandMicros = DEFAULT_MAX_USED_HAND_MICROS;
   maxUsedPerHandMicros = DEFAULT_MAX_USED_PER_HAND_MICROS;
 
-  /* use random ports */
+  /* use random ports on newly opened sockets */
   for (i = 0; i < MAX_PLAYERS; ++i) {
     listenPort[i] = 0;
+    listenSocket[i] = -1;
   }
 
   /* use log file, don't use transaction file */
@@ -889,6 +1116,9 @@ int main(int argc, char **argv) {
   /* no timeout on startup */
   startTimeoutMicros = -1;
 
+  /* no latency reports */
+  reportLatencyHands = 0;
+
   /* parse options */
   while (1) {
     i = getopt_long(argc, argv, "flLp:qtTa", longOptions, &longOpt);
@@ -957,6 +1187,41 @@ int main(int argc, char **argv) {
               startTimeoutMicros *= 1000;
             }
             break;
+
+          case 4:
+            /* socket_profile */
+
+            if (parseSocketProfile(optarg, &socketProfile) < 0) {
+              fprintf(stderr, "ERROR: bad socket profile %s\n", optarg);
+              exit(EXIT_FAILURE);
+            }
+            setSocketProfile(&socketProfile);
+            break;
+
+          case 5:
+            /* listen_fds */
+
+            if (scanFDString(optarg, listenSocket) < 0) {
+              fprintf(stderr, "ERROR: bad listen fd string %s\n", optarg);
+              exit(EXIT_FAILURE);
+            }
+            break;
+
+          case 6:
+            /* report_latency */
+
+            if (sscanf(optarg, "%" SCNu32, &reportLatencyHands) < 1) {
+              fprintf(stderr, "ERROR: could not get latency report interval %s\n",
+                      optarg);
+              exit(EXIT_FAILURE);
+            }
+            break;
+
+          case 7:
+            /* pausable */
+
+            initPauseHandling();
+            break;
         }
         break;
 
@@ -1023,18 +1288,10 @@ int main(int argc, char **argv) {
   }
 
   /* get the game definition */
-  file = fopen(argv[optind + 1], "r");
-  if (file == NULL) {
-    fprintf(stderr, "ERROR: could not open game definition %s\n",
-            argv[optind + 1]);
-    exit(EXIT_FAILURE);
-  }
-  game = readGame(file);
+  game = getGame(argv[optind + 1]);
   if (game == NULL) {
-    fprintf(stderr, "ERROR: could not read game %s\n", argv[optind + 1]);
     exit(EXIT_FAILURE);
   }
-  fclose(file);
 
   /* save the seat names */
   if (optind + 4 + game->numPlayers > argc) {
@@ -1105,9 +1362,25 @@ int main(int argc, char **argv) {
   /* set up the error info */
   initErrorInfo(maxInvalidActions, maxResponseMicros, maxUsedHandMicros,
                 maxUsedPerHandMicros * numHands, &errorInfo);
+  errorInfo.reportHands = reportLatencyHands;
 
-  /* open sockets for players to connect to */
+  /* open sockets for players to connect to, unless they were handed
+     to us already bound and listening (by bm_server, for example) */
   for (i = 0; i < game->numPlayers; ++i) {
+    if (listenSocket[i] >= 0) {
+      struct sockaddr_in sin;
+      socklen_t len = sizeof(sin);
+
+      if (getsockname(listenSocket[i], (struct sockaddr *)&sin, &len) < 0) {
+        fprintf(stderr, "ERROR: listen fd %d for player %d is not a socket\n",
+                listenSocket[i], i + 1);
+        exit(EXIT_FAILURE);
+      }
+      listenPort[i] = ntohs(sin.sin_port);
+      applySocketProfile(listenSocket[i]);
+      continue;
+    }
+
     listenSocket[i] = getListenSocket(&listenPort[i]);
     if (listenSocket[i] < 0) {
       fprintf(stderr, "ERROR: could not create listen socket for player %d\n",
@@ -1127,26 +1400,34 @@ int main(int argc, char **argv) {
   printInitialMessage(argv[optind], argv[optind + 1], numHands, seed,
                       &errorInfo, logFile);
 
-  /* wait for each player to connect */
+  /* wait for each player to connect - time spent paused doesn't count */
   gettimeofday(&startTime, NULL);
+  startPaused = pausedMicros;
   for (i = 0; i < game->numPlayers; ++i) {
     if (startTimeoutMicros >= 0) {
-      uint64_t startTimeLeft;
+      uint64_t startTimeLeft, paused;
       fd_set fds;
 
-      gettimeofday(&tv, NULL);
-      startTimeLeft = startTimeoutMicros -
-                      (uint64_t)(tv.tv_sec - startTime.tv_sec) * 1000000 -
-                      (tv.tv_usec - startTime.tv_usec);
-      if (startTimeLeft < 0) {
-        startTimeLeft = 0;
-      }
-      tv.tv_sec = startTimeLeft / 1000000;
-      tv.tv_usec = startTimeLeft % 1000000;
-
-      FD_ZERO(&fds);
-      FD_SET(listenSocket[i], &fds);
-      if (select(listenSocket[i] + 1, &fds, NULL, NULL, &tv) < 1) {
+      do {
+        paused = pausedMicros;
+        addMicros(&startTime, paused - startPaused);
+        startPaused = paused;
+
+        gettimeofday(&tv, NULL);
+        startTimeLeft = startTimeoutMicros -
+                        (uint64_t)(tv.tv_sec - startTime.tv_sec) * 1000000 -
+                        (tv.tv_usec - startTime.tv_usec);
+        if (startTimeLeft < 0) {
+          startTimeLeft = 0;
+        }
+        tv.tv_sec = startTimeLeft / 1000000;
+        tv.tv_usec = startTimeLeft % 1000000;
+
+        FD_ZERO(&fds);
+        FD_SET(listenSocket[i], &fds);
+        r = select(listenSocket[i] + 1, &fds, NULL, NULL, &tv);
+      } while (r < 0 && errno == EINTR);
+      if (r < 1) {
         /* no input ready within time, or an actual error */
 
         fprintf(stderr, "ERROR: timed out waiting for seat %d to connect\n",
@@ -1155,8 +1436,7 @@ int main(int argc, char **argv) {
       }
     }
 
-    addrLen = sizeof(addr);
-    seatFD[i] = accept(listenSocket[i], (struct sockaddr *)&addr, &addrLen);
+    seatFD[i] = acceptSocket(listenSocket[i]);
     if (seatFD[i] < 0) {
       fprintf(stderr, "ERROR: seat %d could not connect\n", i + 1);
       exit(EXIT_FAILURE);
@@ -1189,7 +1469,108 @@ int main(int argc, char **argv) {
   if (logFile != NULL) {
     fclose(logFile);
   }
-  free(game);
 
   return EXIT_SUCCESS;
 }
+
+/* run matches sent by bm_server over ctrlFD until it is closed */
+static int runWorker(const int ctrlFD) {
+  int fds[MAX_PLAYERS + 1], numFDs, argc, i, pos, status;
+  ssize_t r, len;
+  pid_t pid;
+  struct rusage usage;
+  char msg[READBUF_LEN];
+  char *argv[MAX_PLAYERS + 64];
+  char listenFDString[MAX_PLAYERS * 12];
+  char reply[128];
+
+  while (1) {
+    r = recvWithFDs(ctrlFD, msg, sizeof(msg) - 1, fds, MAX_PLAYERS + 1,
+                    &numFDs);
+    if (r <= 0) {
+      /* server has gone away */
+
+      return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    msg[r] = 0;
+
+    /* split the message into the game file and the dealer arguments,
+       leaving room for --listen_fds */
+    argc = 0;
+    for (pos = strlen(msg) + 1; pos < r && argc < MAX_PLAYERS + 61;
+         pos += strlen(&msg[pos]) + 1) {
+      argv[argc] = &msg[pos];
+      ++argc;
+    }
+    if (numFDs > 1) {
+      len = 0;
+      for (i = 1; i < numFDs; ++i) {
+        len += snprintf(&listenFDString[len], sizeof(listenFDString) - len,
+                        i > 1 ? ",%d" : "%d", fds[i]);
+      }
+      argv[argc] = "--listen_fds";
+      ++argc;
+      argv[argc] = listenFDString;
+      ++argc;
+    }
+    argv[argc] = NULL;
+
+    /* parse the game here, so every later match gets it for free */
+    getGame(msg);
+
+    fflush(NULL);
+    pid = numFDs > 0 && argc > 0 ? fork() : -1;
+    if (pid == 0) {
+      /* child runs the match with the passed standard error */
+
+      close(ctrlFD);
+      dup2(fds[0], 2);
+      exit(runDealer(argc, argv));
+    }
+
+    for (i = 0; i < numFDs; ++i) {
+      close(fds[i]);
+    }
+
+    if (pid < 0) {
+      status = EXIT_FAILURE << 8;
+      memset(&usage, 0, sizeof(usage));
+    } else {
+      len = snprintf(reply, sizeof(reply), "STARTED %d\n", (int)pid);
+      send(ctrlFD, reply, len, MSG_NOSIGNAL);
+
+      while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+          status = EXIT_FAILURE << 8;
+          memset(&usage, 0, sizeof(usage));
+          break;
+        }
+      }
+    }
+
+    len = snprintf(reply, sizeof(reply),
+                   "DONE %d %" PRId64 " %" PRId64 " %ld %ld %ld\n", status,
+                   (int64_t)usage.ru_utime.tv_sec * 1000000 +
+                       usage.ru_utime.tv_usec,
+                   (int64_t)usage.ru_stime.tv_sec * 1000000 +
+                       usage.ru_stime.tv_usec,
+                   usage.ru_maxrss, usage.ru_nvcsw, usage.ru_nivcsw);
+    if (send(ctrlFD, reply, len, MSG_NOSIGNAL) < 0) {
+      return EXIT_FAILURE;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int ctrlFD;
+
+  if (argc == 3 && !strcmp(argv[1], "--worker")) {
+    if (sscanf(argv[2], "%d", &ctrlFD) < 1) {
+      fprintf(stderr, "ERROR: bad worker fd %s\n", argv[2]);
+      exit(EXIT_FAILURE);
+    }
+    return runWorker(ctrlFD);
+  }
+
+  return runDealer(argc, argv);
+}
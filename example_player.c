@@ -17,68 +17,37 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include "rng.h"
 #include "net.h"
 
-int main( int argc, char **argv )
+/* play one match against the dealer at host:port
+   returns 0 when the dealer closes the connection, -1 if we never got in */
+static int playMatch( const Game *game,
+		      const double *probs,
+		      rng_state_t *rng,
+		      const char *host,
+		      const char *portString )
 {
   int sock, len, r, a;
   int32_t min, max;
   uint16_t port;
   double p;
-  Game *game;
   MatchState state;
   Action action;
-  FILE *file, *toServer, *fromServer;
-  struct timeval tv;
-  double probs[ NUM_ACTION_TYPES ];
+  FILE *toServer, *fromServer;
   double actionProbs[ NUM_ACTION_TYPES ];
-  rng_state_t rng;
   char line[ MAX_LINE_LEN ];
 
-  /* we make some assumptions about the actions - check them here */
-  assert( NUM_ACTION_TYPES == 3 );
-
-  if( argc < 4 ) {
-
-    fprintf( stderr, "usage: player game server port\n" );
-    exit( EXIT_FAILURE );
-  }
-
-  /* Define the probabilities of actions for the player */
-  probs[ a_fold ] = 0.06;
-  probs[ a_call ] = ( 1.0 - probs[ a_fold ] ) * 0.5;
-  probs[ a_raise ] = ( 1.0 - probs[ a_fold ] ) * 0.5;
-
-  /* Initialize the player's random number state using time */
-  gettimeofday( &tv, NULL );
-  init_genrand( &rng, tv.tv_usec );
-
-  /* get the game */
-  file = fopen( argv[ 1 ], "r" );
-  if( file == NULL ) {
-
-    fprintf( stderr, "ERROR: could not open game %s\n", argv[ 1 ] );
-    exit( EXIT_FAILURE );
-  }
-  game = readGame( file );
-  if( game == NULL ) {
-
-    fprintf( stderr, "ERROR: could not read game %s\n", argv[ 1 ] );
-    exit( EXIT_FAILURE );
-  }
-  fclose( file );
-
   /* connect to the dealer */
-  if( sscanf( argv[ 3 ], "%"SCNu16, &port ) < 1 ) {
+  if( sscanf( portString, "%"SCNu16, &port ) < 1 ) {
 
-    fprintf( stderr, "ERROR: invalid port %s\n", argv[ 3 ] );
-    exit( EXIT_FAILURE );
+    fprintf( stderr, "ERROR: invalid port %s\n", portString );
+    return -1;
   }
-  sock = connectTo( argv[ 2 ], port );
+  sock = connectTo( (char *)host, port );
   if( sock < 0 ) {
 
-    exit( EXIT_FAILURE );
+    return -1;
   }
   toServer = fdopen( sock, "w" );
-  fromServer = fdopen( sock, "r" );
+  fromServer = fdopen( dup( sock ), "r" );
   if( toServer == NULL || fromServer == NULL ) {
 
     fprintf( stderr, "ERROR: could not get socket streams\n" );
@@ -162,7 +131,7 @@ int main( int argc, char **argv )
     }
 
     /* choose one of the valid actions at random */
-    p = genrand_real2( &rng );
+    p = genrand_real2( rng );
     for( a = 0; a < NUM_ACTION_TYPES - 1; ++a ) {
 
       if( p <= actionProbs[ a ] ) {
@@ -174,7 +143,7 @@ int main( int argc, char **argv )
     action.type = (enum ActionType)a;
     if( a == a_raise ) {
 
-      action.size = min + genrand_int32( &rng ) % ( max - min + 1 );
+      action.size = min + genrand_int32( rng ) % ( max - min + 1 );
     }
 
     /* do the action! */
@@ -200,5 +169,90 @@ int main( int argc, char **argv )
     fflush( toServer );
   }
 
+
+  fclose( fromServer );
+  fclose( toServer );
+  return 0;
+}
+
+/* play a match for every "RUN host port [position]" line on stdin,
+   answering "DONE" after each one, until stdin closes */
+static void servePersistent( const Game *game,
+			     const double *probs,
+			     rng_state_t *rng )
+{
+  char line[ MAX_LINE_LEN ], host[ MAX_LINE_LEN ], port[ MAX_LINE_LEN ];
+
+  while( fgets( line, MAX_LINE_LEN, stdin ) ) {
+
+    if( sscanf( line, "RUN %s %s", host, port ) < 2 ) {
+
+      fprintf( stderr, "ERROR: unknown command %s", line );
+      continue;
+    }
+
+    playMatch( game, probs, rng, host, port );
+
+    printf( "DONE\n" );
+    fflush( stdout );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  Game *game;
+  FILE *file;
+  struct timeval tv;
+  double probs[ NUM_ACTION_TYPES ];
+  rng_state_t rng;
+  int persistent;
+
+  /* we make some assumptions about the actions - check them here */
+  assert( NUM_ACTION_TYPES == 3 );
+
+  persistent = ( argc == 3 && !strcmp( argv[ 2 ], "--persistent" ) );
+  if( argc < 4 && !persistent ) {
+
+    fprintf( stderr, "usage: player game server port\n" );
+    fprintf( stderr, "       player game --persistent\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  /* Define the probabilities of actions for the player */
+  probs[ a_fold ] = 0.06;
+  probs[ a_call ] = ( 1.0 - probs[ a_fold ] ) * 0.5;
+  probs[ a_raise ] = ( 1.0 - probs[ a_fold ] ) * 0.5;
+
+  /* Initialize the player's random number state using time */
+  gettimeofday( &tv, NULL );
+  init_genrand( &rng, tv.tv_usec );
+
+  /* get the game */
+  file = fopen( argv[ 1 ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  if( persistent ) {
+    /* stay up between matches, taking work from the server on stdin */
+
+    servePersistent( game, &probs[ 0 ], &rng );
+    return EXIT_SUCCESS;
+  }
+
+  if( playMatch( game, &probs[ 0 ], &rng, argv[ 2 ], argv[ 3 ] ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
   return EXIT_SUCCESS;
 }
@@ -7,18 +7,227 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+static SocketProfile socketProfile;
+static int haveSocketProfile = 0;
+
+int parseSocketProfile(const char *spec, SocketProfile *profile) {
+  int len, value;
+  const char *item;
+
+  memset(profile, 0, sizeof(*profile));
+
+  item = spec;
+  while (*item) {
+    len = strcspn(item, ",");
+
+    if (len == 7 && !strncasecmp(item, "default", len)) {
+      memset(profile, 0, sizeof(*profile));
+    } else if (len == 10 && !strncasecmp(item, "lowlatency", len)) {
+      /* tuned for small request/response messages between processes
+         on the same host or a dedicated low latency network */
+      profile->noDelay = 1;
+      profile->quickAck = 1;
+      profile->busyPollMicros = 50;
+      profile->sendBufBytes = 65536;
+      profile->recvBufBytes = 65536;
+      profile->notSentLowatBytes = 16384;
+    } else if (len == 7 && !strncasecmp(item, "nodelay", len)) {
+      profile->noDelay = 1;
+    } else if (len == 8 && !strncasecmp(item, "quickack", len)) {
+      profile->quickAck = 1;
+    } else if (sscanf(item, "busy_poll=%d", &value) == 1 && value >= 0) {
+      profile->busyPollMicros = value;
+    } else if (sscanf(item, "sndbuf=%d", &value) == 1 && value >= 0) {
+      profile->sendBufBytes = value;
+    } else if (sscanf(item, "rcvbuf=%d", &value) == 1 && value >= 0) {
+      profile->recvBufBytes = value;
+    } else if (sscanf(item, "notsent_lowat=%d", &value) == 1 && value >= 0) {
+      profile->notSentLowatBytes = value;
+    } else if (len != 0) {
+      fprintf(stderr, "ERROR: unknown socket profile option %.*s\n", len,
+              item);
+      return -1;
+    }
+
+    item += len;
+    if (*item == ',') {
+      ++item;
+    }
+  }
+
+  return 0;
+}
+
+void setSocketProfile(const SocketProfile *profile) {
+  socketProfile = *profile;
+  haveSocketProfile = 1;
+}
+
+const SocketProfile *getSocketProfile() {
+  const char *spec;
+
+  if (!haveSocketProfile) {
+    spec = getenv(SOCKET_PROFILE_ENV);
+    if (spec == NULL || parseSocketProfile(spec, &socketProfile) < 0) {
+      memset(&socketProfile, 0, sizeof(socketProfile));
+    }
+    haveSocketProfile = 1;
+  }
+
+  return &socketProfile;
+}
+
+int applySocketProfile(int sock) {
+  int failed, v;
+  const SocketProfile *profile = getSocketProfile();
+
+  failed = 0;
+  if (profile->noDelay) {
+    v = 1;
+    failed += setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v)) < 0;
+  }
+  if (profile->quickAck) {
+    v = 1;
+    failed += setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &v, sizeof(v)) < 0;
+  }
+#ifdef SO_BUSY_POLL
+  if (profile->busyPollMicros) {
+    v = profile->busyPollMicros;
+    failed += setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &v, sizeof(v)) < 0;
+  }
+#endif
+  if (profile->sendBufBytes) {
+    v = profile->sendBufBytes;
+    failed += setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &v, sizeof(v)) < 0;
+  }
+  if (profile->recvBufBytes) {
+    v = profile->recvBufBytes;
+    failed += setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &v, sizeof(v)) < 0;
+  }
+#ifdef TCP_NOTSENT_LOWAT
+  if (profile->notSentLowatBytes) {
+    v = profile->notSentLowatBytes;
+    failed +=
+        setsockopt(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &v, sizeof(v)) < 0;
+  }
+#endif
+
+  return failed;
+}
+
+int acceptSocket(int listenSocket) {
+  int sock;
+  struct sockaddr_in addr;
+  socklen_t addrLen;
+
+  addrLen = sizeof(addr);
+  sock = accept(listenSocket, (struct sockaddr *)&addr, &addrLen);
+  if (sock < 0) {
+    return -1;
+  }
+  applySocketProfile(sock);
+
+  return sock;
+}
+
+ssize_t sendWithFDs(int sock, const void *buf, size_t len, const int *fds,
+                    int numFDs) {
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+
+  if (numFDs < 0 || numFDs > MAX_PASSED_FDS) {
+    return -1;
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = (void *)buf;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (numFDs) {
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * numFDs);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * numFDs);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * numFDs);
+  }
+
+  return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+ssize_t recvWithFDs(int sock, void *buf, size_t len, int *fds, int maxFDs,
+                    int *numFDs) {
+  int i, n, *passed;
+  ssize_t r;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  *numFDs = 0;
+  r = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if (r < 0) {
+    return -1;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+
+    n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    passed = (int *)CMSG_DATA(cmsg);
+    for (i = 0; i < n; ++i) {
+      if (*numFDs < maxFDs) {
+        fds[*numFDs] = passed[i];
+        ++*numFDs;
+      } else {
+        close(passed[i]);
+      }
+    }
+  }
+
+  return r;
+}
+
 ReadBuf *createReadBuf(int fd) {
+  int type;
+  socklen_t len;
   ReadBuf *readBuf = (ReadBuf *)malloc(sizeof(ReadBuf));
   if (readBuf == 0) {
     return readBuf;
   }
 
   readBuf->fd = fd;
+
+  /* TCP_QUICKACK is not sticky, so reads on profiled sockets re-arm it */
+  len = sizeof(type);
+  readBuf->quickAck =
+      getSocketProfile()->quickAck &&
+      getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 &&
+      type == SOCK_STREAM;
+
   readBuf->bufStart = 0;
   readBuf->bufEnd = 0;
 
@@ -40,7 +249,7 @@ ssize_t getLine(ReadBuf *readBuf, size_t maxLen, char *line,
                 int64_t timeoutMicros) {
   int haveStartTime, c;
   ssize_t len;
-  fd_set fds;
+  struct pollfd pfd;
   struct timeval start, tv;
 
   /* reserve space for string terminator */
@@ -58,12 +267,12 @@ ssize_t getLine(ReadBuf *readBuf, size_t maxLen, char *line,
 
       if (timeoutMicros >= 0) {
         /* figure out how much time is left for reading */
-        uint64_t timeLeft;
+        int64_t timeLeft;
 
         timeLeft = timeoutMicros;
         if (haveStartTime) {
           gettimeofday(&tv, NULL);
-          timeLeft -= (uint64_t)(tv.tv_sec - start.tv_sec) * 1000000 +
+          timeLeft -= (int64_t)(tv.tv_sec - start.tv_sec) * 1000000 +
                       (tv.tv_usec - start.tv_usec);
           if (timeLeft < 0) {
             timeLeft = 0;
@@ -72,15 +281,21 @@ ssize_t getLine(ReadBuf *readBuf, size_t maxLen, char *line,
           haveStartTime = 1;
           gettimeofday(&start, NULL);
         }
-        tv.tv_sec = timeLeft / 1000000;
-        tv.tv_usec = timeLeft % 1000000;
 
-        /* wait for file descriptor to be ready */
-        FD_ZERO(&fds);
-        FD_SET(readBuf->fd, &fds);
-        if (select(readBuf->fd + 1, &fds, NULL, NULL, &tv) < 1) {
+        /* wait for file descriptor to be ready - poll rather than select,
+           so descriptors past FD_SETSIZE work */
+        pfd.fd = readBuf->fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, (timeLeft + 999) / 1000) < 1) {
           /* no input ready within time, or an actual error */
 
+          if (len > 0 && len <= READBUF_LEN) {
+            /* the buffer is empty, so put the partial line back for
+               the next call rather than losing it */
+            memcpy(readBuf->buf, line, len);
+            readBuf->bufStart = 0;
+            readBuf->bufEnd = len;
+          }
           return -1;
         }
       }
@@ -98,6 +313,10 @@ ssize_t getLine(ReadBuf *readBuf, size_t maxLen, char *line,
         readBuf->bufEnd = 0;
         return -1;
       }
+      if (readBuf->quickAck) {
+        c = 1;
+        setsockopt(readBuf->fd, IPPROTO_TCP, TCP_QUICKACK, &c, sizeof(c));
+      }
     }
 
     /* keep adding to the string until we see a newline */
@@ -131,6 +350,9 @@ int connectTo(char *hostname, uint16_t port) {
     return -1;
   }
 
+  /* buffer sizes must be set before connecting to affect the window */
+  applySocketProfile(sock);
+
   addr.sin_family = AF_INET;
   addr.sin_port = htons(port);
   memcpy(&addr.sin_addr, hostent->h_addr_list[0], hostent->h_length);
@@ -156,6 +378,9 @@ int getListenSocket(uint16_t *desiredPort) {
   t = 1;
   setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &t, sizeof(int));
 
+  /* accepted sockets inherit most options from the listening socket */
+  applySocketProfile(sock);
+
   /* bind the socket to the port */
   if (*desiredPort != 0) {
     addr.sin_family = AF_INET;
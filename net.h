@@ -14,6 +14,25 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 
 #define READBUF_LEN 4096
 #define NUM_PORT_CREATION_ATTEMPTS 10
+/* most file descriptors sendWithFDs/recvWithFDs pass in one message */
+#define MAX_PASSED_FDS 16
+
+/* environment variable holding the socket profile specification used
+   when setSocketProfile() has not been called */
+#define SOCKET_PROFILE_ENV "ACPC_SOCKET_PROFILE"
+
+
+/* socket tuning applied by getListenSocket, connectTo and acceptSocket
+   a zero field leaves the kernel default alone, and options the kernel
+   refuses (SO_BUSY_POLL needs CAP_NET_ADMIN to raise) are skipped */
+typedef struct {
+  int noDelay;           /* TCP_NODELAY */
+  int quickAck;          /* TCP_QUICKACK, re-armed after every read */
+  int busyPollMicros;    /* SO_BUSY_POLL */
+  int sendBufBytes;      /* SO_SNDBUF */
+  int recvBufBytes;      /* SO_RCVBUF */
+  int notSentLowatBytes; /* TCP_NOTSENT_LOWAT */
+} SocketProfile;
 
 
 /* buffered I/O on file descriptors
@@ -23,12 +42,36 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
    a) doesn't work, or b) is fairly system specific */
 typedef struct {
   int fd;
+  int quickAck; /* re-arm TCP_QUICKACK after each read */
   int bufStart;
   int bufEnd;
   char buf[ READBUF_LEN ];
 } ReadBuf;
 
 
+/* parse a socket profile specification into profile
+   spec is "default", "lowlatency", or a comma separated list of
+   nodelay, quickack, busy_poll=usecs, sndbuf=bytes, rcvbuf=bytes,
+   and notsent_lowat=bytes, where later items override earlier ones
+   (so "lowlatency,sndbuf=262144" is allowed)
+   returns 0 on success, -1 on failure */
+int parseSocketProfile( const char *spec, SocketProfile *profile );
+
+/* set the profile used for all subsequently created sockets */
+void setSocketProfile( const SocketProfile *profile );
+
+/* get the profile in use, initialising it from SOCKET_PROFILE_ENV
+   if setSocketProfile has not been called */
+const SocketProfile *getSocketProfile();
+
+/* apply the current socket profile to sock
+   returns the number of options which could not be set */
+int applySocketProfile( int sock );
+
+/* accept a connection on listenSocket and apply the socket profile
+   returns file descriptor on success, <0 on failure */
+int acceptSocket( int listenSocket );
+
 /* open a socket to hostname/port
    returns file descriptor on success, <0 on failure */
 int connectTo( char *hostname, uint16_t port );
@@ -40,6 +83,27 @@ int connectTo( char *hostname, uint16_t port );
 int getListenSocket( uint16_t *desiredPort );
 
 
+/* send a message on a local socket, passing numFDs file descriptors
+   with it (they stay open in the sender)
+   returns bytes sent, or -1 on failure */
+ssize_t sendWithFDs( int sock,
+		     const void *buf,
+		     size_t len,
+		     const int *fds,
+		     int numFDs );
+
+/* receive a message sent by sendWithFDs, placing up to maxFDs passed
+   descriptors in fds and their number in *numFDs - any beyond maxFDs
+   are closed
+   returns bytes received, 0 on end of file, or -1 on failure */
+ssize_t recvWithFDs( int sock,
+		     void *buf,
+		     size_t len,
+		     int *fds,
+		     int maxFDs,
+		     int *numFDs );
+
+
 /* create a read buffer structure
    returns 0 on failure */
 ReadBuf *createReadBuf( int fd );
@@ -52,7 +116,8 @@ void destroyReadBuf( ReadBuf *readBuf );
    if timeoutMicros is non-negative, do not spend more than
    that number of microseconds waiting to read data
    return number of characters read (including newline, excluding 0)
-   0 on end of file, or -1 on error or timeout */
+   0 on end of file, or -1 on error or timeout - a partial line read
+   before a timeout is kept for the next call */
 ssize_t getLine( ReadBuf *readBuf,
 		 size_t maxLen,
 		 char *line,